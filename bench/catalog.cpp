@@ -0,0 +1,55 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include "../src/parser.hpp"
+#include "../src/catalog.hpp"
+#include "formulas.hpp"
+
+/*
+    Загрузка каталога формул: построчный вызов parseExpression против loadCatalog
+    с разным числом потоков на сгенерированном каталоге.
+    Запуск: make bench-catalog.
+*/
+
+using Clock = std::chrono::steady_clock;
+
+static double milliseconds(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main() {
+    const size_t lines = 200000;
+    const std::string path = "bench/generated.catalog";
+    {
+        std::ofstream file(path);
+        file << "# сгенерированный каталог\n";
+        for (size_t i = 0; i < lines; ++i)
+            file << catalogFormula(i) << "\n";
+    }
+
+    auto start = Clock::now();
+    std::ifstream file(path);
+    std::string line;
+    std::vector<Expression<double> > serial;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line[0] != '#')
+            serial.push_back(parseExpression<double>(line));
+    }
+    double baseline = milliseconds(start);
+    std::cout << lines << " formulas, " << std::thread::hardware_concurrency() << " hardware threads\n"
+              << "  parseExpression per line  " << std::setw(8) << baseline << " ms\n";
+
+    for (size_t threads: {1, 2, 4, 8, 16}) {
+        start = Clock::now();
+        std::vector<Expression<double> > loaded = loadCatalog<double>(path, threads);
+        double elapsed = milliseconds(start);
+        std::cout << "  loadCatalog, " << std::setw(2) << threads << " threads    " << std::setw(8) << elapsed
+                  << " ms  (x" << std::setprecision(3) << baseline / elapsed << std::setprecision(6) << ")"
+                  << (loaded.size() == serial.size() ? "" : "  MISMATCH") << "\n";
+    }
+    std::remove(path.c_str());
+    return 0;
+}
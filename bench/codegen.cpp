@@ -0,0 +1,81 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cmath>
+#include "../src/parser.hpp"
+#include "gradient.hpp"
+
+/*
+    Сравнение сгенерированного заголовка (differentiator --emit-cpp) с интерпретаторами
+    на тех же формулах: обход деревьев значений и производных и линейная программа Program<T>.
+    Запуск: make bench-codegen.
+*/
+
+using Clock = std::chrono::steady_clock;
+
+static double nanoseconds(Clock::time_point start, size_t points) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / points;
+}
+
+int main() {
+    std::ifstream file("bench/gradient.formulas");
+    std::stringstream text;
+    text << file.rdbuf();
+    auto definitions = parseDefinitions<double>(text.str());
+    std::vector<Expression<double> > trees;
+    for (const auto &definition: definitions)
+        trees.push_back(definition.second);
+    for (const auto &definition: definitions) {
+        trees.push_back(definition.second.differentiate("x"));
+        trees.push_back(definition.second.differentiate("y"));
+    }
+    ProgramBuilder<double> builder{VariableTable({"x", "y"})};
+    for (const auto &tree: trees)
+        builder.addOutput(builder.add(tree));
+    Program<double> program = builder.build();
+
+    const size_t points = 200000;
+    const size_t outputs = gradient::OUTPUT_COUNT;
+    std::vector<double> xs(points), ys(points);
+    for (size_t i = 0; i < points; ++i) {
+        xs[i] = 0.1 + 1e-5 * i;
+        ys[i] = 2.0 - 7e-6 * i;
+    }
+    std::vector<double> treeResults(points * outputs), programResults(points * outputs), generated(points * outputs);
+
+    auto start = Clock::now();
+    std::map<std::string, double> context;
+    for (size_t i = 0; i < points; ++i) {
+        context["x"] = xs[i];
+        context["y"] = ys[i];
+        for (size_t k = 0; k < outputs; ++k)
+            treeResults[i * outputs + k] = trees[k].eval(context);
+    }
+    double tree = nanoseconds(start, points);
+
+    start = Clock::now();
+    std::vector<double> inputs(2), registers, values;
+    for (size_t i = 0; i < points; ++i) {
+        inputs[0] = xs[i];
+        inputs[1] = ys[i];
+        program.eval(inputs, registers, values);
+        std::copy(values.begin(), values.end(), programResults.begin() + i * outputs);
+    }
+    double compiled = nanoseconds(start, points);
+
+    start = Clock::now();
+    for (size_t i = 0; i < points; ++i)
+        gradient::evalAll(xs[i], ys[i], &generated[i * outputs]);
+    double emitted = nanoseconds(start, points);
+
+    double error = 0;
+    for (size_t i = 0; i < points * outputs; ++i)
+        error = std::max(error, std::abs(generated[i] - treeResults[i]) / (1 + std::abs(treeResults[i])));
+    std::cout << points << " points, " << outputs << " outputs (value and gradient)\n"
+              << "  tree walk:        " << tree << " ns/point\n"
+              << "  program:          " << compiled << " ns/point\n"
+              << "  generated header: " << emitted << " ns/point\n"
+              << "  max relative difference: " << error << "\n";
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <malloc.h>
+#include "../src/catalog.hpp"
+#include "../src/compact.hpp"
+#include "formulas.hpp"
+
+/*
+    Память и скорость вычисления каталога формул: деревья Expression<T> против CompactCatalog<T>.
+    Память дерева измеряется по занятой куче (mallinfo2) до и после разбора, компактной формы —
+    так же и по CompactCatalog::bytes().
+    Запуск: make bench-compact.
+*/
+
+using Clock = std::chrono::steady_clock;
+
+static double milliseconds(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Занятая куча, включая крупные блоки, выделенные через mmap.
+static size_t heapBytes() {
+    const struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+// Число узлов дерева (деревья парсера не разделяют поддеревьев).
+static size_t treeNodes(const Expression<double> &expr) {
+    size_t count = 0;
+    std::vector<const ExpressionImpl<double> *> stack{expr.node()};
+    while (!stack.empty()) {
+        const ExpressionImpl<double> *node = stack.back();
+        stack.pop_back();
+        ++count;
+        for (size_t i = 0; i < node->childCount(); ++i)
+            stack.push_back(node->child(i).node());
+    }
+    return count;
+}
+
+int main() {
+    const size_t lines = 200000;
+    std::string text;
+    for (size_t i = 0; i < lines; ++i)
+        text += catalogFormula(i) + "\n";
+
+    size_t before = heapBytes();
+    std::vector<Expression<double> > expressions = parseCatalog<double>(text, 1);
+    const size_t treeBytes = heapBytes() - before;
+    size_t nodes = 0;
+    for (const auto &expr: expressions)
+        nodes += treeNodes(expr);
+
+    before = heapBytes();
+    CompactCatalog<double> catalog;
+    for (const auto &expr: expressions)
+        catalog.add(expr);
+    catalog.shrink();
+    const size_t compactBytes = heapBytes() - before;
+
+    std::cout << lines << " formulas, " << nodes << " nodes\n" << std::fixed << std::setprecision(1)
+              << "  Expression<double>     " << std::setw(12) << treeBytes << " bytes  "
+              << std::setw(6) << double(treeBytes) / nodes << " bytes/node\n"
+              << "  CompactCatalog<double> " << std::setw(12) << compactBytes << " bytes  "
+              << std::setw(6) << double(compactBytes) / catalog.nodes() << " bytes/node  (bytes(): "
+              << catalog.bytes() << ")\n";
+
+    std::map<std::string, double> context{{"x", 0.5}, {"y", 1.5}, {"z", 2.5}};
+    for (size_t k = 0; k < 13; ++k)
+        context["x" + std::to_string(k)] = 0.1 * k + 0.3;
+    ErrorPolicyScope scope(ErrorPolicy::Propagate);
+    auto start = Clock::now();
+    double treeSum = 0;
+    for (const auto &expr: expressions)
+        treeSum += expr.eval(context);
+    const double treeTime = milliseconds(start);
+    start = Clock::now();
+    double compactSum = 0;
+    for (size_t i = 0; i < catalog.size(); ++i)
+        compactSum += catalog.eval(i, context);
+    const double compactTime = milliseconds(start);
+    std::cout << std::setprecision(2) << "  eval all: tree " << treeTime << " ms, compact " << compactTime << " ms"
+              << (treeSum == compactSum || (std::isnan(treeSum) && std::isnan(compactSum)) ? "" : "  MISMATCH") << "\n";
+
+    start = Clock::now();
+    size_t length = 0;
+    for (size_t i = 0; i < catalog.size(); ++i)
+        length += catalog.expression(i).to_string().size();
+    std::cout << "  expression() for all formulas " << milliseconds(start) << " ms (" << length << " chars)\n";
+    return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef BENCH_FORMULAS_HPP
+#define BENCH_FORMULAS_HPP
+
+#include <sstream>
+#include <string>
+
+// Формула строки i сгенерированного каталога: детерминированная смесь операций, функций и вложенности.
+inline std::string catalogFormula(size_t i) {
+    static const char *const functions[] = {"sin", "cos", "exp", "ln", "sqrt", "atan", "tanh"};
+    std::ostringstream out;
+    out << functions[i % 7] << "(x" << i % 13 << " * " << (i % 97) / 10.0 << " + y) ^ 2 - ("
+        << functions[(i / 7) % 7] << "(z - " << i % 31 << ") / (1 + x" << i % 5 << "^2))";
+    if (i % 3 == 0)
+        out << " + max(x, y) * " << functions[(i / 3) % 7] << "(x * y * z)";
+    return out.str();
+}
+
+#endif // BENCH_FORMULAS_HPP
@@ -0,0 +1,71 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include "../src/parser.hpp"
+#include "../src/traversal.hpp"
+
+/*
+    Сравнение обходов с явным стеком (traversal.hpp) с рекурсивными методами узлов:
+    на мелком дереве (типичная формула) и на цепочке высотой RECURSION_LIMIT — самой глубокой,
+    которую Expression<T> ещё обходит рекурсивно. Для цепочки в миллион узлов приводится только
+    обход с явным стеком: рекурсивный переполнил бы стек вызовов.
+    Запуск: make bench-traversal.
+*/
+
+using Clock = std::chrono::steady_clock;
+
+template<typename F>
+static double microseconds(size_t repeats, F f) {
+    auto start = Clock::now();
+    for (size_t i = 0; i < repeats; ++i)
+        f();
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count() / repeats;
+}
+
+static void row(const char *operation, double recursive, double iterative) {
+    std::cout << "  " << std::left << std::setw(14) << operation << std::right << std::setw(12) << recursive
+              << std::setw(12) << iterative << "\n";
+}
+
+static void compare(const std::string &title, const Expression<double> &expr, size_t repeats) {
+    const std::map<std::string, double> context{{"x", 0.5}, {"y", 1.5}};
+    const ExpressionImpl<double> &root = *expr.node();
+    const Expression<double> two(2.0);
+    std::cout << title << " (height " << root.height() << "), microseconds per call:\n"
+              << "  operation        recursive   iterative\n";
+    row("eval", microseconds(repeats, [&] { root.eval(context); }),
+        microseconds(repeats, [&] { evalIterative(expr, context); }));
+    row("to_string", microseconds(repeats, [&] { root.to_string(); }),
+        microseconds(repeats, [&] { toStringIterative(expr); }));
+    row("differentiate", microseconds(repeats, [&] { root.derivative("x"); }),
+        microseconds(repeats, [&] { differentiateIterative(expr, "x"); }));
+    row("substitute", microseconds(repeats, [&] { root.substitute("x", two); }),
+        microseconds(repeats, [&] { substituteIterative(expr, "x", two); }));
+}
+
+static std::string chain(size_t terms) {
+    std::string text = "x";
+    for (size_t i = 1; i < terms; ++i)
+        text += i % 2 ? " + y" : " - x";
+    return text;
+}
+
+int main() {
+    compare("shallow: sin(x) * exp(y) + x^3 / (1 + y^2) - ln(x + y)",
+            parseExpression<double>("sin(x) * exp(y) + x^3 / (1 + y^2) - ln(x + y)"), 100000);
+    compare("deep: x + y - x + y ...", parseExpression<double>(chain(RECURSION_LIMIT)), 200);
+
+    const size_t depth = 1000000;
+    const std::string text = chain(depth);
+    Expression<double> deep(0.0);
+    double parse = microseconds(1, [&] { deep = parseExpression<double>(text); });
+    const std::map<std::string, double> context{{"x", 0.5}, {"y", 1.5}};
+    std::cout << "very deep: " << depth << " terms (height " << deep.node()->height()
+              << "), iterative only, milliseconds:\n"
+              << "  parse          " << parse / 1000 << "\n"
+              << "  eval           " << microseconds(1, [&] { evalIterative(deep, context); }) / 1000 << "\n"
+              << "  to_string      " << microseconds(1, [&] { toStringIterative(deep); }) / 1000 << "\n"
+              << "  differentiate  " << microseconds(1, [&] { differentiateIterative(deep, "x"); }) / 1000 << "\n"
+              << "  destroy        " << microseconds(1, [&] { deep = Expression<double>(0.0); }) / 1000 << "\n";
+    return 0;
+}
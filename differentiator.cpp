@@ -1,23 +1,277 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <limits>
 #include "src/parser.hpp"
 #include "src/expression.hpp"
+#include "src/columns.hpp"
+#include "src/server.hpp"
+#include "src/codegen.hpp"
+#include "src/integrate.hpp"
+#include <csignal>
 
-std::pair<std::string, long double> parseAssignment(const std::string &s) {
+template<typename T>
+std::pair<std::string, T> parseAssignment(const std::string &s) {
     size_t pos = s.find('=');
     if (pos == std::string::npos)
         throw std::runtime_error("Invalid assignment: " + s);
     std::string var = s.substr(0, pos);
-    long double value = std::stold(s.substr(pos + 1));
+    T value = static_cast<T>(std::stold(s.substr(pos + 1)));
     return {var, value};
 }
 
+// Массив для редукций: "name=v1,v2,...".
+template<typename T>
+std::pair<std::string, std::vector<T> > parseArrayAssignment(const std::string &s) {
+    size_t pos = s.find('=');
+    if (pos == std::string::npos)
+        throw std::runtime_error("Invalid assignment: " + s);
+    std::vector<T> values;
+    std::istringstream items(s.substr(pos + 1));
+    std::string item;
+    while (std::getline(items, item, ','))
+        values.push_back(static_cast<T>(std::stold(item)));
+    return {s.substr(0, pos), values};
+}
+
+// Запись профиля вычислений: JSON для файлов *.json, иначе folded stacks для flamegraph.pl.
+void writeProfile(const std::string &path) {
+    std::ofstream file(path);
+    if (!file)
+        throw std::runtime_error("Cannot open file: " + path);
+    const profile::Profiler &profiler = profile::Profiler::instance();
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    file << (json ? profiler.toJson() : profiler.toFolded());
+}
+
+// Флаг остановки сервера по SIGINT и SIGTERM.
+static volatile std::sig_atomic_t interrupted = 0;
+
+static void onSignal(int) {
+    interrupted = 1;
+}
+
+// Значение числового параметра "--name N" среди argv[first..argc); fallback, если параметра нет.
+static size_t numericOption(const std::string &name, int first, int argc, char *argv[], size_t fallback) {
+    for (int i = first; i + 1 < argc; ++i) {
+        if (argv[i] == name)
+            return std::stoul(argv[i + 1]);
+    }
+    return fallback;
+}
+
+// Выполнение режима mode с вычислениями в типе T.
+// С явным --precision (fullPrecision) числа выводятся со всеми значащими цифрами типа T,
+// без него — с точностью потока по умолчанию, как и до появления параметра.
+template<typename T>
+int run(const std::string &mode, const std::string &exprStr, int argc, char *argv[], bool fullPrecision) {
+    if (fullPrecision)
+        std::cout << std::setprecision(std::numeric_limits<T>::digits10);
+    if (mode == "--program") {
+        // Файл с определениями "name = expression"; выводятся значения всех определений.
+        std::ifstream file(exprStr);
+        if (!file)
+            throw std::runtime_error("Cannot open file: " + exprStr);
+        std::stringstream text;
+        text << file.rdbuf();
+        Program<T> program = parseProgram<T>(text.str());
+        std::map<std::string, T> context;
+        for (int i = 3; i < argc; ++i) {
+            auto assign = parseAssignment<T>(argv[i]);
+            context[assign.first] = assign.second;
+        }
+        std::vector<T> outputs = program.eval(context);
+        for (size_t k = 0; k < outputs.size(); ++k)
+            std::cout << program.outputNames()[k] << " = " << outputs[k] << std::endl;
+    } else if (mode == "--columns") {
+        // Столбцы — файлы с сырыми значениями типа T; переменная, заданная числом, подставляется константой.
+        if (argc < 4)
+            throw std::runtime_error("Missing output file for --columns");
+        Expression<T> expr = parseExpression<T>(exprStr);
+        std::map<std::string, std::string> columns;
+        for (int i = 4; i < argc; ++i) {
+            std::string arg = argv[i];
+            size_t pos = arg.find('=');
+            if (pos == std::string::npos)
+                throw std::runtime_error("Invalid assignment: " + arg);
+            std::string value = arg.substr(pos + 1);
+            size_t end = 0;
+            T number = 0;
+            try {
+                number = static_cast<T>(std::stold(value, &end));
+            } catch (const std::exception &) {
+                end = 0;
+            }
+            if (end == value.size() && end > 0)
+                expr = expr.substitute(arg.substr(0, pos), Expression<T>(number));
+            else
+                columns[arg.substr(0, pos)] = value;
+        }
+        size_t rows = evalColumns(compile(expr), columns, {argv[3]});
+        std::cout << rows << " rows written to " << argv[3] << std::endl;
+    } else if (mode == "--eval") {
+        Expression<T> expr = parseExpression<T>(exprStr);
+        std::map<std::string, T> context;
+        ArrayContext<T> arrays;
+        for (int i = 3; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg.find(',') != std::string::npos) {
+                auto assign = parseArrayAssignment<T>(arg);
+                arrays[assign.first] = assign.second;
+            } else {
+                auto assign = parseAssignment<T>(arg);
+                context[assign.first] = assign.second;
+            }
+        }
+        T result = expr.eval(context, arrays);
+        std::cout << result << std::endl;
+    } else if (mode == "--integrate") {
+        // Пределы задаются как var=a:b, остальные присваивания — параметры подынтегрального выражения.
+        Expression<T> expr = parseExpression<T>(exprStr);
+        std::vector<std::string> vars;
+        std::vector<T> lower, upper;
+        std::map<std::string, T> context;
+        IntegrateOptions options;
+        for (int i = 3; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--tol" || arg == "--threads") {
+                if (i + 1 == argc)
+                    throw std::runtime_error("Missing value for " + arg);
+                if (arg == "--tol")
+                    options.tolerance = options.relativeTolerance = std::stold(argv[++i]);
+                else
+                    options.threads = std::stoul(argv[++i]);
+                continue;
+            }
+            size_t pos = arg.find('=');
+            size_t colon = arg.find(':');
+            if (pos != std::string::npos && colon != std::string::npos && colon > pos) {
+                vars.push_back(arg.substr(0, pos));
+                lower.push_back(static_cast<T>(std::stold(arg.substr(pos + 1, colon - pos - 1))));
+                upper.push_back(static_cast<T>(std::stold(arg.substr(colon + 1))));
+            } else {
+                auto assign = parseAssignment<T>(arg);
+                context[assign.first] = assign.second;
+            }
+        }
+        IntegrationResult<T> result = integrateBox(expr, vars, lower, upper, context, options);
+        std::cout << result.value << std::endl;
+        std::cerr << "error estimate " << result.error << ", " << result.boxes << " boxes, "
+                  << result.evaluations << " evaluations" << std::endl;
+    } else if (mode == "--diff") {
+        std::string diffVar;
+
+        for (int i = 3; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--by" && i + 1 < argc) {
+                diffVar = argv[i + 1];
+                break;
+            }
+        }
+        if (diffVar.empty()) {
+            std::cerr << "Missing --by option for differentiation\n";
+            return 1;
+        }
+        Expression<T> expr = parseExpression<T>(exprStr);
+        Expression<T> deriv = expr.differentiate(diffVar);
+        std::cout << deriv.to_string() << std::endl;
+    } else if (mode == "--emit-cpp") {
+        // Заголовок C++ для файла формул exprStr; производные по каждой переменной из --by.
+        std::ifstream file(exprStr);
+        if (!file)
+            throw std::runtime_error("Cannot open file: " + exprStr);
+        std::stringstream text;
+        text << file.rdbuf();
+        CodegenOptions options;
+        options.source = exprStr;
+        for (int i = 3; i < argc; i += 2) {
+            std::string arg = argv[i];
+            if (i + 1 == argc)
+                throw std::runtime_error("Missing value for " + arg);
+            if (arg == "--by")
+                options.derivatives.push_back(argv[i + 1]);
+            else if (arg == "--namespace")
+                options.name = argv[i + 1];
+            else
+                throw std::runtime_error("Unknown option: " + arg);
+        }
+        std::cout << emitCpp(parseDefinitions<T>(text.str()), options);
+    } else if (mode == "--serve") {
+        // exprStr — путь к сокету. Сервер работает до SIGINT или SIGTERM.
+        size_t threads = numericOption("--threads", 3, argc, argv, std::max(1u, std::thread::hardware_concurrency()));
+        EvaluationServer<T> server(exprStr, threads);
+        std::signal(SIGINT, onSignal);
+        std::signal(SIGTERM, onSignal);
+        std::thread acceptor([&server] { server.run(); });
+        std::cerr << "Serving on " << exprStr << " with " << threads << " threads" << std::endl;
+        while (!interrupted)
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        server.stop();
+        acceptor.join();
+        ServerStats stats = server.stats();
+        std::cerr << stats.requests << " requests, " << stats.batches << " batches, "
+                  << stats.cacheMisses << " expressions parsed" << std::endl;
+    } else if (mode == "--load") {
+        // Нагрузочный клиент: differentiator --load socket "expression" [--clients N] [--requests N] var=value ...
+        if (argc < 4)
+            throw std::runtime_error("Missing expression for --load");
+        std::string request = "eval\n0\n" + std::string(argv[3]);
+        for (int i = 4; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--clients" || arg == "--requests")
+                ++i;
+            else
+                request += "\n" + arg;
+        }
+        size_t clients = numericOption("--clients", 4, argc, argv, 8);
+        size_t requests = numericOption("--requests", 4, argc, argv, 10000);
+        LoadReport report = runLoad(exprStr, request, clients, requests);
+        std::cout << std::setprecision(4) << report.requests << " requests (" << report.errors << " errors) in "
+                  << report.seconds << " s: " << report.requestsPerSecond << " requests/s, p50 "
+                  << report.p50 * 1e6 << " us, p99 " << report.p99 * 1e6 << " us" << std::endl;
+    } else {
+        std::cerr << "Unknown mode: " << mode << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
+    // Параметры --profile file и --precision type могут стоять в любом месте командной строки.
+    std::string profileFile;
+    std::string precision = "long";
+    bool fullPrecision = false;
+    std::vector<char *> args;
+    for (int i = 0; i < argc; ++i) {
+        if (std::string(argv[i]) == "--profile" && i + 1 < argc)
+            profileFile = argv[++i];
+        else if (std::string(argv[i]) == "--precision" && i + 1 < argc) {
+            precision = argv[++i];
+            fullPrecision = true;
+        }
+        else
+            args.push_back(argv[i]);
+    }
+    argc = static_cast<int>(args.size());
+    argv = args.data();
+
     if (argc < 3) {
         std::cerr << "Usage:\n"
-                  << "  differentiator --eval \"expression\" var=value ...\n"
-                  << "  differentiator --diff \"expression\" --by variable\n";
+                  << "  differentiator --eval \"expression\" var=value|var=v1,v2,... ...\n"
+                  << "  differentiator --diff \"expression\" --by variable\n"
+                  << "  differentiator --integrate \"expression\" var=a:b ... [--tol eps] [--threads N] var=value ...\n"
+                  << "  differentiator --program file var=value ...\n"
+                  << "  differentiator --columns \"expression\" output_file var=column_file|value ...\n"
+                  << "  differentiator --emit-cpp file [--by variable ...] [--namespace name]\n"
+                  << "  differentiator --serve socket [--threads N]\n"
+                  << "  differentiator --load socket \"expression\" [--clients N] [--requests N] var=value ...\n"
+                  << "Options:\n"
+                  << "  --profile file   write evaluation profile (JSON for *.json, folded stacks otherwise)\n"
+                  << "  --precision type float, double or long (long double, default);\n"
+                  << "                   when given, results are printed with all digits of the type\n";
         return 1;
     }
 
@@ -25,38 +279,35 @@ int main(int argc, char* argv[]) {
     std::string exprStr = argv[2];
 
     try {
-        Expression<long double> expr = parseExpression(exprStr);
-
-        if (mode == "--eval") {
-            std::map<std::string, long double> context;
-            for (int i = 3; i < argc; ++i) {
-                auto assign = parseAssignment(argv[i]);
-                context[assign.first] = assign.second;
-            }
-            long double result = expr.eval(context);
-            std::cout << result << std::endl;
-        } else if (mode == "--diff") {
-            std::string diffVar;
-
-            for (int i = 3; i < argc; ++i) {
-                std::string arg = argv[i];
-                if (arg == "--by" && i + 1 < argc) {
-                    diffVar = argv[i + 1];
-                    break;
-                }
-            }
-            if (diffVar.empty()) {
-                std::cerr << "Missing --by option for differentiation\n";
-                return 1;
-            }
-            Expression<long double> deriv = expr.differentiate(diffVar);
-            std::cout << deriv.to_string() << std::endl;
-        } else {
-            std::cerr << "Unknown mode: " << mode << std::endl;
-            return 1;
+        if (!profileFile.empty()) {
+#ifndef EXPRESSION_PROFILE
+            std::cerr << "Warning: profiling is not compiled in, rebuild with make PROFILE=1\n";
+#endif
+            profile::Profiler::instance().enable(true);
         }
+
+        int status;
+        if (precision == "float")
+            status = run<float>(mode, exprStr, argc, argv, fullPrecision);
+        else if (precision == "double")
+            status = run<double>(mode, exprStr, argc, argv, fullPrecision);
+        else if (precision == "long")
+            status = run<long double>(mode, exprStr, argc, argv, fullPrecision);
+        else
+            throw std::runtime_error("Unknown precision: " + precision);
+        if (status != 0)
+            return status;
+        if (!profileFile.empty())
+            writeProfile(profileFile);
     } catch (const std::exception &ex) {
         std::cerr << "Error: " << ex.what() << std::endl;
+        // Профиль сохраняется и при ошибке: по нему видно, какой узел бросил исключение.
+        if (!profileFile.empty()) {
+            try {
+                writeProfile(profileFile);
+            } catch (const std::exception &) {
+            }
+        }
         return 1;
     }
     return 0;
@@ -0,0 +1,135 @@
+#include "catalog.hpp"
+#include "parser.hpp"
+#include "columns.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+// Порций в несколько раз больше, чем потоков: поток, закончивший раньше, берёт следующую.
+const size_t CHUNKS_PER_THREAD = 8;
+
+// Меньшие порции не окупают запуск потока.
+const size_t MIN_CHUNK_BYTES = 64 * 1024;
+
+// Порция текста из целых строк.
+struct Chunk {
+    const char *begin;
+    const char *end;
+};
+
+template<typename T>
+struct ChunkResult {
+    std::vector<Expression<T> > expressions;
+    size_t lines = 0;       // число строк порции: по нему восстанавливаются номера строк в файле
+    size_t errorLine = 0;   // номер строки с ошибкой внутри порции; 0 — ошибок нет
+    size_t errorColumn = 0;
+    std::string error;
+};
+
+template<typename T>
+ChunkResult<T> parseChunk(const Chunk &chunk) {
+    ChunkResult<T> result;
+    for (const char *line = chunk.begin; line < chunk.end; ++result.lines) {
+        const char *end = static_cast<const char *>(std::memchr(line, '\n', chunk.end - line));
+        if (!end)
+            end = chunk.end;
+        // После первой ошибки строки только считаются.
+        if (result.error.empty()) {
+            std::string text(line, end);
+            if (!text.empty() && text.back() == '\r')
+                text.pop_back();
+            size_t first = text.find_first_not_of(" \t");
+            if (first != std::string::npos && text[first] != '#') {
+                Parser<T> parser(text);
+                try {
+                    Expression<T> expr = parser.parseExpression();
+                    if (!parser.atEnd())
+                        throw std::runtime_error("Unexpected character in input");
+                    result.expressions.push_back(std::move(expr));
+                } catch (const std::exception &ex) {
+                    result.errorLine = result.lines + 1;
+                    result.errorColumn = parser.position() + 1;
+                    result.error = ex.what();
+                }
+            }
+        }
+        line = end + 1;
+    }
+    return result;
+}
+
+} // namespace
+
+template<typename T>
+std::vector<Expression<T> > parseCatalog(const char *text, size_t size, size_t threads) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    // Границы порций сдвигаются к началу следующей строки.
+    const size_t count = std::max<size_t>(1, std::min(threads * CHUNKS_PER_THREAD, size / MIN_CHUNK_BYTES));
+    std::vector<Chunk> chunks;
+    const char *begin = text, *const end = text + size;
+    for (size_t k = 1; k <= count && begin < end; ++k) {
+        const char *split = k == count ? end : text + size / count * k;
+        if (split < begin)
+            split = begin;
+        if (split < end) {
+            const char *newline = static_cast<const char *>(std::memchr(split, '\n', end - split));
+            split = newline ? newline + 1 : end;
+        }
+        if (split > begin)
+            chunks.push_back({begin, split});
+        begin = split;
+    }
+
+    std::vector<ChunkResult<T> > results(chunks.size());
+    std::atomic<size_t> next{0};
+    auto work = [&] {
+        for (size_t i; (i = next.fetch_add(1)) < chunks.size();)
+            results[i] = parseChunk<T>(chunks[i]);
+    };
+    std::vector<std::thread> workers;
+    for (size_t k = 1; k < std::min(threads, chunks.size()); ++k)
+        workers.emplace_back(work);
+    work();
+    for (auto &worker: workers)
+        worker.join();
+
+    size_t lines = 0, total = 0;
+    for (const auto &result: results) {
+        if (!result.error.empty())
+            throw std::runtime_error("Line " + std::to_string(lines + result.errorLine) + ", column " +
+                                     std::to_string(result.errorColumn) + ": " + result.error);
+        lines += result.lines;
+        total += result.expressions.size();
+    }
+    std::vector<Expression<T> > expressions;
+    expressions.reserve(total);
+    for (auto &result: results)
+        std::move(result.expressions.begin(), result.expressions.end(), std::back_inserter(expressions));
+    return expressions;
+}
+
+template<typename T>
+std::vector<Expression<T> > parseCatalog(const std::string &text, size_t threads) {
+    return parseCatalog<T>(text.data(), text.size(), threads);
+}
+
+template<typename T>
+std::vector<Expression<T> > loadCatalog(const std::string &path, size_t threads) {
+    MappedFile file(path);
+    return parseCatalog<T>(file.data(), file.size(), threads);
+}
+
+// ===================================================================
+// Инстанциация шаблонов для всех числовых типов
+#define INSTANTIATE_CATALOG(T)                                                                    \
+    template std::vector<Expression<T> > parseCatalog<T>(const char *, size_t, size_t);          \
+    template std::vector<Expression<T> > parseCatalog<T>(const std::string &, size_t);           \
+    template std::vector<Expression<T> > loadCatalog<T>(const std::string &, size_t);
+
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE_CATALOG)
@@ -0,0 +1,26 @@
+#ifndef CATALOG_HPP
+#define CATALOG_HPP
+
+#include "expression.hpp"
+
+/*
+    Разбор каталога формул: по выражению на строку, пустые строки и строки, начинающиеся с '#', пропускаются.
+
+    Текст делится на порции по границам строк, порции разбираются потоками независимо:
+    у каждого потока свой Parser<T> и свои узлы (общего состояния, кроме реестра функций, нет),
+    результаты порций склеиваются в порядке файла. Ошибка сообщается как "Line N, column C: ...";
+    при нескольких ошибках — самая ранняя по файлу.
+*/
+
+// Разбор текста каталога в threads потоков (0 — по числу ядер).
+template<typename T = long double>
+std::vector<Expression<T> > parseCatalog(const char *text, size_t size, size_t threads = 0);
+
+template<typename T = long double>
+std::vector<Expression<T> > parseCatalog(const std::string &text, size_t threads = 0);
+
+// Разбор файла каталога, отображённого в память.
+template<typename T = long double>
+std::vector<Expression<T> > loadCatalog(const std::string &path, size_t threads = 0);
+
+#endif // CATALOG_HPP
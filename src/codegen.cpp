@@ -0,0 +1,264 @@
+#include "codegen.hpp"
+#include "functions.hpp"
+#include "optimizer.hpp"
+#include <cctype>
+#include <limits>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <type_traits>
+
+template<typename T>
+static const char *typeName() {
+    if constexpr (std::is_same_v<T, float>)
+        return "float";
+    else if constexpr (std::is_same_v<T, double>)
+        return "double";
+    else
+        return "long double";
+}
+
+// Литерал, при чтении которого компилятором получается в точности value.
+template<typename T>
+static std::string literal(T value) {
+    if (value != value)
+        return "std::numeric_limits<Real>::quiet_NaN()";
+    if (value == std::numeric_limits<T>::infinity() || value == -std::numeric_limits<T>::infinity())
+        return std::string(value < 0 ? "-" : "") + "std::numeric_limits<Real>::infinity()";
+    std::ostringstream out;
+    out << std::setprecision(std::numeric_limits<T>::max_digits10) << value;
+    std::string text = out.str();
+    if (text.find_first_of(".e") == std::string::npos)
+        text += ".0";
+    if constexpr (std::is_same_v<T, float>)
+        text += "f";
+    else if constexpr (std::is_same_v<T, long double>)
+        text += "L";
+    return value < 0 ? "(" + text + ")" : text;
+}
+
+// Выражение C++ для функции реестра; бросает исключение для функций без аналога.
+static std::string functionName(const std::string &name) {
+    static const char *const standard[] = {"tan", "sqrt", "asin", "acos", "atan", "sinh", "cosh", "tanh",
+                                           "abs", "atan2"};
+    for (const char *function: standard) {
+        if (name == function)
+            return "std::" + name;
+    }
+    if (name == "sign" || name == "min" || name == "max")
+        return "detail::" + name;
+    throw std::runtime_error("Function " + name + " has no C++ equivalent");
+}
+
+// Проверка имени переменной, определения или пространства имён. Имена, которые порождает генератор
+// (локальные r<N>_ и out_), оканчиваются подчёркиванием, поэтому такие имена пользователю запрещены,
+// как и ключевые слова C++ и имена, которые использует заголовок.
+static void checkName(const std::string &name, const char *what) {
+    static const char *const reserved[] = {
+        "Real", "detail", "std", "evalAll", "OUTPUT_COUNT", "OUTPUT_NAMES",
+        "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break", "case", "catch",
+        "char", "char8_t", "char16_t", "char32_t", "class", "compl", "concept", "const", "consteval", "constexpr",
+        "constinit", "const_cast", "continue", "co_await", "co_return", "co_yield", "decltype", "default", "delete",
+        "do", "double", "dynamic_cast", "else", "enum", "explicit", "export", "extern", "false", "float", "for",
+        "friend", "goto", "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept", "not", "not_eq",
+        "nullptr", "operator", "or", "or_eq", "private", "protected", "public", "register", "reinterpret_cast",
+        "requires", "return", "short", "signed", "sizeof", "static", "static_assert", "static_cast", "struct",
+        "switch", "template", "this", "thread_local", "throw", "true", "try", "typedef", "typeid", "typename",
+        "union", "unsigned", "using", "virtual", "void", "volatile", "wchar_t", "while", "xor", "xor_eq"};
+    bool valid = !name.empty() && std::isalpha(static_cast<unsigned char>(name[0])) && name.back() != '_';
+    for (char c: name)
+        valid = valid && (std::isalnum(static_cast<unsigned char>(c)) || c == '_');
+    for (const char *word: reserved)
+        valid = valid && name != word;
+    if (!valid)
+        throw std::runtime_error(std::string(what) + " \"" + name + "\" cannot be used as a C++ name");
+}
+
+template<typename T>
+static std::string operand(const Program<T> &program, uint32_t code) {
+    switch (code & OPERAND_KIND) {
+        case OPERAND_REGISTER:
+            return "r" + std::to_string(code) + "_";
+        case OPERAND_CONSTANT:
+            return literal(program.constants()[code & OPERAND_INDEX]);
+        default:
+            return program.variables()[code & OPERAND_INDEX];
+    }
+}
+
+// Тело функции: по локальной константе на инструкцию.
+template<typename T>
+static void emitInstructions(const Program<T> &program, std::string &out) {
+    const FunctionRegistry<T> &registry = FunctionRegistry<T>::instance();
+    const auto &code = program.instructions();
+    for (size_t i = 0; i < code.size(); ++i) {
+        const Instruction &ins = code[i];
+        const bool leaf = ins.op == OpCode::Constant || ins.op == OpCode::Variable;
+        const bool binary = ins.op == OpCode::Add || ins.op == OpCode::Sub || ins.op == OpCode::Mul ||
+                            ins.op == OpCode::Div || ins.op == OpCode::Pow || ins.op == OpCode::Call2 ||
+                            ins.op == OpCode::Less || ins.op == OpCode::LessEqual || ins.op == OpCode::Equal ||
+                            ins.op == OpCode::NotEqual || ins.op == OpCode::Select;
+        std::string a = leaf ? "" : operand(program, ins.a);
+        std::string b = binary ? operand(program, ins.b) : "";
+        std::string value;
+        switch (ins.op) {
+            case OpCode::Constant:
+                value = literal(program.constants()[ins.a]);
+                break;
+            case OpCode::Variable:
+                value = program.variables()[ins.a];
+                break;
+            case OpCode::Add:
+                value = a + " + " + b;
+                break;
+            case OpCode::Sub:
+                value = a + " - " + b;
+                break;
+            case OpCode::Mul:
+                value = a + " * " + b;
+                break;
+            case OpCode::Div:
+                value = a + " / " + b;
+                break;
+            case OpCode::Pow:
+                value = "std::pow(" + a + ", " + b + ")";
+                break;
+            case OpCode::PowInt:
+                value = "detail::ipow(" + a + ", " + std::to_string(static_cast<int32_t>(ins.b)) + ")";
+                break;
+            case OpCode::Sin:
+                value = "std::sin(" + a + ")";
+                break;
+            case OpCode::Cos:
+                value = "std::cos(" + a + ")";
+                break;
+            case OpCode::Ln:
+                value = "std::log(" + a + ")";
+                break;
+            case OpCode::Exp:
+                value = "std::exp(" + a + ")";
+                break;
+            case OpCode::Call1:
+                value = functionName(registry.get(ins.function).name) + "(" + a + ")";
+                break;
+            case OpCode::Call2:
+                value = functionName(registry.get(ins.function).name) + "(" + a + ", " + b + ")";
+                break;
+            case OpCode::Less:
+                value = "Real(" + a + " < " + b + ")";
+                break;
+            case OpCode::LessEqual:
+                value = "Real(" + a + " <= " + b + ")";
+                break;
+            case OpCode::Equal:
+                value = "Real(" + a + " == " + b + ")";
+                break;
+            case OpCode::NotEqual:
+                value = "Real(" + a + " != " + b + ")";
+                break;
+            case OpCode::Select:
+                value = a + " != 0 ? " + b + " : " + operand(program, ins.c);
+                break;
+        }
+        out += "    const Real r" + std::to_string(i) + "_ = " + value + ";\n";
+    }
+}
+
+static std::string parameters(const std::vector<std::string> &variables) {
+    std::string list;
+    for (const auto &name: variables)
+        list += (list.empty() ? "Real " : ", Real ") + name;
+    return list;
+}
+
+template<typename T>
+std::string emitCpp(const std::vector<std::pair<std::string, Expression<T> > > &definitions,
+                    const CodegenOptions &options) {
+    // Выходы: определения, затем производные каждого определения по порядку options.derivatives.
+    std::vector<std::pair<std::string, Expression<T> > > outputs = definitions;
+    for (const auto &definition: definitions) {
+        for (const auto &var: options.derivatives)
+            outputs.emplace_back("d_" + definition.first + "_d_" + var,
+                                 optimize(definition.second.differentiate(var)));
+    }
+    checkName(options.name, "Namespace");
+    for (size_t k = 0; k < outputs.size(); ++k) {
+        checkName(outputs[k].first, "Definition");
+        for (size_t j = 0; j < k; ++j) {
+            if (outputs[j].first == outputs[k].first)
+                throw std::runtime_error("Function \"" + outputs[k].first + "\" is generated twice");
+        }
+    }
+    ProgramBuilder<T> all;
+    for (const auto &output: outputs)
+        all.addOutput(all.add(output.second), output.first);
+    Program<T> program = all.build();
+    const std::vector<std::string> &variables = program.variables();
+    for (const auto &name: variables)
+        checkName(name, "Variable");
+
+    std::string guard;
+    for (char c: options.name + "_GENERATED_HPP")
+        guard += std::isalnum(static_cast<unsigned char>(c)) ? static_cast<char>(std::toupper(c)) : '_';
+
+    std::string out;
+    out += "// Сгенерировано differentiator --emit-cpp" + (options.source.empty() ? "" : " из " + options.source) +
+           "; не редактировать.\n";
+    out += "#ifndef " + guard + "\n#define " + guard + "\n\n#include <cmath>\n#include <limits>\n\n";
+    out += "namespace " + options.name + " {\n\nusing Real = " + typeName<T>() + ";\n\n";
+    out += "namespace detail {\n\n"
+           "// Целая степень двоичным алгоритмом, как в интерпретаторе.\n"
+           "inline Real ipow(Real base, long exponent) {\n"
+           "    unsigned long n = exponent < 0 ? 0ul - static_cast<unsigned long>(exponent) : "
+           "static_cast<unsigned long>(exponent);\n"
+           "    Real result = 1;\n"
+           "    while (n > 0) {\n"
+           "        if (n & 1)\n"
+           "            result *= base;\n"
+           "        n >>= 1;\n"
+           "        if (n > 0)\n"
+           "            base *= base;\n"
+           "    }\n"
+           "    return exponent < 0 ? Real(1) / result : result;\n"
+           "}\n\n"
+           "inline Real sign(Real x) { return Real((x > 0) - (x < 0)); }\n\n"
+           "inline Real min(Real a, Real b) { return b < a ? b : a; }\n\n"
+           "inline Real max(Real a, Real b) { return a < b ? b : a; }\n\n"
+           "} // namespace detail\n\n";
+
+    out += "const int OUTPUT_COUNT = " + std::to_string(outputs.size()) + ";\n\n";
+    out += "const char *const OUTPUT_NAMES[OUTPUT_COUNT] = {";
+    for (size_t k = 0; k < outputs.size(); ++k)
+        out += (k ? ", \"" : "\"") + outputs[k].first + "\"";
+    out += "};\n\n";
+
+    // Отдельная программа на каждый выход: функция вычисляет только то, от чего зависит её результат.
+    for (const auto &output: outputs) {
+        ProgramBuilder<T> builder{VariableTable(variables)};
+        uint32_t reg = builder.add(output.second);
+        builder.addOutput(reg);
+        Program<T> single = builder.build();
+        out += "// " + output.first + " = " + output.second.to_string() + "\n";
+        out += "inline Real " + output.first + "(" + parameters(variables) + ") {\n";
+        emitInstructions(single, out);
+        out += "    return " + operand(single, single.outputs()[0]) + ";\n}\n\n";
+    }
+
+    out += "// Все выходы в порядке OUTPUT_NAMES; общие подвыражения вычисляются один раз.\n";
+    out += "inline void evalAll(" + parameters(variables) + (variables.empty() ? "" : ", ") + "Real *out_) {\n";
+    emitInstructions(program, out);
+    for (size_t k = 0; k < program.outputs().size(); ++k)
+        out += "    out_[" + std::to_string(k) + "] = " + operand(program, program.outputs()[k]) + ";\n";
+    out += "}\n\n} // namespace " + options.name + "\n\n#endif // " + guard + "\n";
+    return out;
+}
+
+// ===================================================================
+// Инстанциация шаблонов для вещественных типов: комплексная арифметика в заголовок не генерируется.
+#define INSTANTIATE_CODEGEN(T)                                                                \
+    template std::string emitCpp<T>(const std::vector<std::pair<std::string, Expression<T> > > &, \
+                                    const CodegenOptions &);
+
+INSTANTIATE_CODEGEN(float)
+INSTANTIATE_CODEGEN(double)
+INSTANTIATE_CODEGEN(long double)
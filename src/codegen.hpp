@@ -0,0 +1,39 @@
+#ifndef CODEGEN_HPP
+#define CODEGEN_HPP
+
+#include "program.hpp"
+
+/*
+    Генерация C++ для формул, известных на этапе сборки (differentiator --emit-cpp).
+
+    Результат — самодостаточный заголовок, зависящий только от <cmath>: для каждого определения
+    и для каждой запрошенной производной — inline-функция от всех переменных файла формул,
+    а также evalAll, вычисляющая все выходы сразу с общими подвыражениями.
+    Производные строятся через Expression<T>::differentiate, упрощаются конвейером optimize,
+    затем компилируются в Program<T>: построитель программы объединяет общие подвыражения.
+    Каждая функция — последовательность присваиваний локальным константам, по одной на инструкцию.
+    Имена локальных констант оканчиваются подчёркиванием (r0_, out_) и не пересекаются с параметрами:
+    имена переменных и определений должны быть идентификаторами C++ без подчёркивания в конце,
+    не ключевыми словами и не именами самого заголовка (Real, detail, evalAll, ...), иначе emitCpp
+    бросает исключение.
+
+    Сгенерированный код не проверяет ошибки в точке: результат соответствует политике Propagate.
+*/
+
+struct CodegenOptions {
+    // Пространство имён заголовка; из него же строится защитный макрос.
+    std::string name = "formulas";
+
+    // Переменные, по которым генерируются производные d_<определение>_d_<переменная>.
+    std::vector<std::string> derivatives;
+
+    // Исходный файл для комментария в заголовке.
+    std::string source;
+};
+
+// Заголовок для определений definitions (в порядке файла; см. parseDefinitions).
+template<typename T>
+std::string emitCpp(const std::vector<std::pair<std::string, Expression<T> > > &definitions,
+                    const CodegenOptions &options);
+
+#endif // CODEGEN_HPP
@@ -0,0 +1,162 @@
+#include "columns.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+/*
+    Реализация класса MappedFile
+*/
+
+static std::runtime_error systemError(const std::string &what, const std::string &path) {
+    return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+MappedFile::MappedFile(const std::string &path) {
+    fd_ = ::open(path.c_str(), O_RDONLY);
+    if (fd_ < 0)
+        throw systemError("Cannot open file", path);
+    struct stat info;
+    if (::fstat(fd_, &info) != 0) {
+        close();
+        throw systemError("Cannot stat file", path);
+    }
+    size_ = static_cast<size_t>(info.st_size);
+    if (size_ == 0)
+        return;
+    void *data = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) {
+        close();
+        throw systemError("Cannot map file", path);
+    }
+    data_ = static_cast<char *>(data);
+    // Столбцы читаются один раз подряд.
+    ::madvise(data_, size_, MADV_SEQUENTIAL);
+}
+
+MappedFile::MappedFile(const std::string &path, size_t size)
+    : size_(size), writable_(true) {
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0)
+        throw systemError("Cannot create file", path);
+    if (::ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+        close();
+        throw systemError("Cannot resize file", path);
+    }
+    if (size_ == 0)
+        return;
+    void *data = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) {
+        close();
+        throw systemError("Cannot map file", path);
+    }
+    data_ = static_cast<char *>(data);
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : fd_(other.fd_), data_(other.data_), size_(other.size_), writable_(other.writable_) {
+    other.fd_ = -1;
+    other.data_ = nullptr;
+    other.size_ = 0;
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        close();
+        std::swap(fd_, other.fd_);
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(writable_, other.writable_);
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+void MappedFile::close() {
+    if (data_)
+        ::munmap(data_, size_);
+    if (fd_ >= 0)
+        ::close(fd_);
+    data_ = nullptr;
+    fd_ = -1;
+    size_ = 0;
+}
+
+void MappedFile::release(size_t offset, size_t length) {
+    // madvise и msync работают с целыми страницами. Диапазоны освобождаются по порядку,
+    // поэтому начало округляется вниз, а неполная последняя страница остаётся до следующего вызова.
+    const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    size_t begin = offset / page * page;
+    size_t end = offset + length >= size_ ? size_ : (offset + length) / page * page;
+    if (!data_ || begin >= end)
+        return;
+    if (writable_)
+        ::msync(data_ + begin, end - begin, MS_ASYNC);
+    ::madvise(data_ + begin, end - begin, MADV_DONTNEED);
+}
+
+// ===================================================================
+
+template<typename T>
+size_t evalColumns(const Program<T> &program, const std::map<std::string, std::string> &inputs,
+                   const std::vector<std::string> &outputs, ErrorPolicy policy, size_t chunkRows) {
+    if (outputs.size() != program.outputs().size())
+        throw std::runtime_error("Expected " + std::to_string(program.outputs().size()) + " output file(s)");
+    if (chunkRows == 0)
+        throw std::runtime_error("Chunk size must be positive");
+
+    const std::vector<std::string> &variables = program.variables();
+    std::vector<MappedFile> columns;
+    size_t rows = 0;
+    for (size_t v = 0; v < variables.size(); ++v) {
+        auto it = inputs.find(variables[v]);
+        if (it == inputs.end())
+            throw std::runtime_error("No column file for variable \"" + variables[v] + "\"");
+        columns.emplace_back(it->second);
+        if (columns.back().size() % sizeof(T) != 0)
+            throw std::runtime_error("Column file " + it->second + " is not a whole number of values");
+        size_t count = columns.back().size() / sizeof(T);
+        if (v > 0 && count != rows)
+            throw std::runtime_error("Column file " + it->second + " has " + std::to_string(count) +
+                                     " rows, expected " + std::to_string(rows));
+        rows = count;
+    }
+    // Программа без переменных (константа) даёт одну строку.
+    if (variables.empty())
+        rows = 1;
+
+    std::vector<MappedFile> results;
+    for (const auto &path: outputs)
+        results.emplace_back(path, rows * sizeof(T));
+
+    std::vector<const T *> in(columns.size());
+    std::vector<T *> out(results.size());
+    for (size_t start = 0; start < rows; start += chunkRows) {
+        const size_t n = std::min(chunkRows, rows - start);
+        for (size_t v = 0; v < columns.size(); ++v)
+            in[v] = reinterpret_cast<const T *>(columns[v].data()) + start;
+        for (size_t k = 0; k < results.size(); ++k)
+            out[k] = reinterpret_cast<T *>(results[k].data()) + start;
+        program.evalBatch(in.data(), out.data(), n, policy);
+        for (auto &column: columns)
+            column.release(start * sizeof(T), n * sizeof(T));
+        for (auto &result: results)
+            result.release(start * sizeof(T), n * sizeof(T));
+    }
+    return rows;
+}
+
+// ===================================================================
+// Инстанциация шаблонов для всех числовых типов
+#define INSTANTIATE_COLUMNS(T)                                                                       \
+    template size_t evalColumns<T>(const Program<T> &, const std::map<std::string, std::string> &,   \
+                                   const std::vector<std::string> &, ErrorPolicy, size_t);
+
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE_COLUMNS)
@@ -0,0 +1,62 @@
+#ifndef COLUMNS_HPP
+#define COLUMNS_HPP
+
+#include "program.hpp"
+
+/*
+    Вычисление по столбцовым файлам, отображённым в память.
+    Столбец — файл с сырыми значениями типа T подряд (в порядке байтов машины), по одному файлу на переменную.
+    Файлы обрабатываются порциями: после каждой порции её страницы возвращаются системе,
+    поэтому объём данных может превышать объём памяти.
+*/
+
+// Файл, отображённый в память (POSIX mmap).
+class MappedFile {
+public:
+    // Отображение существующего файла только для чтения.
+    explicit MappedFile(const std::string &path);
+
+    // Создание (или перезапись) файла размером size байт, отображённого для записи.
+    MappedFile(const std::string &path, size_t size);
+
+    MappedFile(MappedFile &&other) noexcept;
+
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile();
+
+    const char *data() const { return data_; }
+
+    char *data() { return data_; }
+
+    size_t size() const { return size_; }
+
+    // Освобождение страниц диапазона [offset, offset + length): изменённые данные
+    // записываются в файл, страницы вытесняются из памяти процесса.
+    void release(size_t offset, size_t length);
+
+private:
+    void close();
+
+    int fd_ = -1;
+    char *data_ = nullptr;
+    size_t size_ = 0;
+    bool writable_ = false;
+};
+
+// Число строк в одной порции: 1M строк — 16 МБ на столбец long double.
+const size_t COLUMN_CHUNK_ROWS = size_t(1) << 20;
+
+// Вычисление всех выходов программы по столбцовым файлам.
+// inputs — файл столбца для каждой переменной программы, outputs — файлы результатов, по одному на выход.
+// Все входные столбцы должны содержать одинаковое число строк; возвращается число строк.
+template<typename T>
+size_t evalColumns(const Program<T> &program, const std::map<std::string, std::string> &inputs,
+                   const std::vector<std::string> &outputs, ErrorPolicy policy = ErrorPolicy::Throw,
+                   size_t chunkRows = COLUMN_CHUNK_ROWS);
+
+#endif // COLUMNS_HPP
@@ -0,0 +1,485 @@
+#include "compact.hpp"
+#include "functions.hpp"
+#include "lazy.hpp"
+#include "polynomial.hpp"
+#include "reduction.hpp"
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+
+namespace {
+
+// Вид узла. Сравнения идут в порядке Relation.
+enum CompactKind : uint8_t {
+    KIND_CONSTANT,      // a — номер в пуле констант
+    KIND_VARIABLE,      // a — номер в пуле имён
+    KIND_ADD,           // a, b — потомки
+    KIND_SUB,
+    KIND_MUL,
+    KIND_DIV,
+    KIND_POW,
+    KIND_LESS,
+    KIND_LESS_EQUAL,
+    KIND_GREATER,
+    KIND_GREATER_EQUAL,
+    KIND_EQUAL,
+    KIND_NOT_EQUAL,
+    KIND_SELECT,        // a — условие, extra[b], extra[b + 1] — ветви
+    KIND_INT_POW,       // a — основание, b — показатель (int32)
+    KIND_SIN,           // a — аргумент
+    KIND_COS,
+    KIND_LN,
+    KIND_EXP,
+    KIND_CALL1,         // a — аргумент, b — функция реестра
+    KIND_CALL2,         // a — первый аргумент, extra[b] — второй, extra[b + 1] — функция реестра
+    KIND_OPAQUE         // a — номер исходного узла
+};
+
+// Старший бит вида: узел нужен только ветвям select, и его ошибка возбуждается, только если ветвь выбрана.
+const uint8_t CONDITIONAL = 0x80;
+
+} // namespace
+
+// Запись узла дерева по номерам уже записанных потомков.
+template<typename T>
+class CompactCatalog<T>::Encoder : public ExpressionVisitor<T> {
+public:
+    explicit Encoder(CompactCatalog &catalog) : catalog_(catalog) {}
+
+    // Запись узла expr; возвращает его номер.
+    uint32_t encode(const Expression<T> &expr) {
+        current_ = &expr;
+        expr.node()->accept(*this);
+        const uint32_t index = static_cast<uint32_t>(catalog_.kinds_.size() - 1);
+        encoded_[expr.node()] = index;
+        return index;
+    }
+
+    bool encoded(const ExpressionImpl<T> *node) const { return encoded_.count(node) != 0; }
+
+    void visitNode(const ExpressionImpl<T> &) override {
+        emit(KIND_OPAQUE, static_cast<uint32_t>(catalog_.opaque_.size()), 0);
+        catalog_.opaque_.push_back(*current_);
+    }
+
+    void visit(const Value<T> &node) override { emit(KIND_CONSTANT, catalog_.constant(node.value()), 0); }
+
+    void visit(const Variable<T> &node) override { emit(KIND_VARIABLE, catalog_.name(node.name()), 0); }
+
+    void visit(const OperationAdd<T> &node) override { binary(KIND_ADD, node); }
+
+    void visit(const OperationSub<T> &node) override { binary(KIND_SUB, node); }
+
+    void visit(const OperationMul<T> &node) override { binary(KIND_MUL, node); }
+
+    void visit(const OperationDiv<T> &node) override { binary(KIND_DIV, node); }
+
+    void visit(const OperationPow<T> &node) override { binary(KIND_POW, node); }
+
+    void visit(const Comparison<T> &node) override {
+        binary(static_cast<uint8_t>(KIND_LESS + static_cast<int>(node.relation())), node);
+    }
+
+    void visit(const Select<T> &node) override {
+        emit(KIND_SELECT, index(node.child(0)), static_cast<uint32_t>(catalog_.extra_.size()));
+        catalog_.extra_.push_back(index(node.child(1)));
+        catalog_.extra_.push_back(index(node.child(2)));
+    }
+
+    void visit(const OperationIntPow<T> &node) override {
+        if (node.exponent() < std::numeric_limits<int32_t>::min() ||
+            node.exponent() > std::numeric_limits<int32_t>::max())
+            return visitNode(node);
+        emit(KIND_INT_POW, index(node.child(0)), static_cast<uint32_t>(static_cast<int32_t>(node.exponent())));
+    }
+
+    void visit(const FunctionSin<T> &node) override { emit(KIND_SIN, index(node.child(0)), 0); }
+
+    void visit(const FunctionCos<T> &node) override { emit(KIND_COS, index(node.child(0)), 0); }
+
+    void visit(const FunctionLn<T> &node) override { emit(KIND_LN, index(node.child(0)), 0); }
+
+    void visit(const FunctionExp<T> &node) override { emit(KIND_EXP, index(node.child(0)), 0); }
+
+    void visit(const FunctionCall<T> &node) override {
+        if (node.childCount() == 1) {
+            emit(KIND_CALL1, index(node.child(0)), node.function());
+        } else {
+            emit(KIND_CALL2, index(node.child(0)), static_cast<uint32_t>(catalog_.extra_.size()));
+            catalog_.extra_.push_back(index(node.child(1)));
+            catalog_.extra_.push_back(node.function());
+        }
+    }
+
+private:
+    uint32_t index(const Expression<T> &expr) const { return encoded_.at(expr.node()); }
+
+    void binary(uint8_t kind, const ExpressionImpl<T> &node) {
+        emit(kind, index(node.child(0)), index(node.child(1)));
+    }
+
+    void emit(uint8_t kind, uint32_t a, uint32_t b) {
+        if (catalog_.kinds_.size() >= std::numeric_limits<uint32_t>::max())
+            throw std::runtime_error("Compact catalog is limited to 2^32 - 1 nodes");
+        catalog_.kinds_.push_back(kind);
+        catalog_.a_.push_back(a);
+        catalog_.b_.push_back(b);
+    }
+
+    CompactCatalog &catalog_;
+    const Expression<T> *current_ = nullptr;
+    std::unordered_map<const ExpressionImpl<T> *, uint32_t> encoded_;
+};
+
+template<typename T>
+bool CompactCatalog<T>::ConstantLess::operator()(const T &l, const T &r) const {
+    auto key = [](const T &value) {
+        return std::make_tuple(std::real(value), std::signbit(std::real(value)), std::imag(value),
+                               std::signbit(std::imag(value)));
+    };
+    return key(l) < key(r);
+}
+
+template<typename T>
+uint32_t CompactCatalog<T>::constant(const T &value) {
+    if (value != value) {
+        constants_.push_back(value);
+        return static_cast<uint32_t>(constants_.size() - 1);
+    }
+    auto it = constantIndex_.find(value);
+    if (it != constantIndex_.end())
+        return it->second;
+    constants_.push_back(value);
+    return constantIndex_[value] = static_cast<uint32_t>(constants_.size() - 1);
+}
+
+template<typename T>
+uint32_t CompactCatalog<T>::name(const std::string &name) {
+    auto it = nameIndex_.find(name);
+    if (it != nameIndex_.end())
+        return it->second;
+    names_.push_back(name);
+    return nameIndex_[name] = static_cast<uint32_t>(names_.size() - 1);
+}
+
+template<typename T>
+size_t CompactCatalog<T>::add(const Expression<T> &expr) {
+    // После shrink индексы интернирования восстанавливаются по пулам.
+    if (constantIndex_.empty()) {
+        for (size_t i = 0; i < constants_.size(); ++i) {
+            if (constants_[i] == constants_[i])
+                constantIndex_.emplace(constants_[i], static_cast<uint32_t>(i));
+        }
+    }
+    if (nameIndex_.empty()) {
+        for (size_t i = 0; i < names_.size(); ++i)
+            nameIndex_.emplace(names_[i], static_cast<uint32_t>(i));
+    }
+
+    // Потомки записываются раньше родителя; поддеревья редукций остаются внутри исходного узла.
+    const size_t nodes = kinds_.size(), extra = extra_.size(), opaque = opaque_.size();
+    try {
+        Encoder encoder(*this);
+        std::vector<std::pair<const Expression<T> *, bool> > stack{{&expr, false}};
+        while (!stack.empty()) {
+            auto [current, expanded] = stack.back();
+            stack.pop_back();
+            const ExpressionImpl<T> *node = current->node();
+            if (encoder.encoded(node))
+                continue;
+            if (expanded) {
+                encoder.encode(*current);
+            } else {
+                stack.push_back({current, true});
+                if (!dynamic_cast<const Reduction<T> *>(node)) {
+                    for (size_t i = node->childCount(); i-- > 0;)
+                        stack.push_back({&node->child(i), false});
+                }
+            }
+        }
+    } catch (...) {
+        kinds_.resize(nodes);
+        a_.resize(nodes);
+        b_.resize(nodes);
+        extra_.resize(extra);
+        opaque_.erase(opaque_.begin() + opaque, opaque_.end());
+        throw;
+    }
+
+    // Узлы, до которых от корня можно дойти, не проходя через ветви select, вычисляются всегда.
+    const uint32_t first = static_cast<uint32_t>(nodes), root = static_cast<uint32_t>(kinds_.size() - 1);
+    std::vector<bool> unconditional(root - first + 1);
+    unconditional.back() = true;
+    for (uint32_t i = root + 1; i-- > first;) {
+        if (!unconditional[i - first]) {
+            kinds_[i] |= CONDITIONAL;
+            continue;
+        }
+        switch (kinds_[i]) {
+            case KIND_CONSTANT:
+            case KIND_VARIABLE:
+            case KIND_OPAQUE:
+                break;
+            case KIND_SELECT:
+            case KIND_INT_POW:
+            case KIND_SIN:
+            case KIND_COS:
+            case KIND_LN:
+            case KIND_EXP:
+            case KIND_CALL1:
+                unconditional[a_[i] - first] = true;
+                break;
+            case KIND_CALL2:
+                unconditional[a_[i] - first] = true;
+                unconditional[extra_[b_[i]] - first] = true;
+                break;
+            default:
+                unconditional[a_[i] - first] = true;
+                unconditional[b_[i] - first] = true;
+                break;
+        }
+    }
+    roots_.push_back(root);
+    return roots_.size() - 1;
+}
+
+template<typename T>
+T CompactCatalog<T>::evalNode(uint32_t node, const T *values, uint32_t first,
+                              const std::map<std::string, T> &context) const {
+    const uint32_t a = a_[node], b = b_[node];
+    auto value = [values, first](uint32_t index) { return values[index - first]; };
+    switch (kinds_[node] & ~CONDITIONAL) {
+        case KIND_CONSTANT:
+            return constants_[a];
+        case KIND_VARIABLE: {
+            auto it = context.find(names_[a]);
+            if (it == context.end()) {
+                if (errorPolicy() == ErrorPolicy::Propagate)
+                    return quietNaN<T>();
+                throw std::runtime_error("Variable \"" + names_[a] + "\" not found in context");
+            }
+            return it->second;
+        }
+        case KIND_ADD:
+            return value(a) + value(b);
+        case KIND_SUB:
+            return value(a) - value(b);
+        case KIND_MUL:
+            return value(a) * value(b);
+        case KIND_DIV:
+            if (value(b) == T(0) && errorPolicy() == ErrorPolicy::Throw)
+                throw std::runtime_error("Division by zero");
+            return value(a) / value(b);
+        case KIND_POW:
+            return std::pow(value(a), value(b));
+        case KIND_EQUAL:
+            return T(value(a) == value(b) ? 1 : 0);
+        case KIND_NOT_EQUAL:
+            return T(value(a) != value(b) ? 1 : 0);
+        case KIND_LESS:
+        case KIND_LESS_EQUAL:
+        case KIND_GREATER:
+        case KIND_GREATER_EQUAL:
+            // Упорядочивающие сравнения комплексных чисел не создаются (см. compare).
+            if constexpr (std::is_floating_point_v<T>) {
+                const uint8_t kind = kinds_[node] & ~CONDITIONAL;
+                const bool result = kind == KIND_LESS         ? value(a) < value(b)
+                                    : kind == KIND_LESS_EQUAL ? value(a) <= value(b)
+                                    : kind == KIND_GREATER    ? value(a) > value(b)
+                                                              : value(a) >= value(b);
+                return T(result ? 1 : 0);
+            }
+            return T(0);
+        case KIND_SELECT:
+            return value(a) != T(0) ? value(extra_[b]) : value(extra_[b + 1]);
+        case KIND_INT_POW:
+            return integerPower(value(a), static_cast<long>(static_cast<int32_t>(b)));
+        case KIND_SIN:
+            return std::sin(value(a));
+        case KIND_COS:
+            return std::cos(value(a));
+        case KIND_LN:
+            if constexpr (std::is_floating_point_v<T>) {
+                if (value(a) <= T(0) && errorPolicy() == ErrorPolicy::Throw)
+                    throw std::runtime_error("Logarithm of non-positive value");
+            }
+            return std::log(value(a));
+        case KIND_EXP:
+            return std::exp(value(a));
+        case KIND_CALL1: {
+            const T args[] = {value(a)};
+            return FunctionRegistry<T>::instance().get(static_cast<uint16_t>(b)).eval(args);
+        }
+        case KIND_CALL2: {
+            const T args[] = {value(a), value(extra_[b])};
+            return FunctionRegistry<T>::instance().get(static_cast<uint16_t>(extra_[b + 1])).eval(args);
+        }
+        default:
+            return opaque_[a].eval(context);
+    }
+}
+
+template<typename T>
+T CompactCatalog<T>::eval(size_t index, const std::map<std::string, T> &context) const {
+    if (index >= roots_.size())
+        throw std::out_of_range("Compact expression index out of range");
+    const uint32_t first = this->first(index), root = roots_[index];
+    // Буфер значений потока переиспользуется между вызовами.
+    thread_local std::vector<T> values;
+    values.resize(root - first + 1);
+    if (errorPolicy() == ErrorPolicy::Propagate) {
+        for (uint32_t i = first; i <= root; ++i)
+            values[i - first] = evalNode(i, values.data(), first, context);
+        return values[root - first];
+    }
+    // Исключение узла ветви (в том числе об отсутствующей переменной) запоминается и переходит
+    // к зависимым узлам ветвей; возбуждается оно, только если ветвь выбрана, как в дереве.
+    thread_local std::vector<std::exception_ptr> pending;
+    bool failed = false;
+    auto error = [&](uint32_t node) { return pending[node - first]; };
+    for (uint32_t i = first; i <= root; ++i) {
+        const uint32_t a = a_[i], b = b_[i];
+        const uint8_t kind = kinds_[i] & ~CONDITIONAL;
+        if (failed && kind != KIND_CONSTANT && kind != KIND_VARIABLE && kind != KIND_OPAQUE) {
+            std::exception_ptr cause = error(a);
+            if (kind == KIND_SELECT && !cause)
+                cause = error(values[a - first] != T(0) ? extra_[b] : extra_[b + 1]);
+            else if (kind == KIND_CALL2 && !cause)
+                cause = error(extra_[b]);
+            else if (kind < KIND_SELECT && !cause)
+                cause = error(b);
+            if (cause) {
+                if (!(kinds_[i] & CONDITIONAL))
+                    std::rethrow_exception(cause);
+                pending[i - first] = cause;
+                continue;
+            }
+        }
+        if (!(kinds_[i] & CONDITIONAL)) {
+            values[i - first] = evalNode(i, values.data(), first, context);
+            continue;
+        }
+        try {
+            values[i - first] = evalNode(i, values.data(), first, context);
+        } catch (...) {
+            if (!failed)
+                pending.assign(root - first + 1, nullptr);
+            failed = true;
+            pending[i - first] = std::current_exception();
+        }
+    }
+    return values[root - first];
+}
+
+template<typename T>
+Expression<T> CompactCatalog<T>::expression(size_t index) const {
+    if (index >= roots_.size())
+        throw std::out_of_range("Compact expression index out of range");
+    const uint32_t first = this->first(index), root = roots_[index];
+    std::vector<Expression<T> > built;
+    built.reserve(root - first + 1);
+    auto child = [&built, first](uint32_t node) -> const Expression<T> & { return built[node - first]; };
+    for (uint32_t i = first; i <= root; ++i) {
+        const uint32_t a = a_[i], b = b_[i];
+        const uint8_t kind = kinds_[i] & ~CONDITIONAL;
+        switch (kind) {
+            case KIND_CONSTANT:
+                built.emplace_back(constants_[a]);
+                break;
+            case KIND_VARIABLE:
+                built.emplace_back(names_[a]);
+                break;
+            case KIND_ADD:
+                built.emplace_back(std::make_shared<OperationAdd<T> >(child(a), child(b)));
+                break;
+            case KIND_SUB:
+                built.emplace_back(std::make_shared<OperationSub<T> >(child(a), child(b)));
+                break;
+            case KIND_MUL:
+                built.emplace_back(std::make_shared<OperationMul<T> >(child(a), child(b)));
+                break;
+            case KIND_DIV:
+                built.emplace_back(std::make_shared<OperationDiv<T> >(child(a), child(b)));
+                break;
+            case KIND_POW:
+                built.emplace_back(std::make_shared<OperationPow<T> >(child(a), child(b)));
+                break;
+            case KIND_LESS:
+            case KIND_LESS_EQUAL:
+            case KIND_GREATER:
+            case KIND_GREATER_EQUAL:
+            case KIND_EQUAL:
+            case KIND_NOT_EQUAL:
+                built.emplace_back(std::make_shared<Comparison<T> >(static_cast<Relation>(kind - KIND_LESS), child(a),
+                                                                    child(b)));
+                break;
+            case KIND_SELECT:
+                built.emplace_back(std::make_shared<Select<T> >(child(a), child(extra_[b]), child(extra_[b + 1])));
+                break;
+            case KIND_INT_POW:
+                built.emplace_back(
+                    std::make_shared<OperationIntPow<T> >(child(a), static_cast<long>(static_cast<int32_t>(b))));
+                break;
+            case KIND_SIN:
+                built.emplace_back(std::make_shared<FunctionSin<T> >(child(a)));
+                break;
+            case KIND_COS:
+                built.emplace_back(std::make_shared<FunctionCos<T> >(child(a)));
+                break;
+            case KIND_LN:
+                built.emplace_back(std::make_shared<FunctionLn<T> >(child(a)));
+                break;
+            case KIND_EXP:
+                built.emplace_back(std::make_shared<FunctionExp<T> >(child(a)));
+                break;
+            case KIND_CALL1:
+                built.emplace_back(std::make_shared<FunctionCall<T> >(static_cast<uint16_t>(b),
+                                                                      std::vector<Expression<T> >{child(a)}));
+                break;
+            case KIND_CALL2:
+                built.emplace_back(std::make_shared<FunctionCall<T> >(
+                    static_cast<uint16_t>(extra_[b + 1]), std::vector<Expression<T> >{child(a), child(extra_[b])}));
+                break;
+            default:
+                built.push_back(opaque_[a]);
+                break;
+        }
+    }
+    return built.back();
+}
+
+template<typename T>
+size_t CompactCatalog<T>::bytes() const {
+    size_t total = kinds_.capacity() * sizeof(uint8_t) + (a_.capacity() + b_.capacity()) * sizeof(uint32_t) +
+                   (extra_.capacity() + roots_.capacity()) * sizeof(uint32_t) + constants_.capacity() * sizeof(T) +
+                   names_.capacity() * sizeof(std::string) + opaque_.capacity() * sizeof(Expression<T>);
+    // Короткие имена хранятся внутри std::string, длинные — в отдельном блоке.
+    for (const auto &name: names_) {
+        if (name.capacity() > std::string().capacity())
+            total += name.capacity() + 1;
+    }
+    return total;
+}
+
+template<typename T>
+void CompactCatalog<T>::shrink() {
+    constantIndex_.clear();
+    std::unordered_map<std::string, uint32_t>().swap(nameIndex_);
+    kinds_.shrink_to_fit();
+    a_.shrink_to_fit();
+    b_.shrink_to_fit();
+    extra_.shrink_to_fit();
+    roots_.shrink_to_fit();
+    constants_.shrink_to_fit();
+    names_.shrink_to_fit();
+    opaque_.shrink_to_fit();
+}
+
+// ===================================================================
+// Инстанциация шаблонов для всех числовых типов
+#define INSTANTIATE_COMPACT(T) template class CompactCatalog<T>;
+
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE_COMPACT)
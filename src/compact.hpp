@@ -0,0 +1,82 @@
+#ifndef COMPACT_HPP
+#define COMPACT_HPP
+
+#include "expression.hpp"
+#include <cstdint>
+#include <unordered_map>
+
+/*
+    Компактное неизменяемое хранение множества выражений.
+
+    Узел занимает 9 байт в трёх параллельных массивах: вид узла (байт) и два 32-битных поля.
+    У операций поля — номера потомков, у констант и переменных — номера в общих пулах:
+    равные константы и имена переменных всех формул хранятся один раз. Узлы формулы лежат
+    подряд в обратном порядке обхода (потомки раньше родителя), поэтому вычисление — один
+    проход по отрезку массива без рекурсии и без построения дерева. Поддеревья, разделяемые
+    внутри формулы (как в производных), кодируются один раз.
+
+    Третий потомок select и второй аргумент функции реестра хранятся в дополнительном массиве.
+    Узлы без компактной записи (многочлены, редукции, ленивые производные) хранятся
+    как ссылки на исходные узлы.
+
+    Как и в Program<T>, ветви select вычисляются обе, но ошибка узла ветви (деление на ноль,
+    отсутствующая переменная) возбуждается, только если ветвь выбрана, — результат и ошибки
+    совпадают с Expression<T>::eval.
+*/
+
+template<typename T>
+class CompactCatalog {
+public:
+    // Добавление выражения; возвращает его номер.
+    size_t add(const Expression<T> &expr);
+
+    size_t size() const { return roots_.size(); }
+
+    // Вычисление выражения index без построения дерева.
+    T eval(size_t index, const std::map<std::string, T> &context) const;
+
+    // Восстановление дерева выражения index.
+    Expression<T> expression(size_t index) const;
+
+    // Число узлов всех выражений.
+    size_t nodes() const { return kinds_.size(); }
+
+    // Память под узлы, пулы и номера корней в байтах (без индексов интернирования, см. shrink).
+    size_t bytes() const;
+
+    // Освобождение индексов интернирования и запаса ёмкости массивов;
+    // при следующем add индексы восстанавливаются.
+    void shrink();
+
+private:
+    // Сравнение констант для пула: -0 отличается от 0, NaN в пул не попадает.
+    struct ConstantLess {
+        bool operator()(const T &l, const T &r) const;
+    };
+
+    class Encoder;
+
+    // Первый узел выражения index.
+    uint32_t first(size_t index) const { return index == 0 ? 0 : roots_[index - 1] + 1; }
+
+    uint32_t constant(const T &value);
+
+    uint32_t name(const std::string &name);
+
+    T evalNode(uint32_t node, const T *values, uint32_t first, const std::map<std::string, T> &context) const;
+
+    std::vector<uint8_t> kinds_;
+    std::vector<uint32_t> a_;
+    std::vector<uint32_t> b_;
+    std::vector<uint32_t> extra_;
+    std::vector<uint32_t> roots_;
+
+    std::vector<T> constants_;
+    std::vector<std::string> names_;
+    std::vector<Expression<T> > opaque_;
+
+    std::map<T, uint32_t, ConstantLess> constantIndex_;
+    std::unordered_map<std::string, uint32_t> nameIndex_;
+};
+
+#endif // COMPACT_HPP
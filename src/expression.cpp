@@ -1,7 +1,70 @@
 #include "expression.hpp"
+#include "taylor.hpp"
+#include "program.hpp"
+#include "polynomial.hpp"
+#include "traversal.hpp"
+#include <algorithm>
 #include <sstream>
 #include <cmath>
 #include <type_traits>
+#include <limits>
+
+/*
+    Политика ошибок вычисления
+*/
+
+static thread_local ErrorPolicy currentErrorPolicy = ErrorPolicy::Throw;
+
+ErrorPolicy errorPolicy() {
+    return currentErrorPolicy;
+}
+
+ErrorPolicyScope::ErrorPolicyScope(ErrorPolicy policy)
+    : previous_(currentErrorPolicy) {
+    currentErrorPolicy = policy;
+}
+
+ErrorPolicyScope::~ErrorPolicyScope() {
+    currentErrorPolicy = previous_;
+}
+
+/*
+    Массивы текущего потока
+*/
+
+template<typename T>
+static const ArrayContext<T> *&currentArrays() {
+    static thread_local const ArrayContext<T> *arrays = nullptr;
+    return arrays;
+}
+
+template<typename T>
+ArrayScope<T>::ArrayScope(const ArrayContext<T> &arrays)
+    : previous_(currentArrays<T>()) {
+    currentArrays<T>() = &arrays;
+}
+
+template<typename T>
+ArrayScope<T>::~ArrayScope() {
+    currentArrays<T>() = previous_;
+}
+
+template<typename T>
+const ArrayContext<T> *ArrayScope<T>::current() {
+    return currentArrays<T>();
+}
+
+/*
+    Реализация методов класса ExpressionImpl<T>
+*/
+
+template<typename T>
+void ExpressionImpl<T>::updateHeight() {
+    for (size_t i = 0; i < childCount(); ++i)
+        height_ = std::max(height_, child(i).node()->height() + 1);
+}
+
+// ===================================================================
 
 /*
     Реализация методов класса Expression<T>
@@ -17,9 +80,10 @@ Expression<T>::Expression(T value)
     : impl_(std::make_shared<Value<T> >(value)) {
 }
 
+// Узлы неизменяемы, поэтому копия выражения разделяет дерево с оригиналом.
 template<typename T>
 Expression<T>::Expression(const Expression<T> &other)
-    : impl_(other.impl_->clone()) {
+    : impl_(other.impl_) {
 }
 
 template<typename T>
@@ -30,7 +94,7 @@ Expression<T>::Expression(Expression<T> &&other) noexcept
 template<typename T>
 Expression<T> &Expression<T>::operator=(const Expression<T> &other) {
     if (this != &other) {
-        impl_ = other.impl_->clone();
+        impl_ = other.impl_;
     }
     return *this;
 }
@@ -48,6 +112,28 @@ Expression<T>::Expression(std::shared_ptr<ExpressionImpl<T> > impl)
     : impl_(impl) {
 }
 
+template<typename T>
+Expression<T>::~Expression() {
+    // Рекурсивное освобождение цепочки из миллиона узлов переполнило бы стек вызовов:
+    // потомки единолично принадлежащих узлов переносятся в явный стек до удаления родителя.
+    if (!impl_ || impl_->height() <= RECURSION_LIMIT || impl_.use_count() != 1)
+        return;
+    std::vector<std::shared_ptr<ExpressionImpl<T> > > pending;
+    pending.push_back(std::move(impl_));
+    while (!pending.empty()) {
+        std::shared_ptr<ExpressionImpl<T> > node = std::move(pending.back());
+        pending.pop_back();
+        if (node.use_count() != 1)
+            continue;
+        for (size_t i = 0; i < node->childCount(); ++i) {
+            // Узел удаляется в конце итерации, и опустевший потомок больше никем не читается.
+            auto &child = const_cast<Expression<T> &>(node->child(i));
+            if (child.impl_)
+                pending.push_back(std::move(child.impl_));
+        }
+    }
+}
+
 template<typename T>
 Expression<T> Expression<T>::operator+(const Expression<T> &right) const {
     return Expression<T>(std::make_shared<OperationAdd<T> >(*this, right));
@@ -70,6 +156,11 @@ Expression<T> Expression<T>::operator/(const Expression<T> &right) const {
 
 template<typename T>
 Expression<T> Expression<T>::operator^(const Expression<T> &right) const {
+    // Целочисленный постоянный показатель обрабатывается отдельным узлом.
+    long exponent;
+    auto value = dynamic_cast<const Value<T> *>(right.impl_.get());
+    if (value && asInteger(value->value(), exponent))
+        return Expression<T>(std::make_shared<OperationIntPow<T> >(*this, exponent));
     return Expression<T>(std::make_shared<OperationPow<T> >(*this, right));
 }
 
@@ -105,24 +196,81 @@ Expression<T> &Expression<T>::operator^=(const Expression<T> &right) {
 
 template<typename T>
 T Expression<T>::eval(const std::map<std::string, T> &context) const {
+    PROFILE_SCOPE(profile::Kind::Eval, impl_.get());
+    if (impl_->height() > RECURSION_LIMIT)
+        return evalIterative(*this, context);
     return impl_->eval(context);
 }
 
+template<typename T>
+T Expression<T>::eval(const std::map<std::string, T> &context, ErrorPolicy policy) const {
+    ErrorPolicyScope scope(policy);
+    return eval(context);
+}
+
+template<typename T>
+T Expression<T>::eval(const std::map<std::string, T> &context, const ArrayContext<T> &arrays) const {
+    ArrayScope<T> scope(arrays);
+    return eval(context);
+}
+
 template<typename T>
 std::string Expression<T>::to_string() const {
+    if (impl_->height() > RECURSION_LIMIT)
+        return toStringIterative(*this);
     return impl_->to_string();
 }
 
 template<typename T>
 Expression<T> Expression<T>::substitute(const std::string &var, const Expression<T> &expr) const {
+    PROFILE_SCOPE(profile::Kind::Substitute, impl_.get());
+    if (impl_->height() > RECURSION_LIMIT)
+        return substituteIterative(*this, var, expr);
     return impl_->substitute(var, expr);
 }
 
 template<typename T>
 Expression<T> Expression<T>::differentiate(const std::string &var) const {
+    PROFILE_SCOPE(profile::Kind::Differentiate, impl_.get());
+    if (impl_->height() > RECURSION_LIMIT)
+        return differentiateIterative(*this, var);
     return impl_->derivative(var);
 }
 
+template<typename T>
+std::vector<T> Expression<T>::taylor(const std::string &var, const std::map<std::string, T> &context,
+                                     size_t order) const {
+    requireShallow(*this, "taylor");
+    return impl_->taylor(context, var, order);
+}
+
+template<typename T>
+std::pair<T, T> Expression<T>::evalWithDerivative(const std::string &var,
+                                                  const std::map<std::string, T> &context) const {
+    requireShallow(*this, "evalWithDerivative");
+    Jet<T> jet = impl_->evalJet(context, var);
+    return {jet.value, jet.first};
+}
+
+template<typename T>
+Jet<T> Expression<T>::evalJet(const std::string &var, const std::map<std::string, T> &context) const {
+    requireShallow(*this, "evalJet");
+    return impl_->evalJet(context, var);
+}
+
+template<typename T>
+std::vector<T> Expression<T>::derivatives(const std::string &var, const std::map<std::string, T> &context,
+                                          size_t order) const {
+    requireShallow(*this, "derivatives");
+    return taylorToDerivatives(impl_->taylor(context, var, order));
+}
+
+template<typename T>
+uint32_t Expression<T>::compile(ProgramBuilder<T> &builder) const {
+    requireShallow(*this, "compile");
+    return impl_->compile(builder);
+}
+
 // ===================================================================
 
 /*
@@ -156,11 +304,43 @@ Expression<T> Value<T>::substitute(const std::string &, const Expression<T> &) c
     return Expression<T>(value_);
 }
 
+template<typename T>
+std::vector<T> Value<T>::taylor(const std::map<std::string, T> &, const std::string &,
+                                size_t order) const {
+    return taylorConstant(value_, order);
+}
+
+template<typename T>
+Jet<T> Value<T>::evalJet(const std::map<std::string, T> &, const std::string &) const {
+    return {value_, T(0), T(0)};
+}
+
+template<typename T>
+uint32_t Value<T>::compile(ProgramBuilder<T> &builder) const {
+    return builder.constant(value_);
+}
+
+template<typename T>
+bool Value<T>::toPolynomial(Polynomial<T> &result) const {
+    result = Polynomial<T>(value_);
+    return true;
+}
+
+template<typename T>
+Expression<T> Value<T>::mapChildren(const std::function<Expression<T>(const Expression<T> &)> &) const {
+    return Expression<T>(value_);
+}
+
 template<typename T>
 std::shared_ptr<ExpressionImpl<T> > Value<T>::clone() const {
     return std::make_shared<Value<T> >(value_);
 }
 
+template<typename T>
+void Value<T>::accept(ExpressionVisitor<T> &visitor) const {
+    visitor.visit(*this);
+}
+
 // ===================================================================
 
 /*
@@ -176,6 +356,8 @@ template<typename T>
 T Variable<T>::eval(const std::map<std::string, T> &context) const {
     auto it = context.find(name_);
     if (it == context.end()) {
+        if (errorPolicy() == ErrorPolicy::Propagate)
+            return quietNaN<T>();
         throw std::runtime_error("Variable \"" + name_ + "\" not found in context");
     }
     return it->second;
@@ -196,11 +378,46 @@ Expression<T> Variable<T>::substitute(const std::string &var, const Expression<T
     return (name_ == var) ? expr : Expression<T>(std::make_shared<Variable<T> >(name_));
 }
 
+template<typename T>
+std::vector<T> Variable<T>::taylor(const std::map<std::string, T> &context, const std::string &var,
+                                   size_t order) const {
+    std::vector<T> result = taylorConstant(eval(context), order);
+    if (name_ == var && order > 0)
+        result[1] = T(1);
+    return result;
+}
+
+template<typename T>
+Jet<T> Variable<T>::evalJet(const std::map<std::string, T> &context, const std::string &var) const {
+    return {eval(context), T(name_ == var ? 1 : 0), T(0)};
+}
+
+template<typename T>
+uint32_t Variable<T>::compile(ProgramBuilder<T> &builder) const {
+    return builder.variable(name_);
+}
+
+template<typename T>
+bool Variable<T>::toPolynomial(Polynomial<T> &result) const {
+    result = Polynomial<T>(name_);
+    return true;
+}
+
+template<typename T>
+Expression<T> Variable<T>::mapChildren(const std::function<Expression<T>(const Expression<T> &)> &) const {
+    return Expression<T>(name_);
+}
+
 template<typename T>
 std::shared_ptr<ExpressionImpl<T> > Variable<T>::clone() const {
     return std::make_shared<Variable<T> >(name_);
 }
 
+template<typename T>
+void Variable<T>::accept(ExpressionVisitor<T> &visitor) const {
+    visitor.visit(*this);
+}
+
 // ===================================================================
 
 /*
@@ -210,6 +427,24 @@ std::shared_ptr<ExpressionImpl<T> > Variable<T>::clone() const {
 template<typename T>
 BinaryOperation<T>::BinaryOperation(const Expression<T> &left, const Expression<T> &right)
     : left_(left), right_(right) {
+    this->updateHeight();
+}
+
+template<typename T>
+T BinaryOperation<T>::eval(const std::map<std::string, T> &context) const {
+    const T args[2] = {left_.eval(context), right_.eval(context)};
+    return this->apply(args, context);
+}
+
+template<typename T>
+std::string BinaryOperation<T>::to_string() const {
+    return this->part(0) + left_.to_string() + this->part(1) + right_.to_string() + this->part(2);
+}
+
+template<typename T>
+Expression<T> BinaryOperation<T>::derivative(const std::string &var) const {
+    const Expression<T> derivatives[2] = {left_.differentiate(var), right_.differentiate(var)};
+    return this->derivativeFrom(derivatives, var);
 }
 
 
@@ -219,18 +454,18 @@ OperationAdd<T>::OperationAdd(const Expression<T> &left, const Expression<T> &ri
 }
 
 template<typename T>
-T OperationAdd<T>::eval(const std::map<std::string, T> &context) const {
-    return this->left_.eval(context) + this->right_.eval(context);
+T OperationAdd<T>::apply(const T *args, const std::map<std::string, T> &) const {
+    return args[0] + args[1];
 }
 
 template<typename T>
-std::string OperationAdd<T>::to_string() const {
-    return "(" + this->left_.to_string() + " + " + this->right_.to_string() + ")";
+std::string OperationAdd<T>::part(size_t index) const {
+    return index == 0 ? "(" : index == 1 ? " + " : ")";
 }
 
 template<typename T>
-Expression<T> OperationAdd<T>::derivative(const std::string &var) const {
-    return this->left_.differentiate(var) + this->right_.differentiate(var);
+Expression<T> OperationAdd<T>::derivativeFrom(const Expression<T> *derivatives, const std::string &) const {
+    return derivatives[0] + derivatives[1];
 }
 
 template<typename T>
@@ -238,11 +473,49 @@ Expression<T> OperationAdd<T>::substitute(const std::string &var, const Expressi
     return this->left_.substitute(var, expr) + this->right_.substitute(var, expr);
 }
 
+template<typename T>
+std::vector<T> OperationAdd<T>::taylor(const std::map<std::string, T> &context, const std::string &var,
+                                       size_t order) const {
+    return taylorAdd(this->left_.taylor(var, context, order), this->right_.taylor(var, context, order));
+}
+
+template<typename T>
+Jet<T> OperationAdd<T>::evalJet(const std::map<std::string, T> &context, const std::string &var) const {
+    Jet<T> a = this->left_.evalJet(var, context), b = this->right_.evalJet(var, context);
+    return {a.value + b.value, a.first + b.first, a.second + b.second};
+}
+
+template<typename T>
+uint32_t OperationAdd<T>::compile(ProgramBuilder<T> &builder) const {
+    uint32_t left = this->left_.compile(builder);
+    uint32_t right = this->right_.compile(builder);
+    return builder.binary(OpCode::Add, left, right);
+}
+
+template<typename T>
+bool OperationAdd<T>::toPolynomial(Polynomial<T> &result) const {
+    Polynomial<T> left, right;
+    if (!this->left_.getImpl()->toPolynomial(left) || !this->right_.getImpl()->toPolynomial(right))
+        return false;
+    result = left + right;
+    return result.size() <= Polynomial<T>::MAX_TERMS;
+}
+
+template<typename T>
+Expression<T> OperationAdd<T>::mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const {
+    return Expression<T>(std::make_shared<OperationAdd<T> >(f(this->left_), f(this->right_)));
+}
+
 template<typename T>
 std::shared_ptr<ExpressionImpl<T> > OperationAdd<T>::clone() const {
     return std::make_shared<OperationAdd<T> >(this->left_, this->right_);
 }
 
+template<typename T>
+void OperationAdd<T>::accept(ExpressionVisitor<T> &visitor) const {
+    visitor.visit(*this);
+}
+
 
 template<typename T>
 OperationSub<T>::OperationSub(const Expression<T> &left, const Expression<T> &right)
@@ -250,18 +523,18 @@ OperationSub<T>::OperationSub(const Expression<T> &left, const Expression<T> &ri
 }
 
 template<typename T>
-T OperationSub<T>::eval(const std::map<std::string, T> &context) const {
-    return this->left_.eval(context) - this->right_.eval(context);
+T OperationSub<T>::apply(const T *args, const std::map<std::string, T> &) const {
+    return args[0] - args[1];
 }
 
 template<typename T>
-std::string OperationSub<T>::to_string() const {
-    return "(" + this->left_.to_string() + " - " + this->right_.to_string() + ")";
+std::string OperationSub<T>::part(size_t index) const {
+    return index == 0 ? "(" : index == 1 ? " - " : ")";
 }
 
 template<typename T>
-Expression<T> OperationSub<T>::derivative(const std::string &var) const {
-    return this->left_.differentiate(var) - this->right_.differentiate(var);
+Expression<T> OperationSub<T>::derivativeFrom(const Expression<T> *derivatives, const std::string &) const {
+    return derivatives[0] - derivatives[1];
 }
 
 template<typename T>
@@ -269,11 +542,49 @@ Expression<T> OperationSub<T>::substitute(const std::string &var, const Expressi
     return this->left_.substitute(var, expr) - this->right_.substitute(var, expr);
 }
 
+template<typename T>
+std::vector<T> OperationSub<T>::taylor(const std::map<std::string, T> &context, const std::string &var,
+                                       size_t order) const {
+    return taylorSub(this->left_.taylor(var, context, order), this->right_.taylor(var, context, order));
+}
+
+template<typename T>
+Jet<T> OperationSub<T>::evalJet(const std::map<std::string, T> &context, const std::string &var) const {
+    Jet<T> a = this->left_.evalJet(var, context), b = this->right_.evalJet(var, context);
+    return {a.value - b.value, a.first - b.first, a.second - b.second};
+}
+
+template<typename T>
+uint32_t OperationSub<T>::compile(ProgramBuilder<T> &builder) const {
+    uint32_t left = this->left_.compile(builder);
+    uint32_t right = this->right_.compile(builder);
+    return builder.binary(OpCode::Sub, left, right);
+}
+
+template<typename T>
+bool OperationSub<T>::toPolynomial(Polynomial<T> &result) const {
+    Polynomial<T> left, right;
+    if (!this->left_.getImpl()->toPolynomial(left) || !this->right_.getImpl()->toPolynomial(right))
+        return false;
+    result = left - right;
+    return result.size() <= Polynomial<T>::MAX_TERMS;
+}
+
+template<typename T>
+Expression<T> OperationSub<T>::mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const {
+    return Expression<T>(std::make_shared<OperationSub<T> >(f(this->left_), f(this->right_)));
+}
+
 template<typename T>
 std::shared_ptr<ExpressionImpl<T> > OperationSub<T>::clone() const {
     return std::make_shared<OperationSub<T> >(this->left_, this->right_);
 }
 
+template<typename T>
+void OperationSub<T>::accept(ExpressionVisitor<T> &visitor) const {
+    visitor.visit(*this);
+}
+
 
 template<typename T>
 OperationMul<T>::OperationMul(const Expression<T> &left, const Expression<T> &right)
@@ -281,18 +592,18 @@ OperationMul<T>::OperationMul(const Expression<T> &left, const Expression<T> &ri
 }
 
 template<typename T>
-T OperationMul<T>::eval(const std::map<std::string, T> &context) const {
-    return this->left_.eval(context) * this->right_.eval(context);
+T OperationMul<T>::apply(const T *args, const std::map<std::string, T> &) const {
+    return args[0] * args[1];
 }
 
 template<typename T>
-std::string OperationMul<T>::to_string() const {
-    return "(" + this->left_.to_string() + " * " + this->right_.to_string() + ")";
+std::string OperationMul<T>::part(size_t index) const {
+    return index == 0 ? "(" : index == 1 ? " * " : ")";
 }
 
 template<typename T>
-Expression<T> OperationMul<T>::derivative(const std::string &var) const {
-    return this->left_.differentiate(var) * this->right_ + this->left_ * this->right_.differentiate(var);
+Expression<T> OperationMul<T>::derivativeFrom(const Expression<T> *derivatives, const std::string &) const {
+    return derivatives[0] * this->right_ + this->left_ * derivatives[1];
 }
 
 template<typename T>
@@ -300,11 +611,48 @@ Expression<T> OperationMul<T>::substitute(const std::string &var, const Expressi
     return this->left_.substitute(var, expr) * this->right_.substitute(var, expr);
 }
 
+template<typename T>
+std::vector<T> OperationMul<T>::taylor(const std::map<std::string, T> &context, const std::string &var,
+                                       size_t order) const {
+    return taylorMul(this->left_.taylor(var, context, order), this->right_.taylor(var, context, order));
+}
+
+template<typename T>
+Jet<T> OperationMul<T>::evalJet(const std::map<std::string, T> &context, const std::string &var) const {
+    return jetMul(this->left_.evalJet(var, context), this->right_.evalJet(var, context));
+}
+
+template<typename T>
+uint32_t OperationMul<T>::compile(ProgramBuilder<T> &builder) const {
+    uint32_t left = this->left_.compile(builder);
+    uint32_t right = this->right_.compile(builder);
+    return builder.binary(OpCode::Mul, left, right);
+}
+
+template<typename T>
+bool OperationMul<T>::toPolynomial(Polynomial<T> &result) const {
+    Polynomial<T> left, right;
+    if (!this->left_.getImpl()->toPolynomial(left) || !this->right_.getImpl()->toPolynomial(right))
+        return false;
+    result = left * right;
+    return result.size() <= Polynomial<T>::MAX_TERMS;
+}
+
+template<typename T>
+Expression<T> OperationMul<T>::mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const {
+    return Expression<T>(std::make_shared<OperationMul<T> >(f(this->left_), f(this->right_)));
+}
+
 template<typename T>
 std::shared_ptr<ExpressionImpl<T> > OperationMul<T>::clone() const {
     return std::make_shared<OperationMul<T> >(this->left_, this->right_);
 }
 
+template<typename T>
+void OperationMul<T>::accept(ExpressionVisitor<T> &visitor) const {
+    visitor.visit(*this);
+}
+
 
 template<typename T>
 OperationDiv<T>::OperationDiv(const Expression<T> &left, const Expression<T> &right)
@@ -312,23 +660,22 @@ OperationDiv<T>::OperationDiv(const Expression<T> &left, const Expression<T> &ri
 }
 
 template<typename T>
-T OperationDiv<T>::eval(const std::map<std::string, T> &context) const {
-    T denominator = this->right_.eval(context);
-    if (denominator == T(0))
+T OperationDiv<T>::apply(const T *args, const std::map<std::string, T> &) const {
+    // При политике Propagate деление на ноль даёт ±Inf или NaN по IEEE 754.
+    if (args[1] == T(0) && errorPolicy() == ErrorPolicy::Throw)
         throw std::runtime_error("Division by zero");
-    return this->left_.eval(context) / denominator;
+    return args[0] / args[1];
 }
 
 template<typename T>
-std::string OperationDiv<T>::to_string() const {
-    return "(" + this->left_.to_string() + " / " + this->right_.to_string() + ")";
+std::string OperationDiv<T>::part(size_t index) const {
+    return index == 0 ? "(" : index == 1 ? " / " : ")";
 }
 
 template<typename T>
-Expression<T> OperationDiv<T>::derivative(const std::string &var) const {
+Expression<T> OperationDiv<T>::derivativeFrom(const Expression<T> *derivatives, const std::string &) const {
     // Правило частного: (f'g - fg') / g^2
-    return (this->left_.differentiate(var) * this->right_ - this->left_ * this->right_.differentiate(var))
-           / (this->right_ ^ Expression<T>(T(2)));
+    return (derivatives[0] * this->right_ - this->left_ * derivatives[1]) / (this->right_ ^ Expression<T>(T(2)));
 }
 
 template<typename T>
@@ -336,11 +683,60 @@ Expression<T> OperationDiv<T>::substitute(const std::string &var, const Expressi
     return this->left_.substitute(var, expr) / this->right_.substitute(var, expr);
 }
 
+template<typename T>
+std::vector<T> OperationDiv<T>::taylor(const std::map<std::string, T> &context, const std::string &var,
+                                       size_t order) const {
+    return taylorDiv(this->left_.taylor(var, context, order), this->right_.taylor(var, context, order));
+}
+
+template<typename T>
+Jet<T> OperationDiv<T>::evalJet(const std::map<std::string, T> &context, const std::string &var) const {
+    Jet<T> b = this->right_.evalJet(var, context);
+    if (b.value == T(0) && errorPolicy() == ErrorPolicy::Throw)
+        throw std::runtime_error("Division by zero");
+    Jet<T> a = this->left_.evalJet(var, context);
+    // q = a / b: q' = (a' - q b') / b, q'' = (a'' - 2 q' b' - q b'') / b.
+    Jet<T> q;
+    q.value = a.value / b.value;
+    q.first = (a.first - q.value * b.first) / b.value;
+    q.second = (a.second - T(2) * q.first * b.first - q.value * b.second) / b.value;
+    return q;
+}
+
+template<typename T>
+uint32_t OperationDiv<T>::compile(ProgramBuilder<T> &builder) const {
+    uint32_t left = this->left_.compile(builder);
+    uint32_t right = this->right_.compile(builder);
+    return builder.binary(OpCode::Div, left, right);
+}
+
+template<typename T>
+bool OperationDiv<T>::toPolynomial(Polynomial<T> &result) const {
+    // Многочленом является только частное от деления на ненулевую константу.
+    Polynomial<T> left, right;
+    if (!this->right_.getImpl()->toPolynomial(right) || !right.isConstant() || right.constantTerm() == T(0))
+        return false;
+    if (!this->left_.getImpl()->toPolynomial(left))
+        return false;
+    result = left.scaled(T(1) / right.constantTerm());
+    return true;
+}
+
+template<typename T>
+Expression<T> OperationDiv<T>::mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const {
+    return Expression<T>(std::make_shared<OperationDiv<T> >(f(this->left_), f(this->right_)));
+}
+
 template<typename T>
 std::shared_ptr<ExpressionImpl<T> > OperationDiv<T>::clone() const {
     return std::make_shared<OperationDiv<T> >(this->left_, this->right_);
 }
 
+template<typename T>
+void OperationDiv<T>::accept(ExpressionVisitor<T> &visitor) const {
+    visitor.visit(*this);
+}
+
 
 template<typename T>
 OperationPow<T>::OperationPow(const Expression<T> &left, const Expression<T> &right)
@@ -348,23 +744,21 @@ OperationPow<T>::OperationPow(const Expression<T> &left, const Expression<T> &ri
 }
 
 template<typename T>
-T OperationPow<T>::eval(const std::map<std::string, T> &context) const {
-    T base = this->left_.eval(context);
-    T exponent = this->right_.eval(context);
-    return std::pow(base, exponent);
+T OperationPow<T>::apply(const T *args, const std::map<std::string, T> &) const {
+    return std::pow(args[0], args[1]);
 }
 
 template<typename T>
-std::string OperationPow<T>::to_string() const {
-    return "(" + this->left_.to_string() + " ^ " + this->right_.to_string() + ")";
+std::string OperationPow<T>::part(size_t index) const {
+    return index == 0 ? "(" : index == 1 ? " ^ " : ")";
 }
 
 template<typename T>
-Expression<T> OperationPow<T>::derivative(const std::string &var) const {
+Expression<T> OperationPow<T>::derivativeFrom(const Expression<T> *derivatives, const std::string &) const {
     // Общая формула дифференцирования: d/dx(f^g) = f^g * (g' * ln(f) + g * f'/f)
-    Expression<T> f = this->left_;
-    Expression<T> g = this->right_;
-    return Expression<T>(this->clone()) * (g.differentiate(var) * ln(f) + g * (f.differentiate(var) / f));
+    const Expression<T> &f = this->left_;
+    const Expression<T> &g = this->right_;
+    return Expression<T>(this->clone()) * (derivatives[1] * ln(f) + g * (derivatives[0] / f));
 }
 
 template<typename T>
@@ -372,146 +766,605 @@ Expression<T> OperationPow<T>::substitute(const std::string &var, const Expressi
     return this->left_.substitute(var, expr) ^ this->right_.substitute(var, expr);
 }
 
+template<typename T>
+std::vector<T> OperationPow<T>::taylor(const std::map<std::string, T> &context, const std::string &var,
+                                       size_t order) const {
+    // Постоянный показатель разлагается рекуррентно (в том числе при отрицательном основании),
+    // переменный — через exp(g * ln(f)).
+    return taylorPow(this->left_.taylor(var, context, order), this->right_.taylor(var, context, order));
+}
+
+template<typename T>
+Jet<T> OperationPow<T>::evalJet(const std::map<std::string, T> &context, const std::string &var) const {
+    Jet<T> f = this->left_.evalJet(var, context), g = this->right_.evalJet(var, context);
+    if (g.first == T(0) && g.second == T(0)) {
+        // Постоянный показатель p: (f^p)' = p f^(p-1) f'; допускает отрицательное основание.
+        T p = g.value;
+        long n;
+        if (asInteger(p, n))
+            return jetPower(f, n);
+        return jetChain(f, std::pow(f.value, p), p * std::pow(f.value, p - T(1)),
+                        p * (p - T(1)) * std::pow(f.value, p - T(2)));
+    }
+    // f^g = exp(g * ln(f)).
+    Jet<T> h = jetMul(g, jetChain(f, std::log(f.value), T(1) / f.value, T(-1) / (f.value * f.value)));
+    T e = std::exp(h.value);
+    return jetChain(h, e, e, e);
+}
+
+template<typename T>
+uint32_t OperationPow<T>::compile(ProgramBuilder<T> &builder) const {
+    uint32_t left = this->left_.compile(builder);
+    uint32_t right = this->right_.compile(builder);
+    return builder.binary(OpCode::Pow, left, right);
+}
+
+template<typename T>
+Expression<T> OperationPow<T>::mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const {
+    return Expression<T>(std::make_shared<OperationPow<T> >(f(this->left_), f(this->right_)));
+}
+
 template<typename T>
 std::shared_ptr<ExpressionImpl<T> > OperationPow<T>::clone() const {
     return std::make_shared<OperationPow<T> >(this->left_, this->right_);
 }
 
+template<typename T>
+void OperationPow<T>::accept(ExpressionVisitor<T> &visitor) const {
+    visitor.visit(*this);
+}
+
+
+template<typename T>
+Comparison<T>::Comparison(Relation relation, const Expression<T> &left, const Expression<T> &right)
+    : BinaryOperation<T>(left, right), relation_(relation) {
+    if constexpr (!std::is_floating_point_v<T>) {
+        if (relation != Relation::Equal && relation != Relation::NotEqual)
+            throw std::runtime_error("Ordering comparison of complex values");
+    }
+}
+
+template<typename T>
+T Comparison<T>::apply(const T *args, const std::map<std::string, T> &) const {
+    bool result = false;
+    if (relation_ == Relation::Equal) {
+        result = args[0] == args[1];
+    } else if (relation_ == Relation::NotEqual) {
+        result = args[0] != args[1];
+    } else if constexpr (std::is_floating_point_v<T>) {
+        switch (relation_) {
+            case Relation::Less:
+                result = args[0] < args[1];
+                break;
+            case Relation::LessEqual:
+                result = args[0] <= args[1];
+                break;
+            case Relation::Greater:
+                result = args[0] > args[1];
+                break;
+            default:
+                result = args[0] >= args[1];
+                break;
+        }
+    }
+    return T(result ? 1 : 0);
+}
+
+template<typename T>
+std::string Comparison<T>::part(size_t index) const {
+    static const char *const symbols[] = {" < ", " <= ", " > ", " >= ", " == ", " != "};
+    return index == 0 ? "(" : index == 1 ? symbols[static_cast<int>(relation_)] : ")";
+}
+
+template<typename T>
+Expression<T> Comparison<T>::derivativeFrom(const Expression<T> *, const std::string &) const {
+    return Expression<T>(T(0));
+}
+
+template<typename T>
+Expression<T> Comparison<T>::substitute(const std::string &var, const Expression<T> &expr) const {
+    return compare(relation_, this->left_.substitute(var, expr), this->right_.substitute(var, expr));
+}
+
+template<typename T>
+std::vector<T> Comparison<T>::taylor(const std::map<std::string, T> &context, const std::string &,
+                                     size_t order) const {
+    return taylorConstant(this->eval(context), order);
+}
+
+template<typename T>
+Jet<T> Comparison<T>::evalJet(const std::map<std::string, T> &context, const std::string &) const {
+    return {this->eval(context), T(0), T(0)};
+}
+
+template<typename T>
+uint32_t Comparison<T>::compile(ProgramBuilder<T> &builder) const {
+    uint32_t left = this->left_.compile(builder);
+    uint32_t right = this->right_.compile(builder);
+    // В программе только Less и LessEqual: a > b записывается как b < a.
+    switch (relation_) {
+        case Relation::Less:
+            return builder.binary(OpCode::Less, left, right);
+        case Relation::LessEqual:
+            return builder.binary(OpCode::LessEqual, left, right);
+        case Relation::Greater:
+            return builder.binary(OpCode::Less, right, left);
+        case Relation::GreaterEqual:
+            return builder.binary(OpCode::LessEqual, right, left);
+        case Relation::Equal:
+            return builder.binary(OpCode::Equal, left, right);
+        default:
+            return builder.binary(OpCode::NotEqual, left, right);
+    }
+}
+
+template<typename T>
+Expression<T> Comparison<T>::mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const {
+    return compare(relation_, f(this->left_), f(this->right_));
+}
+
+template<typename T>
+std::shared_ptr<ExpressionImpl<T> > Comparison<T>::clone() const {
+    return std::make_shared<Comparison<T> >(relation_, this->left_, this->right_);
+}
+
+template<typename T>
+void Comparison<T>::accept(ExpressionVisitor<T> &visitor) const {
+    visitor.visit(*this);
+}
+
+
+template<typename T>
+Select<T>::Select(const Expression<T> &condition, const Expression<T> &ifTrue, const Expression<T> &ifFalse)
+    : condition_(condition), ifTrue_(ifTrue), ifFalse_(ifFalse) {
+    this->updateHeight();
+}
+
+template<typename T>
+T Select<T>::eval(const std::map<std::string, T> &context) const {
+    return condition_.eval(context) != T(0) ? ifTrue_.eval(context) : ifFalse_.eval(context);
+}
+
+template<typename T>
+std::string Select<T>::to_string() const {
+    return part(0) + condition_.to_string() + part(1) + ifTrue_.to_string() + part(2) + ifFalse_.to_string() +
+           part(3);
+}
+
+template<typename T>
+Expression<T> Select<T>::derivative(const std::string &var) const {
+    return select(condition_, ifTrue_.differentiate(var), ifFalse_.differentiate(var));
+}
+
+template<typename T>
+Expression<T> Select<T>::substitute(const std::string &var, const Expression<T> &expr) const {
+    return select(condition_.substitute(var, expr), ifTrue_.substitute(var, expr), ifFalse_.substitute(var, expr));
+}
+
+template<typename T>
+std::vector<T> Select<T>::taylor(const std::map<std::string, T> &context, const std::string &var,
+                                 size_t order) const {
+    return (condition_.eval(context) != T(0) ? ifTrue_ : ifFalse_).taylor(var, context, order);
+}
+
+template<typename T>
+Jet<T> Select<T>::evalJet(const std::map<std::string, T> &context, const std::string &var) const {
+    return (condition_.eval(context) != T(0) ? ifTrue_ : ifFalse_).evalJet(var, context);
+}
+
+template<typename T>
+uint32_t Select<T>::compile(ProgramBuilder<T> &builder) const {
+    uint32_t condition = condition_.compile(builder);
+    uint32_t ifTrue = ifTrue_.compile(builder);
+    uint32_t ifFalse = ifFalse_.compile(builder);
+    return builder.select(condition, ifTrue, ifFalse);
+}
+
+template<typename T>
+Expression<T> Select<T>::mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const {
+    return select(f(condition_), f(ifTrue_), f(ifFalse_));
+}
+
+template<typename T>
+std::shared_ptr<ExpressionImpl<T> > Select<T>::clone() const {
+    return std::make_shared<Select<T> >(condition_, ifTrue_, ifFalse_);
+}
+
+template<typename T>
+void Select<T>::accept(ExpressionVisitor<T> &visitor) const {
+    visitor.visit(*this);
+}
+
+template<typename T>
+T Select<T>::apply(const T *args, const std::map<std::string, T> &) const {
+    return args[0] != T(0) ? args[1] : args[2];
+}
+
+template<typename T>
+bool Select<T>::needsChild(size_t index, const T *args) const {
+    return index == 0 || (args[0] != T(0)) == (index == 1);
+}
+
+template<typename T>
+std::string Select<T>::part(size_t index) const {
+    return index == 0 ? "select(" : index == 3 ? ")" : ", ";
+}
+
+template<typename T>
+Expression<T> Select<T>::derivativeFrom(const Expression<T> *derivatives, const std::string &) const {
+    return select(condition_, derivatives[1], derivatives[2]);
+}
+
+
+
+template<typename T>
+OperationIntPow<T>::OperationIntPow(const Expression<T> &base, long exponent)
+    : base_(base), exponent_(exponent) {
+    this->updateHeight();
+}
+
+template<typename T>
+T OperationIntPow<T>::eval(const std::map<std::string, T> &context) const {
+    const T base = base_.eval(context);
+    return apply(&base, context);
+}
+
+template<typename T>
+std::string OperationIntPow<T>::to_string() const {
+    return part(0) + base_.to_string() + part(1);
+}
+
+template<typename T>
+Expression<T> OperationIntPow<T>::derivative(const std::string &var) const {
+    if (exponent_ == 0)
+        return Expression<T>(T(0));
+    const Expression<T> derivative = base_.differentiate(var);
+    return derivativeFrom(&derivative, var);
+}
+
+template<typename T>
+T OperationIntPow<T>::apply(const T *args, const std::map<std::string, T> &) const {
+    return integerPower(args[0], exponent_);
+}
+
+template<typename T>
+std::string OperationIntPow<T>::part(size_t index) const {
+    return index == 0 ? "(" : " ^ " + std::to_string(exponent_) + ")";
+}
+
+template<typename T>
+Expression<T> OperationIntPow<T>::derivativeFrom(const Expression<T> *derivatives, const std::string &) const {
+    if (exponent_ == 0)
+        return Expression<T>(T(0));
+    if (exponent_ == 1)
+        return derivatives[0];
+    return Expression<T>(T(exponent_)) * (base_ ^ Expression<T>(T(exponent_ - 1))) * derivatives[0];
+}
+
+template<typename T>
+Expression<T> OperationIntPow<T>::substitute(const std::string &var, const Expression<T> &expr) const {
+    return Expression<T>(std::make_shared<OperationIntPow<T> >(base_.substitute(var, expr), exponent_));
+}
+
+template<typename T>
+std::vector<T> OperationIntPow<T>::taylor(const std::map<std::string, T> &context, const std::string &var,
+                                          size_t order) const {
+    return taylorPow(base_.taylor(var, context, order), T(exponent_));
+}
+
+template<typename T>
+Jet<T> OperationIntPow<T>::evalJet(const std::map<std::string, T> &context, const std::string &var) const {
+    return jetPower(base_.evalJet(var, context), exponent_);
+}
+
+template<typename T>
+uint32_t OperationIntPow<T>::compile(ProgramBuilder<T> &builder) const {
+    uint32_t base = base_.compile(builder);
+    return builder.binary(OpCode::Pow, base, builder.constant(T(exponent_)));
+}
+
+template<typename T>
+bool OperationIntPow<T>::toPolynomial(Polynomial<T> &result) const {
+    Polynomial<T> base;
+    if (exponent_ < 0 || !base_.getImpl()->toPolynomial(base))
+        return false;
+    return base.power(static_cast<unsigned>(exponent_), result);
+}
+
+template<typename T>
+Expression<T> OperationIntPow<T>::mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const {
+    return Expression<T>(std::make_shared<OperationIntPow<T> >(f(base_), exponent_));
+}
+
+template<typename T>
+std::shared_ptr<ExpressionImpl<T> > OperationIntPow<T>::clone() const {
+    return std::make_shared<OperationIntPow<T> >(base_, exponent_);
+}
+
+template<typename T>
+void OperationIntPow<T>::accept(ExpressionVisitor<T> &visitor) const {
+    visitor.visit(*this);
+}
+
+
+/*
+    Реализация класса UnaryFunction<T>
+*/
+
+template<typename T>
+UnaryFunction<T>::UnaryFunction(const Expression<T> &arg)
+    : arg_(arg) {
+    this->updateHeight();
+}
+
+template<typename T>
+T UnaryFunction<T>::eval(const std::map<std::string, T> &context) const {
+    const T arg = arg_.eval(context);
+    return this->apply(&arg, context);
+}
+
+template<typename T>
+std::string UnaryFunction<T>::to_string() const {
+    return this->part(0) + arg_.to_string() + this->part(1);
+}
+
+template<typename T>
+Expression<T> UnaryFunction<T>::derivative(const std::string &var) const {
+    const Expression<T> derivative = arg_.differentiate(var);
+    return this->derivativeFrom(&derivative, var);
+}
+
 
 // Функция sin: sin(f)
 template<typename T>
 FunctionSin<T>::FunctionSin(const Expression<T> &arg)
-    : arg_(arg) {
+    : UnaryFunction<T>(arg) {
 }
 
 template<typename T>
-T FunctionSin<T>::eval(const std::map<std::string, T> &context) const {
-    return std::sin(arg_.eval(context));
+T FunctionSin<T>::apply(const T *args, const std::map<std::string, T> &) const {
+    return std::sin(args[0]);
 }
 
 template<typename T>
-std::string FunctionSin<T>::to_string() const {
-    return "sin(" + arg_.to_string() + ")";
+std::string FunctionSin<T>::part(size_t index) const {
+    return index == 0 ? "sin(" : ")";
 }
 
 template<typename T>
-Expression<T> FunctionSin<T>::derivative(const std::string &var) const {
+Expression<T> FunctionSin<T>::derivativeFrom(const Expression<T> *derivatives, const std::string &) const {
     // Производная sin(f) = cos(f) * f'
-    return cos(arg_) * arg_.differentiate(var);
+    return cos(this->arg_) * derivatives[0];
 }
 
 template<typename T>
 Expression<T> FunctionSin<T>::substitute(const std::string &var, const Expression<T> &expr) const {
-    return sin(arg_.substitute(var, expr));
+    return sin(this->arg_.substitute(var, expr));
+}
+
+template<typename T>
+std::vector<T> FunctionSin<T>::taylor(const std::map<std::string, T> &context, const std::string &var,
+                                      size_t order) const {
+    return taylorSin(this->arg_.taylor(var, context, order));
+}
+
+template<typename T>
+Jet<T> FunctionSin<T>::evalJet(const std::map<std::string, T> &context, const std::string &var) const {
+    Jet<T> u = this->arg_.evalJet(var, context);
+    T s = std::sin(u.value), c = std::cos(u.value);
+    return jetChain(u, s, c, -s);
+}
+
+template<typename T>
+uint32_t FunctionSin<T>::compile(ProgramBuilder<T> &builder) const {
+    return builder.unary(OpCode::Sin, this->arg_.compile(builder));
+}
+
+template<typename T>
+Expression<T> FunctionSin<T>::mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const {
+    return sin(f(this->arg_));
 }
 
 template<typename T>
 std::shared_ptr<ExpressionImpl<T> > FunctionSin<T>::clone() const {
-    return std::make_shared<FunctionSin<T> >(arg_);
+    return std::make_shared<FunctionSin<T> >(this->arg_);
+}
+
+template<typename T>
+void FunctionSin<T>::accept(ExpressionVisitor<T> &visitor) const {
+    visitor.visit(*this);
 }
 
 
 // Функция cos: cos(f)
 template<typename T>
 FunctionCos<T>::FunctionCos(const Expression<T> &arg)
-    : arg_(arg) {
+    : UnaryFunction<T>(arg) {
 }
 
 template<typename T>
-T FunctionCos<T>::eval(const std::map<std::string, T> &context) const {
-    return std::cos(arg_.eval(context));
+T FunctionCos<T>::apply(const T *args, const std::map<std::string, T> &) const {
+    return std::cos(args[0]);
 }
 
 template<typename T>
-std::string FunctionCos<T>::to_string() const {
-    return "cos(" + arg_.to_string() + ")";
+std::string FunctionCos<T>::part(size_t index) const {
+    return index == 0 ? "cos(" : ")";
 }
 
 template<typename T>
-Expression<T> FunctionCos<T>::derivative(const std::string &var) const {
+Expression<T> FunctionCos<T>::derivativeFrom(const Expression<T> *derivatives, const std::string &) const {
     // Производная cos(f) = -sin(f) * f'
-    return Expression<T>(T(-1)) * sin(arg_) * arg_.differentiate(var);
+    return Expression<T>(T(-1)) * sin(this->arg_) * derivatives[0];
 }
 
 template<typename T>
 Expression<T> FunctionCos<T>::substitute(const std::string &var, const Expression<T> &expr) const {
-    return cos(arg_.substitute(var, expr));
+    return cos(this->arg_.substitute(var, expr));
+}
+
+template<typename T>
+std::vector<T> FunctionCos<T>::taylor(const std::map<std::string, T> &context, const std::string &var,
+                                      size_t order) const {
+    return taylorCos(this->arg_.taylor(var, context, order));
+}
+
+template<typename T>
+Jet<T> FunctionCos<T>::evalJet(const std::map<std::string, T> &context, const std::string &var) const {
+    Jet<T> u = this->arg_.evalJet(var, context);
+    T s = std::sin(u.value), c = std::cos(u.value);
+    return jetChain(u, c, -s, -c);
+}
+
+template<typename T>
+uint32_t FunctionCos<T>::compile(ProgramBuilder<T> &builder) const {
+    return builder.unary(OpCode::Cos, this->arg_.compile(builder));
+}
+
+template<typename T>
+Expression<T> FunctionCos<T>::mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const {
+    return cos(f(this->arg_));
 }
 
 template<typename T>
 std::shared_ptr<ExpressionImpl<T> > FunctionCos<T>::clone() const {
-    return std::make_shared<FunctionCos<T> >(arg_);
+    return std::make_shared<FunctionCos<T> >(this->arg_);
+}
+
+template<typename T>
+void FunctionCos<T>::accept(ExpressionVisitor<T> &visitor) const {
+    visitor.visit(*this);
 }
 
 
 // Функция ln: ln(f)
 template<typename T>
 FunctionLn<T>::FunctionLn(const Expression<T> &arg)
-    : arg_(arg) {
+    : UnaryFunction<T>(arg) {
 }
 
 template<typename T>
-T FunctionLn<T>::eval(const std::map<std::string, T> &context) const {
-    T val = arg_.eval(context);
+T FunctionLn<T>::apply(const T *args, const std::map<std::string, T> &) const {
+    const T val = args[0];
     if constexpr (std::is_floating_point_v<T>) {
-        if (val <= T(0))
+        if (val <= T(0) && errorPolicy() == ErrorPolicy::Throw)
             throw std::runtime_error("Logarithm of non-positive value");
     }
     return std::log(val);
 }
 
 template<typename T>
-std::string FunctionLn<T>::to_string() const {
-    return "ln(" + arg_.to_string() + ")";
+std::string FunctionLn<T>::part(size_t index) const {
+    return index == 0 ? "ln(" : ")";
 }
 
 template<typename T>
-Expression<T> FunctionLn<T>::derivative(const std::string &var) const {
+Expression<T> FunctionLn<T>::derivativeFrom(const Expression<T> *derivatives, const std::string &) const {
     // Производная ln(f) = f'/f
-    return arg_.differentiate(var) / arg_;
+    return derivatives[0] / this->arg_;
 }
 
 template<typename T>
 Expression<T> FunctionLn<T>::substitute(const std::string &var, const Expression<T> &expr) const {
-    return ln(arg_.substitute(var, expr));
+    return ln(this->arg_.substitute(var, expr));
+}
+
+template<typename T>
+std::vector<T> FunctionLn<T>::taylor(const std::map<std::string, T> &context, const std::string &var,
+                                     size_t order) const {
+    return taylorLn(this->arg_.taylor(var, context, order));
+}
+
+template<typename T>
+Jet<T> FunctionLn<T>::evalJet(const std::map<std::string, T> &context, const std::string &var) const {
+    Jet<T> u = this->arg_.evalJet(var, context);
+    if constexpr (std::is_floating_point_v<T>) {
+        if (u.value <= T(0) && errorPolicy() == ErrorPolicy::Throw)
+            throw std::runtime_error("Logarithm of non-positive value");
+    }
+    T inverse = T(1) / u.value;
+    return jetChain(u, std::log(u.value), inverse, -inverse * inverse);
+}
+
+template<typename T>
+uint32_t FunctionLn<T>::compile(ProgramBuilder<T> &builder) const {
+    return builder.unary(OpCode::Ln, this->arg_.compile(builder));
+}
+
+template<typename T>
+Expression<T> FunctionLn<T>::mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const {
+    return ln(f(this->arg_));
 }
 
 template<typename T>
 std::shared_ptr<ExpressionImpl<T> > FunctionLn<T>::clone() const {
-    return std::make_shared<FunctionLn<T> >(arg_);
+    return std::make_shared<FunctionLn<T> >(this->arg_);
+}
+
+template<typename T>
+void FunctionLn<T>::accept(ExpressionVisitor<T> &visitor) const {
+    visitor.visit(*this);
 }
 
 
 // Функция exp: exp(f)
 template<typename T>
 FunctionExp<T>::FunctionExp(const Expression<T> &arg)
-    : arg_(arg) {
+    : UnaryFunction<T>(arg) {
 }
 
 template<typename T>
-T FunctionExp<T>::eval(const std::map<std::string, T> &context) const {
-    return std::exp(arg_.eval(context));
+T FunctionExp<T>::apply(const T *args, const std::map<std::string, T> &) const {
+    return std::exp(args[0]);
 }
 
 template<typename T>
-std::string FunctionExp<T>::to_string() const {
-    return "exp(" + arg_.to_string() + ")";
+std::string FunctionExp<T>::part(size_t index) const {
+    return index == 0 ? "exp(" : ")";
 }
 
 template<typename T>
-Expression<T> FunctionExp<T>::derivative(const std::string &var) const {
+Expression<T> FunctionExp<T>::derivativeFrom(const Expression<T> *derivatives, const std::string &) const {
     // Производная exp(f) = exp(f) * f'
-    return exp(arg_) * arg_.differentiate(var);
+    return exp(this->arg_) * derivatives[0];
 }
 
 template<typename T>
 Expression<T> FunctionExp<T>::substitute(const std::string &var, const Expression<T> &expr) const {
-    return exp(arg_.substitute(var, expr));
+    return exp(this->arg_.substitute(var, expr));
+}
+
+template<typename T>
+std::vector<T> FunctionExp<T>::taylor(const std::map<std::string, T> &context, const std::string &var,
+                                      size_t order) const {
+    return taylorExp(this->arg_.taylor(var, context, order));
+}
+
+template<typename T>
+Jet<T> FunctionExp<T>::evalJet(const std::map<std::string, T> &context, const std::string &var) const {
+    Jet<T> u = this->arg_.evalJet(var, context);
+    T e = std::exp(u.value);
+    return jetChain(u, e, e, e);
+}
+
+template<typename T>
+uint32_t FunctionExp<T>::compile(ProgramBuilder<T> &builder) const {
+    return builder.unary(OpCode::Exp, this->arg_.compile(builder));
+}
+
+template<typename T>
+Expression<T> FunctionExp<T>::mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const {
+    return exp(f(this->arg_));
 }
 
 template<typename T>
 std::shared_ptr<ExpressionImpl<T> > FunctionExp<T>::clone() const {
-    return std::make_shared<FunctionExp<T> >(arg_);
+    return std::make_shared<FunctionExp<T> >(this->arg_);
+}
+
+template<typename T>
+void FunctionExp<T>::accept(ExpressionVisitor<T> &visitor) const {
+    visitor.visit(*this);
 }
 
 // ===================================================================
@@ -536,6 +1389,72 @@ Expression<T> exp(const Expression<T> &arg) {
     return Expression<T>(std::make_shared<FunctionExp<T> >(arg));
 }
 
+template<typename T>
+Expression<T> compare(Relation relation, const Expression<T> &left, const Expression<T> &right) {
+    return Expression<T>(std::make_shared<Comparison<T> >(relation, left, right));
+}
+
+template<typename T>
+Expression<T> select(const Expression<T> &condition, const Expression<T> &ifTrue, const Expression<T> &ifFalse) {
+    return Expression<T>(std::make_shared<Select<T> >(condition, ifTrue, ifFalse));
+}
+
+template<typename T>
+bool asInteger(const T &value, long &result) {
+    auto re = std::real(value);
+    if (std::imag(value) != 0 || std::floor(re) != re || re < INT32_MIN || re > INT32_MAX)
+        return false;
+    result = static_cast<long>(re);
+    return true;
+}
+
+template<typename T>
+T integerPower(T base, long exponent) {
+    unsigned long n = exponent < 0 ? 0ul - static_cast<unsigned long>(exponent) : static_cast<unsigned long>(exponent);
+    T result = T(1);
+    while (n > 0) {
+        if (n & 1)
+            result *= base;
+        n >>= 1;
+        if (n > 0)
+            base *= base;
+    }
+    return exponent < 0 ? T(1) / result : result;
+}
+
+template<typename T>
+Jet<T> jetMul(const Jet<T> &a, const Jet<T> &b) {
+    return {a.value * b.value, a.first * b.value + a.value * b.first,
+            a.second * b.value + T(2) * a.first * b.first + a.value * b.second};
+}
+
+template<typename T>
+Jet<T> jetChain(const Jet<T> &u, T g, T g1, T g2) {
+    return {g, g1 * u.first, g2 * u.first * u.first + g1 * u.second};
+}
+
+template<typename T>
+Jet<T> jetPower(const Jet<T> &x, long n) {
+    T g1 = n == 0 ? T(0) : T(n) * integerPower(x.value, n - 1);
+    T g2 = n == 0 || n == 1 ? T(0) : T(n) * T(n - 1) * integerPower(x.value, n - 2);
+    return jetChain(x, integerPower(x.value, n), g1, g2);
+}
+
+template<typename T>
+T quietNaN() {
+    using Real = decltype(std::real(std::declval<T>()));
+    const Real nan = std::numeric_limits<Real>::quiet_NaN();
+    if constexpr (std::is_floating_point_v<T>)
+        return nan;
+    else
+        return T(nan, nan);
+}
+
+template<typename T>
+bool isFinite(const T &value) {
+    return std::isfinite(std::real(value)) && std::isfinite(std::imag(value));
+}
+
 
 // Литералы для создания выражений с действительными числами.
 Expression<long double> operator"" _val(const long double val) {
@@ -551,48 +1470,39 @@ Expression<long double> operator"" _var(const char *variable, size_t) {
 }
 
 // ===================================================================
-// Инстанциация шаблонов для long double и std::complex<long double>
-template class Expression<long double>;
-template class Value<long double>;
-template class Variable<long double>;
-template class BinaryOperation<long double>;
-template class OperationAdd<long double>;
-template class OperationSub<long double>;
-template class OperationMul<long double>;
-template class OperationDiv<long double>;
-template class OperationPow<long double>;
-template class FunctionSin<long double>;
-template class FunctionCos<long double>;
-template class FunctionLn<long double>;
-template class FunctionExp<long double>;
-
-template Expression<long double> sin<long double>(const Expression<long double> &);
-template Expression<long double> cos<long double>(const Expression<long double> &);
-template Expression<long double> ln<long double>(const Expression<long double> &);
-template Expression<long double> exp<long double>(const Expression<long double> &);
-
-template class Expression<std::complex<long double> >;
-template class Value<std::complex<long double> >;
-template class Variable<std::complex<long double> >;
-template class BinaryOperation<std::complex<long double> >;
-template class OperationAdd<std::complex<long double> >;
-template class OperationSub<std::complex<long double> >;
-template class OperationMul<std::complex<long double> >;
-template class OperationDiv<std::complex<long double> >;
-template class OperationPow<std::complex<long double> >;
-template class FunctionSin<std::complex<long double> >;
-template class FunctionCos<std::complex<long double> >;
-template class FunctionLn<std::complex<long double> >;
-template class FunctionExp<std::complex<long double> >;
-
-template Expression<std::complex<long double> > sin<std::complex<long double> >(
-    const Expression<std::complex<long double> > &);
-
-template Expression<std::complex<long double> > cos<std::complex<long double> >(
-    const Expression<std::complex<long double> > &);
-
-template Expression<std::complex<long double> > ln<std::complex<long double> >(
-    const Expression<std::complex<long double> > &);
-
-template Expression<std::complex<long double> > exp<std::complex<long double> >(
-    const Expression<std::complex<long double> > &);
+// Инстанциация шаблонов для всех числовых типов
+#define INSTANTIATE_EXPRESSION(T)                              \
+    template class ExpressionImpl<T>;                          \
+    template class ArrayScope<T>;                              \
+    template class Expression<T>;                              \
+    template class Value<T>;                                   \
+    template class Variable<T>;                                \
+    template class BinaryOperation<T>;                         \
+    template class OperationAdd<T>;                            \
+    template class OperationSub<T>;                            \
+    template class OperationMul<T>;                            \
+    template class OperationDiv<T>;                            \
+    template class OperationPow<T>;                            \
+    template class Comparison<T>;                              \
+    template class Select<T>;                                  \
+    template class OperationIntPow<T>;                         \
+    template class UnaryFunction<T>;                           \
+    template class FunctionSin<T>;                             \
+    template class FunctionCos<T>;                             \
+    template class FunctionLn<T>;                              \
+    template class FunctionExp<T>;                             \
+    template Expression<T> sin<T>(const Expression<T> &);      \
+    template Expression<T> cos<T>(const Expression<T> &);      \
+    template Expression<T> ln<T>(const Expression<T> &);       \
+    template Expression<T> exp<T>(const Expression<T> &);      \
+    template Expression<T> compare<T>(Relation, const Expression<T> &, const Expression<T> &); \
+    template Expression<T> select<T>(const Expression<T> &, const Expression<T> &, const Expression<T> &); \
+    template bool asInteger<T>(const T &, long &);             \
+    template T integerPower<T>(T, long);                       \
+    template Jet<T> jetMul<T>(const Jet<T> &, const Jet<T> &); \
+    template Jet<T> jetChain<T>(const Jet<T> &, T, T, T);      \
+    template Jet<T> jetPower<T>(const Jet<T> &, long);         \
+    template T quietNaN<T>();                                  \
+    template bool isFinite<T>(const T &);
+
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE_EXPRESSION)
@@ -5,15 +5,101 @@
 #include <map>
 #include <memory>
 #include <complex>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include "numeric.hpp"
+#include "profile.hpp"
 
 template<typename T>
 class Expression;
 
+template<typename T>
+class ProgramBuilder;
+
+template<typename T>
+class Polynomial;
+
+template<typename T>
+class ExpressionVisitor;
+
+// Реакция на ошибку в точке вычисления: деление на ноль, логарифм или корень
+// вне области определения, отсутствующая в контексте переменная.
+enum class ErrorPolicy {
+    Throw,    // бросить std::runtime_error
+    Propagate // вернуть результат по IEEE 754 (±Inf или NaN) и продолжить вычисление
+};
+
+// Политика текущего потока; по умолчанию Throw.
+ErrorPolicy errorPolicy();
+
+// Установка политики текущего потока на время жизни объекта.
+class ErrorPolicyScope {
+public:
+    explicit ErrorPolicyScope(ErrorPolicy policy);
+
+    ~ErrorPolicyScope();
+
+    ErrorPolicyScope(const ErrorPolicyScope &) = delete;
+
+    ErrorPolicyScope &operator=(const ErrorPolicyScope &) = delete;
+
+private:
+    ErrorPolicy previous_;
+};
+
+// Значения переменных-массивов: имя -> элементы.
+template<typename T>
+using ArrayContext = std::map<std::string, std::vector<T> >;
+
+// Массивы, которые видят редукции sum, prod, dot, norm (reduction.hpp) в текущем потоке,
+// на время жизни объекта. Переменная-массив в аргументе редукции обозначает текущий элемент.
+template<typename T>
+class ArrayScope {
+public:
+    explicit ArrayScope(const ArrayContext<T> &arrays);
+
+    ~ArrayScope();
+
+    ArrayScope(const ArrayScope &) = delete;
+
+    ArrayScope &operator=(const ArrayScope &) = delete;
+
+    // Массивы текущего потока; nullptr, если они не заданы.
+    static const ArrayContext<T> *current();
+
+private:
+    const ArrayContext<T> *previous_;
+};
+
+// Значение функции и первые две производные по одной переменной.
+// Вычисляется за один обход дерева без выделения памяти (см. Expression<T>::evalJet).
+template<typename T>
+struct Jet {
+    T value;
+    T first;
+    T second;
+};
+
+// Отношение в узле сравнения.
+enum class Relation {
+    Less,
+    LessEqual,
+    Greater,
+    GreaterEqual,
+    Equal,
+    NotEqual
+};
+
 // Абстрактный базовый класс для реализации выражения.
 template<typename T>
 class ExpressionImpl {
 public:
-    ExpressionImpl() = default;
+    // Создание узла учитывается инструментированием как выделение памяти.
+    ExpressionImpl() { PROFILE_ALLOCATION(); }
+
+    ExpressionImpl(const ExpressionImpl &other) : height_(other.height_) { PROFILE_ALLOCATION(); }
 
     virtual ~ExpressionImpl() = default;
 
@@ -29,8 +115,61 @@ public:
     // Подстановка в выражение: замена переменной на другое выражение.
     virtual Expression<T> substitute(const std::string &var, const Expression<T> &expr) const = 0;
 
+    // Усечённый ряд Тейлора по переменной var в точке context: коэффициенты c_0..c_order.
+    virtual std::vector<T> taylor(const std::map<std::string, T> &context, const std::string &var,
+                                  size_t order) const = 0;
+
+    // Значение и первые две производные по переменной var в точке context.
+    virtual Jet<T> evalJet(const std::map<std::string, T> &context, const std::string &var) const = 0;
+
+    // Компиляция в линейную программу; возвращает регистр с результатом.
+    virtual uint32_t compile(ProgramBuilder<T> &builder) const = 0;
+
+    // Представление в виде многочлена; false, если выражение многочленом не является.
+    virtual bool toPolynomial(Polynomial<T> &) const { return false; }
+
+    // Копия узла, в которой каждый непосредственный потомок c заменён на f(c).
+    virtual Expression<T> mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const = 0;
+
     // Клонирование (для реализации операций копирования).
     virtual std::shared_ptr<ExpressionImpl<T> > clone() const = 0;
+
+    // Двойная диспетчеризация: вызов метода visitor, соответствующего классу узла.
+    virtual void accept(ExpressionVisitor<T> &visitor) const = 0;
+
+    // Непосредственные потомки узла.
+    virtual size_t childCount() const { return 0; }
+
+    virtual const Expression<T> &child(size_t) const { throw std::out_of_range("Expression node has no children"); }
+
+    // Шаги eval, to_string и derivative для одного узла по результатам для его потомков.
+    // На них построены и рекурсивные методы, и обход с явным стеком (см. traversal.hpp).
+    // У листьев совпадают с eval, to_string и derivative.
+
+    // Значение узла по значениям потомков args.
+    virtual T apply(const T *, const std::map<std::string, T> &context) const { return eval(context); }
+
+    // Нужно ли значение потомка index при значениях args предыдущих потомков;
+    // ненужный потомок не вычисляется и передаётся в apply нулём.
+    virtual bool needsChild(size_t, const T *) const { return true; }
+
+    // Текст записи перед потомком index; при index = childCount() — после последнего потомка.
+    virtual std::string part(size_t) const { return to_string(); }
+
+    // Производная узла по производным потомков derivatives.
+    virtual Expression<T> derivativeFrom(const Expression<T> *, const std::string &var) const {
+        return derivative(var);
+    }
+
+    // Высота поддерева (у листа 1): по ней выбирается рекурсивный обход или обход с явным стеком.
+    size_t height() const { return height_; }
+
+protected:
+    // Пересчёт высоты по потомкам; вызывается конструкторами узлов с потомками.
+    void updateHeight();
+
+private:
+    size_t height_ = 1;
 };
 
 // Класс для выражения.
@@ -49,7 +188,8 @@ public:
 
     Expression &operator=(Expression &&other) noexcept;
 
-    ~Expression() = default;
+    // Глубокое дерево, которым выражение владеет единолично, разбирается с явным стеком.
+    ~Expression();
 
     Expression operator+(const Expression &right) const;
 
@@ -74,16 +214,40 @@ public:
 
     T eval(const std::map<std::string, T> &context) const;
 
+    // Вычисление с заданной реакцией на ошибки в точке.
+    T eval(const std::map<std::string, T> &context, ErrorPolicy policy) const;
+
+    // Вычисление с массивами для редукций (см. ArrayScope).
+    T eval(const std::map<std::string, T> &context, const ArrayContext<T> &arrays) const;
+
     std::string to_string() const;
 
     Expression substitute(const std::string &var, const Expression &expr) const;
 
     Expression differentiate(const std::string &var) const;
 
+    // Коэффициенты ряда Тейлора c_0..c_order по переменной var в точке context.
+    // Вычисляются за один обход дерева, без построения деревьев производных.
+    std::vector<T> taylor(const std::string &var, const std::map<std::string, T> &context, size_t order) const;
+
+    // Значение и первые order производных по переменной var в точке context.
+    std::vector<T> derivatives(const std::string &var, const std::map<std::string, T> &context, size_t order) const;
+
+    // Значение и первая производная по var за один обход исходного дерева.
+    std::pair<T, T> evalWithDerivative(const std::string &var, const std::map<std::string, T> &context) const;
+
+    // Значение, первая и вторая производные по var за один обход исходного дерева.
+    Jet<T> evalJet(const std::string &var, const std::map<std::string, T> &context) const;
+
+    uint32_t compile(ProgramBuilder<T> &builder) const;
+
     explicit Expression(std::shared_ptr<ExpressionImpl<T> > impl);
 
     std::shared_ptr<ExpressionImpl<T> > getImpl() const { return impl_; }
 
+    // Корневой узел без копирования указателя (и без атомарного счётчика ссылок).
+    const ExpressionImpl<T> *node() const { return impl_.get(); }
+
 private:
     std::shared_ptr<ExpressionImpl<T> > impl_;
 };
@@ -116,8 +280,23 @@ public:
     // Подстановка не влияет на константу.
     Expression<T> substitute(const std::string &var, const Expression<T> &expr) const override;
 
+    std::vector<T> taylor(const std::map<std::string, T> &context, const std::string &var,
+                          size_t order) const override;
+
+    Jet<T> evalJet(const std::map<std::string, T> &context, const std::string &var) const override;
+
+    uint32_t compile(ProgramBuilder<T> &builder) const override;
+
+    bool toPolynomial(Polynomial<T> &result) const override;
+
+    Expression<T> mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const override;
+
     std::shared_ptr<ExpressionImpl<T> > clone() const override;
 
+    void accept(ExpressionVisitor<T> &visitor) const override;
+
+    T value() const { return value_; }
+
 private:
     T value_;
 };
@@ -138,8 +317,23 @@ public:
     // Подстановка: если имена совпадают, то возвращается подставляемое выражение.
     Expression<T> substitute(const std::string &var, const Expression<T> &expr) const override;
 
+    std::vector<T> taylor(const std::map<std::string, T> &context, const std::string &var,
+                          size_t order) const override;
+
+    Jet<T> evalJet(const std::map<std::string, T> &context, const std::string &var) const override;
+
+    uint32_t compile(ProgramBuilder<T> &builder) const override;
+
+    bool toPolynomial(Polynomial<T> &result) const override;
+
+    Expression<T> mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const override;
+
     std::shared_ptr<ExpressionImpl<T> > clone() const override;
 
+    void accept(ExpressionVisitor<T> &visitor) const override;
+
+    const std::string &name() const { return name_; }
+
 private:
     std::string name_;
 };
@@ -150,6 +344,20 @@ class BinaryOperation : public ExpressionImpl<T> {
 public:
     BinaryOperation(const Expression<T> &left, const Expression<T> &right);
 
+    T eval(const std::map<std::string, T> &context) const override;
+
+    std::string to_string() const override;
+
+    Expression<T> derivative(const std::string &var) const override;
+
+    size_t childCount() const override { return 2; }
+
+    const Expression<T> &child(size_t index) const override { return index == 0 ? left_ : right_; }
+
+    const Expression<T> &left() const { return left_; }
+
+    const Expression<T> &right() const { return right_; }
+
 protected:
     Expression<T> left_;
     Expression<T> right_;
@@ -161,15 +369,28 @@ class OperationAdd : public BinaryOperation<T> {
 public:
     OperationAdd(const Expression<T> &left, const Expression<T> &right);
 
-    T eval(const std::map<std::string, T> &context) const override;
+    T apply(const T *args, const std::map<std::string, T> &context) const override;
 
-    std::string to_string() const override;
+    std::string part(size_t index) const override;
 
-    Expression<T> derivative(const std::string &var) const override;
+    Expression<T> derivativeFrom(const Expression<T> *derivatives, const std::string &var) const override;
 
     Expression<T> substitute(const std::string &var, const Expression<T> &expr) const override;
 
+    std::vector<T> taylor(const std::map<std::string, T> &context, const std::string &var,
+                          size_t order) const override;
+
+    Jet<T> evalJet(const std::map<std::string, T> &context, const std::string &var) const override;
+
+    uint32_t compile(ProgramBuilder<T> &builder) const override;
+
+    bool toPolynomial(Polynomial<T> &result) const override;
+
+    Expression<T> mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const override;
+
     std::shared_ptr<ExpressionImpl<T> > clone() const override;
+
+    void accept(ExpressionVisitor<T> &visitor) const override;
 };
 
 // Операция вычитания.
@@ -178,15 +399,28 @@ class OperationSub : public BinaryOperation<T> {
 public:
     OperationSub(const Expression<T> &left, const Expression<T> &right);
 
-    T eval(const std::map<std::string, T> &context) const override;
+    T apply(const T *args, const std::map<std::string, T> &context) const override;
 
-    std::string to_string() const override;
+    std::string part(size_t index) const override;
 
-    Expression<T> derivative(const std::string &var) const override;
+    Expression<T> derivativeFrom(const Expression<T> *derivatives, const std::string &var) const override;
 
     Expression<T> substitute(const std::string &var, const Expression<T> &expr) const override;
 
+    std::vector<T> taylor(const std::map<std::string, T> &context, const std::string &var,
+                          size_t order) const override;
+
+    Jet<T> evalJet(const std::map<std::string, T> &context, const std::string &var) const override;
+
+    uint32_t compile(ProgramBuilder<T> &builder) const override;
+
+    bool toPolynomial(Polynomial<T> &result) const override;
+
+    Expression<T> mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const override;
+
     std::shared_ptr<ExpressionImpl<T> > clone() const override;
+
+    void accept(ExpressionVisitor<T> &visitor) const override;
 };
 
 // Операция умножения.
@@ -195,15 +429,28 @@ class OperationMul : public BinaryOperation<T> {
 public:
     OperationMul(const Expression<T> &left, const Expression<T> &right);
 
-    T eval(const std::map<std::string, T> &context) const override;
+    T apply(const T *args, const std::map<std::string, T> &context) const override;
 
-    std::string to_string() const override;
+    std::string part(size_t index) const override;
 
-    Expression<T> derivative(const std::string &var) const override;
+    Expression<T> derivativeFrom(const Expression<T> *derivatives, const std::string &var) const override;
 
     Expression<T> substitute(const std::string &var, const Expression<T> &expr) const override;
 
+    std::vector<T> taylor(const std::map<std::string, T> &context, const std::string &var,
+                          size_t order) const override;
+
+    Jet<T> evalJet(const std::map<std::string, T> &context, const std::string &var) const override;
+
+    uint32_t compile(ProgramBuilder<T> &builder) const override;
+
+    bool toPolynomial(Polynomial<T> &result) const override;
+
+    Expression<T> mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const override;
+
     std::shared_ptr<ExpressionImpl<T> > clone() const override;
+
+    void accept(ExpressionVisitor<T> &visitor) const override;
 };
 
 // Операция деления.
@@ -212,15 +459,28 @@ class OperationDiv : public BinaryOperation<T> {
 public:
     OperationDiv(const Expression<T> &left, const Expression<T> &right);
 
-    T eval(const std::map<std::string, T> &context) const override;
+    T apply(const T *args, const std::map<std::string, T> &context) const override;
 
-    std::string to_string() const override;
+    std::string part(size_t index) const override;
 
-    Expression<T> derivative(const std::string &var) const override;
+    Expression<T> derivativeFrom(const Expression<T> *derivatives, const std::string &var) const override;
 
     Expression<T> substitute(const std::string &var, const Expression<T> &expr) const override;
 
+    std::vector<T> taylor(const std::map<std::string, T> &context, const std::string &var,
+                          size_t order) const override;
+
+    Jet<T> evalJet(const std::map<std::string, T> &context, const std::string &var) const override;
+
+    uint32_t compile(ProgramBuilder<T> &builder) const override;
+
+    bool toPolynomial(Polynomial<T> &result) const override;
+
+    Expression<T> mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const override;
+
     std::shared_ptr<ExpressionImpl<T> > clone() const override;
+
+    void accept(ExpressionVisitor<T> &visitor) const override;
 };
 
 // Операция возведения в степень.
@@ -229,22 +489,125 @@ class OperationPow : public BinaryOperation<T> {
 public:
     OperationPow(const Expression<T> &left, const Expression<T> &right);
 
+    T apply(const T *args, const std::map<std::string, T> &context) const override;
+
+    std::string part(size_t index) const override;
+
+    Expression<T> derivativeFrom(const Expression<T> *derivatives, const std::string &var) const override;
+
+    Expression<T> substitute(const std::string &var, const Expression<T> &expr) const override;
+
+    std::vector<T> taylor(const std::map<std::string, T> &context, const std::string &var,
+                          size_t order) const override;
+
+    Jet<T> evalJet(const std::map<std::string, T> &context, const std::string &var) const override;
+
+    uint32_t compile(ProgramBuilder<T> &builder) const override;
+
+    Expression<T> mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const override;
+
+    std::shared_ptr<ExpressionImpl<T> > clone() const override;
+
+    void accept(ExpressionVisitor<T> &visitor) const override;
+};
+
+// Сравнение: 1, если отношение выполнено, иначе 0.
+// Упорядочивающие отношения определены только для вещественных чисел.
+template<typename T>
+class Comparison : public BinaryOperation<T> {
+public:
+    Comparison(Relation relation, const Expression<T> &left, const Expression<T> &right);
+
+    T apply(const T *args, const std::map<std::string, T> &context) const override;
+
+    std::string part(size_t index) const override;
+
+    // Сравнение кусочно-постоянно: производная равна нулю всюду, кроме точек разрыва.
+    Expression<T> derivativeFrom(const Expression<T> *derivatives, const std::string &var) const override;
+
+    Expression<T> substitute(const std::string &var, const Expression<T> &expr) const override;
+
+    std::vector<T> taylor(const std::map<std::string, T> &context, const std::string &var,
+                          size_t order) const override;
+
+    Jet<T> evalJet(const std::map<std::string, T> &context, const std::string &var) const override;
+
+    uint32_t compile(ProgramBuilder<T> &builder) const override;
+
+    Expression<T> mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const override;
+
+    std::shared_ptr<ExpressionImpl<T> > clone() const override;
+
+    void accept(ExpressionVisitor<T> &visitor) const override;
+
+    Relation relation() const { return relation_; }
+
+private:
+    Relation relation_;
+};
+
+// Выбор select(condition, ifTrue, ifFalse): ifTrue, если условие не равно нулю, иначе ifFalse.
+// Вычисляется только выбранная ветвь; производная и ряды берутся по ветви, выбранной в точке.
+template<typename T>
+class Select : public ExpressionImpl<T> {
+public:
+    Select(const Expression<T> &condition, const Expression<T> &ifTrue, const Expression<T> &ifFalse);
+
     T eval(const std::map<std::string, T> &context) const override;
 
     std::string to_string() const override;
 
+    // Производная по частям: select(condition, ifTrue', ifFalse').
     Expression<T> derivative(const std::string &var) const override;
 
     Expression<T> substitute(const std::string &var, const Expression<T> &expr) const override;
 
+    std::vector<T> taylor(const std::map<std::string, T> &context, const std::string &var,
+                          size_t order) const override;
+
+    Jet<T> evalJet(const std::map<std::string, T> &context, const std::string &var) const override;
+
+    // Обе ветви вычисляются для всех строк пакета и смешиваются по маске условия.
+    uint32_t compile(ProgramBuilder<T> &builder) const override;
+
+    Expression<T> mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const override;
+
     std::shared_ptr<ExpressionImpl<T> > clone() const override;
+
+    void accept(ExpressionVisitor<T> &visitor) const override;
+
+    size_t childCount() const override { return 3; }
+
+    const Expression<T> &child(size_t index) const override {
+        return index == 0 ? condition_ : index == 1 ? ifTrue_ : ifFalse_;
+    }
+
+    T apply(const T *args, const std::map<std::string, T> &context) const override;
+
+    bool needsChild(size_t index, const T *args) const override;
+
+    std::string part(size_t index) const override;
+
+    Expression<T> derivativeFrom(const Expression<T> *derivatives, const std::string &var) const override;
+
+    const Expression<T> &condition() const { return condition_; }
+
+    const Expression<T> &ifTrue() const { return ifTrue_; }
+
+    const Expression<T> &ifFalse() const { return ifFalse_; }
+
+private:
+    Expression<T> condition_;
+    Expression<T> ifTrue_;
+    Expression<T> ifFalse_;
 };
 
-// Функция sin.
+// Операция возведения в постоянную целую степень.
+// Создаётся оператором ^, если показатель — целочисленная константа.
 template<typename T>
-class FunctionSin : public ExpressionImpl<T> {
+class OperationIntPow : public ExpressionImpl<T> {
 public:
-    explicit FunctionSin(const Expression<T> &arg);
+    OperationIntPow(const Expression<T> &base, long exponent);
 
     T eval(const std::map<std::string, T> &context) const override;
 
@@ -252,19 +615,49 @@ public:
 
     Expression<T> derivative(const std::string &var) const override;
 
+    size_t childCount() const override { return 1; }
+
+    const Expression<T> &child(size_t) const override { return base_; }
+
+    // Возведение в степень двоичным алгоритмом, без вызова std::pow.
+    T apply(const T *args, const std::map<std::string, T> &context) const override;
+
+    std::string part(size_t index) const override;
+
+    // Производная (f^n)' = n * f^(n-1) * f' определена и при отрицательном основании.
+    Expression<T> derivativeFrom(const Expression<T> *derivatives, const std::string &var) const override;
+
     Expression<T> substitute(const std::string &var, const Expression<T> &expr) const override;
 
+    std::vector<T> taylor(const std::map<std::string, T> &context, const std::string &var,
+                          size_t order) const override;
+
+    Jet<T> evalJet(const std::map<std::string, T> &context, const std::string &var) const override;
+
+    uint32_t compile(ProgramBuilder<T> &builder) const override;
+
+    bool toPolynomial(Polynomial<T> &result) const override;
+
+    Expression<T> mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const override;
+
     std::shared_ptr<ExpressionImpl<T> > clone() const override;
 
+    void accept(ExpressionVisitor<T> &visitor) const override;
+
+    const Expression<T> &base() const { return base_; }
+
+    long exponent() const { return exponent_; }
+
 private:
-    Expression<T> arg_;
+    Expression<T> base_;
+    long exponent_;
 };
 
-// Функция cos.
+// Базовый класс для функций одного аргумента.
 template<typename T>
-class FunctionCos : public ExpressionImpl<T> {
+class UnaryFunction : public ExpressionImpl<T> {
 public:
-    explicit FunctionCos(const Expression<T> &arg);
+    explicit UnaryFunction(const Expression<T> &arg);
 
     T eval(const std::map<std::string, T> &context) const override;
 
@@ -272,52 +665,185 @@ public:
 
     Expression<T> derivative(const std::string &var) const override;
 
+    size_t childCount() const override { return 1; }
+
+    const Expression<T> &child(size_t) const override { return arg_; }
+
+    const Expression<T> &argument() const { return arg_; }
+
+protected:
+    Expression<T> arg_;
+};
+
+// Функция sin.
+template<typename T>
+class FunctionSin : public UnaryFunction<T> {
+public:
+    explicit FunctionSin(const Expression<T> &arg);
+
+    T apply(const T *args, const std::map<std::string, T> &context) const override;
+
+    std::string part(size_t index) const override;
+
+    Expression<T> derivativeFrom(const Expression<T> *derivatives, const std::string &var) const override;
+
     Expression<T> substitute(const std::string &var, const Expression<T> &expr) const override;
 
+    std::vector<T> taylor(const std::map<std::string, T> &context, const std::string &var,
+                          size_t order) const override;
+
+    Jet<T> evalJet(const std::map<std::string, T> &context, const std::string &var) const override;
+
+    uint32_t compile(ProgramBuilder<T> &builder) const override;
+
+    Expression<T> mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const override;
+
     std::shared_ptr<ExpressionImpl<T> > clone() const override;
 
-private:
-    Expression<T> arg_;
+    void accept(ExpressionVisitor<T> &visitor) const override;
+};
+
+// Функция cos.
+template<typename T>
+class FunctionCos : public UnaryFunction<T> {
+public:
+    explicit FunctionCos(const Expression<T> &arg);
+
+    T apply(const T *args, const std::map<std::string, T> &context) const override;
+
+    std::string part(size_t index) const override;
+
+    Expression<T> derivativeFrom(const Expression<T> *derivatives, const std::string &var) const override;
+
+    Expression<T> substitute(const std::string &var, const Expression<T> &expr) const override;
+
+    std::vector<T> taylor(const std::map<std::string, T> &context, const std::string &var,
+                          size_t order) const override;
+
+    Jet<T> evalJet(const std::map<std::string, T> &context, const std::string &var) const override;
+
+    uint32_t compile(ProgramBuilder<T> &builder) const override;
+
+    Expression<T> mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const override;
+
+    std::shared_ptr<ExpressionImpl<T> > clone() const override;
+
+    void accept(ExpressionVisitor<T> &visitor) const override;
 };
 
 // Функция ln.
 template<typename T>
-class FunctionLn : public ExpressionImpl<T> {
+class FunctionLn : public UnaryFunction<T> {
 public:
     explicit FunctionLn(const Expression<T> &arg);
 
-    T eval(const std::map<std::string, T> &context) const override;
+    T apply(const T *args, const std::map<std::string, T> &context) const override;
 
-    std::string to_string() const override;
+    std::string part(size_t index) const override;
 
-    Expression<T> derivative(const std::string &var) const override;
+    Expression<T> derivativeFrom(const Expression<T> *derivatives, const std::string &var) const override;
 
     Expression<T> substitute(const std::string &var, const Expression<T> &expr) const override;
 
+    std::vector<T> taylor(const std::map<std::string, T> &context, const std::string &var,
+                          size_t order) const override;
+
+    Jet<T> evalJet(const std::map<std::string, T> &context, const std::string &var) const override;
+
+    uint32_t compile(ProgramBuilder<T> &builder) const override;
+
+    Expression<T> mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const override;
+
     std::shared_ptr<ExpressionImpl<T> > clone() const override;
 
-private:
-    Expression<T> arg_;
+    void accept(ExpressionVisitor<T> &visitor) const override;
 };
 
 // Функция exp.
 template<typename T>
-class FunctionExp : public ExpressionImpl<T> {
+class FunctionExp : public UnaryFunction<T> {
 public:
     explicit FunctionExp(const Expression<T> &arg);
 
-    T eval(const std::map<std::string, T> &context) const override;
+    T apply(const T *args, const std::map<std::string, T> &context) const override;
 
-    std::string to_string() const override;
+    std::string part(size_t index) const override;
 
-    Expression<T> derivative(const std::string &var) const override;
+    Expression<T> derivativeFrom(const Expression<T> *derivatives, const std::string &var) const override;
 
     Expression<T> substitute(const std::string &var, const Expression<T> &expr) const override;
 
+    std::vector<T> taylor(const std::map<std::string, T> &context, const std::string &var,
+                          size_t order) const override;
+
+    Jet<T> evalJet(const std::map<std::string, T> &context, const std::string &var) const override;
+
+    uint32_t compile(ProgramBuilder<T> &builder) const override;
+
+    Expression<T> mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const override;
+
     std::shared_ptr<ExpressionImpl<T> > clone() const override;
 
-private:
-    Expression<T> arg_;
+    void accept(ExpressionVisitor<T> &visitor) const override;
+};
+
+template<typename T>
+class PolynomialNode;
+
+template<typename T>
+class FunctionCall;
+
+template<typename T>
+class Reduction;
+
+template<typename T>
+class LazyDerivative;
+
+// Посетитель дерева выражения: по методу на каждый класс узла.
+// Непереопределённые методы передают узел в visitNode, поэтому наследнику достаточно
+// переопределить только интересующие его классы. Обход потомков — забота наследника.
+template<typename T>
+class ExpressionVisitor {
+public:
+    virtual ~ExpressionVisitor() = default;
+
+    virtual void visitNode(const ExpressionImpl<T> &) {}
+
+    virtual void visit(const Value<T> &node) { visitNode(node); }
+
+    virtual void visit(const Variable<T> &node) { visitNode(node); }
+
+    virtual void visit(const OperationAdd<T> &node) { visitNode(node); }
+
+    virtual void visit(const OperationSub<T> &node) { visitNode(node); }
+
+    virtual void visit(const OperationMul<T> &node) { visitNode(node); }
+
+    virtual void visit(const OperationDiv<T> &node) { visitNode(node); }
+
+    virtual void visit(const OperationPow<T> &node) { visitNode(node); }
+
+    virtual void visit(const Comparison<T> &node) { visitNode(node); }
+
+    virtual void visit(const Select<T> &node) { visitNode(node); }
+
+    virtual void visit(const OperationIntPow<T> &node) { visitNode(node); }
+
+    virtual void visit(const FunctionSin<T> &node) { visitNode(node); }
+
+    virtual void visit(const FunctionCos<T> &node) { visitNode(node); }
+
+    virtual void visit(const FunctionLn<T> &node) { visitNode(node); }
+
+    virtual void visit(const FunctionExp<T> &node) { visitNode(node); }
+
+    virtual void visit(const PolynomialNode<T> &node) { visitNode(node); }
+
+    virtual void visit(const FunctionCall<T> &node) { visitNode(node); }
+
+    virtual void visit(const Reduction<T> &node) { visitNode(node); }
+
+    virtual void visit(const LazyDerivative<T> &node) { visitNode(node); }
 };
 
 // Функции для создания функциональных выражений.
@@ -333,4 +859,40 @@ Expression<T> ln(const Expression<T> &expr);
 template<typename T>
 Expression<T> exp(const Expression<T> &expr);
 
+// Сравнение left relation right; для комплексных T допустимы только Equal и NotEqual.
+template<typename T>
+Expression<T> compare(Relation relation, const Expression<T> &left, const Expression<T> &right);
+
+template<typename T>
+Expression<T> select(const Expression<T> &condition, const Expression<T> &ifTrue, const Expression<T> &ifFalse);
+
+// Проверка, что значение — целое число, представимое в int32 (для комплексных — с нулевой мнимой частью).
+template<typename T>
+bool asInteger(const T &value, long &result);
+
+// Возведение в целую степень двоичным алгоритмом.
+template<typename T>
+T integerPower(T base, long exponent);
+
+// Произведение двух Jet по правилу Лейбница.
+template<typename T>
+Jet<T> jetMul(const Jet<T> &a, const Jet<T> &b);
+
+// Композиция g(u) по значениям g(u), g'(u), g''(u):
+// (g o u)' = g' u', (g o u)'' = g'' u'^2 + g' u''.
+template<typename T>
+Jet<T> jetChain(const Jet<T> &u, T g, T g1, T g2);
+
+// Целая степень Jet; при n = 0 и n = 1 старшие производные точно равны нулю и в точке x = 0.
+template<typename T>
+Jet<T> jetPower(const Jet<T> &x, long n);
+
+// Тихий NaN (для комплексных — в обеих частях).
+template<typename T>
+T quietNaN();
+
+// Проверка, что значение конечно (для комплексных — обе части).
+template<typename T>
+bool isFinite(const T &value);
+
 #endif // EXPRESSION_HPP
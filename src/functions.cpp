@@ -0,0 +1,617 @@
+#include "functions.hpp"
+#include "taylor.hpp"
+#include "program.hpp"
+#include "reduction.hpp"
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+
+const char *const FUNCTION_ARGUMENTS[2] = {"#0", "#1"};
+
+/*
+    Скалярные функции и пакетные ядра.
+*/
+
+template<typename T>
+static T tanValue(T x) { return std::tan(x); }
+
+template<typename T>
+static T sqrtValue(T x) {
+    if constexpr (std::is_floating_point_v<T>) {
+        if (x < T(0) && errorPolicy() == ErrorPolicy::Throw)
+            throw std::runtime_error("Square root of negative value");
+    }
+    return std::sqrt(x);
+}
+
+template<typename T>
+static T asinValue(T x) { return std::asin(x); }
+
+template<typename T>
+static T acosValue(T x) { return std::acos(x); }
+
+template<typename T>
+static T atanValue(T x) { return std::atan(x); }
+
+template<typename T>
+static T sinhValue(T x) { return std::sinh(x); }
+
+template<typename T>
+static T coshValue(T x) { return std::cosh(x); }
+
+template<typename T>
+static T tanhValue(T x) { return std::tanh(x); }
+
+template<typename T>
+static T absValue(T x) { return std::abs(x); }
+
+template<typename T>
+static T signValue(T x) { return T((x > T(0)) - (x < T(0))); }
+
+template<typename T>
+static T minValue(T a, T b) { return b < a ? b : a; }
+
+template<typename T>
+static T maxValue(T a, T b) { return a < b ? b : a; }
+
+template<typename T>
+static T atan2Value(T y, T x) { return std::atan2(y, x); }
+
+template<typename T, T (*F)(T)>
+static T unaryEval(const T *args) {
+    return F(args[0]);
+}
+
+template<typename T, T (*F)(T, T)>
+static T binaryEval(const T *args) {
+    return F(args[0], args[1]);
+}
+
+// Ядра — простые циклы по непрерывным массивам без ветвлений, которые компилятор может векторизовать.
+template<typename T, T (*F)(T)>
+static void unaryKernel(const T *const *args, T *out, size_t n) {
+    const T *a = args[0];
+    for (size_t i = 0; i < n; ++i)
+        out[i] = F(a[i]);
+}
+
+template<typename T, T (*F)(T, T)>
+static void binaryKernel(const T *const *args, T *out, size_t n) {
+    const T *a = args[0];
+    const T *b = args[1];
+    for (size_t i = 0; i < n; ++i)
+        out[i] = F(a[i], b[i]);
+}
+
+template<typename T>
+static void sqrtKernel(const T *const *args, T *out, size_t n) {
+    const T *a = args[0];
+    if constexpr (std::is_floating_point_v<T>) {
+        // Проверка области определения вынесена из основного цикла.
+        if (errorPolicy() == ErrorPolicy::Throw) {
+            for (size_t i = 0; i < n; ++i) {
+                if (a[i] < T(0))
+                    throw std::runtime_error("Square root of negative value");
+            }
+        }
+    }
+    for (size_t i = 0; i < n; ++i)
+        out[i] = std::sqrt(a[i]);
+}
+
+/*
+    Правила дифференцирования.
+*/
+
+template<typename T>
+static Expression<T> square(const Expression<T> &x) {
+    return x ^ Expression<T>(T(2));
+}
+
+template<typename T>
+static Expression<T> tanPartial(const std::vector<Expression<T> > &a, size_t) {
+    // tg'(u) = 1 / cos(u)^2
+    return Expression<T>(T(1)) / square(cos(a[0]));
+}
+
+template<typename T>
+static Expression<T> sqrtPartial(const std::vector<Expression<T> > &a, size_t) {
+    return Expression<T>(T(0.5)) / call<T>("sqrt", {a[0]});
+}
+
+template<typename T>
+static Expression<T> asinPartial(const std::vector<Expression<T> > &a, size_t) {
+    // arcsin'(u) = (1 - u^2)^(-1/2)
+    return (Expression<T>(T(1)) - square(a[0])) ^ Expression<T>(T(-0.5));
+}
+
+template<typename T>
+static Expression<T> acosPartial(const std::vector<Expression<T> > &a, size_t) {
+    return Expression<T>(T(-1)) * ((Expression<T>(T(1)) - square(a[0])) ^ Expression<T>(T(-0.5)));
+}
+
+template<typename T>
+static Expression<T> atanPartial(const std::vector<Expression<T> > &a, size_t) {
+    return Expression<T>(T(1)) / (Expression<T>(T(1)) + square(a[0]));
+}
+
+template<typename T>
+static Expression<T> sinhPartial(const std::vector<Expression<T> > &a, size_t) {
+    return call<T>("cosh", {a[0]});
+}
+
+template<typename T>
+static Expression<T> coshPartial(const std::vector<Expression<T> > &a, size_t) {
+    return call<T>("sinh", {a[0]});
+}
+
+template<typename T>
+static Expression<T> tanhPartial(const std::vector<Expression<T> > &a, size_t) {
+    return Expression<T>(T(1)) / square(call<T>("cosh", {a[0]}));
+}
+
+template<typename T>
+static Expression<T> absPartial(const std::vector<Expression<T> > &a, size_t) {
+    return call<T>("sign", {a[0]});
+}
+
+template<typename T>
+static Expression<T> signPartial(const std::vector<Expression<T> > &, size_t) {
+    return Expression<T>(T(0));
+}
+
+// min и max: производная по выбранному аргументу равна 1, при равенстве аргументов — 1/2.
+template<typename T>
+static Expression<T> minPartial(const std::vector<Expression<T> > &a, size_t index) {
+    Expression<T> sign = call<T>("sign", {a[0] - a[1]});
+    return (index == 0 ? Expression<T>(T(1)) - sign : Expression<T>(T(1)) + sign) / Expression<T>(T(2));
+}
+
+template<typename T>
+static Expression<T> maxPartial(const std::vector<Expression<T> > &a, size_t index) {
+    Expression<T> sign = call<T>("sign", {a[0] - a[1]});
+    return (index == 0 ? Expression<T>(T(1)) + sign : Expression<T>(T(1)) - sign) / Expression<T>(T(2));
+}
+
+template<typename T>
+static Expression<T> atan2Partial(const std::vector<Expression<T> > &a, size_t index) {
+    // atan2(y, x): d/dy = x / (x^2 + y^2), d/dx = -y / (x^2 + y^2)
+    Expression<T> norm = square(a[0]) + square(a[1]);
+    return index == 0 ? a[1] / norm : Expression<T>(T(-1)) * a[0] / norm;
+}
+
+/*
+    Правила разложения в ряд Тейлора.
+*/
+
+template<typename T>
+static std::vector<T> oneMinusSquare(const std::vector<T> &u) {
+    return taylorSub(taylorConstant(T(1), u.size() - 1), taylorMul(u, u));
+}
+
+template<typename T>
+static std::vector<T> tanTaylor(const std::vector<std::vector<T> > &a) {
+    return taylorDiv(taylorSin(a[0]), taylorCos(a[0]));
+}
+
+template<typename T>
+static std::vector<T> sqrtTaylor(const std::vector<std::vector<T> > &a) {
+    sqrtValue(a[0][0]);
+    return taylorPow(a[0], T(0.5));
+}
+
+template<typename T>
+static std::vector<T> asinTaylor(const std::vector<std::vector<T> > &a) {
+    const auto &u = a[0];
+    return taylorIntegrate(std::asin(u[0]), taylorMul(taylorPow(oneMinusSquare(u), T(-0.5)), taylorDerivative(u)));
+}
+
+template<typename T>
+static std::vector<T> acosTaylor(const std::vector<std::vector<T> > &a) {
+    const auto &u = a[0];
+    std::vector<T> derivative = taylorMul(taylorPow(oneMinusSquare(u), T(-0.5)), taylorDerivative(u));
+    return taylorIntegrate(std::acos(u[0]), taylorScale(derivative, T(-1)));
+}
+
+template<typename T>
+static std::vector<T> atanTaylor(const std::vector<std::vector<T> > &a) {
+    const auto &u = a[0];
+    std::vector<T> denominator = taylorAdd(taylorConstant(T(1), u.size() - 1), taylorMul(u, u));
+    return taylorIntegrate(std::atan(u[0]), taylorDiv(taylorDerivative(u), denominator));
+}
+
+template<typename T>
+static std::vector<T> sinhTaylor(const std::vector<std::vector<T> > &a) {
+    return taylorScale(taylorSub(taylorExp(a[0]), taylorExp(taylorScale(a[0], T(-1)))), T(0.5));
+}
+
+template<typename T>
+static std::vector<T> coshTaylor(const std::vector<std::vector<T> > &a) {
+    return taylorScale(taylorAdd(taylorExp(a[0]), taylorExp(taylorScale(a[0], T(-1)))), T(0.5));
+}
+
+template<typename T>
+static std::vector<T> tanhTaylor(const std::vector<std::vector<T> > &a) {
+    return taylorDiv(sinhTaylor(a), coshTaylor(a));
+}
+
+template<typename T>
+static std::vector<T> absTaylor(const std::vector<std::vector<T> > &a) {
+    return taylorScale(a[0], signValue(a[0][0]));
+}
+
+template<typename T>
+static std::vector<T> signTaylor(const std::vector<std::vector<T> > &a) {
+    return taylorConstant(signValue(a[0][0]), a[0].size() - 1);
+}
+
+template<typename T>
+static std::vector<T> minTaylor(const std::vector<std::vector<T> > &a) {
+    return a[1][0] < a[0][0] ? a[1] : a[0];
+}
+
+template<typename T>
+static std::vector<T> maxTaylor(const std::vector<std::vector<T> > &a) {
+    return a[0][0] < a[1][0] ? a[1] : a[0];
+}
+
+template<typename T>
+static std::vector<T> atan2Taylor(const std::vector<std::vector<T> > &a) {
+    const auto &y = a[0];
+    const auto &x = a[1];
+    std::vector<T> numerator = taylorSub(taylorMul(x, taylorDerivative(y)), taylorMul(y, taylorDerivative(x)));
+    return taylorIntegrate(std::atan2(y[0], x[0]), taylorDiv(numerator, taylorAdd(taylorMul(x, x), taylorMul(y, y))));
+}
+
+/*
+    Правила для Jet: значение, первая и вторая производные функции в точке.
+*/
+
+template<typename T>
+static Jet<T> tanJet(const Jet<T> *a) {
+    T t = std::tan(a[0].value);
+    T first = T(1) + t * t;
+    return jetChain(a[0], t, first, T(2) * t * first);
+}
+
+template<typename T>
+static Jet<T> sqrtJet(const Jet<T> *a) {
+    T s = sqrtValue(a[0].value);
+    return jetChain(a[0], s, T(0.5) / s, T(-0.25) / (s * s * s));
+}
+
+template<typename T>
+static Jet<T> asinJet(const Jet<T> *a) {
+    // arcsin' = q^(-1/2), arcsin'' = u q^(-3/2), q = 1 - u^2.
+    T u = a[0].value;
+    T root = std::sqrt(T(1) - u * u);
+    return jetChain(a[0], std::asin(u), T(1) / root, u / (root * root * root));
+}
+
+template<typename T>
+static Jet<T> acosJet(const Jet<T> *a) {
+    T u = a[0].value;
+    T root = std::sqrt(T(1) - u * u);
+    return jetChain(a[0], std::acos(u), T(-1) / root, -u / (root * root * root));
+}
+
+template<typename T>
+static Jet<T> atanJet(const Jet<T> *a) {
+    T u = a[0].value;
+    T first = T(1) / (T(1) + u * u);
+    return jetChain(a[0], std::atan(u), first, T(-2) * u * first * first);
+}
+
+template<typename T>
+static Jet<T> sinhJet(const Jet<T> *a) {
+    T sh = std::sinh(a[0].value);
+    return jetChain(a[0], sh, std::cosh(a[0].value), sh);
+}
+
+template<typename T>
+static Jet<T> coshJet(const Jet<T> *a) {
+    T ch = std::cosh(a[0].value);
+    return jetChain(a[0], ch, std::sinh(a[0].value), ch);
+}
+
+template<typename T>
+static Jet<T> tanhJet(const Jet<T> *a) {
+    T t = std::tanh(a[0].value);
+    T first = T(1) - t * t;
+    return jetChain(a[0], t, first, T(-2) * t * first);
+}
+
+template<typename T>
+static Jet<T> absJet(const Jet<T> *a) {
+    T sign = signValue(a[0].value);
+    return {std::abs(a[0].value), sign * a[0].first, sign * a[0].second};
+}
+
+template<typename T>
+static Jet<T> signJet(const Jet<T> *a) {
+    return {signValue(a[0].value), T(0), T(0)};
+}
+
+template<typename T>
+static Jet<T> minJet(const Jet<T> *a) {
+    return a[1].value < a[0].value ? a[1] : a[0];
+}
+
+template<typename T>
+static Jet<T> maxJet(const Jet<T> *a) {
+    return a[0].value < a[1].value ? a[1] : a[0];
+}
+
+template<typename T>
+static Jet<T> atan2Jet(const Jet<T> *a) {
+    // atan2(y, x)' = (x y' - y x') / r, r = x^2 + y^2; в производной числителя слагаемые x' y' сокращаются.
+    const Jet<T> &y = a[0], &x = a[1];
+    T r = x.value * x.value + y.value * y.value;
+    T first = (x.value * y.first - y.value * x.first) / r;
+    T numeratorDerivative = x.value * y.second - y.value * x.second;
+    T normDerivative = T(2) * (x.value * x.first + y.value * y.first);
+    return {std::atan2(y.value, x.value), first, (numeratorDerivative - first * normDerivative) / r};
+}
+
+/*
+    Функции с собственными классами узлов.
+*/
+
+template<typename T>
+static Expression<T> makeSin(const std::vector<Expression<T> > &a) { return sin(a[0]); }
+
+template<typename T>
+static Expression<T> makeCos(const std::vector<Expression<T> > &a) { return cos(a[0]); }
+
+template<typename T>
+static Expression<T> makeLn(const std::vector<Expression<T> > &a) { return ln(a[0]); }
+
+template<typename T>
+static Expression<T> makeExp(const std::vector<Expression<T> > &a) { return exp(a[0]); }
+
+template<typename T>
+static Expression<T> makePow(const std::vector<Expression<T> > &a) { return a[0] ^ a[1]; }
+
+template<typename T>
+static Expression<T> makeSelect(const std::vector<Expression<T> > &a) { return select(a[0], a[1], a[2]); }
+
+template<typename T>
+static Expression<T> makeSum(const std::vector<Expression<T> > &a) { return sum(a[0]); }
+
+template<typename T>
+static Expression<T> makeProd(const std::vector<Expression<T> > &a) { return prod(a[0]); }
+
+template<typename T>
+static Expression<T> makeDot(const std::vector<Expression<T> > &a) { return dot(a[0], a[1]); }
+
+template<typename T>
+static Expression<T> makeNorm(const std::vector<Expression<T> > &a) { return norm(a[0]); }
+
+template<typename T>
+static Expression<T> makeProductDerivative(const std::vector<Expression<T> > &a) { return dprod(a); }
+
+// piecewise(c1, v1, c2, v2, ..., default) = select(c1, v1, select(c2, v2, ... default)).
+template<typename T>
+static Expression<T> makePiecewise(const std::vector<Expression<T> > &a) {
+    if (a.size() < 3 || a.size() % 2 == 0)
+        throw std::runtime_error("Function piecewise expects condition/value pairs and a default value");
+    Expression<T> result = a.back();
+    for (size_t k = a.size() - 1; k > 0; k -= 2)
+        result = select(a[k - 2], a[k - 1], result);
+    return result;
+}
+
+// ===================================================================
+
+/*
+    Реализация класса FunctionRegistry<T>
+*/
+
+template<typename T>
+FunctionRegistry<T>::FunctionRegistry() {
+    add({"sin", 1, makeSin<T>, nullptr, nullptr, nullptr, nullptr, nullptr});
+    add({"cos", 1, makeCos<T>, nullptr, nullptr, nullptr, nullptr, nullptr});
+    add({"ln", 1, makeLn<T>, nullptr, nullptr, nullptr, nullptr, nullptr});
+    add({"exp", 1, makeExp<T>, nullptr, nullptr, nullptr, nullptr, nullptr});
+    add({"pow", 2, makePow<T>, nullptr, nullptr, nullptr, nullptr, nullptr});
+    add({"select", 3, makeSelect<T>, nullptr, nullptr, nullptr, nullptr, nullptr});
+    add({"piecewise", 0, makePiecewise<T>, nullptr, nullptr, nullptr, nullptr, nullptr});
+    add({"sum", 1, makeSum<T>, nullptr, nullptr, nullptr, nullptr, nullptr});
+    add({"prod", 1, makeProd<T>, nullptr, nullptr, nullptr, nullptr, nullptr});
+    add({"dot", 2, makeDot<T>, nullptr, nullptr, nullptr, nullptr, nullptr});
+    add({"norm", 1, makeNorm<T>, nullptr, nullptr, nullptr, nullptr, nullptr});
+    add({"dprod", 0, makeProductDerivative<T>, nullptr, nullptr, nullptr, nullptr, nullptr});
+
+    add({"tan", 1, nullptr, unaryEval<T, tanValue<T> >, unaryKernel<T, tanValue<T> >, tanPartial<T>, tanTaylor<T>,
+         tanJet<T>});
+    add({"sqrt", 1, nullptr, unaryEval<T, sqrtValue<T> >, sqrtKernel<T>, sqrtPartial<T>, sqrtTaylor<T>,
+         sqrtJet<T>});
+    add({"asin", 1, nullptr, unaryEval<T, asinValue<T> >, unaryKernel<T, asinValue<T> >, asinPartial<T>, asinTaylor<T>,
+         asinJet<T>});
+    add({"acos", 1, nullptr, unaryEval<T, acosValue<T> >, unaryKernel<T, acosValue<T> >, acosPartial<T>, acosTaylor<T>,
+         acosJet<T>});
+    add({"atan", 1, nullptr, unaryEval<T, atanValue<T> >, unaryKernel<T, atanValue<T> >, atanPartial<T>, atanTaylor<T>,
+         atanJet<T>});
+    add({"sinh", 1, nullptr, unaryEval<T, sinhValue<T> >, unaryKernel<T, sinhValue<T> >, sinhPartial<T>, sinhTaylor<T>,
+         sinhJet<T>});
+    add({"cosh", 1, nullptr, unaryEval<T, coshValue<T> >, unaryKernel<T, coshValue<T> >, coshPartial<T>, coshTaylor<T>,
+         coshJet<T>});
+    add({"tanh", 1, nullptr, unaryEval<T, tanhValue<T> >, unaryKernel<T, tanhValue<T> >, tanhPartial<T>, tanhTaylor<T>,
+         tanhJet<T>});
+
+    // Функции, использующие упорядоченность, определены только для вещественных чисел.
+    if constexpr (std::is_floating_point_v<T>) {
+        add({"abs", 1, nullptr, unaryEval<T, absValue<T> >, unaryKernel<T, absValue<T> >, absPartial<T>, absTaylor<T>,
+             absJet<T>});
+        add({"sign", 1, nullptr, unaryEval<T, signValue<T> >, unaryKernel<T, signValue<T> >, signPartial<T>,
+             signTaylor<T>, signJet<T>});
+        add({"min", 2, nullptr, binaryEval<T, minValue<T> >, binaryKernel<T, minValue<T> >, minPartial<T>, minTaylor<T>,
+             minJet<T>});
+        add({"max", 2, nullptr, binaryEval<T, maxValue<T> >, binaryKernel<T, maxValue<T> >, maxPartial<T>, maxTaylor<T>,
+             maxJet<T>});
+        add({"atan2", 2, nullptr, binaryEval<T, atan2Value<T> >, binaryKernel<T, atan2Value<T> >, atan2Partial<T>,
+             atan2Taylor<T>, atan2Jet<T>});
+    }
+}
+
+template<typename T>
+FunctionRegistry<T> &FunctionRegistry<T>::instance() {
+    static FunctionRegistry registry;
+    return registry;
+}
+
+template<typename T>
+uint16_t FunctionRegistry<T>::add(const FunctionInfo<T> &info) {
+    if (index_.count(info.name))
+        throw std::runtime_error("Function already registered: " + info.name);
+    uint16_t id = static_cast<uint16_t>(functions_.size());
+    functions_.push_back(info);
+    index_.emplace(info.name, id);
+    return id;
+}
+
+template<typename T>
+const FunctionInfo<T> *FunctionRegistry<T>::find(const std::string &name) const {
+    auto it = index_.find(name);
+    return it == index_.end() ? nullptr : &functions_[it->second];
+}
+
+template<typename T>
+uint16_t FunctionRegistry<T>::id(const std::string &name) const {
+    auto it = index_.find(name);
+    if (it == index_.end())
+        throw std::runtime_error("Unknown function: " + name);
+    return it->second;
+}
+
+// ===================================================================
+
+/*
+    Реализация класса FunctionCall<T>
+*/
+
+template<typename T>
+FunctionCall<T>::FunctionCall(uint16_t function, const std::vector<Expression<T> > &args)
+    : function_(function), args_(args) {
+    this->updateHeight();
+}
+
+template<typename T>
+T FunctionCall<T>::eval(const std::map<std::string, T> &context) const {
+    T values[2];
+    for (size_t i = 0; i < args_.size(); ++i)
+        values[i] = args_[i].eval(context);
+    return apply(values, context);
+}
+
+template<typename T>
+std::string FunctionCall<T>::to_string() const {
+    std::string result = part(0);
+    for (size_t i = 0; i < args_.size(); ++i)
+        result += args_[i].to_string() + part(i + 1);
+    return result;
+}
+
+template<typename T>
+Expression<T> FunctionCall<T>::derivative(const std::string &var) const {
+    std::vector<Expression<T> > derivatives;
+    for (const auto &arg: args_)
+        derivatives.push_back(arg.differentiate(var));
+    return derivativeFrom(derivatives.data(), var);
+}
+
+template<typename T>
+T FunctionCall<T>::apply(const T *args, const std::map<std::string, T> &) const {
+    return FunctionRegistry<T>::instance().get(function_).eval(args);
+}
+
+template<typename T>
+std::string FunctionCall<T>::part(size_t index) const {
+    if (index == 0)
+        return FunctionRegistry<T>::instance().get(function_).name + "(";
+    return index < args_.size() ? ", " : ")";
+}
+
+template<typename T>
+Expression<T> FunctionCall<T>::derivativeFrom(const Expression<T> *derivatives, const std::string &) const {
+    const FunctionInfo<T> &info = FunctionRegistry<T>::instance().get(function_);
+    Expression<T> result = info.partial(args_, 0) * derivatives[0];
+    for (size_t i = 1; i < args_.size(); ++i)
+        result += info.partial(args_, i) * derivatives[i];
+    return result;
+}
+
+template<typename T>
+Expression<T> FunctionCall<T>::substitute(const std::string &var, const Expression<T> &expr) const {
+    std::vector<Expression<T> > args;
+    for (const auto &arg: args_)
+        args.push_back(arg.substitute(var, expr));
+    return Expression<T>(std::make_shared<FunctionCall<T> >(function_, args));
+}
+
+template<typename T>
+std::vector<T> FunctionCall<T>::taylor(const std::map<std::string, T> &context, const std::string &var,
+                                       size_t order) const {
+    std::vector<std::vector<T> > args;
+    for (const auto &arg: args_)
+        args.push_back(arg.taylor(var, context, order));
+    return FunctionRegistry<T>::instance().get(function_).taylor(args);
+}
+
+template<typename T>
+Jet<T> FunctionCall<T>::evalJet(const std::map<std::string, T> &context, const std::string &var) const {
+    Jet<T> args[2];
+    for (size_t i = 0; i < args_.size(); ++i)
+        args[i] = args_[i].evalJet(var, context);
+    return FunctionRegistry<T>::instance().get(function_).jet(args);
+}
+
+template<typename T>
+uint32_t FunctionCall<T>::compile(ProgramBuilder<T> &builder) const {
+    std::vector<uint32_t> args;
+    for (const auto &arg: args_)
+        args.push_back(arg.compile(builder));
+    return builder.call(function_, args);
+}
+
+template<typename T>
+Expression<T> FunctionCall<T>::mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const {
+    std::vector<Expression<T> > args;
+    for (const auto &arg: args_)
+        args.push_back(f(arg));
+    return Expression<T>(std::make_shared<FunctionCall<T> >(function_, args));
+}
+
+template<typename T>
+std::shared_ptr<ExpressionImpl<T> > FunctionCall<T>::clone() const {
+    return std::make_shared<FunctionCall<T> >(function_, args_);
+}
+
+template<typename T>
+void FunctionCall<T>::accept(ExpressionVisitor<T> &visitor) const {
+    visitor.visit(*this);
+}
+
+// ===================================================================
+
+template<typename T>
+Expression<T> call(const std::string &name, const std::vector<Expression<T> > &args) {
+    const FunctionRegistry<T> &registry = FunctionRegistry<T>::instance();
+    const FunctionInfo<T> *info = registry.find(name);
+    if (!info)
+        throw std::runtime_error("Unknown function: " + name);
+    if (info->arity != 0 && args.size() != info->arity)
+        throw std::runtime_error("Function " + name + " expects " + std::to_string(info->arity) + " argument(s)");
+    if (info->make)
+        return info->make(args);
+    return Expression<T>(std::make_shared<FunctionCall<T> >(registry.id(name), args));
+}
+
+// ===================================================================
+// Инстанциация шаблонов для всех числовых типов
+#define INSTANTIATE_FUNCTIONS(T)                                                              \
+    template class FunctionRegistry<T>;                                                       \
+    template class FunctionCall<T>;                                                           \
+    template Expression<T> call<T>(const std::string &, const std::vector<Expression<T> > &);
+
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE_FUNCTIONS)
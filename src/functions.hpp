@@ -0,0 +1,120 @@
+#ifndef FUNCTIONS_HPP
+#define FUNCTIONS_HPP
+
+#include "expression.hpp"
+#include <unordered_map>
+
+/*
+    Реестр элементарных функций.
+    Каждая функция описывается записью таблицы: имя, число аргументов, скалярное вычисление,
+    пакетное ядро, правило дифференцирования, правило для Jet и правило разложения в ряд Тейлора.
+    Парсер находит функции по имени через хеш-таблицу реестра.
+*/
+
+// Имена аргументов в выражениях производных, которые возвращает FunctionInfo::partial.
+// Такие имена не может породить парсер, поэтому они не пересекаются с переменными пользователя.
+extern const char *const FUNCTION_ARGUMENTS[2];
+
+template<typename T>
+struct FunctionInfo {
+    std::string name;
+    size_t arity; // 0 — произвольное число аргументов, проверяемое функцией make
+
+    // Конструктор выражения для функций, у которых есть собственный класс узла (sin, cos, ln, exp, pow).
+    // Для остальных функций равен nullptr, и вызов представляется узлом FunctionCall;
+    // у функций с собственным классом узла остальные поля не используются и равны nullptr.
+    Expression<T> (*make)(const std::vector<Expression<T> > &args);
+
+    // Значение функции; args содержит arity значений.
+    T (*eval)(const T *args);
+
+    // Пакетное ядро: out[i] = f(args[0][i], ..., args[arity - 1][i]) для i < n.
+    void (*kernel)(const T *const *args, T *out, size_t n);
+
+    // Частная производная по аргументу index в виде выражения от аргументов args.
+    Expression<T> (*partial)(const std::vector<Expression<T> > &args, size_t index);
+
+    // Ряд Тейлора функции по рядам аргументов.
+    std::vector<T> (*taylor)(const std::vector<std::vector<T> > &args);
+
+    // Значение и первые две производные функции по Jet аргументов, без выделения памяти.
+    // Используется в evalJet; ряд Тейлора нужен только для производных высших порядков.
+    Jet<T> (*jet)(const Jet<T> *args);
+};
+
+template<typename T>
+class FunctionRegistry {
+public:
+    // Общий реестр со встроенными функциями.
+    static FunctionRegistry &instance();
+
+    // Регистрация функции; возвращает её идентификатор.
+    uint16_t add(const FunctionInfo<T> &info);
+
+    // Поиск по имени; nullptr, если функция не зарегистрирована.
+    const FunctionInfo<T> *find(const std::string &name) const;
+
+    // Идентификатор функции по имени; бросает исключение для неизвестной функции.
+    uint16_t id(const std::string &name) const;
+
+    const FunctionInfo<T> &get(uint16_t id) const { return functions_[id]; }
+
+private:
+    FunctionRegistry();
+
+    std::vector<FunctionInfo<T> > functions_;
+    std::unordered_map<std::string, uint16_t> index_;
+};
+
+// Вызов функции из реестра, не имеющей собственного класса узла.
+template<typename T>
+class FunctionCall : public ExpressionImpl<T> {
+public:
+    FunctionCall(uint16_t function, const std::vector<Expression<T> > &args);
+
+    T eval(const std::map<std::string, T> &context) const override;
+
+    std::string to_string() const override;
+
+    Expression<T> derivative(const std::string &var) const override;
+
+    Expression<T> substitute(const std::string &var, const Expression<T> &expr) const override;
+
+    std::vector<T> taylor(const std::map<std::string, T> &context, const std::string &var,
+                          size_t order) const override;
+
+    Jet<T> evalJet(const std::map<std::string, T> &context, const std::string &var) const override;
+
+    uint32_t compile(ProgramBuilder<T> &builder) const override;
+
+    Expression<T> mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const override;
+
+    std::shared_ptr<ExpressionImpl<T> > clone() const override;
+
+    void accept(ExpressionVisitor<T> &visitor) const override;
+
+    size_t childCount() const override { return args_.size(); }
+
+    const Expression<T> &child(size_t index) const override { return args_[index]; }
+
+    T apply(const T *args, const std::map<std::string, T> &context) const override;
+
+    std::string part(size_t index) const override;
+
+    // Цепное правило: sum_i df/darg_i * arg_i'.
+    Expression<T> derivativeFrom(const Expression<T> *derivatives, const std::string &var) const override;
+
+    uint16_t function() const { return function_; }
+
+    const std::vector<Expression<T> > &arguments() const { return args_; }
+
+private:
+    uint16_t function_;
+    std::vector<Expression<T> > args_;
+};
+
+// Построение вызова функции по имени с проверкой числа аргументов.
+template<typename T>
+Expression<T> call(const std::string &name, const std::vector<Expression<T> > &args);
+
+#endif // FUNCTIONS_HPP
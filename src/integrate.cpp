@@ -0,0 +1,259 @@
+#include "integrate.hpp"
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+// Положительные узлы правила Кронрода K15 на [-1, 1] (по убыванию, последний — ноль) и их веса.
+// Узлы с нечётными номерами — узлы правила Гаусса G7, их веса в GAUSS_WEIGHTS.
+const long double KRONROD_NODES[8] = {
+    0.991455371120812639206854697526329L, 0.949107912342758524526189684047851L,
+    0.864864423359769072789712788640926L, 0.741531185599394439863864773280788L,
+    0.586087235467691130294144845693013L, 0.405845151377397166906606412076961L,
+    0.207784955007898467600689403773245L, 0.000000000000000000000000000000000L};
+
+const long double KRONROD_WEIGHTS[8] = {
+    0.022935322010529224963732008058970L, 0.063092092629978553290700663189204L,
+    0.104790010322250183839876322541518L, 0.140653259715525918745189590510238L,
+    0.169004726639267902826583426598550L, 0.190350578064785409913256402421014L,
+    0.204432940075298892414161999234649L, 0.209482141084727828012999174891714L};
+
+const long double GAUSS_WEIGHTS[4] = {
+    0.129484966168869693270611432679082L, 0.279705391489276667901467771423780L,
+    0.381830050505118944950369775488975L, 0.417959183673469387755102040816327L};
+
+const size_t RULE_POINTS = 15;
+
+// Пакет узлов одного шага ограничен, чтобы столбцы входов не росли без предела в старших размерностях.
+const size_t MAX_STEP_ROWS = size_t(1) << 20;
+
+// Меньшие пакеты выгоднее вычислять в одном потоке, чем запускать потоки.
+const size_t ROWS_PER_THREAD = 4096;
+
+template<typename T>
+struct Box {
+    std::vector<T> lower;
+    std::vector<T> upper;
+    T value;
+    T error;
+};
+
+// Вычисление program по столбцам inputs в output, строки делятся между threads потоками.
+template<typename T>
+void evalParallel(const Program<T> &program, const std::vector<const T *> &inputs, T *output, size_t rows,
+                  size_t threads) {
+    const size_t parts = std::max<size_t>(1, std::min(threads, rows / ROWS_PER_THREAD));
+    const size_t step = (rows + parts - 1) / parts;
+    std::vector<std::exception_ptr> errors(parts);
+    auto run = [&](size_t part) {
+        const size_t begin = part * step, end = std::min(rows, begin + step);
+        try {
+            std::vector<const T *> columns(inputs.size());
+            for (size_t k = 0; k < inputs.size(); ++k)
+                columns[k] = inputs[k] + begin;
+            T *outputs[] = {output + begin};
+            program.evalBatch(columns.data(), outputs, end - begin, ErrorPolicy::Throw);
+        } catch (...) {
+            errors[part] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t part = 1; part < parts; ++part)
+        workers.emplace_back(run, part);
+    run(0);
+    for (auto &worker: workers)
+        worker.join();
+    for (const auto &error: errors) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
+// Тензорное правило Гаусса — Кронрода для d переменных: узлы на [-1, 1]^d и веса K15 и G7 в каждом узле.
+template<typename T>
+class Cubature {
+public:
+    Cubature(const Expression<T> &expr, const std::vector<std::string> &vars, const std::map<std::string, T> &context,
+             size_t threads)
+        : dimensions_(vars.size()), threads_(threads) {
+        ProgramBuilder<T> builder{VariableTable(vars)};
+        builder.addOutput(builder.add(expr));
+        program_ = builder.build();
+        // Переменные интегрирования идут в таблице первыми, за ними — параметры из контекста.
+        const std::vector<std::string> &variables = program_.variables();
+        for (size_t k = dimensions_; k < variables.size(); ++k)
+            parameters_.push_back(Expression<T>(variables[k]).eval(context));
+
+        T nodes[RULE_POINTS], kronrod[RULE_POINTS], gauss[RULE_POINTS];
+        for (size_t j = 0; j < RULE_POINTS; ++j) {
+            const size_t i = j < 8 ? j : RULE_POINTS - 1 - j;
+            nodes[j] = T(j < 7 ? -KRONROD_NODES[i] : KRONROD_NODES[i]);
+            kronrod[j] = T(KRONROD_WEIGHTS[i]);
+            gauss[j] = i % 2 ? T(GAUSS_WEIGHTS[i / 2]) : T(0);
+        }
+        size_t points = 1;
+        for (size_t k = 0; k < dimensions_; ++k)
+            points *= RULE_POINTS;
+        nodes_.resize(points * dimensions_);
+        kronrod_.assign(points, T(1));
+        gauss_.assign(points, T(1));
+        for (size_t p = 0; p < points; ++p) {
+            size_t rest = p;
+            for (size_t k = 0; k < dimensions_; ++k, rest /= RULE_POINTS) {
+                nodes_[p * dimensions_ + k] = nodes[rest % RULE_POINTS];
+                kronrod_[p] *= kronrod[rest % RULE_POINTS];
+                gauss_[p] *= gauss[rest % RULE_POINTS];
+            }
+        }
+    }
+
+    size_t points() const { return kronrod_.size(); }
+
+    size_t evaluations() const { return evaluations_; }
+
+    // Значения и погрешности ячеек boxes[begin..): узлы всех ячеек вычисляются одним пакетом.
+    void estimate(std::vector<Box<T> > &boxes, size_t begin) {
+        const size_t points = this->points(), rows = (boxes.size() - begin) * points;
+        std::vector<std::vector<T> > columns(dimensions_ + parameters_.size(), std::vector<T>(rows));
+        for (size_t b = begin; b < boxes.size(); ++b) {
+            const size_t offset = (b - begin) * points;
+            for (size_t k = 0; k < dimensions_; ++k) {
+                const T center = (boxes[b].lower[k] + boxes[b].upper[k]) / T(2);
+                const T half = (boxes[b].upper[k] - boxes[b].lower[k]) / T(2);
+                for (size_t p = 0; p < points; ++p)
+                    columns[k][offset + p] = center + half * nodes_[p * dimensions_ + k];
+            }
+        }
+        for (size_t k = 0; k < parameters_.size(); ++k)
+            std::fill(columns[dimensions_ + k].begin(), columns[dimensions_ + k].end(), parameters_[k]);
+        std::vector<const T *> inputs;
+        for (const auto &column: columns)
+            inputs.push_back(column.data());
+        std::vector<T> values(rows);
+        evalParallel(program_, inputs, values.data(), rows, threads_);
+        evaluations_ += rows;
+
+        for (size_t b = begin; b < boxes.size(); ++b) {
+            const T *f = &values[(b - begin) * points];
+            T k15 = T(0), g7 = T(0);
+            for (size_t p = 0; p < points; ++p) {
+                k15 += kronrod_[p] * f[p];
+                g7 += gauss_[p] * f[p];
+            }
+            T volume = T(1);
+            for (size_t k = 0; k < dimensions_; ++k)
+                volume *= (boxes[b].upper[k] - boxes[b].lower[k]) / T(2);
+            if (!isFinite(k15))
+                throw std::runtime_error("Integrand is not finite in the integration domain");
+            boxes[b].value = k15 * volume;
+            boxes[b].error = std::abs((k15 - g7) * volume);
+        }
+    }
+
+private:
+    Program<T> program_;
+    size_t dimensions_;
+    size_t threads_;
+    std::vector<T> parameters_;
+    std::vector<T> nodes_;
+    std::vector<T> kronrod_;
+    std::vector<T> gauss_;
+    size_t evaluations_ = 0;
+};
+
+} // namespace
+
+template<typename T>
+IntegrationResult<T> integrateBox(const Expression<T> &expr, const std::vector<std::string> &vars,
+                                  const std::vector<T> &lower, const std::vector<T> &upper,
+                                  const std::map<std::string, T> &context, const IntegrateOptions &options) {
+    const size_t dimensions = vars.size();
+    if (dimensions == 0 || dimensions > MAX_INTEGRATION_DIMENSIONS)
+        throw std::runtime_error("Integration needs 1 to " + std::to_string(MAX_INTEGRATION_DIMENSIONS) +
+                                 " variables");
+    if (lower.size() != dimensions || upper.size() != dimensions)
+        throw std::runtime_error("Integration bounds do not match the variables");
+    // Переставленные пределы меняют знак интеграла.
+    Box<T> domain{lower, upper, T(0), T(0)};
+    T sign = T(1);
+    std::vector<T> extent(dimensions);
+    for (size_t k = 0; k < dimensions; ++k) {
+        if (!isFinite(lower[k]) || !isFinite(upper[k]))
+            throw std::runtime_error("Integration bounds must be finite");
+        if (lower[k] > upper[k]) {
+            std::swap(domain.lower[k], domain.upper[k]);
+            sign = -sign;
+        }
+        extent[k] = domain.upper[k] - domain.lower[k];
+    }
+
+    const size_t threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    Cubature<T> cubature(expr, vars, context, threads);
+    std::vector<Box<T> > boxes{domain};
+    cubature.estimate(boxes, 0);
+    const size_t maxSplit = std::max<size_t>(1, MAX_STEP_ROWS / (2 * cubature.points()));
+    for (;;) {
+        T value = T(0), error = T(0);
+        for (const auto &box: boxes) {
+            value += box.value;
+            error += box.error;
+        }
+        // Точность не требуется выше той, что допускает округление в типе T.
+        const T target = std::max({T(options.tolerance), T(options.relativeTolerance) * std::abs(value),
+                                   T(50) * std::numeric_limits<T>::epsilon() * std::abs(value)});
+        if (error <= target)
+            return {sign * value, error, boxes.size(), cubature.evaluations()};
+        if (boxes.size() >= options.maxBoxes)
+            throw std::runtime_error("Integration did not converge in " + std::to_string(options.maxBoxes) +
+                                     " boxes (error estimate " + std::to_string(static_cast<double>(error)) + ")");
+
+        // Делятся ячейки, погрешность которых выше средней допустимой доли, начиная с наибольшей.
+        std::sort(boxes.begin(), boxes.end(), [](const Box<T> &l, const Box<T> &r) { return l.error > r.error; });
+        const T share = target / T(boxes.size());
+        size_t split = 1;
+        while (split < boxes.size() && split < maxSplit && boxes.size() + split < options.maxBoxes &&
+               boxes[split].error > share)
+            ++split;
+        std::vector<Box<T> > children;
+        for (size_t i = 0; i < split; ++i) {
+            const Box<T> &box = boxes[i];
+            size_t axis = 0;
+            for (size_t k = 1; k < dimensions; ++k) {
+                if ((box.upper[k] - box.lower[k]) / extent[k] > (box.upper[axis] - box.lower[axis]) / extent[axis])
+                    axis = k;
+            }
+            const T middle = (box.lower[axis] + box.upper[axis]) / T(2);
+            children.push_back(box);
+            children.back().upper[axis] = middle;
+            children.push_back(box);
+            children.back().lower[axis] = middle;
+        }
+        boxes.erase(boxes.begin(), boxes.begin() + split);
+        const size_t first = boxes.size();
+        boxes.insert(boxes.end(), children.begin(), children.end());
+        cubature.estimate(boxes, first);
+    }
+}
+
+template<typename T>
+IntegrationResult<T> integrate(const Expression<T> &expr, const std::string &var, T a, T b,
+                               const std::map<std::string, T> &context, const IntegrateOptions &options) {
+    return integrateBox(expr, {var}, {a}, {b}, context, options);
+}
+
+// ===================================================================
+// Инстанциация шаблонов для вещественных типов: пределы и деление ячеек требуют упорядоченных чисел.
+#define INSTANTIATE_INTEGRATE(T)                                                                                  \
+    template IntegrationResult<T> integrate<T>(const Expression<T> &, const std::string &, T, T,                 \
+                                               const std::map<std::string, T> &, const IntegrateOptions &);       \
+    template IntegrationResult<T> integrateBox<T>(const Expression<T> &, const std::vector<std::string> &,        \
+                                                  const std::vector<T> &, const std::vector<T> &,                 \
+                                                  const std::map<std::string, T> &, const IntegrateOptions &);
+
+INSTANTIATE_INTEGRATE(float)
+INSTANTIATE_INTEGRATE(double)
+INSTANTIATE_INTEGRATE(long double)
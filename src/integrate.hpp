@@ -0,0 +1,50 @@
+#ifndef INTEGRATE_HPP
+#define INTEGRATE_HPP
+
+#include "program.hpp"
+
+struct IntegrateOptions {
+    // Разбиение прекращается, когда оценка погрешности не превосходит max(tolerance, relativeTolerance * |I|).
+    long double tolerance = 1e-10L;
+
+    long double relativeTolerance = 1e-10L;
+
+    // Предельное число ячеек разбиения; при превышении бросается исключение.
+    size_t maxBoxes = 10000;
+
+    // Потоки вычисления узлов; 0 — по числу ядер.
+    size_t threads = 0;
+};
+
+template<typename T>
+struct IntegrationResult {
+    T value;
+    T error;            // оценка абсолютной погрешности
+    size_t boxes;       // ячейки итогового разбиения
+    size_t evaluations; // вычисленные значения подынтегральной функции
+};
+
+// Предельная размерность кубатуры: у ячейки 15^d узлов.
+const size_t MAX_INTEGRATION_DIMENSIONS = 4;
+
+/*
+    Интеграл expr по отрезку [a, b] по переменной var адаптивной квадратурой Гаусса — Кронрода (7, 15).
+    Остальные переменные берутся из context. Погрешность ячейки оценивается как |K15 - G7|;
+    на каждом шаге делятся пополам ячейки с наибольшей погрешностью, а узлы всех новых ячеек
+    вычисляются одним пакетом (Program<T>::evalBatch), разделённым между потоками.
+    Узлы правила лежат внутри ячеек, поэтому особенности на концах (ln x на [0, 1]) допустимы.
+    Бросает исключение при бесконечных пределах, неконечном значении в узле
+    и если за maxBoxes ячеек точность не достигнута.
+*/
+template<typename T>
+IntegrationResult<T> integrate(const Expression<T> &expr, const std::string &var, T a, T b,
+                               const std::map<std::string, T> &context = {}, const IntegrateOptions &options = {});
+
+// Кубатура по прямоугольному параллелепипеду: тензорное произведение правил Гаусса — Кронрода,
+// ячейка делится пополам по самой длинной (относительно исходной области) стороне.
+template<typename T>
+IntegrationResult<T> integrateBox(const Expression<T> &expr, const std::vector<std::string> &vars,
+                                  const std::vector<T> &lower, const std::vector<T> &upper,
+                                  const std::map<std::string, T> &context = {}, const IntegrateOptions &options = {});
+
+#endif // INTEGRATE_HPP
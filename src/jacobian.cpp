@@ -0,0 +1,87 @@
+#include "jacobian.hpp"
+#include <stdexcept>
+
+template<typename T>
+JacobianSystem<T>::JacobianSystem(const std::vector<Expression<T> > &system,
+                                  const std::vector<std::string> &variables, bool withHessian)
+    : rows_(system.size()), cols_(variables.size()) {
+    ProgramBuilder<T> builder;
+    // Переменные дифференцирования регистрируются первыми, чтобы их индексы совпадали с номерами столбцов.
+    for (size_t col = 0; col < cols_; ++col) {
+        if (builder.variableIndex(variables[col]) != col)
+            throw std::runtime_error("Duplicate variable \"" + variables[col] + "\" in Jacobian");
+    }
+
+    std::vector<uint32_t> functions;
+    for (const auto &expr: system)
+        functions.push_back(builder.add(expr));
+    for (uint32_t reg: functions)
+        builder.addOutput(reg);
+
+    std::vector<uint32_t> jacobian;
+    for (size_t row = 0; row < rows_; ++row) {
+        for (uint32_t col: builder.dependencies(functions[row])) {
+            if (col >= cols_)
+                continue;
+            uint32_t reg = builder.derivative(functions[row], col);
+            if (builder.isConstant(reg, T(0)))
+                continue;
+            jacobianPattern_.push_back({row, col});
+            jacobian.push_back(reg);
+        }
+    }
+    for (uint32_t reg: jacobian)
+        builder.addOutput(reg);
+
+    if (withHessian) {
+        std::vector<uint32_t> hessian;
+        for (size_t k = 0; k < jacobianPattern_.size(); ++k) {
+            const JacobianEntry &entry = jacobianPattern_[k];
+            for (uint32_t col: builder.dependencies(jacobian[k])) {
+                if (col < entry.col || col >= cols_)
+                    continue;
+                uint32_t reg = builder.derivative(jacobian[k], col);
+                if (builder.isConstant(reg, T(0)))
+                    continue;
+                hessianPattern_.push_back({entry.row, entry.col, col});
+                hessian.push_back(reg);
+            }
+        }
+        for (uint32_t reg: hessian)
+            builder.addOutput(reg);
+    }
+    program_ = builder.build();
+}
+
+template<typename T>
+void JacobianSystem<T>::evaluate(const std::vector<T> &inputs, std::vector<T> &values, std::vector<T> &jacobian,
+                                 std::vector<T> &hessian) const {
+    if (inputs.size() != program_.variables().size())
+        throw std::runtime_error("Wrong number of inputs");
+    std::vector<T> registers(program_.size());
+    std::vector<T> outputs(program_.outputs().size());
+    program_.eval(inputs.data(), registers.data(), outputs.data());
+    auto it = outputs.begin();
+    values.assign(it, it + rows_);
+    it += rows_;
+    jacobian.assign(it, it + jacobianPattern_.size());
+    it += jacobianPattern_.size();
+    hessian.assign(it, outputs.end());
+}
+
+template<typename T>
+void JacobianSystem<T>::evaluateDense(const std::map<std::string, T> &context, std::vector<T> &values,
+                                      std::vector<T> &jacobian) const {
+    std::vector<T> outputs = program_.eval(context);
+    values.assign(outputs.begin(), outputs.begin() + rows_);
+    jacobian.assign(rows_ * cols_, T(0));
+    for (size_t k = 0; k < jacobianPattern_.size(); ++k)
+        jacobian[jacobianPattern_[k].row * cols_ + jacobianPattern_[k].col] = outputs[rows_ + k];
+}
+
+// ===================================================================
+// Инстанциация шаблонов для всех числовых типов
+#define INSTANTIATE_JACOBIAN(T) \
+    template class JacobianSystem<T>;
+
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE_JACOBIAN)
@@ -0,0 +1,66 @@
+#ifndef JACOBIAN_HPP
+#define JACOBIAN_HPP
+
+#include "program.hpp"
+
+// Ненулевой элемент матрицы Якоби: d f_row / d x_col.
+struct JacobianEntry {
+    size_t row;
+    size_t col;
+};
+
+// Ненулевой элемент гессиана функции f_function: d^2 f / (d x_row d x_col), row <= col.
+struct HessianEntry {
+    size_t function;
+    size_t row;
+    size_t col;
+};
+
+/*
+    Система выражений вместе с матрицей Якоби (и, при необходимости, гессианами),
+    скомпилированная в одну программу.
+    Структурные нули определяются заранее по зависимостям от переменных и в программу не попадают;
+    общие подвыражения разделяются между значениями функций и всеми производными.
+*/
+template<typename T>
+class JacobianSystem {
+public:
+    JacobianSystem(const std::vector<Expression<T> > &system, const std::vector<std::string> &variables,
+                   bool withHessian = false);
+
+    size_t rows() const { return rows_; }
+
+    size_t cols() const { return cols_; }
+
+    // Разреженная структура матрицы Якоби (в порядке строк).
+    const std::vector<JacobianEntry> &jacobianPattern() const { return jacobianPattern_; }
+
+    // Разреженная структура гессианов (только верхние треугольники).
+    const std::vector<HessianEntry> &hessianPattern() const { return hessianPattern_; }
+
+    // Общая программа: выходы — значения функций, затем элементы jacobianPattern(), затем hessianPattern().
+    const Program<T> &program() const { return program_; }
+
+    // Имена входов программы: сначала переменные дифференцирования,
+    // затем прочие переменные (параметры), встретившиеся в системе.
+    const std::vector<std::string> &inputs() const { return program_.variables(); }
+
+    // Вычисление в точке. inputs — значения в порядке inputs().
+    // values получает значения функций, jacobian и hessian — значения ненулевых элементов
+    // в порядке соответствующих структур (hessian заполняется, только если он был построен).
+    void evaluate(const std::vector<T> &inputs, std::vector<T> &values, std::vector<T> &jacobian,
+                  std::vector<T> &hessian) const;
+
+    // Вычисление с контекстом переменных; матрица Якоби возвращается в плотном виде (rows x cols, по строкам).
+    void evaluateDense(const std::map<std::string, T> &context, std::vector<T> &values,
+                       std::vector<T> &jacobian) const;
+
+private:
+    size_t rows_;
+    size_t cols_;
+    std::vector<JacobianEntry> jacobianPattern_;
+    std::vector<HessianEntry> hessianPattern_;
+    Program<T> program_;
+};
+
+#endif // JACOBIAN_HPP
@@ -0,0 +1,208 @@
+#include "lazy.hpp"
+#include "reduction.hpp"
+#include "traversal.hpp"
+#include <unordered_map>
+
+// Ленивые производные одной цепочки вызовов по паре (узел, переменная).
+// Узлы хранятся слабыми ссылками: ленивая производная сама держит кэш.
+template<typename T>
+class LazyDerivativeCache {
+public:
+    // Ленивая производная expr по var; повторный запрос возвращает тот же узел с его раскрытием.
+    static Expression<T> get(const std::shared_ptr<LazyDerivativeCache> &cache, const Expression<T> &expr,
+                             const std::string &var) {
+        std::lock_guard<std::mutex> lock(cache->mutex_);
+        std::weak_ptr<ExpressionImpl<T> > &slot = cache->nodes_[{expr.node(), var}];
+        if (std::shared_ptr<ExpressionImpl<T> > node = slot.lock())
+            return Expression<T>(node);
+        std::shared_ptr<ExpressionImpl<T> > node = std::make_shared<LazyDerivative<T> >(expr, var, cache);
+        slot = node;
+        return Expression<T>(node);
+    }
+
+private:
+    std::mutex mutex_;
+    std::map<std::pair<const ExpressionImpl<T> *, std::string>, std::weak_ptr<ExpressionImpl<T> > > nodes_;
+};
+
+template<typename T>
+static const LazyDerivative<T> *asLazy(const Expression<T> &expr) {
+    return dynamic_cast<const LazyDerivative<T> *>(expr.node());
+}
+
+// У листьев производная — константа или многочлен: она строится сразу, без ленивого узла.
+template<typename T>
+static Expression<T> lazyChild(const Expression<T> &expr, const std::string &var,
+                               const std::shared_ptr<LazyDerivativeCache<T> > &cache) {
+    if (expr.node()->childCount() == 0 && !asLazy(expr))
+        return expr.differentiate(var);
+    return LazyDerivativeCache<T>::get(cache, expr, var);
+}
+
+// ===================================================================
+
+template<typename T>
+LazyDerivative<T>::LazyDerivative(const Expression<T> &expr, const std::string &var,
+                                  const std::shared_ptr<LazyDerivativeCache<T> > &cache)
+    : expr_(expr), var_(var), cache_(cache), base_(expr) {
+    // Производные подряд по одной переменной сворачиваются в порядок: f'' — это (f, 2), а не ((f)')'.
+    const LazyDerivative<T> *inner = asLazy(expr);
+    if (inner && inner->var_ == var_) {
+        base_ = inner->base_;
+        order_ = inner->order_ + 1;
+    }
+}
+
+template<typename T>
+const Expression<T> &LazyDerivative<T>::expansion() const {
+    std::call_once(expanded_, [this] {
+        Expression<T> target = expr_;
+        while (const LazyDerivative<T> *inner = asLazy(target))
+            target = inner->expansion();
+        const ExpressionImpl<T> *node = target.node();
+        // Высокие деревья дифференцируются сразу обходом с явным стеком; редукции — тоже сразу,
+        // потому что нулевые производные аргументов они отбрасывают только в готовом виде.
+        if (node->childCount() == 0 || node->height() > RECURSION_LIMIT || dynamic_cast<const Reduction<T> *>(node)) {
+            expansion_ = target.differentiate(var_);
+            return;
+        }
+        std::vector<Expression<T> > derivatives;
+        for (size_t i = 0; i < node->childCount(); ++i)
+            derivatives.push_back(lazyChild(node->child(i), var_, cache_));
+        expansion_ = node->derivativeFrom(derivatives.data(), var_);
+    });
+    return *expansion_;
+}
+
+template<typename T>
+const Expression<T> &LazyDerivative<T>::materialized() const {
+    std::call_once(materializedFlag_, [this] { materialized_ = materialize(expansion()); });
+    return *materialized_;
+}
+
+template<typename T>
+std::vector<T> LazyDerivative<T>::shiftedTaylor(const std::map<std::string, T> &context, size_t order) const {
+    // f^(n)(x0 + h) = sum_k c_(n+k) * (n+k)! / k! * h^k.
+    const std::vector<T> series = base_.taylor(var_, context, order_ + order);
+    std::vector<T> result(order + 1);
+    for (size_t k = 0; k <= order; ++k) {
+        T factor = T(1);
+        for (size_t j = 1; j <= order_; ++j)
+            factor *= T(k + j);
+        result[k] = series[k + order_] * factor;
+    }
+    return result;
+}
+
+template<typename T>
+T LazyDerivative<T>::eval(const std::map<std::string, T> &context) const {
+    // Jet и ряды Тейлора рекурсивны, поэтому высокие деревья вычисляются по готовой производной.
+    if (base_.node()->height() > RECURSION_LIMIT)
+        return expansion().eval(context);
+    if (order_ <= 2) {
+        const Jet<T> jet = base_.evalJet(var_, context);
+        return order_ == 1 ? jet.first : jet.second;
+    }
+    return shiftedTaylor(context, 0)[0];
+}
+
+template<typename T>
+std::string LazyDerivative<T>::to_string() const {
+    return expansion().to_string();
+}
+
+template<typename T>
+Expression<T> LazyDerivative<T>::derivative(const std::string &var) const {
+    auto self = std::const_pointer_cast<LazyDerivative<T> >(this->shared_from_this());
+    return LazyDerivativeCache<T>::get(cache_, Expression<T>(std::shared_ptr<ExpressionImpl<T> >(self)), var);
+}
+
+template<typename T>
+Expression<T> LazyDerivative<T>::substitute(const std::string &var, const Expression<T> &expr) const {
+    return materialized().substitute(var, expr);
+}
+
+template<typename T>
+std::vector<T> LazyDerivative<T>::taylor(const std::map<std::string, T> &context, const std::string &var,
+                                         size_t order) const {
+    if (var == var_ && base_.node()->height() <= RECURSION_LIMIT)
+        return shiftedTaylor(context, order);
+    return expansion().taylor(var, context, order);
+}
+
+template<typename T>
+Jet<T> LazyDerivative<T>::evalJet(const std::map<std::string, T> &context, const std::string &var) const {
+    if (var == var_ && base_.node()->height() <= RECURSION_LIMIT) {
+        const std::vector<T> series = shiftedTaylor(context, 2);
+        return {series[0], series[1], T(2) * series[2]};
+    }
+    return expansion().evalJet(var, context);
+}
+
+template<typename T>
+uint32_t LazyDerivative<T>::compile(ProgramBuilder<T> &builder) const {
+    return materialized().compile(builder);
+}
+
+template<typename T>
+Expression<T> LazyDerivative<T>::mapChildren(const std::function<Expression<T>(const Expression<T> &)> &) const {
+    auto self = std::const_pointer_cast<LazyDerivative<T> >(this->shared_from_this());
+    return Expression<T>(std::shared_ptr<ExpressionImpl<T> >(self));
+}
+
+template<typename T>
+std::shared_ptr<ExpressionImpl<T> > LazyDerivative<T>::clone() const {
+    return std::make_shared<LazyDerivative<T> >(expr_, var_, cache_);
+}
+
+template<typename T>
+void LazyDerivative<T>::accept(ExpressionVisitor<T> &visitor) const {
+    visitor.visit(*this);
+}
+
+// ===================================================================
+
+template<typename T>
+Expression<T> lazyDerivative(const Expression<T> &expr, const std::string &var) {
+    if (const LazyDerivative<T> *lazy = asLazy(expr))
+        return lazy->derivative(var);
+    return lazyChild(expr, var, std::make_shared<LazyDerivativeCache<T> >());
+}
+
+template<typename T>
+Expression<T> materialize(const Expression<T> &expr) {
+    // Обход с явным стеком; узлы без ленивых производных в поддереве остаются теми же объектами.
+    std::unordered_map<const ExpressionImpl<T> *, Expression<T> > done;
+    std::vector<std::pair<const Expression<T> *, bool> > stack{{&expr, false}};
+    while (!stack.empty()) {
+        auto [current, expanded] = stack.back();
+        stack.pop_back();
+        const ExpressionImpl<T> *node = current->node();
+        if (done.count(node))
+            continue;
+        if (const LazyDerivative<T> *lazy = asLazy(*current)) {
+            done.emplace(node, lazy->materialized());
+        } else if (!expanded) {
+            stack.push_back({current, true});
+            for (size_t i = node->childCount(); i-- > 0;)
+                stack.push_back({&node->child(i), false});
+        } else {
+            bool changed = false;
+            for (size_t i = 0; i < node->childCount(); ++i)
+                changed = changed || done.at(node->child(i).node()).node() != node->child(i).node();
+            done.emplace(node, changed ? node->mapChildren([&done](const Expression<T> &child) {
+                return done.at(child.node());
+            }) : *current);
+        }
+    }
+    return done.at(expr.node());
+}
+
+// ===================================================================
+// Инстанциация шаблонов для всех числовых типов
+#define INSTANTIATE_LAZY(T)                                                                \
+    template class LazyDerivative<T>;                                                      \
+    template Expression<T> lazyDerivative<T>(const Expression<T> &, const std::string &);  \
+    template Expression<T> materialize<T>(const Expression<T> &);
+
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE_LAZY)
@@ -0,0 +1,91 @@
+#ifndef LAZY_HPP
+#define LAZY_HPP
+
+#include "expression.hpp"
+#include <memory>
+#include <mutex>
+#include <optional>
+
+/*
+    Ленивое символьное дифференцирование.
+
+    lazyDerivative(f, x) возвращает лист, который хранит только пару (f, x). Дерево производной
+    строится по уровням и только когда оно нужно (запись, подстановка, компиляция, оптимизация):
+    производная узла раскрывается через derivativeFrom в операцию над ленивыми производными
+    его потомков, и каждая такая производная раскрывается сама при обращении к ней.
+    Раскрытия запоминаются, а ленивые производные одной цепочки вызовов хранятся в общем кэше
+    по паре (узел, переменная), поэтому разделяемое поддерево раскрывается один раз.
+
+    Значение вычисляется без построения дерева: производные порядка n по одной переменной
+    (вложенные lazyDerivative по x) берутся из Jet или ряда Тейлора исходного выражения.
+    Производная по другой переменной раскрывает внутреннюю производную на нужную глубину,
+    не строя её целиком. Запись совпадает с записью Expression<T>::differentiate.
+*/
+
+template<typename T>
+class LazyDerivativeCache;
+
+template<typename T>
+class LazyDerivative : public ExpressionImpl<T>, public std::enable_shared_from_this<LazyDerivative<T> > {
+public:
+    LazyDerivative(const Expression<T> &expr, const std::string &var,
+                   const std::shared_ptr<LazyDerivativeCache<T> > &cache);
+
+    T eval(const std::map<std::string, T> &context) const override;
+
+    std::string to_string() const override;
+
+    Expression<T> derivative(const std::string &var) const override;
+
+    Expression<T> substitute(const std::string &var, const Expression<T> &expr) const override;
+
+    std::vector<T> taylor(const std::map<std::string, T> &context, const std::string &var,
+                          size_t order) const override;
+
+    Jet<T> evalJet(const std::map<std::string, T> &context, const std::string &var) const override;
+
+    uint32_t compile(ProgramBuilder<T> &builder) const override;
+
+    Expression<T> mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const override;
+
+    std::shared_ptr<ExpressionImpl<T> > clone() const override;
+
+    void accept(ExpressionVisitor<T> &visitor) const override;
+
+    const Expression<T> &expression() const { return expr_; }
+
+    const std::string &variable() const { return var_; }
+
+    // Производная, раскрытая на один уровень: потомки в ней — снова ленивые производные.
+    const Expression<T> &expansion() const;
+
+    // Производная без ленивых узлов.
+    const Expression<T> &materialized() const;
+
+private:
+    // Ряд Тейлора производной порядка order_ по var_, полученный сдвигом ряда base_.
+    std::vector<T> shiftedTaylor(const std::map<std::string, T> &context, size_t order) const;
+
+    Expression<T> expr_;
+    std::string var_;
+    std::shared_ptr<LazyDerivativeCache<T> > cache_;
+
+    // base_ продифференцировано order_ раз по var_.
+    Expression<T> base_;
+    size_t order_ = 1;
+
+    mutable std::once_flag expanded_;
+    mutable std::optional<Expression<T> > expansion_;
+    mutable std::once_flag materializedFlag_;
+    mutable std::optional<Expression<T> > materialized_;
+};
+
+// Ленивая производная expr по var; производные ленивых производных используют их кэш.
+template<typename T>
+Expression<T> lazyDerivative(const Expression<T> &expr, const std::string &var);
+
+// Замена всех ленивых производных в expr их деревьями.
+template<typename T>
+Expression<T> materialize(const Expression<T> &expr);
+
+#endif // LAZY_HPP
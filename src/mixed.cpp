@@ -0,0 +1,48 @@
+#include "mixed.hpp"
+#include <algorithm>
+#include <cmath>
+
+MixedProgram::MixedProgram(const Program<long double> &program, double tolerance)
+    : fast_(program.converted<double>()), precise_(program), tolerance_(tolerance) {
+}
+
+size_t MixedProgram::evalBatch(const double *const *inputs, double *const *outputs, size_t rows,
+                               ErrorPolicy policy, std::vector<bool> *fallback) const {
+    const size_t variables = fast_.variables().size();
+    const size_t results = fast_.outputs().size();
+    if (fallback)
+        fallback->assign(rows, false);
+    std::vector<double> bounds(results * CHUNK);
+    std::vector<double *> boundColumns(results);
+    std::vector<const double *> in(variables);
+    std::vector<double *> out(results);
+    std::vector<long double> preciseInputs(variables), registers(precise_.size()), preciseOutputs(results);
+    ErrorPolicyScope scope(policy);
+    size_t recomputed = 0;
+    for (size_t start = 0; start < rows; start += CHUNK) {
+        const size_t n = std::min(CHUNK, rows - start);
+        for (size_t v = 0; v < variables; ++v)
+            in[v] = inputs[v] + start;
+        for (size_t k = 0; k < results; ++k) {
+            out[k] = outputs[k] + start;
+            boundColumns[k] = &bounds[k * CHUNK];
+        }
+        fast_.evalBatchBounded(in.data(), out.data(), boundColumns.data(), n);
+        for (size_t j = 0; j < n; ++j) {
+            bool accurate = true;
+            for (size_t k = 0; k < results && accurate; ++k)
+                accurate = boundColumns[k][j] <= tolerance_ * std::abs(out[k][j]);
+            if (accurate)
+                continue;
+            for (size_t v = 0; v < variables; ++v)
+                preciseInputs[v] = in[v][j];
+            precise_.eval(preciseInputs.data(), registers.data(), preciseOutputs.data());
+            for (size_t k = 0; k < results; ++k)
+                out[k][j] = static_cast<double>(preciseOutputs[k]);
+            if (fallback)
+                (*fallback)[start + j] = true;
+            ++recomputed;
+        }
+    }
+    return recomputed;
+}
@@ -0,0 +1,38 @@
+#ifndef MIXED_HPP
+#define MIXED_HPP
+
+#include "program.hpp"
+
+/*
+    Вычисление смешанной точности.
+    Программа выполняется в double вместе с оценкой погрешности (Program<T>::evalBatchBounded).
+    Строки, у которых оценка относительной погрешности какого-либо выхода превышает tolerance,
+    пересчитываются в long double. Так большинство строк идёт со скоростью double,
+    а строки с сильным взаимным уничтожением (a - b при a ≈ b и т. п.) получают точность long double.
+*/
+class MixedProgram {
+public:
+    MixedProgram(const Program<long double> &program, double tolerance);
+
+    // Пакетное вычисление в формате Program<T>::evalBatch; возвращает число строк, пересчитанных в long double.
+    // Если задан fallback, (*fallback)[row] отмечает пересчитанные строки.
+    // Ошибки в точке при пересчёте обрабатываются по политике policy.
+    size_t evalBatch(const double *const *inputs, double *const *outputs, size_t rows,
+                     ErrorPolicy policy = ErrorPolicy::Throw, std::vector<bool> *fallback = nullptr) const;
+
+    const Program<double> &fast() const { return fast_; }
+
+    const Program<long double> &precise() const { return precise_; }
+
+    double tolerance() const { return tolerance_; }
+
+private:
+    // Число строк, обрабатываемых за один проход: ограничивает размер буфера оценок.
+    static const size_t CHUNK = 4096;
+
+    Program<double> fast_;
+    Program<long double> precise_;
+    double tolerance_;
+};
+
+#endif // MIXED_HPP
@@ -0,0 +1,16 @@
+#ifndef NUMERIC_HPP
+#define NUMERIC_HPP
+
+#include <complex>
+
+// Вызов MACRO для каждого числового типа, для которого инстанцируются шаблоны библиотеки.
+// __float128 не входит в список: стандартная библиотека не даёт для него std::sin, std::exp и т. п.
+#define FOR_EACH_NUMERIC_TYPE(MACRO) \
+    MACRO(float)                     \
+    MACRO(double)                    \
+    MACRO(long double)               \
+    MACRO(std::complex<float>)       \
+    MACRO(std::complex<double>)      \
+    MACRO(std::complex<long double>)
+
+#endif // NUMERIC_HPP
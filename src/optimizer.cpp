@@ -0,0 +1,387 @@
+#include "optimizer.hpp"
+#include "polynomial.hpp"
+#include "functions.hpp"
+#include "reduction.hpp"
+#include "lazy.hpp"
+#include "traversal.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <type_traits>
+
+/*
+    Оценка стоимости узлов в условных тактах: порядок величин для скалярного кода
+    на современных процессорах. Константы и переменные ничего не стоят.
+*/
+static const double COST_ADD = 1;
+static const double COST_MUL = 1;
+static const double COST_DIV = 10;
+static const double COST_POW = 40;
+static const double COST_FUNCTION = 20;
+static const double COST_CALL = 25;
+
+// Посетитель, собирающий ExpressionStats; обходит потомков рекурсивно.
+template<typename T>
+class StatsVisitor : public ExpressionVisitor<T> {
+public:
+    ExpressionStats stats;
+
+    // Обход поддерева; возвращает стоимость его критического пути.
+    double measure(const Expression<T> &expr) {
+        expr.getImpl()->accept(*this);
+        return path_;
+    }
+
+    void visit(const Value<T> &) override { count(0, 0); }
+
+    void visit(const Variable<T> &) override { count(0, 0); }
+
+    void visit(const OperationAdd<T> &node) override { binary(node, COST_ADD); }
+
+    void visit(const OperationSub<T> &node) override { binary(node, COST_ADD); }
+
+    void visit(const OperationMul<T> &node) override { binary(node, COST_MUL); }
+
+    void visit(const OperationDiv<T> &node) override { binary(node, COST_DIV); }
+
+    void visit(const OperationPow<T> &node) override { binary(node, COST_POW); }
+
+    void visit(const Comparison<T> &node) override { binary(node, COST_ADD); }
+
+    // В пакетном вычислении считаются обе ветви, поэтому учитываются все три потомка.
+    void visit(const Select<T> &node) override {
+        double path = measure(node.condition());
+        path = std::max(path, measure(node.ifTrue()));
+        path = std::max(path, measure(node.ifFalse()));
+        count(COST_ADD, path);
+    }
+
+    // Двоичное возведение: по умножению на каждый бит показателя и на каждую единицу в нём.
+    void visit(const OperationIntPow<T> &node) override {
+        unsigned long n = static_cast<unsigned long>(std::abs(node.exponent()));
+        double multiplications = 0;
+        for (; n > 1; n >>= 1)
+            multiplications += (n & 1) ? 2 : 1;
+        count(multiplications * COST_MUL + (node.exponent() < 0 ? COST_DIV : 0), measure(node.base()));
+    }
+
+    void visit(const FunctionSin<T> &node) override { count(COST_FUNCTION, measure(node.argument())); }
+
+    void visit(const FunctionCos<T> &node) override { count(COST_FUNCTION, measure(node.argument())); }
+
+    void visit(const FunctionLn<T> &node) override { count(COST_FUNCTION, measure(node.argument())); }
+
+    void visit(const FunctionExp<T> &node) override { count(COST_FUNCTION, measure(node.argument())); }
+
+    // Схема Горнера: умножение и сложение на каждый одночлен.
+    void visit(const PolynomialNode<T> &node) override {
+        double terms = static_cast<double>(node.polynomial().size());
+        count(terms * (COST_MUL + COST_ADD), terms * (COST_MUL + COST_ADD));
+    }
+
+    void visit(const FunctionCall<T> &node) override {
+        double path = 0;
+        for (const auto &arg: node.arguments())
+            path = std::max(path, measure(arg));
+        count(COST_CALL, path);
+    }
+
+    // Длина массивов до вычисления неизвестна: учитывается один элемент.
+    void visit(const Reduction<T> &node) override {
+        double path = 0;
+        for (const auto &arg: node.arguments())
+            path = std::max(path, measure(arg));
+        count(COST_ADD, path);
+    }
+
+private:
+    void count(double cost, double childPath) {
+        ++stats.nodes;
+        stats.cost += cost;
+        path_ = childPath + cost;
+        stats.critical = std::max(stats.critical, path_);
+    }
+
+    void binary(const BinaryOperation<T> &node, double cost) {
+        double left = measure(node.left());
+        double right = measure(node.right());
+        count(cost, std::max(left, right));
+    }
+
+    double path_ = 0;
+};
+
+template<typename T>
+ExpressionStats expressionStats(const Expression<T> &expr) {
+    StatsVisitor<T> visitor;
+    visitor.measure(expr);
+    return visitor.stats;
+}
+
+// Посетитель, проверяющий, что все непосредственные потомки узла — константы.
+// Для листьев ответ отрицательный: константу сворачивать незачем, переменную нельзя.
+template<typename T>
+class ConstantChildren : public ExpressionVisitor<T> {
+public:
+    bool result = false;
+
+    void visit(const OperationAdd<T> &node) override { binary(node); }
+
+    void visit(const OperationSub<T> &node) override { binary(node); }
+
+    void visit(const OperationMul<T> &node) override { binary(node); }
+
+    void visit(const OperationDiv<T> &node) override { binary(node); }
+
+    void visit(const OperationPow<T> &node) override { binary(node); }
+
+    void visit(const Comparison<T> &node) override { binary(node); }
+
+    void visit(const OperationIntPow<T> &node) override { result = isValue(node.base()); }
+
+    void visit(const FunctionSin<T> &node) override { result = isValue(node.argument()); }
+
+    void visit(const FunctionCos<T> &node) override { result = isValue(node.argument()); }
+
+    void visit(const FunctionLn<T> &node) override { result = isValue(node.argument()); }
+
+    void visit(const FunctionExp<T> &node) override { result = isValue(node.argument()); }
+
+    void visit(const FunctionCall<T> &node) override {
+        result = std::all_of(node.arguments().begin(), node.arguments().end(),
+                             [](const Expression<T> &arg) { return isValue(arg); });
+    }
+
+private:
+    static bool isValue(const Expression<T> &expr) {
+        return dynamic_cast<const Value<T> *>(expr.getImpl().get()) != nullptr;
+    }
+
+    void binary(const BinaryOperation<T> &node) { result = isValue(node.left()) && isValue(node.right()); }
+};
+
+// Значение константного узла; false, если узел не является константой.
+template<typename T>
+static bool constantValue(const Expression<T> &expr, T &value) {
+    auto node = dynamic_cast<const Value<T> *>(expr.getImpl().get());
+    if (!node)
+        return false;
+    value = node->value();
+    return true;
+}
+
+template<typename T>
+static bool isConstant(const Expression<T> &expr, T expected) {
+    T value;
+    return constantValue(expr, value) && value == expected;
+}
+
+template<typename T>
+Expression<T> RewritePass<T>::run(const Expression<T> &expr) {
+    return rewriteNode(expr.getImpl()->mapChildren([this](const Expression<T> &child) { return run(child); }));
+}
+
+// ===================================================================
+
+template<typename T>
+Expression<T> StrengthReduction<T>::rewriteNode(const Expression<T> &node) {
+    const ExpressionImpl<T> *impl = node.getImpl().get();
+    if (auto div = dynamic_cast<const OperationDiv<T> *>(impl)) {
+        T divisor;
+        if (constantValue(div->right(), divisor) && divisor != T(0) && isFinite(T(1) / divisor))
+            return div->left() * Expression<T>(T(1) / divisor);
+    } else if (auto mul = dynamic_cast<const OperationMul<T> *>(impl)) {
+        auto left = dynamic_cast<const FunctionExp<T> *>(mul->left().getImpl().get());
+        auto right = dynamic_cast<const FunctionExp<T> *>(mul->right().getImpl().get());
+        if (left && right)
+            return exp(left->argument() + right->argument());
+    } else if (auto log = dynamic_cast<const FunctionLn<T> *>(impl)) {
+        // Для комплексных чисел ln(exp(z)) = z только при мнимой части z в (-pi, pi].
+        if constexpr (std::is_floating_point_v<T>) {
+            if (auto inner = dynamic_cast<const FunctionExp<T> *>(log->argument().getImpl().get()))
+                return inner->argument();
+        }
+    }
+    return node;
+}
+
+// ===================================================================
+
+// Операнды максимальной цепочки операций класса Op с корнем в expr.
+template<typename T, typename Op>
+static void chainOperands(const Expression<T> &expr, std::vector<Expression<T> > &operands) {
+    if (auto op = dynamic_cast<const Op *>(expr.getImpl().get())) {
+        chainOperands<T, Op>(op->left(), operands);
+        chainOperands<T, Op>(op->right(), operands);
+    } else {
+        operands.push_back(expr);
+    }
+}
+
+// Сбалансированное дерево из operands[begin, end) с сохранением порядка операндов.
+template<typename T, typename Op>
+static Expression<T> balancedTree(const std::vector<Expression<T> > &operands, size_t begin, size_t end) {
+    if (end - begin == 1)
+        return operands[begin];
+    size_t middle = begin + (end - begin) / 2;
+    return Expression<T>(std::make_shared<Op>(balancedTree<T, Op>(operands, begin, middle),
+                                              balancedTree<T, Op>(operands, middle, end)));
+}
+
+template<typename T, typename Op>
+static bool rebalance(const Expression<T> &node, const std::function<Expression<T>(const Expression<T> &)> &run,
+                      Expression<T> &result) {
+    if (!dynamic_cast<const Op *>(node.getImpl().get()))
+        return false;
+    std::vector<Expression<T> > operands;
+    chainOperands<T, Op>(node, operands);
+    for (auto &operand: operands)
+        operand = run(operand);
+    result = balancedTree<T, Op>(operands, 0, operands.size());
+    return true;
+}
+
+template<typename T>
+Expression<T> Reassociation<T>::rewriteNode(const Expression<T> &node) {
+    // Цепочка разбирается целиком от своего корня, поэтому проход идёт сверху вниз,
+    // а не через RewritePass::run: иначе каждый уровень цепочки разбирался бы заново.
+    auto run = [this](const Expression<T> &child) { return rewriteNode(child); };
+    Expression<T> result = node;
+    if (rebalance<T, OperationAdd<T> >(node, run, result) || rebalance<T, OperationMul<T> >(node, run, result))
+        return result;
+    return node.getImpl()->mapChildren(run);
+}
+
+template<typename T>
+Expression<T> Reassociation<T>::run(const Expression<T> &expr) {
+    return rewriteNode(expr);
+}
+
+// ===================================================================
+
+template<typename T>
+Expression<T> DeadNodeRemoval<T>::rewriteNode(const Expression<T> &node) {
+    const ExpressionImpl<T> *impl = node.getImpl().get();
+    ConstantChildren<T> constant;
+    impl->accept(constant);
+    if (constant.result) {
+        T value = node.eval({}, ErrorPolicy::Propagate);
+        if (isFinite(value))
+            return Expression<T>(value);
+        return node;
+    }
+    if (auto add = dynamic_cast<const OperationAdd<T> *>(impl)) {
+        if (isConstant(add->right(), T(0)))
+            return add->left();
+        if (isConstant(add->left(), T(0)))
+            return add->right();
+    } else if (auto sub = dynamic_cast<const OperationSub<T> *>(impl)) {
+        if (isConstant(sub->right(), T(0)))
+            return sub->left();
+    } else if (auto mul = dynamic_cast<const OperationMul<T> *>(impl)) {
+        if (isConstant(mul->right(), T(1)))
+            return mul->left();
+        if (isConstant(mul->left(), T(1)))
+            return mul->right();
+    } else if (auto div = dynamic_cast<const OperationDiv<T> *>(impl)) {
+        if (isConstant(div->right(), T(1)))
+            return div->left();
+    } else if (auto power = dynamic_cast<const OperationIntPow<T> *>(impl)) {
+        if (power->exponent() == 1)
+            return power->base();
+    } else if (auto choice = dynamic_cast<const Select<T> *>(impl)) {
+        T condition;
+        if (constantValue(choice->condition(), condition))
+            return condition != T(0) ? choice->ifTrue() : choice->ifFalse();
+    }
+    return node;
+}
+
+// ===================================================================
+
+template<typename T>
+Expression<T> ZeroAbsorption<T>::rewriteNode(const Expression<T> &node) {
+    const ExpressionImpl<T> *impl = node.getImpl().get();
+    if (auto mul = dynamic_cast<const OperationMul<T> *>(impl)) {
+        if (isConstant(mul->left(), T(0)) || isConstant(mul->right(), T(0)))
+            return Expression<T>(T(0));
+    } else if (auto div = dynamic_cast<const OperationDiv<T> *>(impl)) {
+        if (isConstant(div->left(), T(0)))
+            return Expression<T>(T(0));
+    } else if (auto power = dynamic_cast<const OperationIntPow<T> *>(impl)) {
+        if (power->exponent() == 0)
+            return Expression<T>(T(1));
+    }
+    return node;
+}
+
+// ===================================================================
+
+template<typename T>
+PassManager<T> &PassManager<T>::add(std::unique_ptr<OptimizerPass<T> > pass) {
+    passes_.push_back(std::move(pass));
+    return *this;
+}
+
+template<typename T>
+Expression<T> PassManager<T>::run(const Expression<T> &expr) {
+    requireShallow(expr, "optimize");
+    reports_.clear();
+    Expression<T> current = materialize(expr);
+    ExpressionStats stats = expressionStats(current);
+    for (const auto &pass: passes_) {
+        PassReport report;
+        report.pass = pass->name();
+        report.before = stats;
+        current = pass->run(current);
+        stats = expressionStats(current);
+        report.after = stats;
+        reports_.push_back(report);
+    }
+    return current;
+}
+
+template<typename T>
+std::string PassManager<T>::summary() const {
+    std::string out;
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-20s %16s %20s %20s\n", "pass", "nodes", "cost", "critical");
+    out += line;
+    for (const auto &report: reports_) {
+        std::snprintf(line, sizeof(line), "%-20s %7zu -> %-6zu %8.0f -> %-8.0f %8.0f -> %-8.0f\n",
+                      report.pass.c_str(), report.before.nodes, report.after.nodes,
+                      report.before.cost, report.after.cost, report.before.critical, report.after.critical);
+        out += line;
+    }
+    return out;
+}
+
+template<typename T>
+PassManager<T> defaultPipeline() {
+    PassManager<T> manager;
+    manager.add(std::make_unique<DeadNodeRemoval<T> >())
+            .add(std::make_unique<StrengthReduction<T> >())
+            .add(std::make_unique<DeadNodeRemoval<T> >())
+            .add(std::make_unique<Reassociation<T> >());
+    return manager;
+}
+
+template<typename T>
+Expression<T> optimize(const Expression<T> &expr) {
+    return defaultPipeline<T>().run(expr);
+}
+
+// ===================================================================
+// Инстанциация шаблонов для всех числовых типов
+#define INSTANTIATE_OPTIMIZER(T)                                            \
+    template ExpressionStats expressionStats<T>(const Expression<T> &);     \
+    template class RewritePass<T>;                                          \
+    template class StrengthReduction<T>;                                    \
+    template class Reassociation<T>;                                        \
+    template class DeadNodeRemoval<T>;                                      \
+    template class ZeroAbsorption<T>;                                       \
+    template class PassManager<T>;                                          \
+    template PassManager<T> defaultPipeline<T>();                           \
+    template Expression<T> optimize<T>(const Expression<T> &);
+
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE_OPTIMIZER)
@@ -0,0 +1,132 @@
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+#include "expression.hpp"
+
+/*
+    Оптимизация дерева выражения конвейером проходов переписывания.
+    Каждый проход получает дерево и возвращает новое, эквивалентное ему; исходное дерево не меняется.
+    PassManager выполняет проходы по порядку и для каждого записывает размер и оценку стоимости
+    дерева до и после прохода.
+
+    Проходы меняют порядок операций с плавающей точкой, поэтому результат может отличаться
+    от исходного в последних битах (x / c и x * (1 / c), (a + b) + c и a + (b + c)).
+*/
+
+// Размер и оценка стоимости вычисления дерева.
+struct ExpressionStats {
+    size_t nodes = 0;
+    double cost = 0;     // суммарная стоимость операций в условных тактах
+    double critical = 0; // стоимость самого дорогого пути от листа до корня
+};
+
+// Статистика дерева, собираемая посетителем за один обход.
+template<typename T>
+ExpressionStats expressionStats(const Expression<T> &expr);
+
+// Проход оптимизатора.
+template<typename T>
+class OptimizerPass {
+public:
+    virtual ~OptimizerPass() = default;
+
+    virtual std::string name() const = 0;
+
+    virtual Expression<T> run(const Expression<T> &expr) = 0;
+};
+
+// Проход, переписывающий дерево снизу вверх: rewriteNode получает узел с уже переписанными потомками.
+template<typename T>
+class RewritePass : public OptimizerPass<T> {
+public:
+    Expression<T> run(const Expression<T> &expr) override;
+
+protected:
+    virtual Expression<T> rewriteNode(const Expression<T> &node) = 0;
+};
+
+// Замена дорогих операций дешёвыми:
+// x / c -> x * (1 / c), exp(a) * exp(b) -> exp(a + b), ln(exp(x)) -> x (только для вещественных типов).
+template<typename T>
+class StrengthReduction : public RewritePass<T> {
+public:
+    std::string name() const override { return "strength-reduction"; }
+
+protected:
+    Expression<T> rewriteNode(const Expression<T> &node) override;
+};
+
+// Перестройка цепочек сложений и умножений в сбалансированные деревья:
+// ((a + b) + c) + d -> (a + b) + (c + d). Число операций не меняется, а независимые
+// операции могут выполняться параллельно, поэтому длина критического пути сокращается.
+template<typename T>
+class Reassociation : public OptimizerPass<T> {
+public:
+    std::string name() const override { return "reassociation"; }
+
+    Expression<T> run(const Expression<T> &expr) override;
+
+private:
+    Expression<T> rewriteNode(const Expression<T> &node);
+};
+
+// Удаление узлов, не влияющих на результат: x + 0, x - 0, x * 1, x / 1, x^1,
+// и свёртка поддеревьев из одних констант. Такие узлы в изобилии порождает differentiate.
+// Свёртка пропускается, если её результат не является конечным числом. Неконстантные поддеревья
+// не отбрасываются, поэтому ошибки, NaN и Inf сохраняются (x + 0 при x = -0 даёт x, а не +0).
+template<typename T>
+class DeadNodeRemoval : public RewritePass<T> {
+public:
+    std::string name() const override { return "dead-node-removal"; }
+
+protected:
+    Expression<T> rewriteNode(const Expression<T> &node) override;
+};
+
+// Поглощение нулём: x * 0 -> 0, 0 / x -> 0, x^0 -> 1 для любого x.
+// Отбрасывает x вместе с его ошибками, NaN и Inf (ln(x) * 0 при x = -1 даёт 0 вместо исключения),
+// поэтому в defaultPipeline не входит и подключается явно, когда такие значения исключены.
+template<typename T>
+class ZeroAbsorption : public RewritePass<T> {
+public:
+    std::string name() const override { return "zero-absorption"; }
+
+protected:
+    Expression<T> rewriteNode(const Expression<T> &node) override;
+};
+
+// Результат одного прохода.
+struct PassReport {
+    std::string pass;
+    ExpressionStats before;
+    ExpressionStats after;
+};
+
+template<typename T>
+class PassManager {
+public:
+    PassManager &add(std::unique_ptr<OptimizerPass<T> > pass);
+
+    // Последовательное выполнение проходов; отчёты предыдущего запуска удаляются.
+    // Ленивые производные (lazy.hpp) перед первым проходом раскрываются.
+    Expression<T> run(const Expression<T> &expr);
+
+    const std::vector<PassReport> &reports() const { return reports_; }
+
+    // Отчёты в виде таблицы: проход, узлы и стоимость до и после.
+    std::string summary() const;
+
+private:
+    std::vector<std::unique_ptr<OptimizerPass<T> > > passes_;
+    std::vector<PassReport> reports_;
+};
+
+// Стандартный конвейер: dead-node-removal, strength-reduction, dead-node-removal, reassociation.
+template<typename T>
+PassManager<T> defaultPipeline();
+
+// Оптимизация стандартным конвейером.
+template<typename T>
+Expression<T> optimize(const Expression<T> &expr);
+
+#endif // OPTIMIZER_HPP
@@ -1,124 +1,345 @@
 #include "parser.hpp"
+#include "functions.hpp"
 #include <cctype>
 #include <stdexcept>
 #include <sstream>
+#include <type_traits>
 
-void Parser::skipWhitespace() {
+template<typename T>
+void Parser<T>::skipWhitespace() {
     while (pos_ < input_.size() && std::isspace(input_[pos_])) {
         ++pos_;
     }
 }
 
-char Parser::peek() const {
+template<typename T>
+char Parser<T>::peek() const {
     return (pos_ < input_.size()) ? input_[pos_] : '\0';
 }
 
-char Parser::get() {
-    return (pos_ < input_.size()) ? input_[pos_++] : '\0';
+template<typename T>
+bool Parser<T>::atEnd() {
+    skipWhitespace();
+    return pos_ >= input_.size();
 }
 
-Expression<long double> Parser::parseExpression() {
-    Expression<long double> expr = parseTerm();
-    skipWhitespace();
-    while (peek() == '+' || peek() == '-') {
-        char op = get();
-        skipWhitespace();
-        Expression<long double> term = parseTerm();
-        expr = (op == '+') ? (expr + term) : (expr - term);
-        skipWhitespace();
-    }
-    return expr;
+template<typename T>
+char Parser<T>::get() {
+    return (pos_ < input_.size()) ? input_[pos_++] : '\0';
 }
 
-Expression<long double> Parser::parseTerm() {
-    Expression<long double> expr = parseFactor();
-    skipWhitespace();
-    while (peek() == '*' || peek() == '/') {
-        char op = get();
-        skipWhitespace();
-        Expression<long double> factor = parseFactor();
-        expr = (op == '*') ? (expr * factor) : (expr / factor);
-        skipWhitespace();
+template<typename T>
+char Parser<T>::readOperator() {
+    char c = peek();
+    char next = pos_ + 1 < input_.size() ? input_[pos_ + 1] : '\0';
+    switch (c) {
+        case '+':
+        case '-':
+        case '*':
+        case '/':
+        case '^':
+            ++pos_;
+            return c;
+        case '<':
+        case '>':
+            pos_ += next == '=' ? 2 : 1;
+            return next == '=' ? (c == '<' ? 'l' : 'g') : c;
+        case '=':
+        case '!':
+            // Одиночные '=' и '!' операциями не являются.
+            if (next != '=')
+                return '\0';
+            pos_ += 2;
+            return c;
+        default:
+            return '\0';
     }
-    return expr;
 }
 
-Expression<long double> Parser::parseFactor() {
-    Expression<long double> expr = parsePrimary();
-    skipWhitespace();
-    while (peek() == '^') {
-        get();
-        skipWhitespace();
-        Expression<long double> exponent = parseFactor();
-        expr = expr ^ exponent;
-        skipWhitespace();
+// Приоритет бинарной операции; 0 — не бинарная операция.
+static int precedence(char op) {
+    switch (op) {
+        case '<':
+        case 'l':
+        case '>':
+        case 'g':
+        case '=':
+        case '!':
+            return 1;
+        case '+':
+        case '-':
+            return 2;
+        case '*':
+        case '/':
+            return 3;
+        case '^':
+            return 4;
+        default:
+            return 0;
     }
-    return expr;
 }
 
-Expression<long double> Parser::parsePrimary() {
-    skipWhitespace();
-    char c = peek();
-    if (c == '(') {
-        get();
-        Expression<long double> expr = parseExpression();
-        skipWhitespace();
-        if (get() != ')')
-            throw std::runtime_error("Expected ')'");
-        return expr;
-    } else if (std::isdigit(c) || c == '.') {
-        return parseNumber();
-    } else if (std::isalpha(c)) {
-        std::string id = parseIdentifier();
+template<typename T>
+Expression<T> Parser<T>::parseExpression() {
+    // Грамматика:
+    //   expression = sum {('<' | '<=' | '>' | '>=' | '==' | '!=') sum}
+    //   sum        = term {('+' | '-') term}
+    //   term       = factor {('*' | '/') factor}
+    //   factor     = primary ['^' factor]
+    //   primary    = number | name | name '(' expression {',' expression} ')' | '(' expression ')' | '-' primary
+    // Разбор идёт с явными стеками операндов и операций, без рекурсии: вложенность скобок
+    // и длина цепочек операций ограничены только памятью.
+    struct Operation {
+        char symbol;        // бинарная операция; 'n' — унарный минус; '(' — скобка; 'f' — вызов функции
+        std::string name;   // имя вызываемой функции
+        size_t operands;    // для скобки и вызова — размер стека операндов при открытии
+    };
+    std::vector<Expression<T> > operands;
+    std::vector<Operation> operations;
+
+    auto reduce = [&operands, &operations]() {
+        char op = operations.back().symbol;
+        operations.pop_back();
+        Expression<T> right = std::move(operands.back());
+        operands.pop_back();
+        Expression<T> &left = operands.back();
+        switch (op) {
+            case '+':
+                left = left + right;
+                break;
+            case '-':
+                left = left - right;
+                break;
+            case '*':
+                left = left * right;
+                break;
+            case '/':
+                left = left / right;
+                break;
+            case '<':
+                left = compare(Relation::Less, left, right);
+                break;
+            case 'l':
+                left = compare(Relation::LessEqual, left, right);
+                break;
+            case '>':
+                left = compare(Relation::Greater, left, right);
+                break;
+            case 'g':
+                left = compare(Relation::GreaterEqual, left, right);
+                break;
+            case '=':
+                left = compare(Relation::Equal, left, right);
+                break;
+            case '!':
+                left = compare(Relation::NotEqual, left, right);
+                break;
+            default:
+                left = left ^ right;
+                break;
+        }
+    };
+    // Унарный минус относится к ближайшему элементу: -x^2 = (-x)^2.
+    auto negate = [&operands, &operations]() {
+        while (!operations.empty() && operations.back().symbol == 'n') {
+            operations.pop_back();
+            operands.back() = Expression<T>(T(-1)) * operands.back();
+        }
+    };
+
+    bool expectOperand = true;
+    while (true) {
         skipWhitespace();
-        // Если после идентификатора идёт скобка – это функция.
-        if (peek() == '(') {
-            get();
-            Expression<long double> arg = parseExpression();
-            skipWhitespace();
+        char c = peek();
+        if (expectOperand) {
+            if (c == '(') {
+                get();
+                operations.push_back({'(', "", operands.size()});
+                continue;
+            } else if (std::isdigit(c) || c == '.') {
+                operands.push_back(parseNumber());
+            } else if (std::isalpha(c)) {
+                std::string id = parseIdentifier();
+                skipWhitespace();
+                // Если после идентификатора идёт скобка – это функция.
+                if (peek() == '(') {
+                    get();
+                    operations.push_back({'f', id, operands.size()});
+                    continue;
+                } else if (!std::is_floating_point_v<T> && (id == "i" || id == "j")) {
+                    // В комплексных выражениях i и j обозначают мнимую единицу, а не переменные.
+                    operands.push_back(Expression<T>(imaginaryUnit()));
+                } else {
+                    operands.push_back(Expression<T>(id));
+                }
+            } else if (c == '-') {
+                get();
+                skipWhitespace();
+                // Отрицательное число разбирается как константа, чтобы x ^ -2 получал целочисленный показатель.
+                if (!std::isdigit(peek()) && peek() != '.') {
+                    operations.push_back({'n', "", 0});
+                    continue;
+                }
+                operands.push_back(Expression<T>(-parseNumber().eval({})));
+            } else {
+                throw std::runtime_error("Unexpected character in input");
+            }
+            negate();
+            expectOperand = false;
+            continue;
+        }
+
+        c = readOperator();
+        int priority = precedence(c);
+        if (priority > 0) {
+            // Возведение в степень правоассоциативно, остальные операции — левоассоциативны.
+            while (!operations.empty() && (precedence(operations.back().symbol) > priority ||
+                                           (precedence(operations.back().symbol) == priority && c != '^')))
+                reduce();
+            operations.push_back({c, "", 0});
+            expectOperand = true;
+            continue;
+        }
+
+        // Конец подвыражения: сворачиваются операции до ближайшей скобки или вызова.
+        while (!operations.empty() && precedence(operations.back().symbol) > 0)
+            reduce();
+        if (operations.empty())
+            break;
+        Operation &open = operations.back();
+        if (open.symbol == '(') {
             if (get() != ')')
-                throw std::runtime_error("Expected ')' after function argument");
-            if (id == "sin")
-                return ::sin(arg);
-            else if (id == "cos")
-                return ::cos(arg);
-            else if (id == "ln")
-                return ::ln(arg);
-            else if (id == "exp")
-                return ::exp(arg);
-            else
-                throw std::runtime_error("Unknown function: " + id);
+                throw std::runtime_error("Expected ')'");
+            operations.pop_back();
         } else {
-            return Expression<long double>(id);
+            char next = get();
+            if (next == ',') {
+                expectOperand = true;
+                continue;
+            }
+            if (next != ')')
+                throw std::runtime_error("Expected ')' after function argument");
+            std::vector<Expression<T> > args(std::make_move_iterator(operands.begin() + open.operands),
+                                             std::make_move_iterator(operands.end()));
+            operands.erase(operands.begin() + open.operands, operands.end());
+            std::string name = std::move(open.name);
+            operations.pop_back();
+            // Имя функции ищется в реестре (хеш-таблица), он же проверяет число аргументов.
+            operands.push_back(call(name, args));
         }
-    } else if (c == '-') {
-        get();
-        return Expression<long double>(-1.0L) * parsePrimary();
+        negate();
     }
-    throw std::runtime_error("Unexpected character in input");
+    return std::move(operands.back());
 }
 
-Expression<long double> Parser::parseNumber() {
+template<typename T>
+Expression<T> Parser<T>::parseNumber() {
     skipWhitespace();
     size_t start = pos_;
     while (pos_ < input_.size() && (std::isdigit(input_[pos_]) || input_[pos_] == '.'))
         pos_++;
     std::string numStr = input_.substr(start, pos_ - start);
     std::istringstream iss(numStr);
-    long double value;
+    // Для комплексных типов читается вещественная часть: оператор >> для std::complex ждёт формат "(re,im)".
+    decltype(std::real(T())) value;
     iss >> value;
-    return Expression<long double>(value);
+    // Суффикс i или j делает число мнимым: 2.5i, 3j.
+    if (!std::is_floating_point_v<T> && (peek() == 'i' || peek() == 'j') &&
+        !std::isalnum(static_cast<unsigned char>(pos_ + 1 < input_.size() ? input_[pos_ + 1] : '\0'))) {
+        get();
+        return Expression<T>(imaginaryUnit() * T(value));
+    }
+    return Expression<T>(T(value));
+}
+
+template<typename T>
+T Parser<T>::imaginaryUnit() {
+    if constexpr (std::is_floating_point_v<T>)
+        throw std::logic_error("Imaginary unit in a real expression");
+    else
+        return T(0, 1);
 }
 
-std::string Parser::parseIdentifier() {
+template<typename T>
+std::string Parser<T>::parseIdentifier() {
     skipWhitespace();
     size_t start = pos_;
-    while (pos_ < input_.size() && std::isalpha(input_[pos_]))
+    // Первый символ — буква (проверяется в parseExpression), далее допускаются цифры: x1, atan2.
+    while (pos_ < input_.size() && std::isalnum(input_[pos_]))
         pos_++;
     return input_.substr(start, pos_ - start);
 }
 
-Expression<long double> parseExpression(const std::string &str) {
-    Parser parser(str);
+template<typename T>
+Expression<T> parseExpression(const std::string &str) {
+    Parser<T> parser(str);
     return parser.parseExpression();
 }
+
+// Разбор строк "name = expression": definition вызывается для каждого определения по порядку.
+template<typename T>
+static void forEachDefinition(const std::string &text,
+                              const std::function<void(const std::string &, const Expression<T> &)> &definition) {
+    std::istringstream lines(text);
+    std::string line;
+    size_t number = 0;
+    while (std::getline(lines, line)) {
+        ++number;
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+        try {
+            size_t eq = line.find('=');
+            if (eq == std::string::npos)
+                throw std::runtime_error("Expected 'name = expression'");
+            std::string name = line.substr(0, eq);
+            name.erase(0, name.find_first_not_of(" \t"));
+            name.erase(name.find_last_not_of(" \t") + 1);
+            bool valid = !name.empty() && std::isalpha(static_cast<unsigned char>(name[0]));
+            for (char c: name)
+                valid = valid && std::isalnum(static_cast<unsigned char>(c));
+            if (!valid)
+                throw std::runtime_error("Invalid definition name \"" + name + "\"");
+            Parser<T> exprParser(line.substr(eq + 1));
+            Expression<T> expr = exprParser.parseExpression();
+            if (!exprParser.atEnd())
+                throw std::runtime_error("Unexpected character in input");
+            definition(name, expr);
+        } catch (const std::exception &ex) {
+            throw std::runtime_error("Line " + std::to_string(number) + ": " + ex.what());
+        }
+    }
+}
+
+template<typename T>
+Program<T> parseProgram(const std::string &text) {
+    ProgramBuilder<T> builder;
+    forEachDefinition<T>(text, [&builder](const std::string &name, const Expression<T> &expr) {
+        uint32_t reg = builder.add(expr);
+        builder.define(name, reg);
+        builder.addOutput(reg, name);
+    });
+    return builder.build();
+}
+
+template<typename T>
+std::vector<std::pair<std::string, Expression<T> > > parseDefinitions(const std::string &text) {
+    std::vector<std::pair<std::string, Expression<T> > > definitions;
+    forEachDefinition<T>(text, [&definitions](const std::string &name, const Expression<T> &expr) {
+        Expression<T> full = expr;
+        for (auto it = definitions.rbegin(); it != definitions.rend(); ++it)
+            full = full.substitute(it->first, it->second);
+        definitions.emplace_back(name, full);
+    });
+    return definitions;
+}
+
+// ===================================================================
+// Инстанциация шаблонов для всех числовых типов
+#define INSTANTIATE_PARSER(T)                                          \
+    template class Parser<T>;                                          \
+    template Expression<T> parseExpression<T>(const std::string &str); \
+    template Program<T> parseProgram<T>(const std::string &text);     \
+    template std::vector<std::pair<std::string, Expression<T> > > parseDefinitions<T>(const std::string &text);
+
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE_PARSER)
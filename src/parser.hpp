@@ -2,32 +2,42 @@
 #define PARSER_HPP
 
 #include "expression.hpp"
+#include "program.hpp"
 
+// Разбор выражения в Expression<T>; числа читаются с точностью вещественной части T.
+// Для комплексных T имена i и j и суффиксы чисел 2i, 0.5j обозначают мнимую единицу.
+template<typename T = long double>
 class Parser {
 public:
     explicit Parser(const std::string &input) : input_(input), pos_(0) {}
 
-    Expression<long double> parseExpression();
+    // Разбор выражения с текущей позиции; останавливается перед первым символом, который не может
+    // продолжить выражение. Не рекурсивен: глубина вложенности ограничена только памятью.
+    Expression<T> parseExpression();
+
+    // Проверка, что весь вход разобран (с точностью до пробелов).
+    bool atEnd();
+
+    // Текущая позиция во входе; после исключения — место, где разбор остановился.
+    size_t position() const { return pos_; }
 
 private:
     std::string input_;
     size_t pos_;
 
-    // Парсит сумму и разность.
-    Expression<long double> parseTerm();
-
-    // Парсит произведение и деление.
-    Expression<long double> parseFactor();
-
-    // Парсит элемент: число, переменная, функция, скобочное выражение.
-    Expression<long double> parsePrimary();
-
     // Парсит число.
-    Expression<long double> parseNumber();
+    Expression<T> parseNumber();
+
+    // Мнимая единица (только для комплексных T).
+    static T imaginaryUnit();
 
     // Парсит идентификатор (имя переменной или имя функции).
     std::string parseIdentifier();
 
+    // Чтение бинарной операции: символ операции или '\0', если с текущей позиции она не начинается.
+    // Сравнения обозначаются '<', 'l' (<=), '>', 'g' (>=), '=' (==), '!' (!=).
+    char readOperator();
+
     // Пропуск пробельных символов.
     void skipWhitespace();
 
@@ -39,6 +49,18 @@ private:
 };
 
 
-Expression<long double> parseExpression(const std::string &str);
+template<typename T = long double>
+Expression<T> parseExpression(const std::string &str);
+
+// Разбор программы из строк вида "name = expression".
+// Выражение может ссылаться на имена, определённые в предыдущих строках; пустые строки
+// и строки, начинающиеся с '#', пропускаются. Каждое определение становится выходом программы,
+// общие подвыражения всех строк вычисляются один раз.
+template<typename T = long double>
+Program<T> parseProgram(const std::string &text);
+
+// Разбор тех же строк в деревья выражений: ссылки на предыдущие определения заменяются их деревьями.
+template<typename T = long double>
+std::vector<std::pair<std::string, Expression<T> > > parseDefinitions(const std::string &text);
 
 #endif
@@ -0,0 +1,475 @@
+#include "polynomial.hpp"
+#include "taylor.hpp"
+#include "program.hpp"
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+/*
+    Реализация класса Polynomial<T>
+*/
+
+template<typename T>
+Polynomial<T>::Polynomial(T constant) {
+    if (constant != T(0))
+        terms_[Exponents()] = constant;
+}
+
+template<typename T>
+Polynomial<T>::Polynomial(const std::string &variable)
+    : variables_{variable} {
+    terms_[Exponents{1}] = T(1);
+}
+
+template<typename T>
+Polynomial<T> Polynomial<T>::withVariables(const std::vector<std::string> &variables) const {
+    if (variables == variables_)
+        return *this;
+    std::vector<size_t> position(variables_.size());
+    for (size_t i = 0; i < variables_.size(); ++i)
+        position[i] = std::lower_bound(variables.begin(), variables.end(), variables_[i]) - variables.begin();
+    Polynomial result;
+    result.variables_ = variables;
+    for (const auto &term: terms_) {
+        Exponents exponents(variables.size(), 0);
+        for (size_t i = 0; i < term.first.size(); ++i)
+            exponents[position[i]] = term.first[i];
+        result.terms_[exponents] = term.second;
+    }
+    return result;
+}
+
+// Общий отсортированный список переменных двух многочленов.
+static std::vector<std::string> mergeVariables(const std::vector<std::string> &a, const std::vector<std::string> &b) {
+    std::vector<std::string> result;
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+    return result;
+}
+
+template<typename T>
+void Polynomial<T>::normalize() {
+    for (auto it = terms_.begin(); it != terms_.end();) {
+        if (it->second == T(0))
+            it = terms_.erase(it);
+        else
+            ++it;
+    }
+    std::vector<bool> used(variables_.size(), false);
+    for (const auto &term: terms_) {
+        for (size_t i = 0; i < term.first.size(); ++i)
+            used[i] = used[i] || term.first[i] != 0;
+    }
+    if (std::find(used.begin(), used.end(), false) == used.end())
+        return;
+    std::vector<std::string> variables;
+    for (size_t i = 0; i < variables_.size(); ++i) {
+        if (used[i])
+            variables.push_back(variables_[i]);
+    }
+    std::map<Exponents, T> terms;
+    for (const auto &term: terms_) {
+        Exponents exponents;
+        for (size_t i = 0; i < term.first.size(); ++i) {
+            if (used[i])
+                exponents.push_back(term.first[i]);
+        }
+        terms[exponents] = term.second;
+    }
+    variables_ = std::move(variables);
+    terms_ = std::move(terms);
+}
+
+template<typename T>
+Polynomial<T> Polynomial<T>::operator+(const Polynomial &right) const {
+    std::vector<std::string> variables = mergeVariables(variables_, right.variables_);
+    Polynomial result = withVariables(variables);
+    for (const auto &term: right.withVariables(variables).terms_)
+        result.terms_[term.first] += term.second;
+    result.normalize();
+    return result;
+}
+
+template<typename T>
+Polynomial<T> Polynomial<T>::operator-(const Polynomial &right) const {
+    return *this + right.scaled(T(-1));
+}
+
+template<typename T>
+Polynomial<T> Polynomial<T>::operator*(const Polynomial &right) const {
+    std::vector<std::string> variables = mergeVariables(variables_, right.variables_);
+    Polynomial left = withVariables(variables);
+    Polynomial other = right.withVariables(variables);
+    Polynomial result;
+    result.variables_ = variables;
+    for (const auto &a: left.terms_) {
+        for (const auto &b: other.terms_) {
+            Exponents exponents(variables.size());
+            for (size_t i = 0; i < exponents.size(); ++i)
+                exponents[i] = a.first[i] + b.first[i];
+            result.terms_[exponents] += a.second * b.second;
+        }
+    }
+    result.normalize();
+    return result;
+}
+
+template<typename T>
+Polynomial<T> Polynomial<T>::scaled(T factor) const {
+    Polynomial result = *this;
+    for (auto &term: result.terms_)
+        term.second *= factor;
+    result.normalize();
+    return result;
+}
+
+template<typename T>
+bool Polynomial<T>::power(unsigned exponent, Polynomial &result) const {
+    result = Polynomial(T(1));
+    Polynomial base = *this;
+    while (exponent > 0) {
+        if (exponent & 1) {
+            result = result * base;
+            if (result.size() > MAX_TERMS)
+                return false;
+        }
+        exponent >>= 1;
+        if (exponent > 0) {
+            base = base * base;
+            if (base.size() > MAX_TERMS)
+                return false;
+        }
+    }
+    return true;
+}
+
+template<typename T>
+Polynomial<T> Polynomial<T>::derivative(const std::string &var) const {
+    auto it = std::lower_bound(variables_.begin(), variables_.end(), var);
+    if (it == variables_.end() || *it != var)
+        return Polynomial();
+    size_t index = it - variables_.begin();
+    Polynomial result;
+    result.variables_ = variables_;
+    for (const auto &term: terms_) {
+        if (term.first[index] == 0)
+            continue;
+        Exponents exponents = term.first;
+        exponents[index] -= 1;
+        result.terms_[exponents] += term.second * T(term.first[index]);
+    }
+    result.normalize();
+    return result;
+}
+
+template<typename T>
+T Polynomial<T>::constantTerm() const {
+    auto it = terms_.find(Exponents(variables_.size(), 0));
+    return it == terms_.end() ? T(0) : it->second;
+}
+
+template<typename T>
+std::string Polynomial<T>::to_string() const {
+    if (terms_.empty())
+        return "0";
+    std::ostringstream oss;
+    oss << "(";
+    bool first = true;
+    for (auto it = terms_.rbegin(); it != terms_.rend(); ++it) {
+        if (!first)
+            oss << " + ";
+        first = false;
+        bool hasFactors = std::any_of(it->first.begin(), it->first.end(), [](unsigned e) { return e != 0; });
+        bool needCoefficient = !hasFactors || it->second != T(1);
+        if (needCoefficient)
+            oss << it->second;
+        for (size_t i = 0; i < variables_.size(); ++i) {
+            if (it->first[i] == 0)
+                continue;
+            if (needCoefficient)
+                oss << " * ";
+            needCoefficient = true;
+            oss << variables_[i];
+            if (it->first[i] > 1)
+                oss << " ^ " << it->first[i];
+        }
+    }
+    oss << ")";
+    return oss.str();
+}
+
+// ===================================================================
+
+/*
+    Реализация класса PolynomialNode<T>
+*/
+
+template<typename T>
+PolynomialNode<T>::PolynomialNode(const Polynomial<T> &polynomial)
+    : polynomial_(polynomial), root_(-1) {
+    const auto &terms = polynomial_.terms();
+    if (!polynomial_.isConstant())
+        root_ = buildLevel(terms.begin(), terms.end(), 0);
+}
+
+template<typename T>
+int PolynomialNode<T>::buildLevel(TermIterator begin, TermIterator end, size_t var) {
+    // Одночлены упорядочены лексикографически по показателям, поэтому одночлены
+    // с одинаковыми показателями первых var переменных идут подряд.
+    const size_t count = polynomial_.variables().size();
+    while (var < count) {
+        bool used = false;
+        for (auto it = begin; it != end && !used; ++it)
+            used = it->first[var] != 0;
+        if (used)
+            break;
+        ++var;
+    }
+    if (var == count)
+        return -1;
+
+    HornerLevel level{var, {}};
+    auto groupEnd = end;
+    while (groupEnd != begin) {
+        // Группа с наибольшим показателем переменной var находится в конце диапазона.
+        auto groupBegin = std::prev(groupEnd);
+        unsigned exponent = groupBegin->first[var];
+        while (groupBegin != begin && std::prev(groupBegin)->first[var] == exponent)
+            --groupBegin;
+        int child = buildLevel(groupBegin, groupEnd, var + 1);
+        T coefficient = child < 0 ? groupBegin->second : T(0);
+        level.terms.push_back({exponent, child, coefficient});
+        groupEnd = groupBegin;
+    }
+    levels_.push_back(std::move(level));
+    return static_cast<int>(levels_.size() - 1);
+}
+
+template<typename T>
+template<typename V, typename Ops>
+V PolynomialNode<T>::evalTerm(const HornerTerm &term, const std::vector<V> &values, Ops &ops) const {
+    return term.child < 0 ? ops.constant(term.coefficient) : evalLevel(term.child, values, ops);
+}
+
+template<typename T>
+template<typename V, typename Ops>
+V PolynomialNode<T>::evalLevel(int level, const std::vector<V> &values, Ops &ops) const {
+    // c_1 x^e_1 + c_2 x^e_2 + ... = ((c_1 x^(e_1 - e_2) + c_2) x^(e_2 - e_3) + ...) x^e_k
+    const HornerLevel &horner = levels_[level];
+    const V &x = values[horner.var];
+    V result = evalTerm(horner.terms[0], values, ops);
+    for (size_t i = 1; i < horner.terms.size(); ++i) {
+        unsigned gap = horner.terms[i - 1].exponent - horner.terms[i].exponent;
+        result = ops.add(ops.mul(result, ops.power(x, gap)), evalTerm(horner.terms[i], values, ops));
+    }
+    unsigned last = horner.terms.back().exponent;
+    if (last > 0)
+        result = ops.mul(result, ops.power(x, last));
+    return result;
+}
+
+template<typename T>
+template<typename V, typename Ops>
+V PolynomialNode<T>::evalHorner(const std::vector<V> &values, Ops &ops) const {
+    if (root_ < 0)
+        return ops.constant(polynomial_.constantTerm());
+    return evalLevel(root_, values, ops);
+}
+
+// Арифметика над числами.
+template<typename T>
+struct ValueOps {
+    T constant(T value) { return value; }
+
+    T add(T a, T b) { return a + b; }
+
+    T mul(T a, T b) { return a * b; }
+
+    T power(T x, unsigned n) { return n == 1 ? x : integerPower(x, static_cast<long>(n)); }
+};
+
+// Арифметика над регистрами программы.
+template<typename T>
+struct BuilderOps {
+    ProgramBuilder<T> &builder;
+
+    uint32_t constant(T value) { return builder.constant(value); }
+
+    uint32_t add(uint32_t a, uint32_t b) { return builder.binary(OpCode::Add, a, b); }
+
+    uint32_t mul(uint32_t a, uint32_t b) { return builder.binary(OpCode::Mul, a, b); }
+
+    uint32_t power(uint32_t x, unsigned n) { return builder.binary(OpCode::Pow, x, builder.constant(T(n))); }
+};
+
+// Арифметика над усечёнными рядами Тейлора.
+template<typename T>
+struct TaylorOps {
+    size_t order;
+
+    std::vector<T> constant(T value) { return taylorConstant(value, order); }
+
+    std::vector<T> add(const std::vector<T> &a, const std::vector<T> &b) { return taylorAdd(a, b); }
+
+    std::vector<T> mul(const std::vector<T> &a, const std::vector<T> &b) { return taylorMul(a, b); }
+
+    std::vector<T> power(const std::vector<T> &x, unsigned n) { return taylorPow(x, T(n)); }
+};
+
+// Арифметика над значениями с первыми двумя производными.
+template<typename T>
+struct JetOps {
+    Jet<T> constant(T value) { return {value, T(0), T(0)}; }
+
+    Jet<T> add(const Jet<T> &a, const Jet<T> &b) { return {a.value + b.value, a.first + b.first, a.second + b.second}; }
+
+    Jet<T> mul(const Jet<T> &a, const Jet<T> &b) { return jetMul(a, b); }
+
+    Jet<T> power(const Jet<T> &x, unsigned n) { return jetPower(x, static_cast<long>(n)); }
+};
+
+// Арифметика над деревьями выражений.
+template<typename T>
+struct ExpressionOps {
+    Expression<T> constant(T value) { return Expression<T>(value); }
+
+    Expression<T> add(const Expression<T> &a, const Expression<T> &b) { return a + b; }
+
+    Expression<T> mul(const Expression<T> &a, const Expression<T> &b) { return a * b; }
+
+    Expression<T> power(const Expression<T> &x, unsigned n) { return n == 1 ? x : x ^ Expression<T>(T(n)); }
+};
+
+template<typename T>
+T PolynomialNode<T>::eval(const std::map<std::string, T> &context) const {
+    const auto &names = polynomial_.variables();
+    std::vector<T> values(names.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        auto it = context.find(names[i]);
+        if (it != context.end())
+            values[i] = it->second;
+        else if (errorPolicy() == ErrorPolicy::Propagate)
+            values[i] = quietNaN<T>();
+        else
+            throw std::runtime_error("Variable \"" + names[i] + "\" not found in context");
+    }
+    ValueOps<T> ops;
+    return evalHorner(values, ops);
+}
+
+template<typename T>
+std::string PolynomialNode<T>::to_string() const {
+    return polynomial_.to_string();
+}
+
+template<typename T>
+Expression<T> PolynomialNode<T>::derivative(const std::string &var) const {
+    return polynomialExpression(polynomial_.derivative(var));
+}
+
+template<typename T>
+Expression<T> PolynomialNode<T>::substitute(const std::string &var, const Expression<T> &expr) const {
+    const auto &names = polynomial_.variables();
+    if (!std::binary_search(names.begin(), names.end(), var))
+        return Expression<T>(clone());
+    return toExpression().substitute(var, expr);
+}
+
+template<typename T>
+std::vector<T> PolynomialNode<T>::taylor(const std::map<std::string, T> &context, const std::string &var,
+                                         size_t order) const {
+    const auto &names = polynomial_.variables();
+    std::vector<std::vector<T> > values;
+    for (const auto &name: names)
+        values.push_back(Expression<T>(name).taylor(var, context, order));
+    TaylorOps<T> ops{order};
+    return evalHorner(values, ops);
+}
+
+template<typename T>
+Jet<T> PolynomialNode<T>::evalJet(const std::map<std::string, T> &context, const std::string &var) const {
+    // Буфер потока переиспользуется между вызовами: многочлен не содержит вложенных узлов,
+    // поэтому повторного входа в evalJet во время обхода не бывает.
+    thread_local std::vector<Jet<T> > values;
+    const auto &names = polynomial_.variables();
+    values.resize(names.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        auto it = context.find(names[i]);
+        T value = it != context.end() ? it->second : quietNaN<T>();
+        if (it == context.end() && errorPolicy() == ErrorPolicy::Throw)
+            throw std::runtime_error("Variable \"" + names[i] + "\" not found in context");
+        values[i] = {value, T(names[i] == var ? 1 : 0), T(0)};
+    }
+    JetOps<T> ops;
+    return evalHorner(values, ops);
+}
+
+template<typename T>
+uint32_t PolynomialNode<T>::compile(ProgramBuilder<T> &builder) const {
+    std::vector<uint32_t> values;
+    for (const auto &name: polynomial_.variables())
+        values.push_back(builder.variable(name));
+    BuilderOps<T> ops{builder};
+    return evalHorner(values, ops);
+}
+
+template<typename T>
+bool PolynomialNode<T>::toPolynomial(Polynomial<T> &result) const {
+    result = polynomial_;
+    return true;
+}
+
+template<typename T>
+Expression<T> PolynomialNode<T>::mapChildren(const std::function<Expression<T>(const Expression<T> &)> &) const {
+    return Expression<T>(clone());
+}
+
+template<typename T>
+std::shared_ptr<ExpressionImpl<T> > PolynomialNode<T>::clone() const {
+    return std::make_shared<PolynomialNode<T> >(*this);
+}
+
+template<typename T>
+void PolynomialNode<T>::accept(ExpressionVisitor<T> &visitor) const {
+    visitor.visit(*this);
+}
+
+template<typename T>
+Expression<T> PolynomialNode<T>::toExpression() const {
+    std::vector<Expression<T> > values;
+    for (const auto &name: polynomial_.variables())
+        values.emplace_back(name);
+    ExpressionOps<T> ops;
+    return evalHorner(values, ops);
+}
+
+// ===================================================================
+
+template<typename T>
+Expression<T> polynomialExpression(const Polynomial<T> &polynomial) {
+    if (polynomial.isConstant())
+        return Expression<T>(polynomial.constantTerm());
+    return Expression<T>(std::make_shared<PolynomialNode<T> >(polynomial));
+}
+
+template<typename T>
+Expression<T> hornerForm(const Expression<T> &expr) {
+    Polynomial<T> polynomial;
+    const ExpressionImpl<T> *impl = expr.getImpl().get();
+    // Отдельные константы и переменные оставляем как есть.
+    if (dynamic_cast<const Value<T> *>(impl) || dynamic_cast<const Variable<T> *>(impl))
+        return expr;
+    if (impl->toPolynomial(polynomial))
+        return polynomialExpression(polynomial);
+    return expr.getImpl()->mapChildren(hornerForm<T>);
+}
+
+// ===================================================================
+// Инстанциация шаблонов для всех числовых типов
+#define INSTANTIATE_POLYNOMIAL(T)                                          \
+    template class Polynomial<T>;                                          \
+    template class PolynomialNode<T>;                                      \
+    template Expression<T> polynomialExpression<T>(const Polynomial<T> &); \
+    template Expression<T> hornerForm<T>(const Expression<T> &);
+
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE_POLYNOMIAL)
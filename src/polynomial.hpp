@@ -0,0 +1,146 @@
+#ifndef POLYNOMIAL_HPP
+#define POLYNOMIAL_HPP
+
+#include "expression.hpp"
+
+/*
+    Разреженный многочлен от нескольких переменных.
+    Переменные хранятся в отсортированном списке, каждый одночлен задаётся
+    вектором показателей (по одному на переменную) и коэффициентом.
+*/
+template<typename T>
+class Polynomial {
+public:
+    // Предельное число одночленов: более крупные многочлены не строятся,
+    // чтобы раскрытие скобок вида (x + y + z)^30 не приводило к взрыву размера.
+    static const size_t MAX_TERMS = 4096;
+
+    using Exponents = std::vector<unsigned>;
+
+    // Нулевой многочлен.
+    Polynomial() = default;
+
+    explicit Polynomial(T constant);
+
+    explicit Polynomial(const std::string &variable);
+
+    Polynomial operator+(const Polynomial &right) const;
+
+    Polynomial operator-(const Polynomial &right) const;
+
+    Polynomial operator*(const Polynomial &right) const;
+
+    // Умножение на число.
+    Polynomial scaled(T factor) const;
+
+    // Возведение в неотрицательную целую степень; false, если результат превышает MAX_TERMS.
+    bool power(unsigned exponent, Polynomial &result) const;
+
+    // Точная производная по переменной: действует только на коэффициенты и показатели.
+    Polynomial derivative(const std::string &var) const;
+
+    bool isConstant() const { return variables_.empty(); }
+
+    // Значение свободного члена.
+    T constantTerm() const;
+
+    // Число одночленов.
+    size_t size() const { return terms_.size(); }
+
+    const std::vector<std::string> &variables() const { return variables_; }
+
+    const std::map<Exponents, T> &terms() const { return terms_; }
+
+    std::string to_string() const;
+
+private:
+    // Тот же многочлен, записанный над расширенным списком переменных.
+    Polynomial withVariables(const std::vector<std::string> &variables) const;
+
+    // Удаление нулевых коэффициентов и неиспользуемых переменных.
+    void normalize();
+
+    std::vector<std::string> variables_;
+    std::map<Exponents, T> terms_;
+};
+
+// Узел выражения, хранящий многочлен в канонической форме.
+// Вычисляется по многомерной схеме Горнера: для многочлена степени n от одной переменной —
+// n умножений и n сложений вместо вычисления каждой степени отдельно.
+template<typename T>
+class PolynomialNode : public ExpressionImpl<T> {
+public:
+    explicit PolynomialNode(const Polynomial<T> &polynomial);
+
+    T eval(const std::map<std::string, T> &context) const override;
+
+    std::string to_string() const override;
+
+    // Производная вычисляется точно на коэффициентах и снова является многочленом.
+    Expression<T> derivative(const std::string &var) const override;
+
+    Expression<T> substitute(const std::string &var, const Expression<T> &expr) const override;
+
+    std::vector<T> taylor(const std::map<std::string, T> &context, const std::string &var,
+                          size_t order) const override;
+
+    Jet<T> evalJet(const std::map<std::string, T> &context, const std::string &var) const override;
+
+    uint32_t compile(ProgramBuilder<T> &builder) const override;
+
+    bool toPolynomial(Polynomial<T> &result) const override;
+
+    Expression<T> mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const override;
+
+    std::shared_ptr<ExpressionImpl<T> > clone() const override;
+
+    void accept(ExpressionVisitor<T> &visitor) const override;
+
+    const Polynomial<T> &polynomial() const { return polynomial_; }
+
+    // Дерево из операций сложения, умножения и целой степени в форме Горнера.
+    Expression<T> toExpression() const;
+
+private:
+    // Уровень схемы Горнера: многочлен от переменной var с коэффициентами,
+    // которые либо являются константами (child < 0), либо уровнями от следующих переменных.
+    struct HornerTerm {
+        unsigned exponent;
+        int child;
+        T coefficient;
+    };
+
+    struct HornerLevel {
+        size_t var;
+        std::vector<HornerTerm> terms; // по убыванию показателя
+    };
+
+    using TermIterator = typename std::map<typename Polynomial<T>::Exponents, T>::const_iterator;
+
+    int buildLevel(TermIterator begin, TermIterator end, size_t var);
+
+    // Обход схемы Горнера с заданной арифметикой (числа, регистры программы, ряды Тейлора, деревья).
+    template<typename V, typename Ops>
+    V evalHorner(const std::vector<V> &values, Ops &ops) const;
+
+    template<typename V, typename Ops>
+    V evalLevel(int level, const std::vector<V> &values, Ops &ops) const;
+
+    template<typename V, typename Ops>
+    V evalTerm(const HornerTerm &term, const std::vector<V> &values, Ops &ops) const;
+
+    Polynomial<T> polynomial_;
+    std::vector<HornerLevel> levels_;
+    int root_;
+};
+
+// Многочлен в виде выражения: константа — как Value, остальное — как PolynomialNode.
+template<typename T>
+Expression<T> polynomialExpression(const Polynomial<T> &polynomial);
+
+// Проход, заменяющий максимальные многочленные подвыражения узлами PolynomialNode.
+// Рациональные функции превращаются в частное двух многочленов.
+template<typename T>
+Expression<T> hornerForm(const Expression<T> &expr);
+
+#endif // POLYNOMIAL_HPP
@@ -0,0 +1,142 @@
+#include "profile.hpp"
+#include <cstdio>
+#include <algorithm>
+
+namespace profile {
+
+static const char *kindName(Kind kind) {
+    switch (kind) {
+        case Kind::Eval:
+            return "eval";
+        case Kind::Differentiate:
+            return "differentiate";
+        default:
+            return "substitute";
+    }
+}
+
+static void appendEscaped(const std::string &text, std::string &out) {
+    for (char c: text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buffer[8];
+            std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+            out += buffer;
+        } else {
+            out += c;
+        }
+    }
+}
+
+// Дочерние пути в порядке первого посещения.
+static std::vector<size_t> orderedChildren(const Frame &frame) {
+    std::vector<size_t> children;
+    children.reserve(frame.children.size());
+    for (const auto &child: frame.children)
+        children.push_back(child.second);
+    std::sort(children.begin(), children.end());
+    return children;
+}
+
+Profiler &Profiler::instance() {
+    thread_local Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler() {
+    reset();
+}
+
+void Profiler::reset() {
+    frames_.clear();
+    stack_.clear();
+    frames_.emplace_back();
+    frames_[0].kind = Kind::Eval;
+    frames_[0].label = "all";
+    current_ = 0;
+    unwinding_ = false;
+}
+
+size_t Profiler::addFrame(Kind kind, const std::string &label) {
+    Frame frame;
+    frame.kind = kind;
+    frame.label = label;
+    frame.parent = current_;
+    frames_.push_back(std::move(frame));
+    return frames_.size() - 1;
+}
+
+void Profiler::leave(bool failed) {
+    if (stack_.empty())
+        return;
+    Frame &frame = frames_[current_];
+    frame.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - stack_.back().start).count();
+    if (failed && !unwinding_)
+        ++frame.exceptions;
+    unwinding_ = failed;
+    current_ = stack_.back().parent;
+    stack_.pop_back();
+}
+
+void Profiler::writeJson(size_t index, std::string &out) const {
+    const Frame &frame = frames_[index];
+    char numbers[160];
+    out += "{\"kind\": \"";
+    out += index == 0 ? "root" : kindName(frame.kind);
+    out += "\", \"node\": \"";
+    appendEscaped(frame.label, out);
+    std::snprintf(numbers, sizeof(numbers),
+                  "\", \"calls\": %llu, \"seconds\": %.9g, \"exceptions\": %llu, \"allocations\": %llu",
+                  static_cast<unsigned long long>(frame.calls), frame.seconds,
+                  static_cast<unsigned long long>(frame.exceptions),
+                  static_cast<unsigned long long>(frame.allocations));
+    out += numbers;
+    out += ", \"children\": [";
+    bool first = true;
+    for (size_t child: orderedChildren(frame)) {
+        if (!first)
+            out += ", ";
+        first = false;
+        writeJson(child, out);
+    }
+    out += "]}";
+}
+
+std::string Profiler::toJson() const {
+    std::string out;
+    writeJson(0, out);
+    out += '\n';
+    return out;
+}
+
+void Profiler::writeFolded(size_t index, const std::string &prefix, std::string &out) const {
+    const Frame &frame = frames_[index];
+    std::string path = prefix;
+    if (index != 0) {
+        // ';' разделяет кадры, поэтому в подписи узла он заменяется.
+        std::string label = std::string(kindName(frame.kind)) + " " + frame.label;
+        for (char &c: label) {
+            if (c == ';' || c == '\n')
+                c = ',';
+        }
+        path += prefix.empty() ? label : ";" + label;
+    }
+    double self = frame.seconds;
+    for (size_t child: orderedChildren(frame)) {
+        self -= frames_[child].seconds;
+        writeFolded(child, path, out);
+    }
+    long long nanoseconds = static_cast<long long>(self * 1e9);
+    if (index != 0 && nanoseconds > 0)
+        out += path + " " + std::to_string(nanoseconds) + "\n";
+}
+
+std::string Profiler::toFolded() const {
+    std::string out;
+    writeFolded(0, "", out);
+    return out;
+}
+
+} // namespace profile
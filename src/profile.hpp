@@ -0,0 +1,166 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+#include <exception>
+#include <cstdint>
+
+/*
+    Инструментирование вычислений над деревом выражения.
+    Точки измерения стоят в Expression<T>::eval, differentiate, substitute и в конструкторе узла.
+    Они компилируются только при сборке с -DEXPRESSION_PROFILE (make PROFILE=1);
+    без этого макроса PROFILE_SCOPE и PROFILE_ALLOCATION раскрываются в пустые операторы.
+    Даже в инструментированной сборке данные собираются только после Profiler::enable(true).
+
+    Статистика хранится по путям вызовов: узел, вызванный из разных мест дерева,
+    учитывается в каждом пути отдельно. Узел опознаётся по адресу, а подпись вычисляется
+    один раз, при первом посещении пути. Подпись — запись самого узла с "..." вместо потомков,
+    например "(... + ...)" или "sin(...)", не длиннее LABEL_LIMIT символов: полная запись
+    поддерева на каждом пути сделала бы профилирование квадратичным по размеру дерева.
+
+    Деревья выше RECURSION_LIMIT вычисляются обходом с явным стеком (traversal.hpp):
+    такой вызов учитывается одним кадром корня, без кадров вложенных узлов.
+*/
+
+namespace profile {
+
+enum class Kind {
+    Eval,
+    Differentiate,
+    Substitute
+};
+
+// Статистика одного пути вызовов.
+struct Frame {
+    Kind kind;
+    std::string label;
+    uint64_t calls = 0;
+    uint64_t exceptions = 0;  // исключения, брошенные непосредственно этим узлом
+    uint64_t allocations = 0; // узлы, созданные во время вызова (без учёта вложенных путей)
+    double seconds = 0;       // полное время, включая вложенные вызовы
+    size_t parent = 0;
+    std::unordered_map<uint64_t, size_t> children;
+};
+
+// Предельная длина подписи узла в байтах.
+const size_t LABEL_LIMIT = 64;
+
+// Подпись узла: части записи узла (part) с "..." на месте потомков; у листа — его запись.
+template<typename Node>
+std::string nodeLabel(const Node &node) {
+    const size_t count = node.childCount();
+    std::string label = count == 0 ? node.to_string() : node.part(0);
+    for (size_t i = 0; i < count && label.size() <= LABEL_LIMIT; ++i)
+        label += "..." + node.part(i + 1);
+    if (label.size() > LABEL_LIMIT)
+        label = label.substr(0, LABEL_LIMIT - 3) + "...";
+    return label;
+}
+
+// Профилировщик текущего потока.
+class Profiler {
+public:
+    static Profiler &instance();
+
+    void enable(bool enabled) { enabled_ = enabled; }
+
+    bool enabled() const { return enabled_; }
+
+    // Удаление накопленной статистики.
+    void reset();
+
+    // Вход в узел: label вызывается, только если путь посещается впервые.
+    template<typename Label>
+    void enter(Kind kind, const void *node, const Label &label) {
+        const uint64_t key = reinterpret_cast<uintptr_t>(node) * 4 + static_cast<uint64_t>(kind);
+        auto &children = frames_[current_].children;
+        auto it = children.find(key);
+        size_t frame;
+        if (it == children.end()) {
+            frame = addFrame(kind, label());
+            frames_[current_].children.emplace(key, frame);
+        } else {
+            frame = it->second;
+        }
+        stack_.push_back({current_, std::chrono::steady_clock::now()});
+        current_ = frame;
+        ++frames_[frame].calls;
+        unwinding_ = false;
+    }
+
+    // Выход из узла; failed — выход по исключению.
+    void leave(bool failed);
+
+    void allocation() {
+        if (enabled_)
+            ++frames_[current_].allocations;
+    }
+
+    const std::vector<Frame> &frames() const { return frames_; }
+
+    // Дерево путей вызовов в формате JSON.
+    std::string toJson() const;
+
+    // Формат "folded stacks" для flamegraph.pl: путь через ';' и собственное время в наносекундах.
+    std::string toFolded() const;
+
+private:
+    struct Entry {
+        size_t parent;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    Profiler();
+
+    size_t addFrame(Kind kind, const std::string &label);
+
+    void writeJson(size_t frame, std::string &out) const;
+
+    void writeFolded(size_t frame, const std::string &prefix, std::string &out) const;
+
+    bool enabled_ = false;
+    bool unwinding_ = false;
+    std::vector<Frame> frames_; // frames_[0] — корень
+    std::vector<Entry> stack_;
+    size_t current_ = 0;
+};
+
+// Измерение одного вызова: вход в конструкторе, выход в деструкторе.
+// Исключение засчитывается самому внутреннему узлу, из которого оно вышло.
+class Scope {
+public:
+    template<typename Node>
+    Scope(Kind kind, const Node *node)
+        : active_(Profiler::instance().enabled()), exceptions_(std::uncaught_exceptions()) {
+        if (active_)
+            Profiler::instance().enter(kind, node, [node] { return nodeLabel(*node); });
+    }
+
+    ~Scope() {
+        if (active_)
+            Profiler::instance().leave(std::uncaught_exceptions() > exceptions_);
+    }
+
+    Scope(const Scope &) = delete;
+
+    Scope &operator=(const Scope &) = delete;
+
+private:
+    bool active_;
+    int exceptions_;
+};
+
+} // namespace profile
+
+#ifdef EXPRESSION_PROFILE
+#define PROFILE_SCOPE(kind, node) profile::Scope profileScope_(kind, node)
+#define PROFILE_ALLOCATION() profile::Profiler::instance().allocation()
+#else
+#define PROFILE_SCOPE(kind, node) ((void) 0)
+#define PROFILE_ALLOCATION() ((void) 0)
+#endif
+
+#endif // PROFILE_HPP
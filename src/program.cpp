@@ -0,0 +1,1123 @@
+#include "program.hpp"
+#include "functions.hpp"
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <limits>
+
+// Признак отсутствия регистра.
+static const uint32_t NO_REGISTER = UINT32_MAX;
+
+// Вычисление бинарной операции; ошибки совпадают с ошибками Expression<T>::eval.
+template<typename T>
+static inline T evalBinary(OpCode op, T left, T right) {
+    switch (op) {
+        case OpCode::Add:
+            return left + right;
+        case OpCode::Sub:
+            return left - right;
+        case OpCode::Mul:
+            return left * right;
+        case OpCode::Div:
+            if (right == T(0) && errorPolicy() == ErrorPolicy::Throw)
+                throw std::runtime_error("Division by zero");
+            return left / right;
+        case OpCode::Pow:
+            return std::pow(left, right);
+        case OpCode::Less:
+        case OpCode::LessEqual:
+            if constexpr (std::is_floating_point_v<T>)
+                return T(op == OpCode::Less ? left < right : left <= right);
+            else
+                throw std::runtime_error("Ordering comparison of complex values");
+        case OpCode::Equal:
+            return T(left == right);
+        case OpCode::NotEqual:
+            return T(left != right);
+        default:
+            throw std::logic_error("Not a binary operation");
+    }
+}
+
+// Вычисление унарной операции.
+template<typename T>
+static inline T evalUnary(OpCode op, T arg) {
+    switch (op) {
+        case OpCode::Sin:
+            return std::sin(arg);
+        case OpCode::Cos:
+            return std::cos(arg);
+        case OpCode::Ln:
+            if constexpr (std::is_floating_point_v<T>) {
+                if (arg <= T(0) && errorPolicy() == ErrorPolicy::Throw)
+                    throw std::runtime_error("Logarithm of non-positive value");
+            }
+            return std::log(arg);
+        case OpCode::Exp:
+            return std::exp(arg);
+        default:
+            throw std::logic_error("Not a unary operation");
+    }
+}
+
+// Инструкции с операндом b (у Select есть ещё и операнд c).
+static inline bool isBinary(OpCode op) {
+    return op == OpCode::Add || op == OpCode::Sub || op == OpCode::Mul || op == OpCode::Div || op == OpCode::Pow ||
+           op == OpCode::Call2 || op == OpCode::Less || op == OpCode::LessEqual || op == OpCode::Equal ||
+           op == OpCode::NotEqual || op == OpCode::Select;
+}
+
+/*
+    Реализация класса VariableTable
+*/
+
+VariableTable::VariableTable(const std::vector<std::string> &names) {
+    for (const auto &name: names)
+        add(name);
+}
+
+size_t VariableTable::add(const std::string &name) {
+    auto it = index_.find(name);
+    if (it != index_.end())
+        return it->second;
+    names_.push_back(name);
+    index_.emplace(name, names_.size() - 1);
+    return names_.size() - 1;
+}
+
+size_t VariableTable::find(const std::string &name) const {
+    auto it = index_.find(name);
+    return it == index_.end() ? NOT_FOUND : it->second;
+}
+
+// ===================================================================
+
+/*
+    Реализация класса Program<T>
+*/
+
+// Значение операнда исполняемой программы: регистр, константа или вход.
+template<typename T>
+static inline T operand(uint32_t code, const T *registers, const T *constants, const T *inputs) {
+    switch (code & OPERAND_KIND) {
+        case OPERAND_REGISTER:
+            return registers[code];
+        case OPERAND_CONSTANT:
+            return constants[code & OPERAND_INDEX];
+        default:
+            return inputs[code & OPERAND_INDEX];
+    }
+}
+
+// Значение инструкции исполняемой программы.
+template<typename T>
+static inline T evalInstruction(const Instruction &ins, const T *registers, const T *constants, const T *inputs) {
+    switch (ins.op) {
+        case OpCode::Constant:
+            return constants[ins.a];
+        case OpCode::Variable:
+            return inputs[ins.a];
+        case OpCode::Add:
+            return operand(ins.a, registers, constants, inputs) + operand(ins.b, registers, constants, inputs);
+        case OpCode::Sub:
+            return operand(ins.a, registers, constants, inputs) - operand(ins.b, registers, constants, inputs);
+        case OpCode::Mul:
+            return operand(ins.a, registers, constants, inputs) * operand(ins.b, registers, constants, inputs);
+        case OpCode::Div:
+        case OpCode::Pow:
+        case OpCode::Less:
+        case OpCode::LessEqual:
+        case OpCode::Equal:
+        case OpCode::NotEqual:
+            return evalBinary(ins.op, operand(ins.a, registers, constants, inputs),
+                              operand(ins.b, registers, constants, inputs));
+        case OpCode::PowInt:
+            return integerPower(operand(ins.a, registers, constants, inputs),
+                                static_cast<long>(static_cast<int32_t>(ins.b)));
+        case OpCode::Call1:
+        case OpCode::Call2: {
+            T args[2] = {operand(ins.a, registers, constants, inputs), T(0)};
+            if (ins.op == OpCode::Call2)
+                args[1] = operand(ins.b, registers, constants, inputs);
+            return FunctionRegistry<T>::instance().get(ins.function).eval(args);
+        }
+        case OpCode::Select:
+            return operand(ins.a, registers, constants, inputs) != T(0) ? operand(ins.b, registers, constants, inputs)
+                                                                        : operand(ins.c, registers, constants, inputs);
+        default:
+            return evalUnary(ins.op, operand(ins.a, registers, constants, inputs));
+    }
+}
+
+template<typename T>
+void Program<T>::eval(const T *inputs, T *registers, T *outputs) const {
+    if (branches_ && errorPolicy() == ErrorPolicy::Throw) {
+        evalBranches(inputs, registers);
+    } else {
+        const size_t count = code_.size();
+        const T *constants = constants_.data();
+        for (size_t i = 0; i < count; ++i)
+            registers[i] = evalInstruction(code_[i], registers, constants, inputs);
+    }
+    for (size_t k = 0; k < outputs_.size(); ++k)
+        outputs[k] = registers[outputs_[k]];
+}
+
+template<typename T>
+void Program<T>::evalBranches(const T *inputs, T *registers) const {
+    // Исключение инструкции ветви запоминается в её регистре и переходит к зависимым инструкциям ветвей;
+    // возбуждается оно, когда регистр выбран Select или нужен вне ветвей. Пока ошибок нет,
+    // цикл отличается от обычного только блоком try.
+    thread_local std::vector<std::exception_ptr> pending;
+    bool failed = false;
+    auto error = [&](uint32_t code) -> std::exception_ptr {
+        return (code & OPERAND_KIND) == OPERAND_REGISTER ? pending[code] : nullptr;
+    };
+    const size_t count = code_.size();
+    const T *constants = constants_.data();
+    for (size_t i = 0; i < count; ++i) {
+        const Instruction &ins = code_[i];
+        if (failed && ins.op != OpCode::Constant && ins.op != OpCode::Variable) {
+            std::exception_ptr cause = error(ins.a);
+            if (ins.op == OpCode::Select && !cause)
+                cause = error(operand(ins.a, registers, constants, inputs) != T(0) ? ins.b : ins.c);
+            else if (isBinary(ins.op) && ins.op != OpCode::Select && !cause)
+                cause = error(ins.b);
+            if (cause) {
+                if (!ins.conditional)
+                    std::rethrow_exception(cause);
+                pending[i] = cause;
+                continue;
+            }
+        }
+        if (!ins.conditional) {
+            registers[i] = evalInstruction(ins, registers, constants, inputs);
+            continue;
+        }
+        try {
+            registers[i] = evalInstruction(ins, registers, constants, inputs);
+        } catch (...) {
+            if (!failed)
+                pending.assign(count, nullptr);
+            failed = true;
+            pending[i] = std::current_exception();
+        }
+    }
+}
+
+template<typename T>
+void Program<T>::eval(const std::vector<T> &inputs, std::vector<T> &registers, std::vector<T> &outputs) const {
+    if (inputs.size() != variables_.size())
+        throw std::runtime_error("Wrong number of inputs");
+    registers.resize(code_.size());
+    outputs.resize(outputs_.size());
+    eval(inputs.data(), registers.data(), outputs.data());
+}
+
+template<typename T>
+std::vector<T> Program<T>::eval(const std::map<std::string, T> &context, ErrorPolicy policy) const {
+    ErrorPolicyScope scope(policy);
+    std::vector<T> inputs, registers, outputs;
+    variables_.bind(context, inputs, policy);
+    eval(inputs, registers, outputs);
+    return outputs;
+}
+
+template<typename T>
+size_t Program<T>::output(const std::string &name) const {
+    for (size_t k = 0; k < outputNames_.size(); ++k) {
+        if (outputNames_[k] == name)
+            return k;
+    }
+    throw std::runtime_error("Output \"" + name + "\" not found in program");
+}
+
+template<typename T>
+void Program<T>::evalBatch(const T *const *inputs, T *const *outputs, size_t rows,
+                           ErrorPolicy policy, std::vector<bool> *errors) const {
+    ErrorPolicyScope scope(policy);
+    const bool checked = policy == ErrorPolicy::Throw;
+    if (errors)
+        errors->assign(rows, false);
+    const size_t count = code_.size();
+    std::vector<T> buffer(count * BATCH_BLOCK);
+    // Отметки строк, в которых инструкция могла дать ошибку области определения: при Throw нужны
+    // только в ветвях Select, для битовой карты errors — во всех инструкциях.
+    const bool track = (checked && branches_) || errors;
+    std::vector<char> failed(track ? count * BATCH_BLOCK : 0, 0);
+    const std::vector<char> clean(BATCH_BLOCK, 0);
+    // Константы размножаются на блок один раз, чтобы все операнды читались одинаково — как массивы.
+    std::vector<T> constants(constants_.size() * BATCH_BLOCK);
+    for (size_t c = 0; c < constants_.size(); ++c)
+        std::fill(constants.begin() + c * BATCH_BLOCK, constants.begin() + (c + 1) * BATCH_BLOCK, constants_[c]);
+    const FunctionRegistry<T> &registry = FunctionRegistry<T>::instance();
+    for (size_t start = 0; start < rows; start += BATCH_BLOCK) {
+        const size_t n = std::min(BATCH_BLOCK, rows - start);
+        auto column = [&](uint32_t code) -> const T * {
+            switch (code & OPERAND_KIND) {
+                case OPERAND_REGISTER:
+                    return &buffer[code * BATCH_BLOCK];
+                case OPERAND_CONSTANT:
+                    return &constants[(code & OPERAND_INDEX) * BATCH_BLOCK];
+                default:
+                    return inputs[code & OPERAND_INDEX] + start;
+            }
+        };
+        auto flags = [&](uint32_t code) -> const char * {
+            return (code & OPERAND_KIND) == OPERAND_REGISTER ? &failed[code * BATCH_BLOCK] : clean.data();
+        };
+        // Строка с отмеченной выбранной ветвью перевычисляется отдельно: eval следует выбранной ветви
+        // и бросает то же исключение, что и дерево. Отметка может быть ложной (NaN функции реестра
+        // без ошибки) — тогда eval завершается, и значение строки в пакете уже верно.
+        auto raise = [&](size_t row) {
+            std::vector<T> values(variables_.size()), registers(count), results(outputs_.size());
+            for (size_t v = 0; v < values.size(); ++v)
+                values[v] = inputs[v][row];
+            eval(values.data(), registers.data(), results.data());
+        };
+        for (size_t i = 0; i < count; ++i) {
+            const Instruction &ins = code_[i];
+            T *r = &buffer[i * BATCH_BLOCK];
+            // Ветви Select вычисляются для всех строк блока: ошибка в строке, где ветвь не выбрана,
+            // не должна прерывать вычисление.
+            ErrorPolicyScope branch(ins.conditional ? ErrorPolicy::Propagate : policy);
+            const bool check = checked && !ins.conditional;
+            if (ins.op == OpCode::Constant) {
+                std::fill(r, r + n, constants_[ins.a]);
+                continue;
+            }
+            if (ins.op == OpCode::Variable) {
+                std::copy(inputs[ins.a] + start, inputs[ins.a] + start + n, r);
+                continue;
+            }
+            const T *a = column(ins.a);
+            const T *b = isBinary(ins.op) ? column(ins.b) : nullptr;
+            switch (ins.op) {
+                case OpCode::Add:
+                    for (size_t j = 0; j < n; ++j)
+                        r[j] = a[j] + b[j];
+                    break;
+                case OpCode::Sub:
+                    for (size_t j = 0; j < n; ++j)
+                        r[j] = a[j] - b[j];
+                    break;
+                case OpCode::Mul:
+                    for (size_t j = 0; j < n; ++j)
+                        r[j] = a[j] * b[j];
+                    break;
+                case OpCode::Div:
+                    // Проверка знаменателя вынесена из цикла деления, чтобы тот оставался без ветвлений.
+                    for (size_t j = 0; check && j < n; ++j) {
+                        if (b[j] == T(0))
+                            throw std::runtime_error("Division by zero");
+                    }
+                    for (size_t j = 0; j < n; ++j)
+                        r[j] = a[j] / b[j];
+                    break;
+                case OpCode::Pow:
+                    for (size_t j = 0; j < n; ++j)
+                        r[j] = std::pow(a[j], b[j]);
+                    break;
+                case OpCode::PowInt: {
+                    const long exponent = static_cast<int32_t>(ins.b);
+                    for (size_t j = 0; j < n; ++j)
+                        r[j] = integerPower(a[j], exponent);
+                    break;
+                }
+                case OpCode::Sin:
+                    for (size_t j = 0; j < n; ++j)
+                        r[j] = std::sin(a[j]);
+                    break;
+                case OpCode::Cos:
+                    for (size_t j = 0; j < n; ++j)
+                        r[j] = std::cos(a[j]);
+                    break;
+                case OpCode::Ln:
+                    if constexpr (std::is_floating_point_v<T>) {
+                        for (size_t j = 0; check && j < n; ++j) {
+                            if (a[j] <= T(0))
+                                throw std::runtime_error("Logarithm of non-positive value");
+                        }
+                    }
+                    for (size_t j = 0; j < n; ++j)
+                        r[j] = std::log(a[j]);
+                    break;
+                case OpCode::Exp:
+                    for (size_t j = 0; j < n; ++j)
+                        r[j] = std::exp(a[j]);
+                    break;
+                case OpCode::Call1:
+                case OpCode::Call2: {
+                    const T *args[2] = {a, b};
+                    registry.get(ins.function).kernel(args, r, n);
+                    break;
+                }
+                case OpCode::Less:
+                    if constexpr (std::is_floating_point_v<T>) {
+                        for (size_t j = 0; j < n; ++j)
+                            r[j] = T(a[j] < b[j]);
+                    } else {
+                        throw std::runtime_error("Ordering comparison of complex values");
+                    }
+                    break;
+                case OpCode::LessEqual:
+                    if constexpr (std::is_floating_point_v<T>) {
+                        for (size_t j = 0; j < n; ++j)
+                            r[j] = T(a[j] <= b[j]);
+                    } else {
+                        throw std::runtime_error("Ordering comparison of complex values");
+                    }
+                    break;
+                case OpCode::Equal:
+                    for (size_t j = 0; j < n; ++j)
+                        r[j] = T(a[j] == b[j]);
+                    break;
+                case OpCode::NotEqual:
+                    for (size_t j = 0; j < n; ++j)
+                        r[j] = T(a[j] != b[j]);
+                    break;
+                case OpCode::Select: {
+                    // Обе ветви уже вычислены для всего блока; выбор по маске условия — без переходов.
+                    const T *c = column(ins.c);
+                    for (size_t j = 0; j < n; ++j)
+                        r[j] = a[j] != T(0) ? b[j] : c[j];
+                    break;
+                }
+                default:
+                    break;
+            }
+            if (!track || (!errors && !ins.conditional && ins.op != OpCode::Select))
+                continue;
+            // Отметки проходят через операции ветвей и смешиваются Select по той же маске, что и значения.
+            char *f = &failed[i * BATCH_BLOCK];
+            const char *fa = flags(ins.a);
+            if (ins.op == OpCode::Select) {
+                const char *fb = flags(ins.b), *fc = flags(ins.c);
+                for (size_t j = 0; j < n; ++j)
+                    f[j] = fa[j] | (a[j] != T(0) ? fb[j] : fc[j]);
+                if (checked && !ins.conditional) {
+                    for (size_t j = 0; j < n; ++j) {
+                        if (f[j])
+                            raise(start + j);
+                    }
+                    std::fill(f, f + n, 0);
+                }
+                continue;
+            }
+            const char *fb = isBinary(ins.op) ? flags(ins.b) : clean.data();
+            for (size_t j = 0; j < n; ++j)
+                f[j] = fa[j] | fb[j];
+            if (ins.op == OpCode::Div) {
+                for (size_t j = 0; j < n; ++j)
+                    f[j] |= b[j] == T(0);
+            } else if (ins.op == OpCode::Ln) {
+                if constexpr (std::is_floating_point_v<T>) {
+                    for (size_t j = 0; j < n; ++j)
+                        f[j] |= a[j] <= T(0);
+                }
+            } else if (ins.op == OpCode::Call1 || ins.op == OpCode::Call2) {
+                // NaN из конечных аргументов — аргумент вне области определения функции (sqrt(-1)).
+                for (size_t j = 0; j < n; ++j)
+                    f[j] |= r[j] != r[j] && a[j] == a[j] && (!b || b[j] == b[j]);
+            }
+        }
+        for (size_t k = 0; k < outputs_.size(); ++k) {
+            const T *r = &buffer[outputs_[k] * BATCH_BLOCK];
+            std::copy(r, r + n, outputs[k] + start);
+            if (errors) {
+                const char *f = &failed[outputs_[k] * BATCH_BLOCK];
+                for (size_t j = 0; j < n; ++j) {
+                    if (f[j])
+                        (*errors)[start + j] = true;
+                }
+            }
+        }
+    }
+}
+
+template<typename T>
+void Program<T>::evalBatchBounded(const T *const *inputs, T *const *outputs, Real *const *bounds,
+                                  size_t rows) const {
+    ErrorPolicyScope scope(ErrorPolicy::Propagate);
+    const Real u = std::numeric_limits<Real>::epsilon() / 2;
+    const Real infinity = std::numeric_limits<Real>::infinity();
+    const size_t count = code_.size();
+    std::vector<T> buffer(count * BATCH_BLOCK);
+    std::vector<Real> error(count * BATCH_BLOCK);
+    std::vector<T> constants(constants_.size() * BATCH_BLOCK);
+    std::vector<Real> constantErrors(constants_.size() * BATCH_BLOCK);
+    for (size_t c = 0; c < constants_.size(); ++c) {
+        // Константа из текста уже округлена до T.
+        std::fill(constants.begin() + c * BATCH_BLOCK, constants.begin() + (c + 1) * BATCH_BLOCK, constants_[c]);
+        std::fill(constantErrors.begin() + c * BATCH_BLOCK, constantErrors.begin() + (c + 1) * BATCH_BLOCK,
+                  u * std::abs(constants_[c]));
+    }
+    const std::vector<Real> exact(BATCH_BLOCK, Real(0));
+    std::vector<T> shifted(2 * BATCH_BLOCK), probe(BATCH_BLOCK);
+    const FunctionRegistry<T> &registry = FunctionRegistry<T>::instance();
+    for (size_t start = 0; start < rows; start += BATCH_BLOCK) {
+        const size_t n = std::min(BATCH_BLOCK, rows - start);
+        auto column = [&](uint32_t code) -> const T * {
+            switch (code & OPERAND_KIND) {
+                case OPERAND_REGISTER:
+                    return &buffer[code * BATCH_BLOCK];
+                case OPERAND_CONSTANT:
+                    return &constants[(code & OPERAND_INDEX) * BATCH_BLOCK];
+                default:
+                    return inputs[code & OPERAND_INDEX] + start;
+            }
+        };
+        auto columnError = [&](uint32_t code) -> const Real * {
+            switch (code & OPERAND_KIND) {
+                case OPERAND_REGISTER:
+                    return &error[code * BATCH_BLOCK];
+                case OPERAND_CONSTANT:
+                    return &constantErrors[(code & OPERAND_INDEX) * BATCH_BLOCK];
+                default:
+                    return exact.data();
+            }
+        };
+        for (size_t i = 0; i < count; ++i) {
+            const Instruction &ins = code_[i];
+            T *r = &buffer[i * BATCH_BLOCK];
+            Real *e = &error[i * BATCH_BLOCK];
+            if (ins.op == OpCode::Constant) {
+                std::fill(r, r + n, constants_[ins.a]);
+                std::fill(e, e + n, u * std::abs(constants_[ins.a]));
+                continue;
+            }
+            if (ins.op == OpCode::Variable) {
+                std::copy(inputs[ins.a] + start, inputs[ins.a] + start + n, r);
+                std::fill(e, e + n, Real(0));
+                continue;
+            }
+            const T *a = column(ins.a);
+            const Real *ea = columnError(ins.a);
+            const bool binary = isBinary(ins.op);
+            const T *b = binary ? column(ins.b) : nullptr;
+            const Real *eb = binary ? columnError(ins.b) : nullptr;
+            switch (ins.op) {
+                case OpCode::Add:
+                    for (size_t j = 0; j < n; ++j) {
+                        r[j] = a[j] + b[j];
+                        e[j] = ea[j] + eb[j] + u * std::abs(r[j]);
+                    }
+                    break;
+                case OpCode::Sub:
+                    for (size_t j = 0; j < n; ++j) {
+                        r[j] = a[j] - b[j];
+                        e[j] = ea[j] + eb[j] + u * std::abs(r[j]);
+                    }
+                    break;
+                case OpCode::Mul:
+                    for (size_t j = 0; j < n; ++j) {
+                        r[j] = a[j] * b[j];
+                        e[j] = std::abs(b[j]) * ea[j] + std::abs(a[j]) * eb[j] + ea[j] * eb[j] + u * std::abs(r[j]);
+                    }
+                    break;
+                case OpCode::Div:
+                    for (size_t j = 0; j < n; ++j) {
+                        r[j] = a[j] / b[j];
+                        // Если интервал знаменателя содержит ноль, оценка не ограничена.
+                        Real denominator = std::abs(b[j]) - eb[j];
+                        e[j] = denominator > 0 ? (ea[j] + std::abs(r[j]) * eb[j]) / denominator + u * std::abs(r[j])
+                                               : infinity;
+                    }
+                    break;
+                case OpCode::Pow:
+                    for (size_t j = 0; j < n; ++j) {
+                        r[j] = std::pow(a[j], b[j]);
+                        // d(a^b) = b a^(b-1) da + a^b ln(a) db; pow округляет с точностью до 1-2 ulp.
+                        Real base = eb[j] > 0 ? std::abs(r[j] * std::log(a[j])) * eb[j] : Real(0);
+                        e[j] = std::abs(b[j] * std::pow(a[j], b[j] - T(1))) * ea[j] + base + 2 * u * std::abs(r[j]);
+                    }
+                    break;
+                case OpCode::PowInt: {
+                    const long exponent = static_cast<int32_t>(ins.b);
+                    // Двоичное возведение в степень делает не больше 2 log2|n| умножений.
+                    Real rounding = u;
+                    for (unsigned long k = exponent < 0 ? -exponent : exponent; k > 1; k >>= 1)
+                        rounding += 2 * u;
+                    for (size_t j = 0; j < n; ++j) {
+                        r[j] = integerPower(a[j], exponent);
+                        e[j] = std::abs(T(exponent) * integerPower(a[j], exponent - 1)) * ea[j] + rounding * std::abs(r[j]);
+                    }
+                    break;
+                }
+                case OpCode::Sin:
+                    for (size_t j = 0; j < n; ++j) {
+                        r[j] = std::sin(a[j]);
+                        e[j] = std::abs(std::cos(a[j])) * ea[j] + u * std::abs(r[j]);
+                    }
+                    break;
+                case OpCode::Cos:
+                    for (size_t j = 0; j < n; ++j) {
+                        r[j] = std::cos(a[j]);
+                        e[j] = std::abs(std::sin(a[j])) * ea[j] + u * std::abs(r[j]);
+                    }
+                    break;
+                case OpCode::Ln:
+                    for (size_t j = 0; j < n; ++j) {
+                        r[j] = std::log(a[j]);
+                        Real argument = std::abs(a[j]) - ea[j];
+                        e[j] = argument > 0 ? ea[j] / argument + u * std::abs(r[j]) : infinity;
+                    }
+                    break;
+                case OpCode::Exp:
+                    for (size_t j = 0; j < n; ++j) {
+                        r[j] = std::exp(a[j]);
+                        e[j] = std::abs(r[j]) * ea[j] + u * std::abs(r[j]);
+                    }
+                    break;
+                case OpCode::Call1:
+                case OpCode::Call2: {
+                    const FunctionInfo<T> &info = registry.get(ins.function);
+                    const T *args[2] = {a, b};
+                    info.kernel(args, r, n);
+                    for (size_t j = 0; j < n; ++j)
+                        e[j] = u * std::abs(r[j]);
+                    // Вклад погрешности каждого аргумента: |f(x + e_x) - f(x)|.
+                    for (size_t k = 0; k < (binary ? 2u : 1u); ++k) {
+                        const T *arg = k == 0 ? a : b;
+                        const Real *argError = k == 0 ? ea : eb;
+                        T *moved = &shifted[k * BATCH_BLOCK];
+                        for (size_t j = 0; j < n; ++j)
+                            moved[j] = arg[j] + T(argError[j]);
+                        const T *probeArgs[2] = {k == 0 ? moved : a, k == 1 ? moved : b};
+                        info.kernel(probeArgs, probe.data(), n);
+                        for (size_t j = 0; j < n; ++j)
+                            e[j] += std::abs(probe[j] - r[j]);
+                    }
+                    break;
+                }
+                case OpCode::Less:
+                case OpCode::LessEqual:
+                case OpCode::Equal:
+                case OpCode::NotEqual:
+                    // Результат точен, если интервалы погрешности операндов не дают другого исхода; иначе он может
+                    // отличаться от точного на 1.
+                    for (size_t j = 0; j < n; ++j) {
+                        r[j] = evalBinary(ins.op, a[j], b[j]);
+                        e[j] = std::abs(a[j] - b[j]) > ea[j] + eb[j] ? Real(0) : Real(1);
+                    }
+                    break;
+                case OpCode::Select: {
+                    const T *c = column(ins.c);
+                    const Real *ec = columnError(ins.c);
+                    for (size_t j = 0; j < n; ++j) {
+                        const bool first = a[j] != T(0);
+                        r[j] = first ? b[j] : c[j];
+                        // При неточном условии могла быть выбрана другая ветвь.
+                        e[j] = ea[j] == Real(0) ? (first ? eb[j] : ec[j])
+                                                : std::max(eb[j], ec[j]) + std::abs(b[j] - c[j]);
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+        for (size_t k = 0; k < outputs_.size(); ++k) {
+            const T *r = &buffer[outputs_[k] * BATCH_BLOCK];
+            const Real *e = &error[outputs_[k] * BATCH_BLOCK];
+            for (size_t j = 0; j < n; ++j) {
+                outputs[k][start + j] = r[j];
+                // Неконечное значение или оценка (NaN, ошибка в точке) считается неограниченной погрешностью.
+                bounds[k][start + j] = isFinite(r[j]) && e[j] == e[j] ? e[j] : infinity;
+            }
+        }
+    }
+}
+
+template<typename T>
+template<typename U>
+Program<U> Program<T>::converted() const {
+    Program<U> result;
+    result.code_ = code_;
+    for (auto &ins: result.code_) {
+        if (ins.op == OpCode::Call1 || ins.op == OpCode::Call2)
+            ins.function = FunctionRegistry<U>::instance().id(FunctionRegistry<T>::instance().get(ins.function).name);
+    }
+    for (const T &value: constants_)
+        result.constants_.push_back(static_cast<U>(value));
+    result.variables_ = variables_;
+    result.outputs_ = outputs_;
+    result.outputNames_ = outputNames_;
+    result.branches_ = branches_;
+    return result;
+}
+
+// ===================================================================
+
+/*
+    Реализация класса ProgramBuilder<T>
+*/
+
+template<typename T>
+size_t ProgramBuilder<T>::InstructionHash::operator()(const Instruction &ins) const {
+    size_t h = static_cast<size_t>(ins.op) << 16 | ins.function;
+    h = h * 1000003u ^ ins.a;
+    h = h * 1000003u ^ ins.b;
+    h = h * 1000003u ^ ins.c;
+    return h;
+}
+
+template<typename T>
+bool ProgramBuilder<T>::InstructionEqual::operator()(const Instruction &l, const Instruction &r) const {
+    return l.op == r.op && l.function == r.function && l.a == r.a && l.b == r.b && l.c == r.c;
+}
+
+template<typename T>
+size_t ProgramBuilder<T>::ValueHash::operator()(const T &value) const {
+    if constexpr (std::is_floating_point_v<T>) {
+        return std::hash<T>()(value);
+    } else {
+        using R = typename T::value_type;
+        return std::hash<R>()(value.real()) * 31u ^ std::hash<R>()(value.imag());
+    }
+}
+
+template<typename T>
+ProgramBuilder<T>::ProgramBuilder(const VariableTable &variables)
+    : variables_(variables) {
+}
+
+template<typename T>
+uint32_t ProgramBuilder<T>::emit(OpCode op, uint32_t a, uint32_t b, uint16_t function, uint32_t c) {
+    Instruction ins{op, function, a, b, c, false};
+    auto it = instructions_.find(ins);
+    if (it != instructions_.end())
+        return it->second;
+    uint32_t reg = static_cast<uint32_t>(code_.size());
+    code_.push_back(ins);
+    instructions_.emplace(ins, reg);
+    return reg;
+}
+
+template<typename T>
+uint32_t ProgramBuilder<T>::add(const Expression<T> &expr) {
+    return expr.compile(*this);
+}
+
+template<typename T>
+uint32_t ProgramBuilder<T>::constant(T value) {
+    auto it = constants_.find(value);
+    if (it != constants_.end())
+        return it->second;
+    uint32_t index = static_cast<uint32_t>(values_.size());
+    values_.push_back(value);
+    uint32_t reg = emit(OpCode::Constant, index, 0);
+    constants_.emplace(value, reg);
+    return reg;
+}
+
+template<typename T>
+uint32_t ProgramBuilder<T>::variableIndex(const std::string &name) {
+    return static_cast<uint32_t>(variables_.add(name));
+}
+
+template<typename T>
+uint32_t ProgramBuilder<T>::variable(const std::string &name) {
+    auto it = bindings_.find(name);
+    if (it != bindings_.end())
+        return it->second;
+    return emit(OpCode::Variable, variableIndex(name), 0);
+}
+
+template<typename T>
+bool ProgramBuilder<T>::isConstant(uint32_t reg, T value) const {
+    const Instruction &ins = code_[reg];
+    return ins.op == OpCode::Constant && values_[ins.a] == value;
+}
+
+template<typename T>
+uint32_t ProgramBuilder<T>::unary(OpCode op, uint32_t arg) {
+    const Instruction &ins = code_[arg];
+    if (ins.op == OpCode::Constant) {
+        T value = values_[ins.a];
+        bool foldable = true;
+        if constexpr (std::is_floating_point_v<T>) {
+            // Ошибка логарифма должна возникать при вычислении, а не при компиляции.
+            foldable = op != OpCode::Ln || value > T(0);
+        }
+        if (foldable)
+            return constant(evalUnary(op, value));
+    }
+    return emit(op, arg, 0);
+}
+
+template<typename T>
+uint32_t ProgramBuilder<T>::binary(OpCode op, uint32_t left, uint32_t right) {
+    const Instruction &l = code_[left];
+    const Instruction &r = code_[right];
+    // Упорядочивание комплексных чисел — ошибка вычисления, а не компиляции, поэтому не сворачивается.
+    const bool ordering = op == OpCode::Less || op == OpCode::LessEqual;
+    if (l.op == OpCode::Constant && r.op == OpCode::Constant && (std::is_floating_point_v<T> || !ordering)) {
+        T lv = values_[l.a];
+        T rv = values_[r.a];
+        if (op != OpCode::Div || rv != T(0))
+            return constant(evalBinary(op, lv, rv));
+    }
+    switch (op) {
+        case OpCode::Add:
+            if (isConstant(left, T(0)))
+                return right;
+            if (isConstant(right, T(0)))
+                return left;
+            if (left > right)
+                std::swap(left, right);
+            break;
+        case OpCode::Sub:
+            if (isConstant(right, T(0)))
+                return left;
+            break;
+        case OpCode::Mul:
+            if (isConstant(left, T(1)))
+                return right;
+            if (isConstant(right, T(1)))
+                return left;
+            if (left > right)
+                std::swap(left, right);
+            break;
+        case OpCode::Div:
+            if (isConstant(right, T(1)))
+                return left;
+            break;
+        case OpCode::Pow: {
+            if (isConstant(right, T(1)))
+                return left;
+            long exponent;
+            if (r.op == OpCode::Constant && asInteger(values_[r.a], exponent))
+                return emit(OpCode::PowInt, left, static_cast<uint32_t>(static_cast<int32_t>(exponent)));
+            break;
+        }
+        case OpCode::Less:
+        case OpCode::LessEqual:
+            break;
+        case OpCode::Equal:
+        case OpCode::NotEqual:
+            if (left > right)
+                std::swap(left, right);
+            break;
+        default:
+            throw std::logic_error("Not a binary operation");
+    }
+    return emit(op, left, right);
+}
+
+template<typename T>
+uint32_t ProgramBuilder<T>::select(uint32_t condition, uint32_t ifTrue, uint32_t ifFalse) {
+    const Instruction &ins = code_[condition];
+    if (ins.op == OpCode::Constant)
+        return values_[ins.a] != T(0) ? ifTrue : ifFalse;
+    if (ifTrue == ifFalse)
+        return ifTrue;
+    return emit(OpCode::Select, condition, ifTrue, 0, ifFalse);
+}
+
+template<typename T>
+uint32_t ProgramBuilder<T>::call(uint16_t function, const std::vector<uint32_t> &args) {
+    const FunctionInfo<T> &info = FunctionRegistry<T>::instance().get(function);
+    bool constantArgs = true;
+    T values[2];
+    for (size_t i = 0; i < args.size(); ++i) {
+        const Instruction &ins = code_[args[i]];
+        constantArgs = constantArgs && ins.op == OpCode::Constant;
+        if (constantArgs)
+            values[i] = values_[ins.a];
+    }
+    if (constantArgs) {
+        try {
+            return constant(info.eval(values));
+        } catch (const std::runtime_error &) {
+            // Ошибка области определения должна возникать при вычислении, а не при компиляции.
+        }
+    }
+    if (args.size() == 1)
+        return emit(OpCode::Call1, args[0], 0, function);
+    return emit(OpCode::Call2, args[0], args[1], function);
+}
+
+template<typename T>
+uint32_t ProgramBuilder<T>::inlineExpression(const Expression<T> &expr, const std::vector<uint32_t> &args) {
+    std::map<std::string, uint32_t> saved;
+    saved.swap(bindings_);
+    for (size_t i = 0; i < args.size(); ++i)
+        bindings_[FUNCTION_ARGUMENTS[i]] = args[i];
+    uint32_t result = expr.compile(*this);
+    bindings_.swap(saved);
+    return result;
+}
+
+template<typename T>
+std::vector<uint32_t> ProgramBuilder<T>::dependencies(uint32_t reg) const {
+    std::vector<char> visited(reg + 1, 0);
+    std::vector<uint32_t> stack{reg};
+    std::vector<uint32_t> result;
+    visited[reg] = 1;
+    while (!stack.empty()) {
+        uint32_t current = stack.back();
+        stack.pop_back();
+        const Instruction &ins = code_[current];
+        if (ins.op == OpCode::Variable) {
+            result.push_back(ins.a);
+        } else if (ins.op != OpCode::Constant) {
+            if (!visited[ins.a]) {
+                visited[ins.a] = 1;
+                stack.push_back(ins.a);
+            }
+            if (isBinary(ins.op) && !visited[ins.b]) {
+                visited[ins.b] = 1;
+                stack.push_back(ins.b);
+            }
+            if (ins.op == OpCode::Select && !visited[ins.c]) {
+                visited[ins.c] = 1;
+                stack.push_back(ins.c);
+            }
+        }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+template<typename T>
+uint32_t ProgramBuilder<T>::derivative(uint32_t reg, uint32_t variableIndex) {
+    // Отмечаем подграф, от которого зависит reg; регистры упорядочены топологически,
+    // поэтому производные можно считать простым проходом по возрастанию номеров.
+    std::vector<char> needed(reg + 1, 0);
+    needed[reg] = 1;
+    for (uint32_t i = reg + 1; i-- > 0;) {
+        if (!needed[i])
+            continue;
+        const Instruction &ins = code_[i];
+        if (ins.op == OpCode::Constant || ins.op == OpCode::Variable)
+            continue;
+        needed[ins.a] = 1;
+        if (isBinary(ins.op))
+            needed[ins.b] = 1;
+        if (ins.op == OpCode::Select)
+            needed[ins.c] = 1;
+    }
+
+    std::vector<uint32_t> d(reg + 1, NO_REGISTER);
+    for (uint32_t i = 0; i <= reg; ++i) {
+        if (!needed[i])
+            continue;
+        // Копия: добавление инструкций может перераспределить память code_.
+        const Instruction ins = code_[i];
+        switch (ins.op) {
+            case OpCode::Constant:
+                d[i] = constant(T(0));
+                break;
+            case OpCode::Variable:
+                d[i] = constant(ins.a == variableIndex ? T(1) : T(0));
+                break;
+            case OpCode::Add:
+                d[i] = binary(OpCode::Add, d[ins.a], d[ins.b]);
+                break;
+            case OpCode::Sub:
+                d[i] = binary(OpCode::Sub, d[ins.a], d[ins.b]);
+                break;
+            case OpCode::Mul:
+                d[i] = binary(OpCode::Add, derivativeMul(d[ins.a], ins.b), derivativeMul(ins.a, d[ins.b]));
+                break;
+            case OpCode::Div:
+                // (f / g)' = (f' - (f / g) * g') / g
+                d[i] = derivativeDiv(binary(OpCode::Sub, d[ins.a], derivativeMul(i, d[ins.b])), ins.b);
+                break;
+            case OpCode::Pow: {
+                const Instruction &exponent = code_[ins.b];
+                if (exponent.op == OpCode::Constant) {
+                    // (f ^ c)' = c * f ^ (c - 1) * f'
+                    T c = values_[exponent.a];
+                    uint32_t power = binary(OpCode::Pow, ins.a, constant(c - T(1)));
+                    d[i] = derivativeMul(derivativeMul(ins.b, power), d[ins.a]);
+                } else {
+                    // (f ^ g)' = f ^ g * (g' * ln(f) + g * f' / f)
+                    uint32_t logPart = derivativeMul(d[ins.b], unary(OpCode::Ln, ins.a));
+                    uint32_t basePart = derivativeDiv(derivativeMul(ins.b, d[ins.a]), ins.a);
+                    d[i] = derivativeMul(i, binary(OpCode::Add, logPart, basePart));
+                }
+                break;
+            }
+            case OpCode::PowInt: {
+                // (f ^ n)' = n * f ^ (n - 1) * f'
+                long n = static_cast<int32_t>(ins.b);
+                uint32_t power = binary(OpCode::Pow, ins.a, constant(T(n - 1)));
+                d[i] = derivativeMul(derivativeMul(constant(T(n)), power), d[ins.a]);
+                break;
+            }
+            case OpCode::Sin:
+                d[i] = derivativeMul(unary(OpCode::Cos, ins.a), d[ins.a]);
+                break;
+            case OpCode::Cos:
+                d[i] = derivativeMul(constant(T(-1)), derivativeMul(unary(OpCode::Sin, ins.a), d[ins.a]));
+                break;
+            case OpCode::Ln:
+                d[i] = derivativeDiv(d[ins.a], ins.a);
+                break;
+            case OpCode::Exp:
+                d[i] = derivativeMul(i, d[ins.a]);
+                break;
+            case OpCode::Call1:
+            case OpCode::Call2: {
+                // Цепное правило с частными производными из реестра функций.
+                const FunctionInfo<T> &info = FunctionRegistry<T>::instance().get(ins.function);
+                std::vector<Expression<T> > placeholders;
+                std::vector<uint32_t> args{ins.a};
+                if (ins.op == OpCode::Call2)
+                    args.push_back(ins.b);
+                for (size_t k = 0; k < args.size(); ++k)
+                    placeholders.emplace_back(std::string(FUNCTION_ARGUMENTS[k]));
+                d[i] = constant(T(0));
+                for (size_t k = 0; k < args.size(); ++k) {
+                    if (isConstant(d[args[k]], T(0)))
+                        continue;
+                    uint32_t partial = inlineExpression(info.partial(placeholders, k), args);
+                    d[i] = binary(OpCode::Add, d[i], binary(OpCode::Mul, partial, d[args[k]]));
+                }
+                break;
+            }
+            case OpCode::Less:
+            case OpCode::LessEqual:
+            case OpCode::Equal:
+            case OpCode::NotEqual:
+                d[i] = constant(T(0));
+                break;
+            case OpCode::Select:
+                d[i] = select(ins.a, d[ins.b], d[ins.c]);
+                break;
+        }
+    }
+    return d[reg];
+}
+
+template<typename T>
+uint32_t ProgramBuilder<T>::derivativeMul(uint32_t left, uint32_t right) {
+    if (isConstant(left, T(0)) || isConstant(right, T(0)))
+        return constant(T(0));
+    return binary(OpCode::Mul, left, right);
+}
+
+template<typename T>
+uint32_t ProgramBuilder<T>::derivativeDiv(uint32_t numerator, uint32_t denominator) {
+    if (isConstant(numerator, T(0)))
+        return constant(T(0));
+    return binary(OpCode::Div, numerator, denominator);
+}
+
+template<typename T>
+size_t ProgramBuilder<T>::addOutput(uint32_t reg, const std::string &name) {
+    outputs_.push_back(reg);
+    outputNames_.push_back(name);
+    return outputs_.size() - 1;
+}
+
+template<typename T>
+void ProgramBuilder<T>::define(const std::string &name, uint32_t reg) {
+    if (variables_.find(name) != VariableTable::NOT_FOUND)
+        throw std::runtime_error("\"" + name + "\" is used as a variable before its definition");
+    if (!bindings_.emplace(name, reg).second)
+        throw std::runtime_error("Redefinition of \"" + name + "\"");
+}
+
+template<typename T>
+Program<T> ProgramBuilder<T>::build() const {
+    // Отмечаем инструкции, нужные выходам, и среди них — нужные не только ветвям Select.
+    std::vector<char> live(code_.size(), 0), unconditional(code_.size(), 0);
+    for (uint32_t reg: outputs_)
+        live[reg] = unconditional[reg] = 1;
+    for (size_t i = code_.size(); i-- > 0;) {
+        const Instruction &ins = code_[i];
+        if (!live[i] || ins.op == OpCode::Constant || ins.op == OpCode::Variable)
+            continue;
+        live[ins.a] = 1;
+        unconditional[ins.a] |= unconditional[i];
+        if (isBinary(ins.op)) {
+            live[ins.b] = 1;
+            unconditional[ins.b] |= unconditional[i] && ins.op != OpCode::Select;
+        }
+        if (ins.op == OpCode::Select)
+            live[ins.c] = 1;
+    }
+
+    Program<T> program;
+    program.variables_ = variables_;
+    // Операнд исполняемой программы для каждого регистра графа.
+    std::vector<uint32_t> operands(code_.size(), NO_REGISTER);
+    std::vector<uint32_t> constantIndex(values_.size(), NO_REGISTER);
+    auto leaf = [&](const Instruction &ins) -> uint32_t {
+        if (ins.op == OpCode::Variable)
+            return OPERAND_INPUT | ins.a;
+        if (constantIndex[ins.a] == NO_REGISTER) {
+            constantIndex[ins.a] = static_cast<uint32_t>(program.constants_.size());
+            program.constants_.push_back(values_[ins.a]);
+        }
+        return OPERAND_CONSTANT | constantIndex[ins.a];
+    };
+    for (size_t i = 0; i < code_.size(); ++i) {
+        if (!live[i])
+            continue;
+        Instruction ins = code_[i];
+        if (ins.op == OpCode::Constant || ins.op == OpCode::Variable) {
+            operands[i] = leaf(ins);
+            continue;
+        }
+        ins.a = operands[ins.a];
+        if (isBinary(ins.op))
+            ins.b = operands[ins.b];
+        if (ins.op == OpCode::Select)
+            ins.c = operands[ins.c];
+        ins.conditional = !unconditional[i];
+        program.branches_ = program.branches_ || ins.conditional;
+        operands[i] = static_cast<uint32_t>(program.code_.size());
+        program.code_.push_back(ins);
+    }
+    for (uint32_t reg: outputs_) {
+        uint32_t code = operands[reg];
+        if ((code & OPERAND_KIND) != OPERAND_REGISTER) {
+            // Выход-лист загружается в регистр отдельной инструкцией.
+            OpCode op = (code & OPERAND_KIND) == OPERAND_INPUT ? OpCode::Variable : OpCode::Constant;
+            code = static_cast<uint32_t>(program.code_.size());
+            program.code_.push_back({op, 0, operands[reg] & OPERAND_INDEX, 0, 0, false});
+        }
+        program.outputs_.push_back(code);
+    }
+    program.outputNames_ = outputNames_;
+    return program;
+}
+
+template<typename T>
+Program<T> compile(const Expression<T> &expr) {
+    ProgramBuilder<T> builder;
+    builder.addOutput(builder.add(expr));
+    return builder.build();
+}
+
+// ===================================================================
+// Инстанциация шаблонов для всех числовых типов
+#define INSTANTIATE_PROGRAM(T)                             \
+    template class Program<T>;                             \
+    template class ProgramBuilder<T>;                      \
+    template Program<T> compile<T>(const Expression<T> &);
+
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE_PROGRAM)
+
+// Преобразования программ между вещественными типами и между комплексными типами.
+#define INSTANTIATE_CONVERSION(T, U) template Program<U> Program<T>::converted<U>() const;
+
+INSTANTIATE_CONVERSION(float, double)
+INSTANTIATE_CONVERSION(float, long double)
+INSTANTIATE_CONVERSION(double, float)
+INSTANTIATE_CONVERSION(double, long double)
+INSTANTIATE_CONVERSION(long double, float)
+INSTANTIATE_CONVERSION(long double, double)
+INSTANTIATE_CONVERSION(std::complex<float>, std::complex<double>)
+INSTANTIATE_CONVERSION(std::complex<float>, std::complex<long double>)
+INSTANTIATE_CONVERSION(std::complex<double>, std::complex<float>)
+INSTANTIATE_CONVERSION(std::complex<double>, std::complex<long double>)
+INSTANTIATE_CONVERSION(std::complex<long double>, std::complex<float>)
+INSTANTIATE_CONVERSION(std::complex<long double>, std::complex<double>)
@@ -0,0 +1,291 @@
+#ifndef PROGRAM_HPP
+#define PROGRAM_HPP
+
+#include "expression.hpp"
+#include <cstdint>
+#include <unordered_map>
+#include <stdexcept>
+
+/*
+    Линейная программа вычисления: дерево выражения (или несколько деревьев),
+    развёрнутое в последовательность инструкций над регистрами.
+    Каждая инструкция записывает результат в регистр со своим номером.
+
+    Построитель хранит граф, в котором константы и переменные — отдельные инструкции,
+    а операнды ссылаются на регистры с меньшими номерами. Исполняемая программа хранит
+    листья прямо в операндах: старшие два бита операнда задают его вид (OPERAND_*),
+    остальные — номер регистра, константы или входной переменной. Так листья читаются
+    родительской инструкцией на месте, без отдельной инструкции и записи в регистр.
+*/
+
+static const uint32_t OPERAND_REGISTER = 0u << 30;
+static const uint32_t OPERAND_CONSTANT = 1u << 30;
+static const uint32_t OPERAND_INPUT = 2u << 30;
+static const uint32_t OPERAND_KIND = 3u << 30;
+static const uint32_t OPERAND_INDEX = ~OPERAND_KIND;
+
+// Таблица переменных: имя -> индекс во входном векторе.
+// Общая таблица позволяет нескольким программам использовать одну раскладку входов.
+class VariableTable {
+public:
+    static const size_t NOT_FOUND = static_cast<size_t>(-1);
+
+    VariableTable() = default;
+
+    explicit VariableTable(const std::vector<std::string> &names);
+
+    // Индекс переменной; новая переменная добавляется в конец таблицы.
+    size_t add(const std::string &name);
+
+    // Индекс переменной или NOT_FOUND.
+    size_t find(const std::string &name) const;
+
+    size_t size() const { return names_.size(); }
+
+    const std::vector<std::string> &names() const { return names_; }
+
+    // Разрешение контекста в вектор входов. Отсутствующая в контексте переменная
+    // приводит к исключению, а при политике Propagate получает значение NaN.
+    template<typename T>
+    void bind(const std::map<std::string, T> &context, std::vector<T> &inputs,
+              ErrorPolicy policy = ErrorPolicy::Throw) const {
+        inputs.resize(names_.size());
+        for (size_t i = 0; i < names_.size(); ++i) {
+            auto it = context.find(names_[i]);
+            if (it != context.end())
+                inputs[i] = it->second;
+            else if (policy == ErrorPolicy::Propagate)
+                inputs[i] = quietNaN<T>();
+            else
+                throw std::runtime_error("Variable \"" + names_[i] + "\" not found in context");
+        }
+    }
+
+private:
+    std::vector<std::string> names_;
+    std::unordered_map<std::string, size_t> index_;
+};
+
+// Код операции.
+enum class OpCode : unsigned char {
+    Constant, // регистр = constants[a]
+    Variable, // регистр = inputs[a]
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Pow,
+    PowInt,   // регистр = a ^ b, где b — целый показатель (int32), а не регистр
+    Sin,
+    Cos,
+    Ln,
+    Exp,
+    Call1,    // регистр = f(a), f — функция реестра с номером function
+    Call2,    // регистр = f(a, b)
+    Less,     // регистр = 1, если a < b, иначе 0 (a > b записывается как b < a)
+    LessEqual,
+    Equal,
+    NotEqual,
+    Select    // регистр = a != 0 ? b : c; в пакете — смешивание столбцов по маске, без ветвлений
+};
+
+// Инструкция программы. Для бинарных операций a и b — операнды,
+// для унарных используется только a. Для Constant/Variable a — индекс константы/переменной.
+struct Instruction {
+    OpCode op;
+    uint16_t function; // номер функции в FunctionRegistry для Call1/Call2
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;        // третий операнд Select
+    // Инструкция нужна только ветвям Select: ошибка в точке в ней прерывает вычисление,
+    // только если ветвь выбрана.
+    bool conditional;
+};
+
+template<typename T>
+class ProgramBuilder;
+
+// Скомпилированная программа с несколькими выходами.
+template<typename T>
+class Program {
+public:
+    Program() = default;
+
+    // Вычисление всех выходов.
+    // inputs — значения переменных в порядке variables(),
+    // registers — рабочий буфер размером size(), outputs — буфер размером outputs().size().
+    // Ошибки в точке обрабатываются по политике текущего потока (errorPolicy()). Ошибка в ветви Select
+    // возбуждается, только если ветвь выбрана, как в дереве; при Propagate ветви вычисляются обе.
+    void eval(const T *inputs, T *registers, T *outputs) const;
+
+    // Вычисление всех выходов с контекстом переменных, как в Expression<T>::eval.
+    std::vector<T> eval(const std::map<std::string, T> &context, ErrorPolicy policy = ErrorPolicy::Throw) const;
+
+    // Вычисление с буферами вызывающей стороны: после первого вызова память не выделяется.
+    void eval(const std::vector<T> &inputs, std::vector<T> &registers, std::vector<T> &outputs) const;
+
+    // Пакетное вычисление по rows строкам в столбцовом формате:
+    // inputs[v][row] — значение переменной v, outputs[k][row] — значение выхода k.
+    // Строки обрабатываются блоками по BATCH_BLOCK, каждая инструкция — одним циклом по блоку.
+    // При политике Propagate ошибка в строке не прерывает вычисление: её выходы получают ±Inf или NaN.
+    // Если задан errors, (*errors)[row] отмечает строки, в которых выход зависит от ошибки области
+    // определения: деления на нуль, логарифма или функции реестра (sqrt) вне области. Переполнение
+    // (exp(1000) = Inf) и ошибки в невыбранных ветвях Select не отмечаются.
+    // Ветви Select вычисляются для всех строк; при Throw строки, где выбранная ветвь могла дать ошибку,
+    // перевычисляются по одной функцией eval, и её исключение прерывает пакет.
+    void evalBatch(const T *const *inputs, T *const *outputs, size_t rows,
+                   ErrorPolicy policy = ErrorPolicy::Throw, std::vector<bool> *errors = nullptr) const;
+
+    // Вещественный тип модулей значений T.
+    using Real = decltype(std::abs(T()));
+
+    // Пакетное вычисление с оценкой погрешности: bounds[k][row] — оценка сверху абсолютной
+    // погрешности выхода k от округлений при вычислении в T (входы считаются точными).
+    // Оценка строится в первом порядке по правилам распространения ошибок для каждой инструкции;
+    // для функций реестра используется разность значений на концах интервала погрешности аргумента.
+    // Ошибки в точке обрабатываются по политике Propagate: такие строки получают бесконечную оценку.
+    void evalBatchBounded(const T *const *inputs, T *const *outputs, Real *const *bounds, size_t rows) const;
+
+    // Та же программа в числовом типе U: константы приводятся к U, функции реестра сопоставляются по имени.
+    template<typename U>
+    Program<U> converted() const;
+
+    static const size_t BATCH_BLOCK = 256;
+
+    // Количество инструкций (и регистров).
+    size_t size() const { return code_.size(); }
+
+    const std::vector<Instruction> &instructions() const { return code_; }
+
+    // Есть ли инструкции, нужные только ветвям Select.
+    bool hasBranches() const { return branches_; }
+
+    const std::vector<T> &constants() const { return constants_; }
+
+    const std::vector<std::string> &variables() const { return variables_.names(); }
+
+    const VariableTable &variableTable() const { return variables_; }
+
+    // Регистры, значения которых являются выходами программы.
+    const std::vector<uint32_t> &outputs() const { return outputs_; }
+
+    // Имена выходов (пустые для безымянных).
+    const std::vector<std::string> &outputNames() const { return outputNames_; }
+
+    // Номер выхода по имени; бросает исключение, если такого выхода нет.
+    size_t output(const std::string &name) const;
+
+private:
+    friend class ProgramBuilder<T>;
+
+    template<typename>
+    friend class Program;
+
+    std::vector<Instruction> code_;
+    std::vector<T> constants_;
+    VariableTable variables_;
+    std::vector<uint32_t> outputs_;
+    std::vector<std::string> outputNames_;
+    bool branches_ = false;
+
+    // eval при политике Throw для программы с ветвями.
+    void evalBranches(const T *inputs, T *registers) const;
+};
+
+// Построитель программы.
+// Одинаковые подвыражения (в том числе из разных деревьев) получают один регистр,
+// константные подвыражения сворачиваются, а тождества вида x + 0, x * 1, x ^ 1
+// упрощаются сразу при добавлении инструкции. Упрощения не отбрасывают неконстантных операндов:
+// x * 0, 0 / x и x ^ 0 вычисляются, чтобы ошибка, NaN или Inf в x проявились, как в дереве.
+// Сравнения < и <= комплексных констант не сворачиваются: их ошибка возникает при вычислении.
+template<typename T>
+class ProgramBuilder {
+public:
+    ProgramBuilder() = default;
+
+    // Построитель с заранее заданной раскладкой входов.
+    explicit ProgramBuilder(const VariableTable &variables);
+
+    // Добавление дерева выражения; возвращает регистр с его значением.
+    uint32_t add(const Expression<T> &expr);
+
+    uint32_t constant(T value);
+
+    uint32_t variable(const std::string &name);
+
+    uint32_t unary(OpCode op, uint32_t arg);
+
+    uint32_t binary(OpCode op, uint32_t left, uint32_t right);
+
+    uint32_t select(uint32_t condition, uint32_t ifTrue, uint32_t ifFalse);
+
+    // Вызов функции реестра с одним или двумя аргументами.
+    uint32_t call(uint16_t function, const std::vector<uint32_t> &args);
+
+    // Компиляция выражения, в котором переменные FUNCTION_ARGUMENTS заменены регистрами args
+    // (используется для правил дифференцирования функций реестра).
+    uint32_t inlineExpression(const Expression<T> &expr, const std::vector<uint32_t> &args);
+
+    // Символьная производная значения регистра reg по переменной variableIndex.
+    // Производная строится прямо на графе программы: каждое общее подвыражение
+    // дифференцируется один раз, а результаты переиспользуют уже имеющиеся регистры.
+    uint32_t derivative(uint32_t reg, uint32_t variableIndex);
+
+    // Индексы переменных, от которых зависит значение регистра (по возрастанию).
+    std::vector<uint32_t> dependencies(uint32_t reg) const;
+
+    // Проверка, что регистр содержит известную на этапе компиляции константу value.
+    bool isConstant(uint32_t reg, T value) const;
+
+    // Индекс переменной в таблице переменных (добавляет переменную, если её ещё нет).
+    uint32_t variableIndex(const std::string &name);
+
+    // Объявление регистра выходом программы; возвращает номер выхода.
+    size_t addOutput(uint32_t reg, const std::string &name = "");
+
+    // Именованное определение: последующие выражения, ссылающиеся на переменную name,
+    // используют регистр reg вместо входной переменной.
+    void define(const std::string &name, uint32_t reg);
+
+    // Исполняемая программа: листья переносятся в операнды, недостижимые
+    // из выходов инструкции удаляются, регистры перенумеровываются.
+    Program<T> build() const;
+
+private:
+    struct InstructionHash {
+        size_t operator()(const Instruction &ins) const;
+    };
+
+    struct InstructionEqual {
+        bool operator()(const Instruction &l, const Instruction &r) const;
+    };
+
+    struct ValueHash {
+        size_t operator()(const T &value) const;
+    };
+
+    uint32_t emit(OpCode op, uint32_t a, uint32_t b, uint16_t function = 0, uint32_t c = 0);
+
+    // Умножение и деление в правилах дифференцирования: нулевая константа-производная
+    // означает, что слагаемого в производной нет, и результат — нуль без вычисления второго операнда.
+    uint32_t derivativeMul(uint32_t left, uint32_t right);
+
+    uint32_t derivativeDiv(uint32_t numerator, uint32_t denominator);
+
+    // Граф: операнды всех инструкций — номера регистров.
+    std::vector<Instruction> code_;
+    std::vector<T> values_;
+    VariableTable variables_;
+    std::vector<uint32_t> outputs_;
+    std::vector<std::string> outputNames_;
+
+    std::unordered_map<Instruction, uint32_t, InstructionHash, InstructionEqual> instructions_;
+    std::unordered_map<T, uint32_t, ValueHash> constants_;
+    std::map<std::string, uint32_t> bindings_;
+};
+
+// Компиляция одного выражения в программу с единственным выходом.
+template<typename T>
+Program<T> compile(const Expression<T> &expr);
+
+#endif // PROGRAM_HPP
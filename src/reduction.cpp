@@ -0,0 +1,388 @@
+#include "reduction.hpp"
+#include "polynomial.hpp"
+#include "taylor.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <type_traits>
+
+static const char *reductionName(ReductionKind kind) {
+    switch (kind) {
+        case ReductionKind::Sum:
+            return "sum";
+        case ReductionKind::Product:
+            return "prod";
+        case ReductionKind::Dot:
+            return "dot";
+        case ReductionKind::Norm:
+            return "norm";
+        default:
+            return "dprod";
+    }
+}
+
+// Наибольшее m в dprod(f, g1, ..., gm): вычисление хранит 2^m коэффициентов.
+static const size_t PRODUCT_DERIVATIVE_LIMIT = 16;
+
+// Шаг вычисления dprod: умножение коэффициентов c[S] при произведениях e_t, t из S, на (f + sum_t e_t * g_t).
+// add и mul задают арифметику значений или рядов Тейлора.
+template<typename V, typename Add, typename Mul>
+static void productStep(std::vector<V> &c, std::vector<V> &next, const V &f, const std::vector<V> &g,
+                        Add add, Mul mul) {
+    for (size_t set = 0; set < c.size(); ++set) {
+        next[set] = mul(c[set], f);
+        for (size_t t = 0; t < g.size(); ++t) {
+            if (set & (size_t(1) << t))
+                next[set] = add(next[set], mul(c[set ^ (size_t(1) << t)], g[t]));
+        }
+    }
+    c.swap(next);
+}
+
+// Переменные выражения без заходов во вложенные редукции: их массивы перебирает сама вложенная редукция.
+template<typename T>
+static void collectVariables(const Expression<T> &expr, std::vector<std::string> &names) {
+    auto add = [&names](const std::string &name) {
+        if (std::find(names.begin(), names.end(), name) == names.end())
+            names.push_back(name);
+    };
+    std::vector<const ExpressionImpl<T> *> stack{expr.node()};
+    while (!stack.empty()) {
+        const ExpressionImpl<T> *node = stack.back();
+        stack.pop_back();
+        if (auto variable = dynamic_cast<const Variable<T> *>(node)) {
+            add(variable->name());
+        } else if (auto polynomial = dynamic_cast<const PolynomialNode<T> *>(node)) {
+            for (const auto &name: polynomial->polynomial().variables())
+                add(name);
+        } else if (!dynamic_cast<const Reduction<T> *>(node)) {
+            for (size_t i = 0; i < node->childCount(); ++i)
+                stack.push_back(node->child(i).node());
+        }
+    }
+}
+
+// Вызов f(i, element) для каждого элемента: в контексте element переменные-массивы равны своим i-м элементам.
+template<typename T, typename F>
+static void forEachElement(const std::map<std::string, T> &context,
+                           const std::vector<std::pair<std::string, const std::vector<T> *> > &arrays,
+                           size_t rows, F f) {
+    std::map<std::string, T> element = context;
+    std::vector<T *> slots;
+    for (const auto &array: arrays)
+        slots.push_back(&element[array.first]);
+    for (size_t i = 0; i < rows; ++i) {
+        for (size_t k = 0; k < arrays.size(); ++k)
+            *slots[k] = (*arrays[k].second)[i];
+        f(i, element);
+    }
+}
+
+template<typename T>
+static bool isZero(const Expression<T> &expr) {
+    auto value = dynamic_cast<const Value<T> *>(expr.node());
+    return value && value->value() == T(0);
+}
+
+// ===================================================================
+
+template<typename T>
+Reduction<T>::Reduction(ReductionKind kind, const std::vector<Expression<T> > &args)
+    : kind_(kind), args_(args) {
+    if (kind_ == ReductionKind::ProductDerivative &&
+        (args_.size() < 2 || args_.size() > PRODUCT_DERIVATIVE_LIMIT + 1))
+        throw std::runtime_error("Function dprod expects from 2 to " + std::to_string(PRODUCT_DERIVATIVE_LIMIT + 1) +
+                                 " arguments");
+    this->updateHeight();
+    for (const auto &arg: args_)
+        collectVariables(arg, names_);
+    try {
+        ProgramBuilder<T> builder;
+        if (kind_ == ReductionKind::ProductDerivative) {
+            for (const auto &arg: args_)
+                builder.addOutput(builder.add(arg));
+        } else {
+            uint32_t reg = builder.add(args_[0]);
+            if (kind_ == ReductionKind::Dot)
+                reg = builder.binary(OpCode::Mul, reg, builder.add(args_[1]));
+            builder.addOutput(reg);
+        }
+        body_ = std::make_shared<const Program<T> >(builder.build());
+    } catch (const std::runtime_error &) {
+        // Вложенная редукция не компилируется: аргумент будет вычисляться обходом дерева.
+    }
+}
+
+template<typename T>
+typename Reduction<T>::Arrays Reduction<T>::bindArrays(size_t &rows) const {
+    const ArrayContext<T> *arrays = ArrayScope<T>::current();
+    Arrays bound;
+    for (const auto &name: names_) {
+        if (!arrays)
+            break;
+        auto it = arrays->find(name);
+        if (it == arrays->end())
+            continue;
+        if (!bound.empty() && it->second.size() != rows)
+            throw std::runtime_error(std::string("Arrays of different lengths in ") + reductionName(kind_));
+        rows = it->second.size();
+        bound.emplace_back(name, &it->second);
+    }
+    if (bound.empty())
+        throw std::runtime_error(std::string("Argument of ") + reductionName(kind_) + " does not depend on an array");
+    return bound;
+}
+
+template<typename T>
+std::vector<std::vector<T> > Reduction<T>::elements(const std::map<std::string, T> &context) const {
+    size_t rows = 0;
+    const Arrays arrays = bindArrays(rows);
+    const size_t columns = kind_ == ReductionKind::ProductDerivative ? args_.size() : 1;
+    std::vector<std::vector<T> > values(columns, std::vector<T>(rows));
+    if (!body_) {
+        forEachElement(context, arrays, rows, [this, &values](size_t i, const std::map<std::string, T> &element) {
+            for (size_t k = 0; k < values.size(); ++k)
+                values[k][i] = args_[k].eval(element);
+            if (kind_ == ReductionKind::Dot)
+                values[0][i] *= args_[1].eval(element);
+        });
+        return values;
+    }
+    // Массивы подаются в программу как столбцы, скалярные переменные размножаются на всю длину.
+    const std::vector<std::string> &variables = body_->variables();
+    std::vector<std::vector<T> > scalars;
+    scalars.reserve(variables.size());
+    std::vector<const T *> inputs;
+    for (const auto &name: variables) {
+        auto it = std::find_if(arrays.begin(), arrays.end(), [&name](const auto &array) { return array.first == name; });
+        if (it != arrays.end()) {
+            inputs.push_back(it->second->data());
+        } else {
+            scalars.emplace_back(rows, Expression<T>(name).eval(context));
+            inputs.push_back(scalars.back().data());
+        }
+    }
+    std::vector<T *> outputs;
+    for (auto &column: values)
+        outputs.push_back(column.data());
+    body_->evalBatch(inputs.data(), outputs.data(), rows, errorPolicy());
+    return values;
+}
+
+template<typename T>
+T Reduction<T>::eval(const std::map<std::string, T> &context) const {
+    const std::vector<std::vector<T> > columns = elements(context);
+    const std::vector<T> &values = columns[0];
+    switch (kind_) {
+        case ReductionKind::Sum:
+        case ReductionKind::Dot: {
+            T total = T(0);
+            for (const T &value: values)
+                total += value;
+            return total;
+        }
+        case ReductionKind::Product: {
+            T total = T(1);
+            for (const T &value: values)
+                total *= value;
+            return total;
+        }
+        case ReductionKind::Norm: {
+            decltype(std::real(T())) total = 0;
+            for (const T &value: values)
+                total += std::norm(value);
+            return T(std::sqrt(total));
+        }
+        default: {
+            std::vector<T> c(size_t(1) << (columns.size() - 1), T(0)), next(c.size()), g(columns.size() - 1);
+            c[0] = T(1);
+            for (size_t i = 0; i < values.size(); ++i) {
+                for (size_t t = 0; t < g.size(); ++t)
+                    g[t] = columns[t + 1][i];
+                productStep(c, next, values[i], g, std::plus<T>(), std::multiplies<T>());
+            }
+            return c.back();
+        }
+    }
+}
+
+template<typename T>
+std::string Reduction<T>::to_string() const {
+    std::string result = part(0);
+    for (size_t i = 0; i < args_.size(); ++i)
+        result += args_[i].to_string() + part(i + 1);
+    return result;
+}
+
+template<typename T>
+std::string Reduction<T>::part(size_t index) const {
+    if (index == 0)
+        return std::string(reductionName(kind_)) + "(";
+    return index < args_.size() ? ", " : ")";
+}
+
+template<typename T>
+Expression<T> Reduction<T>::derivative(const std::string &var) const {
+    std::vector<Expression<T> > derivatives;
+    for (const auto &arg: args_)
+        derivatives.push_back(arg.differentiate(var));
+    return derivativeFrom(derivatives.data(), var);
+}
+
+template<typename T>
+Expression<T> Reduction<T>::derivativeFrom(const Expression<T> *derivatives, const std::string &) const {
+    // Редукция от нуля не вычисляется без массивов, поэтому нулевые слагаемые отбрасываются сразу.
+    if (std::all_of(derivatives, derivatives + args_.size(), isZero<T>))
+        return Expression<T>(T(0));
+    switch (kind_) {
+        case ReductionKind::Sum:
+            return sum(derivatives[0]);
+        case ReductionKind::Product:
+            return dprod(std::vector<Expression<T> >{args_[0], derivatives[0]});
+        case ReductionKind::ProductDerivative: {
+            // Производная коэффициента при e1 * ... * em: новый множитель e(m+1) при f' и замены gt на gt'.
+            std::vector<Expression<T> > terms;
+            if (!isZero(derivatives[0])) {
+                std::vector<Expression<T> > args = args_;
+                args.push_back(derivatives[0]);
+                terms.push_back(dprod(args));
+            }
+            for (size_t t = 1; t < args_.size(); ++t) {
+                if (isZero(derivatives[t]))
+                    continue;
+                std::vector<Expression<T> > args = args_;
+                args[t] = derivatives[t];
+                terms.push_back(dprod(args));
+            }
+            Expression<T> result = terms[0];
+            for (size_t k = 1; k < terms.size(); ++k)
+                result = result + terms[k];
+            return result;
+        }
+        case ReductionKind::Dot:
+            if (isZero(derivatives[1]))
+                return dot(derivatives[0], args_[1]);
+            if (isZero(derivatives[0]))
+                return dot(args_[0], derivatives[1]);
+            return dot(derivatives[0], args_[1]) + dot(args_[0], derivatives[1]);
+        default:
+            if constexpr (!std::is_floating_point_v<T>)
+                throw std::runtime_error("Derivative of norm of complex values");
+            return dot(args_[0], derivatives[0]) / norm(args_[0]);
+    }
+}
+
+template<typename T>
+Expression<T> Reduction<T>::substitute(const std::string &var, const Expression<T> &expr) const {
+    return mapChildren([&](const Expression<T> &arg) { return arg.substitute(var, expr); });
+}
+
+template<typename T>
+std::vector<T> Reduction<T>::taylor(const std::map<std::string, T> &context, const std::string &var,
+                                    size_t order) const {
+    if constexpr (!std::is_floating_point_v<T>) {
+        if (kind_ == ReductionKind::Norm)
+            throw std::runtime_error("Taylor series of norm of complex values");
+    }
+    size_t rows = 0;
+    const Arrays arrays = bindArrays(rows);
+    if (kind_ == ReductionKind::ProductDerivative) {
+        const std::vector<T> zero = taylorConstant(T(0), order);
+        std::vector<std::vector<T> > c(size_t(1) << (args_.size() - 1), zero), next(c.size()), g(args_.size() - 1);
+        c[0] = taylorConstant(T(1), order);
+        forEachElement(context, arrays, rows, [&](size_t, const std::map<std::string, T> &element) {
+            for (size_t t = 0; t < g.size(); ++t)
+                g[t] = args_[t + 1].taylor(var, element, order);
+            productStep(c, next, args_[0].taylor(var, element, order), g, taylorAdd<T>, taylorMul<T>);
+        });
+        return c.back();
+    }
+    std::vector<T> result = taylorConstant(kind_ == ReductionKind::Product ? T(1) : T(0), order);
+    forEachElement(context, arrays, rows, [&](size_t, const std::map<std::string, T> &element) {
+        std::vector<T> term = args_[0].taylor(var, element, order);
+        switch (kind_) {
+            case ReductionKind::Sum:
+                result = taylorAdd(result, term);
+                break;
+            case ReductionKind::Product:
+                result = taylorMul(result, term);
+                break;
+            case ReductionKind::Dot:
+                result = taylorAdd(result, taylorMul(term, args_[1].taylor(var, element, order)));
+                break;
+            default:
+                result = taylorAdd(result, taylorMul(term, term));
+                break;
+        }
+    });
+    return kind_ == ReductionKind::Norm ? taylorPow(result, T(0.5)) : result;
+}
+
+template<typename T>
+Jet<T> Reduction<T>::evalJet(const std::map<std::string, T> &context, const std::string &var) const {
+    std::vector<T> series = taylor(context, var, 2);
+    return {series[0], series[1], T(2) * series[2]};
+}
+
+template<typename T>
+uint32_t Reduction<T>::compile(ProgramBuilder<T> &) const {
+    throw std::runtime_error(std::string("Reduction ") + reductionName(kind_) + " cannot be compiled: programs have "
+                             "no array inputs");
+}
+
+template<typename T>
+Expression<T> Reduction<T>::mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const {
+    std::vector<Expression<T> > args;
+    for (const auto &arg: args_)
+        args.push_back(f(arg));
+    return Expression<T>(std::make_shared<Reduction<T> >(kind_, args));
+}
+
+template<typename T>
+std::shared_ptr<ExpressionImpl<T> > Reduction<T>::clone() const {
+    return std::make_shared<Reduction<T> >(*this);
+}
+
+template<typename T>
+void Reduction<T>::accept(ExpressionVisitor<T> &visitor) const {
+    visitor.visit(*this);
+}
+
+// ===================================================================
+
+template<typename T>
+Expression<T> sum(const Expression<T> &expr) {
+    return Expression<T>(std::make_shared<Reduction<T> >(ReductionKind::Sum, std::vector<Expression<T> >{expr}));
+}
+
+template<typename T>
+Expression<T> prod(const Expression<T> &expr) {
+    return Expression<T>(std::make_shared<Reduction<T> >(ReductionKind::Product, std::vector<Expression<T> >{expr}));
+}
+
+template<typename T>
+Expression<T> dot(const Expression<T> &left, const Expression<T> &right) {
+    return Expression<T>(std::make_shared<Reduction<T> >(ReductionKind::Dot, std::vector<Expression<T> >{left, right}));
+}
+
+template<typename T>
+Expression<T> norm(const Expression<T> &expr) {
+    return Expression<T>(std::make_shared<Reduction<T> >(ReductionKind::Norm, std::vector<Expression<T> >{expr}));
+}
+
+template<typename T>
+Expression<T> dprod(const std::vector<Expression<T> > &args) {
+    return Expression<T>(std::make_shared<Reduction<T> >(ReductionKind::ProductDerivative, args));
+}
+
+// ===================================================================
+// Инстанциация шаблонов для всех числовых типов
+#define INSTANTIATE_REDUCTION(T)                                                  \
+    template class Reduction<T>;                                                  \
+    template Expression<T> sum<T>(const Expression<T> &);                         \
+    template Expression<T> prod<T>(const Expression<T> &);                        \
+    template Expression<T> dot<T>(const Expression<T> &, const Expression<T> &);  \
+    template Expression<T> norm<T>(const Expression<T> &);                        \
+    template Expression<T> dprod<T>(const std::vector<Expression<T> > &);
+
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE_REDUCTION)
@@ -0,0 +1,112 @@
+#ifndef REDUCTION_HPP
+#define REDUCTION_HPP
+
+#include "expression.hpp"
+#include "program.hpp"
+
+/*
+    Редукции по переменным-массивам: sum(f), prod(f), dot(f, g), norm(f).
+
+    Аргумент редукции — обычное скалярное выражение, в котором переменная, заданная в ArrayScope<T>,
+    обозначает текущий элемент массива, а остальные переменные берутся из контекста:
+    sum((w * x - y)^2) по массивам x и y и параметру w — одна вершина дерева вместо тысяч сложений.
+    Все массивы одного аргумента должны иметь одинаковую длину.
+
+    Аргумент компилируется в Program<T> при создании узла и вычисляется для всех элементов
+    пакетными циклами evalBatch; редукция — один плотный цикл по результату. Аргументы,
+    которые компилировать нельзя (вложенные редукции), вычисляются обходом дерева по элементам.
+    Производные остаются редукциями: (sum f)' = sum f', (dot(f, g))' = dot(f', g) + dot(f, g').
+    Производная произведения — dprod(f, f') = sum_k f'_k * prod_(i != k) f_i без деления на элементы,
+    поэтому она верна и при нулевых элементах. В общем виде dprod(f, g1, ..., gm) — коэффициент
+    при e1 * ... * em в prod_i (f_i + e1 * g1_i + ... + em * gm_i), где e1^2 = ... = em^2 = 0;
+    производные dprod снова выражаются через dprod.
+    Производная берётся по скалярным переменным; переменная-массив в ней — тоже текущий элемент.
+*/
+
+enum class ReductionKind {
+    Sum,
+    Product,
+    Dot,
+    Norm,             // евклидова норма sqrt(sum |f|^2)
+    ProductDerivative // dprod(f, g1, ..., gm)
+};
+
+template<typename T>
+class Reduction : public ExpressionImpl<T> {
+public:
+    // Для Dot аргументов два, для ProductDerivative — не меньше двух, для остальных — один.
+    Reduction(ReductionKind kind, const std::vector<Expression<T> > &args);
+
+    // Бросает исключение, если аргумент не зависит ни от одного массива текущего ArrayScope.
+    T eval(const std::map<std::string, T> &context) const override;
+
+    std::string to_string() const override;
+
+    Expression<T> derivative(const std::string &var) const override;
+
+    Expression<T> substitute(const std::string &var, const Expression<T> &expr) const override;
+
+    // Ряды элементов складываются (перемножаются); считаются обходом дерева по элементам.
+    std::vector<T> taylor(const std::map<std::string, T> &context, const std::string &var,
+                          size_t order) const override;
+
+    Jet<T> evalJet(const std::map<std::string, T> &context, const std::string &var) const override;
+
+    // В Program<T> нет входов-массивов: бросает исключение.
+    uint32_t compile(ProgramBuilder<T> &builder) const override;
+
+    Expression<T> mapChildren(const std::function<Expression<T>(const Expression<T> &)> &f) const override;
+
+    std::shared_ptr<ExpressionImpl<T> > clone() const override;
+
+    void accept(ExpressionVisitor<T> &visitor) const override;
+
+    size_t childCount() const override { return args_.size(); }
+
+    const Expression<T> &child(size_t index) const override { return args_[index]; }
+
+    // Аргументы вычисляются поэлементно внутри узла, а не как скалярные потомки.
+    bool needsChild(size_t, const T *) const override { return false; }
+
+    std::string part(size_t index) const override;
+
+    Expression<T> derivativeFrom(const Expression<T> *derivatives, const std::string &var) const override;
+
+    ReductionKind kind() const { return kind_; }
+
+    const std::vector<Expression<T> > &arguments() const { return args_; }
+
+private:
+    using Arrays = std::vector<std::pair<std::string, const std::vector<T> *> >;
+
+    // Массивы текущего ArrayScope, от которых зависят аргументы, и их общая длина.
+    Arrays bindArrays(size_t &rows) const;
+
+    // Значения элементов: f_i, для Dot — f_i * g_i; для ProductDerivative — столбцы всех аргументов.
+    std::vector<std::vector<T> > elements(const std::map<std::string, T> &context) const;
+
+    ReductionKind kind_;
+    std::vector<Expression<T> > args_;
+    // Переменные аргументов (без заходов во вложенные редукции).
+    std::vector<std::string> names_;
+    // Скомпилированный аргумент; nullptr, если аргумент не компилируется.
+    std::shared_ptr<const Program<T> > body_;
+};
+
+template<typename T>
+Expression<T> sum(const Expression<T> &expr);
+
+template<typename T>
+Expression<T> prod(const Expression<T> &expr);
+
+template<typename T>
+Expression<T> dot(const Expression<T> &left, const Expression<T> &right);
+
+template<typename T>
+Expression<T> norm(const Expression<T> &expr);
+
+// dprod(f, g1, ..., gm); dprod(f, f') — производная prod(f).
+template<typename T>
+Expression<T> dprod(const std::vector<Expression<T> > &args);
+
+#endif // REDUCTION_HPP
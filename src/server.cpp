@@ -0,0 +1,462 @@
+#include "server.hpp"
+#include "parser.hpp"
+#include "traversal.hpp"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+// Предельный размер кадра: защита от мусора вместо длины.
+static const uint32_t MAX_FRAME = uint32_t(64) << 20;
+
+static bool writeAll(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+static bool readAll(int fd, char *data, size_t size) {
+    while (size > 0) {
+        ssize_t received = ::recv(fd, data, size, 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+        data += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+bool writeFrame(int fd, const std::string &payload) {
+    const uint32_t size = static_cast<uint32_t>(payload.size());
+    char header[4] = {static_cast<char>(size & 0xff), static_cast<char>((size >> 8) & 0xff),
+                      static_cast<char>((size >> 16) & 0xff), static_cast<char>((size >> 24) & 0xff)};
+    return writeAll(fd, header, 4) && writeAll(fd, payload.data(), payload.size());
+}
+
+bool readFrame(int fd, std::string &payload) {
+    unsigned char header[4];
+    if (!readAll(fd, reinterpret_cast<char *>(header), 4))
+        return false;
+    const uint32_t size = header[0] | (header[1] << 8) | (header[2] << 16) | (uint32_t(header[3]) << 24);
+    if (size > MAX_FRAME)
+        return false;
+    payload.resize(size);
+    return readAll(fd, &payload[0], size);
+}
+
+static sockaddr_un socketAddress(const std::string &path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        throw std::runtime_error("Socket path is too long: " + path);
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+static std::vector<std::string> splitLines(const std::string &text) {
+    std::vector<std::string> lines;
+    size_t start = 0;
+    for (;;) {
+        size_t end = text.find('\n', start);
+        lines.push_back(text.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        if (end == std::string::npos)
+            return lines;
+        start = end + 1;
+    }
+}
+
+static std::string response(const std::string &id, bool ok, const std::string &body) {
+    return id + (ok ? "\nok\n" : "\nerror\n") + body;
+}
+
+// ===================================================================
+
+ThreadPool::ThreadPool(size_t threads) {
+    for (size_t k = 0; k < std::max<size_t>(threads, 1); ++k)
+        threads_.emplace_back([this] { work(); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    ready_.notify_all();
+    for (auto &thread: threads_)
+        thread.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+    ready_.notify_one();
+}
+
+void ThreadPool::work() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ready_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+            // Очередь дорабатывается и после запроса остановки.
+            if (tasks_.empty())
+                return;
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+// ===================================================================
+
+template<typename T>
+EvaluationServer<T>::Connection::~Connection() {
+    ::close(fd);
+}
+
+template<typename T>
+EvaluationServer<T>::EvaluationServer(const std::string &path, size_t threads)
+    : path_(path), pool_(threads) {
+    sockaddr_un address = socketAddress(path);
+    listener_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener_ < 0)
+        throw std::runtime_error("Cannot create socket: " + std::string(std::strerror(errno)));
+    ::unlink(path.c_str());
+    if (::bind(listener_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 ||
+        ::listen(listener_, SOMAXCONN) < 0) {
+        std::string error = std::strerror(errno);
+        ::close(listener_);
+        throw std::runtime_error("Cannot listen on " + path + ": " + error);
+    }
+}
+
+template<typename T>
+EvaluationServer<T>::~EvaluationServer() {
+    ::close(listener_);
+    ::unlink(path_.c_str());
+}
+
+template<typename T>
+void EvaluationServer<T>::run() {
+    // poll с таймаутом, чтобы stop() из обработчика сигнала замечался без пробуждения accept.
+    pollfd descriptor{listener_, POLLIN, 0};
+    while (!stopping_.load()) {
+        int ready = ::poll(&descriptor, 1, 100);
+        reap();
+        if (ready <= 0 || !(descriptor.revents & POLLIN))
+            continue;
+        int fd = ::accept(listener_, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+        auto connection = std::make_shared<Connection>();
+        connection->fd = fd;
+        auto done = std::make_shared<std::atomic<bool> >(false);
+        std::thread thread([this, connection, done] {
+            serve(connection);
+            done->store(true);
+        });
+        readers_.push_back({std::move(thread), connection, done});
+        readerCount_.store(readers_.size());
+    }
+    // Разрыв соединений будит потоки чтения; уже принятые запросы дорабатывает пул.
+    for (const auto &reader: readers_) {
+        if (auto connection = reader.connection.lock())
+            ::shutdown(connection->fd, SHUT_RDWR);
+    }
+    for (auto &reader: readers_)
+        reader.thread.join();
+    readers_.clear();
+    readerCount_.store(0);
+}
+
+template<typename T>
+void EvaluationServer<T>::reap() {
+    auto finished = std::partition(readers_.begin(), readers_.end(),
+                                   [](const Reader &reader) { return !reader.done->load(); });
+    for (auto it = finished; it != readers_.end(); ++it)
+        it->thread.join();
+    readers_.erase(finished, readers_.end());
+    readerCount_.store(readers_.size());
+}
+
+template<typename T>
+void EvaluationServer<T>::serve(const std::shared_ptr<Connection> &connection) {
+    std::string request;
+    while (!stopping_.load() && readFrame(connection->fd, request)) {
+        handle(request, [connection](const std::string &body) {
+            std::lock_guard<std::mutex> lock(connection->writeMutex);
+            writeFrame(connection->fd, body);
+        });
+    }
+}
+
+template<typename T>
+void EvaluationServer<T>::handle(const std::string &request, const std::function<void(const std::string &)> &reply) {
+    ++requests_;
+    std::vector<std::string> lines = splitLines(request);
+    const std::string id = lines.size() > 1 ? lines[1] : "";
+    Pending pending;
+    pending.id = id;
+    pending.reply = reply;
+    try {
+        if (lines.size() < 3)
+            throw std::runtime_error("Malformed request");
+        if (lines[0] == "diff") {
+            if (lines.size() != 4 || lines[3].empty())
+                throw std::runtime_error("Missing differentiation variable");
+            pending.diff = true;
+            pending.variable = lines[3];
+        } else if (lines[0] == "eval") {
+            pending.diff = false;
+            for (size_t k = 3; k < lines.size(); ++k) {
+                if (lines[k].empty())
+                    continue;
+                size_t pos = lines[k].find('=');
+                if (pos == std::string::npos)
+                    throw std::runtime_error("Invalid assignment: " + lines[k]);
+                pending.context[lines[k].substr(0, pos)] = static_cast<T>(std::stold(lines[k].substr(pos + 1)));
+            }
+        } else {
+            throw std::runtime_error("Unknown request: " + lines[0]);
+        }
+    } catch (const std::exception &ex) {
+        reply(response(id, false, ex.what()));
+        return;
+    }
+    enqueue(entry(lines[2]), std::move(pending));
+}
+
+template<typename T>
+std::shared_ptr<typename EvaluationServer<T>::Entry> EvaluationServer<T>::entry(const std::string &text) {
+    std::lock_guard<std::mutex> lock(cacheMutex_);
+    auto it = cache_.find(text);
+    if (it != cache_.end())
+        return it->second;
+    if (cache_.size() >= MAX_CACHED)
+        cache_.clear();
+    auto created = std::make_shared<Entry>();
+    created->text = text;
+    cache_.emplace(text, created);
+    return created;
+}
+
+template<typename T>
+void EvaluationServer<T>::enqueue(const std::shared_ptr<Entry> &entry, Pending &&request) {
+    {
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        entry->pending.push_back(std::move(request));
+        if (entry->scheduled)
+            return;
+        entry->scheduled = true;
+    }
+    pool_.submit([this, entry] { process(entry); });
+}
+
+template<typename T>
+void EvaluationServer<T>::process(const std::shared_ptr<Entry> &entry) {
+    // Одновременно выражение обрабатывает только одна задача, поэтому поля разбора не требуют блокировки.
+    std::vector<Pending> batch;
+    {
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        batch.swap(entry->pending);
+    }
+    if (!entry->parsed) {
+        ++cacheMisses_;
+        try {
+            entry->expr = parseExpression<T>(entry->text);
+            entry->deep = entry->expr.node()->height() > RECURSION_LIMIT;
+            if (!entry->deep)
+                entry->program = compile(entry->expr);
+        } catch (const std::exception &ex) {
+            entry->error = ex.what();
+        }
+        entry->parsed = true;
+    }
+
+    std::ostringstream number;
+    number << std::setprecision(std::numeric_limits<T>::max_digits10);
+    const Program<T> &program = entry->program;
+    const size_t variables = program.variables().size();
+    std::vector<const Pending *> rows;
+    std::vector<std::vector<T> > columns(variables);
+    for (const Pending &request: batch) {
+        if (!entry->error.empty()) {
+            request.reply(response(request.id, false, entry->error));
+        } else if (request.diff) {
+            auto it = entry->derivatives.find(request.variable);
+            if (it == entry->derivatives.end())
+                it = entry->derivatives.emplace(request.variable,
+                                                entry->expr.differentiate(request.variable).to_string()).first;
+            request.reply(response(request.id, true, it->second));
+        } else if (entry->deep) {
+            // compile рекурсивен, поэтому глубокое дерево вычисляется обходом с явным стеком, без порции.
+            try {
+                number.str("");
+                number << entry->expr.eval(request.context, ErrorPolicy::Propagate);
+                request.reply(response(request.id, true, number.str()));
+            } catch (const std::exception &ex) {
+                request.reply(response(request.id, false, ex.what()));
+            }
+        } else {
+            // Строка порции: значения переменных программы из контекста запроса.
+            size_t v = 0;
+            for (; v < variables; ++v) {
+                auto it = request.context.find(program.variables()[v]);
+                if (it == request.context.end())
+                    break;
+                columns[v].push_back(it->second);
+            }
+            if (v < variables) {
+                for (size_t u = 0; u < v; ++u)
+                    columns[u].pop_back();
+                request.reply(response(request.id, false,
+                                       "Variable " + program.variables()[v] + " not found in context"));
+            } else {
+                rows.push_back(&request);
+            }
+        }
+    }
+    if (!rows.empty()) {
+        ++batches_;
+        std::vector<T> result(rows.size());
+        std::vector<const T *> inputs(variables);
+        for (size_t v = 0; v < variables; ++v)
+            inputs[v] = columns[v].data();
+        T *outputs[] = {result.data()};
+        program.evalBatch(inputs.data(), outputs, rows.size(), ErrorPolicy::Propagate);
+        for (size_t row = 0; row < rows.size(); ++row) {
+            number.str("");
+            number << result[row];
+            rows[row]->reply(response(rows[row]->id, true, number.str()));
+        }
+    }
+
+    // Запросы, пришедшие во время обработки, образуют следующую порцию.
+    {
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        if (entry->pending.empty()) {
+            entry->scheduled = false;
+            return;
+        }
+    }
+    pool_.submit([this, entry] { process(entry); });
+}
+
+template<typename T>
+ServerStats EvaluationServer<T>::stats() const {
+    ServerStats stats;
+    stats.requests = requests_.load();
+    stats.batches = batches_.load();
+    stats.cacheMisses = cacheMisses_.load();
+    stats.readers = readerCount_.load();
+    return stats;
+}
+
+// ===================================================================
+
+EvaluationClient::EvaluationClient(const std::string &path) {
+    sockaddr_un address = socketAddress(path);
+    fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0 || ::connect(fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+        std::string error = std::strerror(errno);
+        if (fd_ >= 0)
+            ::close(fd_);
+        throw std::runtime_error("Cannot connect to " + path + ": " + error);
+    }
+}
+
+EvaluationClient::~EvaluationClient() {
+    ::close(fd_);
+}
+
+void EvaluationClient::send(const std::string &request) {
+    if (!writeFrame(fd_, request))
+        throw std::runtime_error("Connection closed by server");
+}
+
+std::string EvaluationClient::receive() {
+    std::string payload;
+    if (!readFrame(fd_, payload))
+        throw std::runtime_error("Connection closed by server");
+    return payload;
+}
+
+std::string EvaluationClient::call(const std::string &request) {
+    send(request);
+    return receive();
+}
+
+LoadReport runLoad(const std::string &path, const std::string &request, size_t clients, size_t requests) {
+    std::vector<std::vector<double> > latencies(clients);
+    std::vector<size_t> errors(clients, 0);
+    std::vector<std::string> failures(clients);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t c = 0; c < clients; ++c) {
+        threads.emplace_back([&, c] {
+            try {
+                EvaluationClient client(path);
+                latencies[c].reserve(requests);
+                for (size_t k = 0; k < requests; ++k) {
+                    auto sent = std::chrono::steady_clock::now();
+                    std::string answer = client.call(request);
+                    latencies[c].push_back(
+                            std::chrono::duration<double>(std::chrono::steady_clock::now() - sent).count());
+                    std::vector<std::string> lines = splitLines(answer);
+                    if (lines.size() < 2 || lines[1] != "ok")
+                        ++errors[c];
+                }
+            } catch (const std::exception &ex) {
+                failures[c] = ex.what();
+            }
+        });
+    }
+    for (auto &thread: threads)
+        thread.join();
+    for (const auto &failure: failures) {
+        if (!failure.empty())
+            throw std::runtime_error(failure);
+    }
+
+    LoadReport report;
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::vector<double> all;
+    for (size_t c = 0; c < clients; ++c) {
+        all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+        report.errors += errors[c];
+    }
+    report.requests = all.size();
+    if (all.empty())
+        return report;
+    std::sort(all.begin(), all.end());
+    report.requestsPerSecond = report.requests / report.seconds;
+    report.p50 = all[all.size() / 2];
+    report.p99 = all[std::min(all.size() - 1, all.size() * 99 / 100)];
+    return report;
+}
+
+// ===================================================================
+// Инстанциация шаблонов для вещественных типов: значения в протоколе передаются десятичной записью.
+template class EvaluationServer<float>;
+template class EvaluationServer<double>;
+template class EvaluationServer<long double>;
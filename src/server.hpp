@@ -0,0 +1,200 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include "program.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+/*
+    Локальный сервер вычислений на UNIX-сокете (differentiator --serve).
+
+    Протокол: каждое сообщение — кадр из 4 байт длины (little-endian) и тела такой длины.
+    Тело запроса — строки, разделённые '\n':
+        eval, id, выражение, затем по строке "переменная=значение" на каждую переменную;
+        diff, id, выражение, переменная дифференцирования.
+    Тело ответа: id, "ok" или "error", затем результат (число или выражение производной) либо сообщение.
+    id выбирает клиент: ответы приходят по мере готовности, не обязательно в порядке запросов.
+
+    Разобранные выражения, их программы и производные хранятся в общем кэше.
+    Запросы eval к одному выражению, пришедшие, пока предыдущая порция ещё вычисляется,
+    объединяются в одну порцию и вычисляются одним вызовом Program<T>::evalBatch
+    по политике Propagate: ошибка в точке даёт ±Inf или NaN, а не ответ error.
+    Выражения выше RECURSION_LIMIT (traversal.hpp) не компилируются и вычисляются по одному
+    обходом дерева с явным стеком.
+*/
+
+// Запись кадра; false, если соединение закрыто.
+bool writeFrame(int fd, const std::string &payload);
+
+// Чтение кадра; false при закрытии соединения или ошибке.
+bool readFrame(int fd, std::string &payload);
+
+// Пул потоков с общей очередью задач.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads);
+
+    // Дожидается выполнения уже поставленных задач.
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(std::function<void()> task);
+
+private:
+    void work();
+
+    std::vector<std::thread> threads_;
+    std::deque<std::function<void()> > tasks_;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    bool stopping_ = false;
+};
+
+struct ServerStats {
+    uint64_t requests = 0;
+    uint64_t batches = 0;     // вызовы evalBatch; requests / batches — средний размер порции
+    uint64_t cacheMisses = 0; // разборы выражений
+    uint64_t readers = 0;     // потоки чтения, ещё не присоединённые run()
+};
+
+template<typename T>
+class EvaluationServer {
+public:
+    // Предельное число выражений в кэше; при переполнении кэш очищается целиком.
+    static const size_t MAX_CACHED = 4096;
+
+    // Создание сокета path (существующий файл сокета заменяется) и пула из threads потоков.
+    EvaluationServer(const std::string &path, size_t threads);
+
+    ~EvaluationServer();
+
+    EvaluationServer(const EvaluationServer &) = delete;
+
+    EvaluationServer &operator=(const EvaluationServer &) = delete;
+
+    // Приём соединений до вызова stop(); соединения обслуживаются отдельными потоками чтения.
+    // Потоки закрытых соединений присоединяются по ходу приёма, не дожидаясь остановки.
+    void run();
+
+    // Запрос остановки; безопасен для вызова из обработчика сигнала.
+    void stop() { stopping_.store(true); }
+
+    // Обработка тела запроса; reply вызывается с телом ответа, возможно, из другого потока.
+    void handle(const std::string &request, const std::function<void(const std::string &)> &reply);
+
+    ServerStats stats() const;
+
+private:
+    struct Pending {
+        bool diff;
+        std::string id;
+        std::string variable;                 // для diff
+        std::map<std::string, T> context;     // для eval
+        std::function<void(const std::string &)> reply;
+    };
+
+    // Соединение закрывается, когда на него не остаётся ссылок: ответы из пула
+    // могут прийти и после того, как клиент отключился.
+    struct Connection {
+        int fd;
+        std::mutex writeMutex;
+
+        ~Connection();
+    };
+
+    // Кэшированное выражение и очередь запросов к нему.
+    struct Entry {
+        std::string text;
+        bool parsed = false;
+        std::string error;                    // ошибка разбора, если она была
+        bool deep = false;                    // дерево выше RECURSION_LIMIT: программа не строится
+        Expression<T> expr{T(0)};
+        Program<T> program;
+        std::map<std::string, std::string> derivatives;
+
+        std::mutex mutex;                     // защищает pending и scheduled
+        std::vector<Pending> pending;
+        bool scheduled = false;
+    };
+
+    std::shared_ptr<Entry> entry(const std::string &text);
+
+    void enqueue(const std::shared_ptr<Entry> &entry, Pending &&request);
+
+    // Обработка всех накопившихся запросов к выражению; выполняется в пуле.
+    void process(const std::shared_ptr<Entry> &entry);
+
+    // Поток чтения соединения; done выставляется, когда поток заканчивает работу.
+    struct Reader {
+        std::thread thread;
+        std::weak_ptr<Connection> connection;
+        std::shared_ptr<std::atomic<bool> > done;
+    };
+
+    void serve(const std::shared_ptr<Connection> &connection);
+
+    // Присоединение и удаление завершившихся потоков чтения; вызывается только из run().
+    void reap();
+
+    std::string path_;
+    int listener_ = -1;
+    std::atomic<bool> stopping_{false};
+
+    std::mutex cacheMutex_;
+    std::unordered_map<std::string, std::shared_ptr<Entry> > cache_;
+
+    std::vector<Reader> readers_;
+    std::atomic<uint64_t> readerCount_{0};
+
+    std::atomic<uint64_t> requests_{0};
+    std::atomic<uint64_t> batches_{0};
+    std::atomic<uint64_t> cacheMisses_{0};
+
+    // Объявлен последним, чтобы при разрушении сервера первым дождаться задач, использующих остальные поля.
+    ThreadPool pool_;
+};
+
+// Клиент сервера вычислений.
+class EvaluationClient {
+public:
+    explicit EvaluationClient(const std::string &path);
+
+    ~EvaluationClient();
+
+    EvaluationClient(const EvaluationClient &) = delete;
+
+    EvaluationClient &operator=(const EvaluationClient &) = delete;
+
+    void send(const std::string &request);
+
+    std::string receive();
+
+    // Отправка запроса и ожидание ответа на него.
+    std::string call(const std::string &request);
+
+private:
+    int fd_ = -1;
+};
+
+// Результат нагрузочного прогона.
+struct LoadReport {
+    size_t requests = 0;
+    size_t errors = 0;
+    double seconds = 0;
+    double requestsPerSecond = 0;
+    double p50 = 0; // задержки в секундах
+    double p99 = 0;
+};
+
+// Нагрузочный клиент: clients соединений, каждое отправляет requests запросов request
+// и ждёт ответа на каждый перед отправкой следующего.
+LoadReport runLoad(const std::string &path, const std::string &request, size_t clients, size_t requests);
+
+#endif // SERVER_HPP
@@ -0,0 +1,47 @@
+#include "solve.hpp"
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+
+template<typename T>
+T solve(const Expression<T> &expr, const std::string &var, T x0,
+        const std::map<std::string, T> &context, const SolveOptions &options) {
+    using Real = decltype(std::abs(T()));
+    const long double epsilon = std::numeric_limits<Real>::epsilon();
+    const long double tolerance = options.tolerance > 0 ? options.tolerance : 4 * epsilon;
+    std::map<std::string, T> point = context;
+    T &x = point[var];
+    x = x0;
+    long double previous = std::numeric_limits<long double>::infinity();
+    for (size_t iteration = 0; iteration < options.maxIterations; ++iteration) {
+        Jet<T> f = expr.evalJet(var, point);
+        if (f.value == T(0))
+            return x;
+        if (f.first == T(0))
+            throw std::runtime_error("Zero derivative at iteration " + std::to_string(iteration));
+        T step = f.value / f.first;
+        if (options.method == SolveMethod::Halley) {
+            // Если знаменатель Галлея обращается в ноль, делается шаг Ньютона.
+            T denominator = T(2) * f.first * f.first - f.value * f.second;
+            if (denominator != T(0))
+                step = T(2) * f.value * f.first / denominator;
+        }
+        x -= step;
+        if (!isFinite(x))
+            throw std::runtime_error("Solver diverged at iteration " + std::to_string(iteration));
+        const long double scale = std::max<long double>(1, std::abs(x)), size = std::abs(step);
+        if (size <= tolerance * scale || (size >= previous && size <= std::sqrt(epsilon) * scale))
+            return x;
+        previous = size;
+    }
+    throw std::runtime_error("Solver did not converge in " + std::to_string(options.maxIterations) + " iterations");
+}
+
+// ===================================================================
+// Инстанциация шаблонов для всех числовых типов
+#define INSTANTIATE_SOLVE(T)                                                       \
+    template T solve<T>(const Expression<T> &, const std::string &, T,               \
+                        const std::map<std::string, T> &, const SolveOptions &);
+
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE_SOLVE)
@@ -0,0 +1,34 @@
+#ifndef SOLVE_HPP
+#define SOLVE_HPP
+
+#include "expression.hpp"
+
+// Метод уточнения корня.
+enum class SolveMethod {
+    Newton, // x -= f / f'
+    Halley  // x -= 2 f f' / (2 f'^2 - f f''), кубическая сходимость
+};
+
+struct SolveOptions {
+    SolveMethod method = SolveMethod::Newton;
+
+    // Итерации прекращаются, когда шаг не превосходит tolerance * max(1, |x|);
+    // 0 — четыре машинных эпсилона типа, в котором решается уравнение.
+    // Кроме того, поиск завершается, когда шаг меньше sqrt(эпсилон) * max(1, |x|) и перестал уменьшаться:
+    // дальше значение меняется только из-за округлений.
+    long double tolerance = 0;
+
+    size_t maxIterations = 100;
+};
+
+/*
+    Решение уравнения expr = 0 относительно переменной var, начиная с x0.
+    Остальные переменные берутся из context. Каждая итерация — один обход дерева (Expression<T>::evalJet),
+    деревья производных не строятся, а контекст выделяется один раз на весь поиск.
+    Бросает исключение, если производная обратилась в ноль или за maxIterations итераций корень не найден.
+*/
+template<typename T>
+T solve(const Expression<T> &expr, const std::string &var, T x0,
+        const std::map<std::string, T> &context = {}, const SolveOptions &options = {});
+
+#endif // SOLVE_HPP
@@ -0,0 +1,319 @@
+#include "split.hpp"
+#include "functions.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+/*
+    Ядра комплексной арифметики над раздельными массивами.
+*/
+
+template<typename R>
+static void mulKernel(const R *ar, const R *ai, const R *br, const R *bi, R *rr, R *ri, size_t n) {
+    for (size_t j = 0; j < n; ++j) {
+        R re = ar[j] * br[j] - ai[j] * bi[j];
+        R im = ar[j] * bi[j] + ai[j] * br[j];
+        rr[j] = re;
+        ri[j] = im;
+    }
+}
+
+template<typename R>
+static void divKernel(const R *ar, const R *ai, const R *br, const R *bi, R *rr, R *ri, size_t n) {
+    if (errorPolicy() == ErrorPolicy::Throw) {
+        for (size_t j = 0; j < n; ++j) {
+            if (br[j] == R(0) && bi[j] == R(0))
+                throw std::runtime_error("Division by zero");
+        }
+    }
+    for (size_t j = 0; j < n; ++j) {
+        R scale = R(1) / (br[j] * br[j] + bi[j] * bi[j]);
+        R re = (ar[j] * br[j] + ai[j] * bi[j]) * scale;
+        R im = (ai[j] * br[j] - ar[j] * bi[j]) * scale;
+        rr[j] = re;
+        ri[j] = im;
+    }
+}
+
+// 1 / b без проверки делителя, как в integerPower: нулевое b даёт (Inf, NaN), а не исключение.
+template<typename R>
+static void reciprocalKernel(const R *br, const R *bi, R *rr, R *ri, size_t n) {
+    for (size_t j = 0; j < n; ++j) {
+        std::complex<R> quotient = R(1) / std::complex<R>(br[j], bi[j]);
+        rr[j] = quotient.real();
+        ri[j] = quotient.imag();
+    }
+}
+
+template<typename R>
+static void expKernel(const R *ar, const R *ai, R *rr, R *ri, size_t n) {
+    for (size_t j = 0; j < n; ++j) {
+        R modulus = std::exp(ar[j]);
+        R angle = ai[j];
+        rr[j] = modulus * std::cos(angle);
+        ri[j] = modulus * std::sin(angle);
+    }
+}
+
+template<typename R>
+static void lnKernel(const R *ar, const R *ai, R *rr, R *ri, size_t n) {
+    for (size_t j = 0; j < n; ++j) {
+        R re = R(0.5) * std::log(ar[j] * ar[j] + ai[j] * ai[j]);
+        R im = std::atan2(ai[j], ar[j]);
+        rr[j] = re;
+        ri[j] = im;
+    }
+}
+
+// sin(a + bi) = sin a ch b + i cos a sh b.
+template<typename R>
+static void sinKernel(const R *ar, const R *ai, R *rr, R *ri, size_t n) {
+    for (size_t j = 0; j < n; ++j) {
+        R re = std::sin(ar[j]) * std::cosh(ai[j]);
+        R im = std::cos(ar[j]) * std::sinh(ai[j]);
+        rr[j] = re;
+        ri[j] = im;
+    }
+}
+
+// cos(a + bi) = cos a ch b - i sin a sh b.
+template<typename R>
+static void cosKernel(const R *ar, const R *ai, R *rr, R *ri, size_t n) {
+    for (size_t j = 0; j < n; ++j) {
+        R re = std::cos(ar[j]) * std::cosh(ai[j]);
+        R im = -std::sin(ar[j]) * std::sinh(ai[j]);
+        rr[j] = re;
+        ri[j] = im;
+    }
+}
+
+template<typename R>
+void evalBatchSplit(const Program<std::complex<R> > &program, const R *const *inputsRe, const R *const *inputsIm,
+                    R *const *outputsRe, R *const *outputsIm, size_t rows) {
+    using Complex = std::complex<R>;
+    const size_t block = Program<Complex>::BATCH_BLOCK;
+    const std::vector<Instruction> &code = program.instructions();
+    const std::vector<Complex> &values = program.constants();
+    const size_t count = code.size();
+    std::vector<R> re(count * block), im(count * block);
+    std::vector<R> constantsRe(values.size() * block), constantsIm(values.size() * block);
+    for (size_t c = 0; c < values.size(); ++c) {
+        std::fill(constantsRe.begin() + c * block, constantsRe.begin() + (c + 1) * block, values[c].real());
+        std::fill(constantsIm.begin() + c * block, constantsIm.begin() + (c + 1) * block, values[c].imag());
+    }
+    // Буферы для функций реестра, которые работают с std::complex.
+    std::vector<Complex> packed(3 * block);
+    std::vector<R> temporaryRe(block), temporaryIm(block);
+    const FunctionRegistry<Complex> &registry = FunctionRegistry<Complex>::instance();
+    // Инструкции ветвей Select вычисляются для всех строк при Propagate; при Throw строки, где выбранная
+    // ветвь могла дать ошибку, отмечаются и перевычисляются функцией Program::eval, как в evalBatch.
+    const bool track = errorPolicy() == ErrorPolicy::Throw && program.hasBranches();
+    std::vector<char> failed(track ? count * block : 0, 0);
+    const std::vector<char> clean(block, 0);
+    for (size_t start = 0; start < rows; start += block) {
+        const size_t n = std::min(block, rows - start);
+        auto real = [&](uint32_t operand) -> const R * {
+            switch (operand & OPERAND_KIND) {
+                case OPERAND_REGISTER:
+                    return &re[operand * block];
+                case OPERAND_CONSTANT:
+                    return &constantsRe[(operand & OPERAND_INDEX) * block];
+                default:
+                    return inputsRe[operand & OPERAND_INDEX] + start;
+            }
+        };
+        auto imag = [&](uint32_t operand) -> const R * {
+            switch (operand & OPERAND_KIND) {
+                case OPERAND_REGISTER:
+                    return &im[operand * block];
+                case OPERAND_CONSTANT:
+                    return &constantsIm[(operand & OPERAND_INDEX) * block];
+                default:
+                    return inputsIm[operand & OPERAND_INDEX] + start;
+            }
+        };
+        auto flags = [&](uint32_t operand) -> const char * {
+            return (operand & OPERAND_KIND) == OPERAND_REGISTER ? &failed[operand * block] : clean.data();
+        };
+        auto raise = [&](size_t row) {
+            std::vector<Complex> inputs(program.variables().size()), registers(count);
+            std::vector<Complex> results(program.outputs().size());
+            for (size_t v = 0; v < inputs.size(); ++v)
+                inputs[v] = Complex(inputsRe[v][row], inputsIm[v][row]);
+            program.eval(inputs.data(), registers.data(), results.data());
+        };
+        for (size_t i = 0; i < count; ++i) {
+            const Instruction &ins = code[i];
+            R *rr = &re[i * block];
+            R *ri = &im[i * block];
+            ErrorPolicyScope branch(ins.conditional ? ErrorPolicy::Propagate : errorPolicy());
+            if (ins.op == OpCode::Constant || ins.op == OpCode::Variable) {
+                uint32_t operand = (ins.op == OpCode::Constant ? OPERAND_CONSTANT : OPERAND_INPUT) | ins.a;
+                std::copy(real(operand), real(operand) + n, rr);
+                std::copy(imag(operand), imag(operand) + n, ri);
+                continue;
+            }
+            const R *ar = real(ins.a), *ai = imag(ins.a);
+            const bool binary = ins.op != OpCode::PowInt && ins.op != OpCode::Call1 &&
+                                ins.op != OpCode::Sin && ins.op != OpCode::Cos &&
+                                ins.op != OpCode::Ln && ins.op != OpCode::Exp;
+            const R *br = binary ? real(ins.b) : nullptr, *bi = binary ? imag(ins.b) : nullptr;
+            switch (ins.op) {
+                case OpCode::Add:
+                    for (size_t j = 0; j < n; ++j) {
+                        rr[j] = ar[j] + br[j];
+                        ri[j] = ai[j] + bi[j];
+                    }
+                    break;
+                case OpCode::Sub:
+                    for (size_t j = 0; j < n; ++j) {
+                        rr[j] = ar[j] - br[j];
+                        ri[j] = ai[j] - bi[j];
+                    }
+                    break;
+                case OpCode::Mul:
+                    mulKernel(ar, ai, br, bi, rr, ri, n);
+                    break;
+                case OpCode::Div:
+                    divKernel(ar, ai, br, bi, rr, ri, n);
+                    break;
+                case OpCode::Pow:
+                    // a^b = exp(b ln a).
+                    lnKernel(ar, ai, temporaryRe.data(), temporaryIm.data(), n);
+                    mulKernel(br, bi, temporaryRe.data(), temporaryIm.data(), temporaryRe.data(), temporaryIm.data(), n);
+                    expKernel(temporaryRe.data(), temporaryIm.data(), rr, ri, n);
+                    // ln 0 = -Inf, и exp(b ln a) даёт NaN там, где std::pow возвращает значение (0^2.5 = 0).
+                    for (size_t j = 0; j < n; ++j) {
+                        if (ar[j] == R(0) && ai[j] == R(0)) {
+                            std::complex<R> power = std::pow(std::complex<R>(ar[j], ai[j]),
+                                                             std::complex<R>(br[j], bi[j]));
+                            rr[j] = power.real();
+                            ri[j] = power.imag();
+                        }
+                    }
+                    break;
+                case OpCode::PowInt: {
+                    // Двоичное возведение в степень сразу над всем блоком.
+                    const long exponent = static_cast<int32_t>(ins.b);
+                    unsigned long k = exponent < 0 ? 0ul - static_cast<unsigned long>(exponent)
+                                                   : static_cast<unsigned long>(exponent);
+                    std::copy(ar, ar + n, temporaryRe.begin());
+                    std::copy(ai, ai + n, temporaryIm.begin());
+                    std::fill(rr, rr + n, R(1));
+                    std::fill(ri, ri + n, R(0));
+                    while (k > 0) {
+                        if (k & 1)
+                            mulKernel(rr, ri, temporaryRe.data(), temporaryIm.data(), rr, ri, n);
+                        k >>= 1;
+                        if (k > 0)
+                            mulKernel(temporaryRe.data(), temporaryIm.data(), temporaryRe.data(), temporaryIm.data(),
+                                      temporaryRe.data(), temporaryIm.data(), n);
+                    }
+                    if (exponent < 0)
+                        reciprocalKernel(rr, ri, rr, ri, n);
+                    break;
+                }
+                case OpCode::Sin:
+                    sinKernel(ar, ai, rr, ri, n);
+                    break;
+                case OpCode::Cos:
+                    cosKernel(ar, ai, rr, ri, n);
+                    break;
+                case OpCode::Ln:
+                    // Как и std::log для std::complex, ln(0) даёт -Inf без исключения.
+                    lnKernel(ar, ai, rr, ri, n);
+                    break;
+                case OpCode::Exp:
+                    expKernel(ar, ai, rr, ri, n);
+                    break;
+                case OpCode::Call1:
+                case OpCode::Call2: {
+                    // Функции реестра вычисляются через std::complex: значения упаковываются и распаковываются.
+                    Complex *a = &packed[0], *b = &packed[block], *out = &packed[2 * block];
+                    for (size_t j = 0; j < n; ++j)
+                        a[j] = Complex(ar[j], ai[j]);
+                    if (binary) {
+                        for (size_t j = 0; j < n; ++j)
+                            b[j] = Complex(br[j], bi[j]);
+                    }
+                    const Complex *args[2] = {a, b};
+                    registry.get(ins.function).kernel(args, out, n);
+                    for (size_t j = 0; j < n; ++j) {
+                        rr[j] = out[j].real();
+                        ri[j] = out[j].imag();
+                    }
+                    break;
+                }
+                case OpCode::Equal:
+                case OpCode::NotEqual: {
+                    const R equal = ins.op == OpCode::Equal ? R(1) : R(0);
+                    for (size_t j = 0; j < n; ++j) {
+                        rr[j] = ar[j] == br[j] && ai[j] == bi[j] ? equal : R(1) - equal;
+                        ri[j] = R(0);
+                    }
+                    break;
+                }
+                case OpCode::Select: {
+                    const R *cr = real(ins.c), *ci = imag(ins.c);
+                    for (size_t j = 0; j < n; ++j) {
+                        const bool first = ar[j] != R(0) || ai[j] != R(0);
+                        rr[j] = first ? br[j] : cr[j];
+                        ri[j] = first ? bi[j] : ci[j];
+                    }
+                    break;
+                }
+                case OpCode::Less:
+                case OpCode::LessEqual:
+                    if (!track || !ins.conditional)
+                        throw std::runtime_error("Ordering comparison of complex values");
+                    std::fill(rr, rr + n, std::numeric_limits<R>::quiet_NaN());
+                    std::fill(ri, ri + n, std::numeric_limits<R>::quiet_NaN());
+                    break;
+                default:
+                    break;
+            }
+            if (!track || (!ins.conditional && ins.op != OpCode::Select))
+                continue;
+            char *f = &failed[i * block];
+            const char *fa = flags(ins.a);
+            if (ins.op == OpCode::Select) {
+                const char *fb = flags(ins.b), *fc = flags(ins.c);
+                for (size_t j = 0; j < n; ++j)
+                    f[j] = fa[j] | (ar[j] != R(0) || ai[j] != R(0) ? fb[j] : fc[j]);
+                if (!ins.conditional) {
+                    for (size_t j = 0; j < n; ++j) {
+                        if (f[j])
+                            raise(start + j);
+                    }
+                    std::fill(f, f + n, 0);
+                }
+                continue;
+            }
+            const char *fb = binary ? flags(ins.b) : clean.data();
+            for (size_t j = 0; j < n; ++j)
+                f[j] = fa[j] | fb[j];
+            if (ins.op == OpCode::Div) {
+                for (size_t j = 0; j < n; ++j)
+                    f[j] |= br[j] == R(0) && bi[j] == R(0);
+            } else if (ins.op == OpCode::Less || ins.op == OpCode::LessEqual) {
+                std::fill(f, f + n, 1);
+            }
+        }
+        for (size_t k = 0; k < program.outputs().size(); ++k) {
+            const uint32_t reg = program.outputs()[k];
+            std::copy(&re[reg * block], &re[reg * block] + n, outputsRe[k] + start);
+            std::copy(&im[reg * block], &im[reg * block] + n, outputsIm[k] + start);
+        }
+    }
+}
+
+// ===================================================================
+// Инстанциация шаблонов для вещественных типов частей
+#define INSTANTIATE_SPLIT(R)                                                                            \
+    template void evalBatchSplit<R>(const Program<std::complex<R> > &, const R *const *, const R *const *, \
+                                    R *const *, R *const *, size_t);
+
+INSTANTIATE_SPLIT(float)
+INSTANTIATE_SPLIT(double)
+INSTANTIATE_SPLIT(long double)
@@ -0,0 +1,20 @@
+#ifndef SPLIT_HPP
+#define SPLIT_HPP
+
+#include "program.hpp"
+
+/*
+    Пакетное вычисление комплексной программы в раздельном формате (structure of arrays):
+    вещественные и мнимые части хранятся в отдельных массивах.
+    inputsRe[v][row], inputsIm[v][row] — значение переменной v; outputsRe[k][row], outputsIm[k][row] — выход k.
+    Умножение, деление, exp, ln, sin и cos раскрыты в формулы над вещественными массивами,
+    которые компилятор векторизует; в них нет восстановления NaN/Inf, которое делают операторы std::complex
+    (результат совпадает с std::complex для конечных значений без переполнения промежуточных величин).
+    Деление на ноль обрабатывается по политике текущего потока, как в Program<T>::evalBatch,
+    в том числе в ветвях Select: ошибка прерывает вычисление, только если ветвь выбрана.
+*/
+template<typename R>
+void evalBatchSplit(const Program<std::complex<R> > &program, const R *const *inputsRe, const R *const *inputsIm,
+                    R *const *outputsRe, R *const *outputsIm, size_t rows);
+
+#endif // SPLIT_HPP
@@ -0,0 +1,230 @@
+#include "taylor.hpp"
+#include "numeric.hpp"
+#include <cmath>
+#include <complex>
+#include <stdexcept>
+#include <type_traits>
+
+// Проверка, что число является неотрицательным целым (для комплексных — с нулевой мнимой частью).
+template<typename T>
+static bool isNonNegativeInteger(const T &value, unsigned long long &result) {
+    auto re = std::real(value);
+    if (std::imag(value) != 0 || re < 0 || std::floor(re) != re || re > 1e18L)
+        return false;
+    result = static_cast<unsigned long long>(re);
+    return true;
+}
+
+template<typename T>
+std::vector<T> taylorConstant(T value, size_t order) {
+    std::vector<T> result(order + 1, T(0));
+    result[0] = value;
+    return result;
+}
+
+template<typename T>
+std::vector<T> taylorAdd(const std::vector<T> &a, const std::vector<T> &b) {
+    std::vector<T> result(a.size());
+    for (size_t k = 0; k < a.size(); ++k)
+        result[k] = a[k] + b[k];
+    return result;
+}
+
+template<typename T>
+std::vector<T> taylorSub(const std::vector<T> &a, const std::vector<T> &b) {
+    std::vector<T> result(a.size());
+    for (size_t k = 0; k < a.size(); ++k)
+        result[k] = a[k] - b[k];
+    return result;
+}
+
+template<typename T>
+std::vector<T> taylorMul(const std::vector<T> &a, const std::vector<T> &b) {
+    // Свёртка Коши: c_k = sum_{j=0..k} a_j b_{k-j}
+    std::vector<T> result(a.size(), T(0));
+    for (size_t k = 0; k < a.size(); ++k) {
+        T sum = T(0);
+        for (size_t j = 0; j <= k; ++j)
+            sum += a[j] * b[k - j];
+        result[k] = sum;
+    }
+    return result;
+}
+
+template<typename T>
+std::vector<T> taylorDiv(const std::vector<T> &a, const std::vector<T> &b) {
+    // q = a / b  =>  q_k = (a_k - sum_{j=1..k} b_j q_{k-j}) / b_0
+    if (b[0] == T(0))
+        throw std::runtime_error("Division by zero");
+    std::vector<T> result(a.size(), T(0));
+    for (size_t k = 0; k < a.size(); ++k) {
+        T sum = a[k];
+        for (size_t j = 1; j <= k; ++j)
+            sum -= b[j] * result[k - j];
+        result[k] = sum / b[0];
+    }
+    return result;
+}
+
+template<typename T>
+std::vector<T> taylorExp(const std::vector<T> &a) {
+    // e' = a' e  =>  e_k = (1/k) sum_{j=1..k} j a_j e_{k-j}
+    std::vector<T> result(a.size(), T(0));
+    result[0] = std::exp(a[0]);
+    for (size_t k = 1; k < a.size(); ++k) {
+        T sum = T(0);
+        for (size_t j = 1; j <= k; ++j)
+            sum += T(j) * a[j] * result[k - j];
+        result[k] = sum / T(k);
+    }
+    return result;
+}
+
+template<typename T>
+std::vector<T> taylorLn(const std::vector<T> &a) {
+    // a l' = a'  =>  l_k = (a_k - (1/k) sum_{j=1..k-1} j l_j a_{k-j}) / a_0
+    if constexpr (std::is_floating_point_v<T>) {
+        if (a[0] <= T(0))
+            throw std::runtime_error("Logarithm of non-positive value");
+    }
+    std::vector<T> result(a.size(), T(0));
+    result[0] = std::log(a[0]);
+    for (size_t k = 1; k < a.size(); ++k) {
+        T sum = T(0);
+        for (size_t j = 1; j < k; ++j)
+            sum += T(j) * result[j] * a[k - j];
+        result[k] = (a[k] - sum / T(k)) / a[0];
+    }
+    return result;
+}
+
+// Синус и косинус считаются совместно: s' = a' c, c' = -a' s.
+template<typename T>
+static void taylorSinCos(const std::vector<T> &a, std::vector<T> &s, std::vector<T> &c) {
+    s.assign(a.size(), T(0));
+    c.assign(a.size(), T(0));
+    s[0] = std::sin(a[0]);
+    c[0] = std::cos(a[0]);
+    for (size_t k = 1; k < a.size(); ++k) {
+        T sumS = T(0);
+        T sumC = T(0);
+        for (size_t j = 1; j <= k; ++j) {
+            sumS += T(j) * a[j] * c[k - j];
+            sumC += T(j) * a[j] * s[k - j];
+        }
+        s[k] = sumS / T(k);
+        c[k] = -sumC / T(k);
+    }
+}
+
+template<typename T>
+std::vector<T> taylorSin(const std::vector<T> &a) {
+    std::vector<T> s, c;
+    taylorSinCos(a, s, c);
+    return s;
+}
+
+template<typename T>
+std::vector<T> taylorCos(const std::vector<T> &a) {
+    std::vector<T> s, c;
+    taylorSinCos(a, s, c);
+    return c;
+}
+
+template<typename T>
+std::vector<T> taylorPow(const std::vector<T> &a, T exponent) {
+    unsigned long long n = 0;
+    if (a[0] == T(0)) {
+        // Рекуррентная формула делит на a_0, поэтому при нулевом основании
+        // допустимы только неотрицательные целые показатели: возводим в степень умножениями.
+        if (!isNonNegativeInteger(exponent, n))
+            throw std::runtime_error("Taylor expansion of power is singular at zero base");
+        std::vector<T> result = taylorConstant(T(1), a.size() - 1);
+        std::vector<T> base = a;
+        while (n > 0) {
+            if (n & 1)
+                result = taylorMul(result, base);
+            n >>= 1;
+            if (n > 0)
+                base = taylorMul(base, base);
+        }
+        return result;
+    }
+    // a p' = p a' exponent  =>  p_k = (1/(k a_0)) sum_{j=1..k} ((exponent+1) j - k) a_j p_{k-j}
+    std::vector<T> result(a.size(), T(0));
+    result[0] = std::pow(a[0], exponent);
+    for (size_t k = 1; k < a.size(); ++k) {
+        T sum = T(0);
+        for (size_t j = 1; j <= k; ++j)
+            sum += ((exponent + T(1)) * T(j) - T(k)) * a[j] * result[k - j];
+        result[k] = sum / (T(k) * a[0]);
+    }
+    return result;
+}
+
+template<typename T>
+std::vector<T> taylorPow(const std::vector<T> &a, const std::vector<T> &b) {
+    for (size_t k = 1; k < b.size(); ++k) {
+        if (b[k] != T(0))
+            return taylorExp(taylorMul(b, taylorLn(a)));
+    }
+    return taylorPow(a, b[0]);
+}
+
+template<typename T>
+std::vector<T> taylorScale(const std::vector<T> &a, T factor) {
+    std::vector<T> result(a.size());
+    for (size_t k = 0; k < a.size(); ++k)
+        result[k] = a[k] * factor;
+    return result;
+}
+
+template<typename T>
+std::vector<T> taylorDerivative(const std::vector<T> &a) {
+    std::vector<T> result(a.size(), T(0));
+    for (size_t k = 0; k + 1 < a.size(); ++k)
+        result[k] = T(k + 1) * a[k + 1];
+    return result;
+}
+
+template<typename T>
+std::vector<T> taylorIntegrate(T value, const std::vector<T> &derivative) {
+    std::vector<T> result(derivative.size(), T(0));
+    result[0] = value;
+    for (size_t k = 1; k < derivative.size(); ++k)
+        result[k] = derivative[k - 1] / T(k);
+    return result;
+}
+
+template<typename T>
+std::vector<T> taylorToDerivatives(const std::vector<T> &a) {
+    std::vector<T> result(a.size());
+    T factorial = T(1);
+    for (size_t k = 0; k < a.size(); ++k) {
+        if (k > 0)
+            factorial *= T(k);
+        result[k] = a[k] * factorial;
+    }
+    return result;
+}
+
+// ===================================================================
+// Инстанциация шаблонов для всех числовых типов
+#define INSTANTIATE_TAYLOR(T)                                                          \
+    template std::vector<T> taylorConstant<T>(T, size_t);                              \
+    template std::vector<T> taylorAdd<T>(const std::vector<T> &, const std::vector<T> &); \
+    template std::vector<T> taylorSub<T>(const std::vector<T> &, const std::vector<T> &); \
+    template std::vector<T> taylorMul<T>(const std::vector<T> &, const std::vector<T> &); \
+    template std::vector<T> taylorDiv<T>(const std::vector<T> &, const std::vector<T> &); \
+    template std::vector<T> taylorExp<T>(const std::vector<T> &);                      \
+    template std::vector<T> taylorLn<T>(const std::vector<T> &);                       \
+    template std::vector<T> taylorSin<T>(const std::vector<T> &);                      \
+    template std::vector<T> taylorCos<T>(const std::vector<T> &);                      \
+    template std::vector<T> taylorPow<T>(const std::vector<T> &, T);                   \
+    template std::vector<T> taylorPow<T>(const std::vector<T> &, const std::vector<T> &); \
+    template std::vector<T> taylorScale<T>(const std::vector<T> &, T);                  \
+    template std::vector<T> taylorDerivative<T>(const std::vector<T> &);               \
+    template std::vector<T> taylorIntegrate<T>(T, const std::vector<T> &);             \
+    template std::vector<T> taylorToDerivatives<T>(const std::vector<T> &);
+
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE_TAYLOR)
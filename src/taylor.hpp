@@ -0,0 +1,70 @@
+#ifndef TAYLOR_HPP
+#define TAYLOR_HPP
+
+#include <vector>
+#include <cstddef>
+
+/*
+    Арифметика усечённых рядов Тейлора.
+    Ряд хранится как вектор коэффициентов c_0..c_n:
+        f(x0 + h) = c_0 + c_1 h + ... + c_n h^n + O(h^(n+1)).
+    Все аргументы одной операции должны иметь одинаковую длину.
+    Сложение и вычитание выполняются за O(n), остальные операции — за O(n^2).
+*/
+
+template<typename T>
+std::vector<T> taylorConstant(T value, size_t order);
+
+template<typename T>
+std::vector<T> taylorAdd(const std::vector<T> &a, const std::vector<T> &b);
+
+template<typename T>
+std::vector<T> taylorSub(const std::vector<T> &a, const std::vector<T> &b);
+
+template<typename T>
+std::vector<T> taylorMul(const std::vector<T> &a, const std::vector<T> &b);
+
+// Деление рядов; бросает исключение, если свободный член знаменателя равен нулю.
+template<typename T>
+std::vector<T> taylorDiv(const std::vector<T> &a, const std::vector<T> &b);
+
+template<typename T>
+std::vector<T> taylorExp(const std::vector<T> &a);
+
+// Логарифм ряда; для вещественных типов свободный член должен быть положительным.
+template<typename T>
+std::vector<T> taylorLn(const std::vector<T> &a);
+
+template<typename T>
+std::vector<T> taylorSin(const std::vector<T> &a);
+
+template<typename T>
+std::vector<T> taylorCos(const std::vector<T> &a);
+
+// Степень ряда с постоянным показателем: a^p.
+// Работает и при отрицательном свободном члене, если p целое.
+template<typename T>
+std::vector<T> taylorPow(const std::vector<T> &a, T exponent);
+
+// Степень ряда с переменным показателем: a^b = exp(b * ln(a)).
+template<typename T>
+std::vector<T> taylorPow(const std::vector<T> &a, const std::vector<T> &b);
+
+// Умножение ряда на число.
+template<typename T>
+std::vector<T> taylorScale(const std::vector<T> &a, T factor);
+
+// Ряд производной: (a')_k = (k + 1) a_{k+1}; старший коэффициент неизвестен и полагается нулевым.
+template<typename T>
+std::vector<T> taylorDerivative(const std::vector<T> &a);
+
+// Ряд функции по её значению в точке и ряду её производной: f_0 = value, f_k = (f')_{k-1} / k.
+// Используется для функций, у которых известна только производная (arcsin, arctg, atan2).
+template<typename T>
+std::vector<T> taylorIntegrate(T value, const std::vector<T> &derivative);
+
+// Перевод коэффициентов ряда в производные: f^(k)(x0) = k! * c_k.
+template<typename T>
+std::vector<T> taylorToDerivatives(const std::vector<T> &a);
+
+#endif // TAYLOR_HPP
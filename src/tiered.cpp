@@ -0,0 +1,137 @@
+#include "tiered.hpp"
+#include "optimizer.hpp"
+#include "traversal.hpp"
+#include <chrono>
+
+// Проходы, не меняющие результата: смена уровня не должна менять значения и ошибки.
+// Понижение силы и переассоциация меняют округление и переполнение, поэтому здесь не применяются.
+template<typename T>
+static PassManager<T> exactPipeline() {
+    PassManager<T> manager;
+    manager.add(std::make_unique<DeadNodeRemoval<T> >());
+    return manager;
+}
+
+template<typename T>
+TieredExpression<T>::TieredExpression(const Expression<T> &expr, const TierOptions &options)
+    : options_(options), state_(std::make_shared<const State>(State{Tier::Tree, expr, Program<T>()})) {
+}
+
+template<typename T>
+TieredExpression<T>::~TieredExpression() {
+    wait();
+}
+
+template<typename T>
+void TieredExpression<T>::wait() {
+    // Фоновый шаг может запустить следующий, поэтому ожидание повторяется, пока потоки не кончатся.
+    for (;;) {
+        std::vector<std::thread> workers;
+        {
+            std::lock_guard<std::mutex> lock(workersMutex_);
+            workers.swap(workers_);
+        }
+        if (workers.empty())
+            break;
+        for (auto &worker: workers)
+            worker.join();
+    }
+}
+
+template<typename T>
+T TieredExpression<T>::eval(const std::map<std::string, T> &context, ErrorPolicy policy) const {
+    std::shared_ptr<const State> state = std::atomic_load(&state_);
+    const uint64_t count = total_.fetch_add(1, std::memory_order_relaxed) + 1;
+    if ((state->tier == Tier::Tree && count >= options_.optimizeAfter) ||
+        (state->tier == Tier::Optimized && count >= options_.compileAfter))
+        promote();
+
+    const size_t tier = static_cast<size_t>(state->tier);
+    auto start = std::chrono::steady_clock::now();
+    T result;
+    if (state->tier == Tier::Compiled) {
+        // Буферы потока: после первого вызова память не выделяется.
+        thread_local std::vector<T> inputs, registers, outputs;
+        ErrorPolicyScope scope(policy);
+        state->program.variableTable().bind(context, inputs, policy);
+        state->program.eval(inputs, registers, outputs);
+        result = outputs[0];
+    } else {
+        result = state->tree.eval(context, policy);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    evaluations_[tier].fetch_add(1, std::memory_order_relaxed);
+    nanoseconds_[tier].fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                                 std::memory_order_relaxed);
+    return result;
+}
+
+template<typename T>
+void TieredExpression<T>::promote() const {
+    // Проходы оптимизатора и compile рекурсивны: глубокие деревья остаются на уровне Tree,
+    // где eval сам переходит на обход с явным стеком.
+    if (std::atomic_load(&state_)->tree.node()->height() > RECURSION_LIMIT)
+        return;
+    bool expected = false;
+    if (failed_.load(std::memory_order_relaxed) || !pending_.compare_exchange_strong(expected, true))
+        return;
+    std::lock_guard<std::mutex> lock(workersMutex_);
+    workers_.emplace_back([this] { promoteInBackground(); });
+}
+
+template<typename T>
+void TieredExpression<T>::promoteInBackground() const {
+    // Если порог компиляции уже пройден, оба перехода выполняются подряд.
+    for (;;) {
+        std::shared_ptr<const State> state = std::atomic_load(&state_);
+        if (state->tier == Tier::Compiled)
+            break;
+        if (state->tier == Tier::Optimized && total_.load(std::memory_order_relaxed) < options_.compileAfter)
+            break;
+        auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<const State> next;
+        try {
+            if (state->tier == Tier::Tree)
+                next = std::make_shared<const State>(State{Tier::Optimized, exactPipeline<T>().run(state->tree), Program<T>()});
+            else
+                next = std::make_shared<const State>(State{Tier::Compiled, state->tree, compile(state->tree)});
+        } catch (const std::exception &) {
+            failed_.store(true);
+            break;
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        promotionNanoseconds_.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        ++promotions_;
+        std::atomic_store(&state_, next);
+    }
+    pending_.store(false);
+    // Порог компиляции мог быть пройден, пока флаг ещё был поднят: такие вызовы переход не запускали.
+    if (!failed_.load() && tier() == Tier::Optimized && total_.load() >= options_.compileAfter)
+        promote();
+}
+
+template<typename T>
+Tier TieredExpression<T>::tier() const {
+    return std::atomic_load(&state_)->tier;
+}
+
+template<typename T>
+TierCounters TieredExpression<T>::counters() const {
+    TierCounters counters;
+    counters.tier = tier();
+    for (size_t k = 0; k < TIER_COUNT; ++k) {
+        counters.evaluations[k] = evaluations_[k].load();
+        counters.seconds[k] = nanoseconds_[k].load() * 1e-9;
+    }
+    counters.promotions = promotions_.load();
+    counters.promotionSeconds = promotionNanoseconds_.load() * 1e-9;
+    counters.promotionFailed = failed_.load();
+    return counters;
+}
+
+// ===================================================================
+// Инстанциация шаблонов для всех числовых типов
+#define INSTANTIATE_TIERED(T) \
+    template class TieredExpression<T>;
+
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE_TIERED)
@@ -0,0 +1,94 @@
+#ifndef TIERED_HPP
+#define TIERED_HPP
+
+#include "expression.hpp"
+#include "program.hpp"
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+/*
+    Выражение с многоуровневым исполнением.
+    Вычисления начинаются обходом исходного дерева. После optimizeAfter вычислений дерево
+    упрощается проходами, сохраняющими результат (dead-node-removal), после compileAfter —
+    компилируется в Program<T>. Все уровни дают одни и те же значения и ошибки.
+    Оба шага выполняются в фоновом потоке: вызывающая сторона продолжает работать на текущем
+    уровне, а готовый уровень подменяется атомарной записью указателя, поэтому eval никогда
+    не ждёт компиляции. Если фоновый шаг бросил исключение, выражение остаётся на достигнутом уровне.
+    Деревья выше RECURSION_LIMIT (traversal.hpp) остаются на уровне Tree.
+
+    eval можно вызывать из нескольких потоков одновременно.
+*/
+
+enum class Tier {
+    Tree,      // обход исходного дерева
+    Optimized, // обход дерева после dead-node-removal
+    Compiled   // линейная программа
+};
+
+const size_t TIER_COUNT = 3;
+
+struct TierOptions {
+    uint64_t optimizeAfter = 64;
+    uint64_t compileAfter = 1024;
+};
+
+// Снимок счётчиков; индексы массивов — значения Tier.
+struct TierCounters {
+    Tier tier = Tier::Tree;
+    uint64_t evaluations[TIER_COUNT] = {};
+    double seconds[TIER_COUNT] = {};   // время внутри eval на каждом уровне
+    uint64_t promotions = 0;
+    double promotionSeconds = 0;       // время фоновых оптимизации и компиляции
+    bool promotionFailed = false;
+};
+
+template<typename T>
+class TieredExpression {
+public:
+    explicit TieredExpression(const Expression<T> &expr, const TierOptions &options = {});
+
+    // Ожидает завершения фонового шага.
+    ~TieredExpression();
+
+    TieredExpression(const TieredExpression &) = delete;
+
+    TieredExpression &operator=(const TieredExpression &) = delete;
+
+    T eval(const std::map<std::string, T> &context, ErrorPolicy policy = ErrorPolicy::Throw) const;
+
+    Tier tier() const;
+
+    TierCounters counters() const;
+
+    // Ожидание завершения запущенных фоновых шагов.
+    void wait();
+
+private:
+    struct State {
+        Tier tier;
+        Expression<T> tree;
+        Program<T> program;
+    };
+
+    // Запуск фонового перехода на следующий уровень, если он ещё не запущен.
+    void promote() const;
+
+    void promoteInBackground() const;
+
+    TierOptions options_;
+    mutable std::shared_ptr<const State> state_; // читается и заменяется через std::atomic_load/atomic_store
+
+    mutable std::atomic<uint64_t> total_{0};
+    mutable std::atomic<uint64_t> evaluations_[TIER_COUNT] = {};
+    mutable std::atomic<uint64_t> nanoseconds_[TIER_COUNT] = {};
+    mutable std::atomic<uint64_t> promotions_{0};
+    mutable std::atomic<uint64_t> promotionNanoseconds_{0};
+    mutable std::atomic<bool> pending_{false};
+    mutable std::atomic<bool> failed_{false};
+
+    mutable std::mutex workersMutex_;
+    mutable std::vector<std::thread> workers_;
+};
+
+#endif // TIERED_HPP
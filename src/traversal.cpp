@@ -0,0 +1,121 @@
+#include "traversal.hpp"
+
+namespace {
+
+// Кадр обхода: узел и номер следующего потомка.
+template<typename T>
+struct Frame {
+    const ExpressionImpl<T> *node;
+    size_t next;
+};
+
+// Обход в обратном порядке: combine(node, args) получает результаты потомков узла
+// (args[i] — для потомка i) и возвращает результат узла. Результаты ещё не обработанных
+// родителей лежат в одном векторе, поэтому память пропорциональна высоте дерева.
+template<typename T, typename R, typename Combine>
+R postOrder(const Expression<T> &expr, Combine combine) {
+    std::vector<Frame<T> > stack{{expr.node(), 0}};
+    std::vector<R> results;
+    while (!stack.empty()) {
+        Frame<T> &frame = stack.back();
+        const ExpressionImpl<T> *node = frame.node;
+        const size_t count = node->childCount();
+        if (frame.next < count) {
+            stack.push_back({node->child(frame.next++).node(), 0});
+            continue;
+        }
+        R result = combine(*node, results.data() + (results.size() - count));
+        results.erase(results.end() - count, results.end());
+        results.push_back(std::move(result));
+        stack.pop_back();
+    }
+    return std::move(results.back());
+}
+
+} // namespace
+
+template<typename T>
+T evalIterative(const Expression<T> &expr, const std::map<std::string, T> &context) {
+    // Как postOrder, но потомок, который узлу не нужен (невыбранная ветвь Select), не вычисляется:
+    // на его место кладётся ноль.
+    std::vector<Frame<T> > stack{{expr.node(), 0}};
+    std::vector<T> results;
+    while (!stack.empty()) {
+        Frame<T> &frame = stack.back();
+        const ExpressionImpl<T> *node = frame.node;
+        const size_t count = node->childCount();
+        if (frame.next < count) {
+            const size_t index = frame.next++;
+            if (node->needsChild(index, results.data() + (results.size() - index)))
+                stack.push_back({node->child(index).node(), 0});
+            else
+                results.push_back(T(0));
+            continue;
+        }
+        T result = node->apply(results.data() + (results.size() - count), context);
+        results.resize(results.size() - count);
+        results.push_back(result);
+        stack.pop_back();
+    }
+    return results.back();
+}
+
+template<typename T>
+std::string toStringIterative(const Expression<T> &expr) {
+    // Узел записывается частями: part(0), потомок 0, part(1), ..., part(childCount()).
+    std::string out;
+    std::vector<Frame<T> > stack{{expr.node(), 0}};
+    while (!stack.empty()) {
+        Frame<T> &frame = stack.back();
+        const ExpressionImpl<T> *node = frame.node;
+        const size_t index = frame.next++;
+        out += node->part(index);
+        if (index < node->childCount())
+            stack.push_back({node->child(index).node(), 0});
+        else
+            stack.pop_back();
+    }
+    return out;
+}
+
+template<typename T>
+Expression<T> differentiateIterative(const Expression<T> &expr, const std::string &var) {
+    return postOrder<T, Expression<T> >(expr, [&](const ExpressionImpl<T> &node, const Expression<T> *derivatives) {
+        return node.derivativeFrom(derivatives, var);
+    });
+}
+
+template<typename T>
+Expression<T> substituteIterative(const Expression<T> &expr, const std::string &var, const Expression<T> &value) {
+    return postOrder<T, Expression<T> >(expr, [&](const ExpressionImpl<T> &node, const Expression<T> *children) {
+        if (node.childCount() == 0)
+            return node.substitute(var, value);
+        // Узел пересобирается с новыми потомками; потомок узнаётся по адресу.
+        return node.mapChildren([&](const Expression<T> &child) {
+            size_t i = 0;
+            while (&node.child(i) != &child)
+                ++i;
+            return children[i];
+        });
+    });
+}
+
+template<typename T>
+void requireShallow(const Expression<T> &expr, const char *operation) {
+    const size_t height = expr.node()->height();
+    if (height > RECURSION_LIMIT)
+        throw std::runtime_error(std::string(operation) + ": expression height " + std::to_string(height) +
+                                 " exceeds the recursion limit " + std::to_string(RECURSION_LIMIT));
+}
+
+// ===================================================================
+// Инстанциация шаблонов для всех числовых типов
+#define INSTANTIATE_TRAVERSAL(T)                                                                 \
+    template void requireShallow<T>(const Expression<T> &, const char *);                       \
+    template T evalIterative<T>(const Expression<T> &, const std::map<std::string, T> &);       \
+    template std::string toStringIterative<T>(const Expression<T> &);                           \
+    template Expression<T> differentiateIterative<T>(const Expression<T> &, const std::string &); \
+    template Expression<T> substituteIterative<T>(const Expression<T> &, const std::string &,   \
+                                                  const Expression<T> &);
+
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE_TRAVERSAL)
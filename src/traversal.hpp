@@ -0,0 +1,43 @@
+#ifndef TRAVERSAL_HPP
+#define TRAVERSAL_HPP
+
+#include "expression.hpp"
+
+/*
+    Обход дерева выражения с явным стеком, без рекурсии.
+
+    Рекурсивные методы узлов расходуют по кадру стека вызовов на уровень дерева и переполняют
+    стек на цепочках в сотни тысяч узлов (например, x + x + ... + x, прочитанной из файла).
+    Здесь те же операции выполняются в цикле: стек обхода и промежуточные результаты хранятся
+    в векторах, поэтому глубина ограничена только памятью, а расход памяти пропорционален высоте дерева.
+    Шаг для одного узла берётся из ExpressionImpl<T>::apply, part и derivativeFrom — тех же методов,
+    на которых построены рекурсивные реализации, поэтому результаты совпадают.
+
+    Expression<T> сам переключается на эти функции для деревьев выше RECURSION_LIMIT;
+    вызывать их напрямую нужно только для сравнения с рекурсивными версиями (bench/traversal.cpp).
+    Разбор (Parser<T>) и разрушение (~Expression) не рекурсивны всегда.
+    Остальные обходы (taylor, evalJet, compile, оптимизатор) остаются рекурсивными и для деревьев
+    выше RECURSION_LIMIT бросают std::runtime_error (requireShallow) вместо переполнения стека.
+*/
+
+// Высота дерева, начиная с которой Expression<T> использует обход с явным стеком.
+const size_t RECURSION_LIMIT = 2000;
+
+// Исключение с именем операции, если рекурсивный обход дерева expr глубже RECURSION_LIMIT.
+template<typename T>
+void requireShallow(const Expression<T> &expr, const char *operation);
+
+template<typename T>
+T evalIterative(const Expression<T> &expr, const std::map<std::string, T> &context);
+
+// Запись за время, линейное по длине результата (рекурсивная запись копирует подстроки на каждом уровне).
+template<typename T>
+std::string toStringIterative(const Expression<T> &expr);
+
+template<typename T>
+Expression<T> differentiateIterative(const Expression<T> &expr, const std::string &var);
+
+template<typename T>
+Expression<T> substituteIterative(const Expression<T> &expr, const std::string &var, const Expression<T> &value);
+
+#endif // TRAVERSAL_HPP
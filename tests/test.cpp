@@ -2,8 +2,30 @@
 #include <string>
 #include <map>
 #include <complex>
+#include <fstream>
+#include <cstdio>
+#include <sstream>
+#include <thread>
+#include <chrono>
+#include <functional>
 #include "../src/parser.hpp"
 #include "../src/expression.hpp"
+#include "../src/jacobian.hpp"
+#include "../src/polynomial.hpp"
+#include "../src/solve.hpp"
+#include "../src/columns.hpp"
+#include "../src/mixed.hpp"
+#include "../src/split.hpp"
+#include "../src/optimizer.hpp"
+#include "../src/tiered.hpp"
+#include "../src/server.hpp"
+#include "../src/codegen.hpp"
+#include "../src/reduction.hpp"
+#include "../src/integrate.hpp"
+#include "../src/catalog.hpp"
+#include "../src/compact.hpp"
+#include "../src/lazy.hpp"
+#include "../src/traversal.hpp"
 
 void testEvaluation() {
     try {
@@ -84,6 +106,1199 @@ void testComplexUsage() {
     }
 }
 
+void testTaylorDerivatives() {
+    try {
+        // Производные до 4-го порядка сравниваются с многократным символьным дифференцированием.
+        auto expr = parseExpression("x ^ 3 * sin(x) / (1 + exp(x)) - ln(x) + x ^ x");
+        std::map<std::string, long double> context = {{"x", 0.7L}};
+        auto derivs = expr.derivatives("x", context, 4);
+        Expression<long double> symbolic = expr;
+        bool ok = derivs.size() == 5;
+        for (size_t k = 0; ok && k < derivs.size(); ++k) {
+            long double expected = symbolic.eval(context);
+            if (std::abs(derivs[k] - expected) > 1e-9L * (1 + std::abs(expected)))
+                ok = false;
+            symbolic = symbolic.differentiate("x");
+        }
+        // Целая степень с отрицательным основанием: (x^3)'' = 6x.
+        auto cube = parseExpression("x ^ 3").derivatives("x", {{"x", -2}}, 3);
+        ok = ok && cube[0] == -8 && cube[1] == 12 && cube[2] == -12 && cube[3] == 6;
+        if (ok)
+            std::cout << "testTaylorDerivatives: OK\n";
+        else
+            std::cout << "testTaylorDerivatives: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testTaylorDerivatives: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+void testJacobian() {
+    try {
+        // f0 = x * sin(y), f1 = exp(x) + z ^ 2, f2 = 5: d f0 / dz, d f1 / dy и вся строка f2 — структурные нули.
+        std::vector<Expression<long double> > system = {
+            parseExpression("x * sin(y)"), parseExpression("exp(x) + z ^ 2"), parseExpression("5")
+        };
+        JacobianSystem<long double> jac(system, {"x", "y", "z"}, true);
+        std::map<std::string, long double> context = {{"x", 0.5L}, {"y", 2}, {"z", 3}};
+        std::vector<long double> values, dense;
+        jac.evaluateDense(context, values, dense);
+        bool ok = jac.jacobianPattern().size() == 4;
+        for (size_t row = 0; ok && row < system.size(); ++row) {
+            ok = std::abs(values[row] - system[row].eval(context)) < 1e-12L;
+            const char *names[] = {"x", "y", "z"};
+            for (size_t col = 0; ok && col < 3; ++col) {
+                long double expected = system[row].differentiate(names[col]).eval(context);
+                ok = std::abs(dense[row * 3 + col] - expected) < 1e-12L;
+            }
+        }
+        // Гессиан: d2f0/dxdy = cos(y), d2f0/dy2 = -x sin(y), d2f1/dx2 = exp(x), d2f1/dz2 = 2.
+        std::vector<long double> inputs = {0.5L, 2, 3}, jacobian, hessian;
+        jac.evaluate(inputs, values, jacobian, hessian);
+        ok = ok && jac.hessianPattern().size() == 4 && hessian.size() == 4;
+        for (size_t k = 0; ok && k < hessian.size(); ++k) {
+            const HessianEntry &e = jac.hessianPattern()[k];
+            long double expected = system[e.function].differentiate(jac.inputs()[e.row])
+                    .differentiate(jac.inputs()[e.col]).eval(context);
+            ok = std::abs(hessian[k] - expected) < 1e-12L;
+        }
+        if (ok)
+            std::cout << "testJacobian: OK\n";
+        else
+            std::cout << "testJacobian: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testJacobian: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+void testIntegerPower() {
+    try {
+        // Числовой показатель даёт узел целой степени; производная определена при x < 0.
+        auto expr = parseExpression("x ^ 3 + x ^ -2");
+        auto deriv = expr.differentiate("x");
+        std::map<std::string, long double> context = {{"x", -2}};
+        long double value = expr.eval(context);
+        long double slope = deriv.eval(context);
+        bool nodeOk = dynamic_cast<OperationIntPow<long double> *>(parseExpression("x ^ 2").getImpl().get()) != nullptr;
+        // f = -8 + 0.25, f' = 3x^2 - 2x^-3 = 12 + 0.25
+        if (nodeOk && value == -7.75L && std::abs(slope - 12.25L) < 1e-15L)
+            std::cout << "testIntegerPower: OK\n";
+        else
+            std::cout << "testIntegerPower: FAIL (got " << value << ", " << slope << ")\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testIntegerPower: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+void testPolynomialForm() {
+    try {
+        // Многочлен, рациональная функция и многочлен внутри функции.
+        auto poly = parseExpression("(x + 1) ^ 5 - 3 * x * y ^ 2 + y / 4 - 7");
+        auto rational = parseExpression("(x ^ 2 + 2 * x + 1) / (x - 3)");
+        auto inside = parseExpression("sin(x * x + 2 * x * y)");
+        std::map<std::string, long double> context = {{"x", -1.5L}, {"y", 0.75L}};
+        bool ok = true;
+        for (const auto &expr: {poly, rational, inside}) {
+            auto horner = hornerForm(expr);
+            ok = ok && std::abs(horner.eval(context) - expr.eval(context)) < 1e-12L;
+            for (const char *var: {"x", "y"}) {
+                long double expected = expr.differentiate(var).eval(context);
+                ok = ok && std::abs(horner.differentiate(var).eval(context) - expected) < 1e-12L;
+            }
+        }
+        auto horner = hornerForm(poly);
+        auto node = dynamic_cast<PolynomialNode<long double> *>(horner.getImpl().get());
+        ok = ok && node != nullptr && node->polynomial().size() == 8;
+        // Производная многочлена снова многочлен, строковая форма разбирается парсером.
+        auto deriv = horner.differentiate("x");
+        ok = ok && dynamic_cast<PolynomialNode<long double> *>(deriv.getImpl().get()) != nullptr;
+        ok = ok && std::abs(parseExpression(horner.to_string()).eval(context) - poly.eval(context)) < 1e-12L;
+        ok = ok && std::abs(compile(horner).eval(context)[0] - poly.eval(context)) < 1e-12L;
+        ok = ok && std::abs(horner.derivatives("x", context, 2)[2] - deriv.differentiate("x").eval(context)) < 1e-12L;
+        if (ok)
+            std::cout << "testPolynomialForm: OK\n";
+        else
+            std::cout << "testPolynomialForm: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testPolynomialForm: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+void testFunctionLibrary() {
+    try {
+        auto expr = parseExpression("tan(x) + sqrt(y) * atan2(y, x) - max(x, y) + abs(x) * tanh(x) + asin(x / 3)"
+                                    " + acos(x / 3) * sinh(y) / cosh(y) + atan(y) + min(x, y) + pow(x, 3)");
+        long double x = -0.4L, y = 1.3L;
+        std::map<std::string, long double> context = {{"x", x}, {"y", y}};
+        long double expected = std::tan(x) + std::sqrt(y) * std::atan2(y, x) - y + std::abs(x) * std::tanh(x) +
+                               std::asin(x / 3) + std::acos(x / 3) * std::sinh(y) / std::cosh(y) + std::atan(y) +
+                               x + x * x * x;
+        bool ok = std::abs(expr.eval(context) - expected) < 1e-15L;
+        // Символьная производная против центральной разности, ряд Тейлора и программа против дерева.
+        for (const char *var: {"x", "y"}) {
+            auto deriv = expr.differentiate(var);
+            auto plus = context, minus = context;
+            plus[var] += 1e-6L;
+            minus[var] -= 1e-6L;
+            long double numeric = (expr.eval(plus) - expr.eval(minus)) / 2e-6L;
+            ok = ok && std::abs(deriv.eval(context) - numeric) < 1e-7L;
+            ok = ok && std::abs(expr.derivatives(var, context, 2)[2] - deriv.differentiate(var).eval(context)) < 1e-12L;
+            // Jet по правилам реестра совпадает с рядом Тейлора.
+            Jet<long double> jet = expr.evalJet(var, context);
+            std::vector<long double> series = expr.derivatives(var, context, 2);
+            ok = ok && std::abs(jet.value - series[0]) < 1e-15L && std::abs(jet.first - series[1]) < 1e-15L &&
+                 std::abs(jet.second - series[2]) < 1e-13L;
+        }
+        JacobianSystem<long double> jac({expr}, {"x", "y"});
+        std::vector<long double> values, dense;
+        jac.evaluateDense(context, values, dense);
+        ok = ok && std::abs(values[0] - expected) < 1e-15L;
+        ok = ok && std::abs(dense[1] - expr.differentiate("y").eval(context)) < 1e-15L;
+        // Пакетное вычисление совпадает со скалярным.
+        Program<long double> program = compile(expr);
+        std::vector<long double> xs, ys, out(300);
+        for (int i = 0; i < 300; ++i) {
+            xs.push_back(-0.9L + i * 0.005L);
+            ys.push_back(0.1L + i * 0.01L);
+        }
+        std::map<std::string, const long double *> columns = {{"x", xs.data()}, {"y", ys.data()}};
+        std::vector<const long double *> inputs;
+        for (const auto &name: program.variables())
+            inputs.push_back(columns[name]);
+        long double *outputs[] = {out.data()};
+        program.evalBatch(inputs.data(), outputs, out.size());
+        for (size_t i = 0; ok && i < out.size(); ++i)
+            ok = std::abs(out[i] - expr.eval({{"x", xs[i]}, {"y", ys[i]}})) < 1e-15L;
+        if (ok)
+            std::cout << "testFunctionLibrary: OK\n";
+        else
+            std::cout << "testFunctionLibrary: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testFunctionLibrary: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+void testProgram() {
+    try {
+        // Общие подвыражения sin(theta) и exp(-t / tau) вычисляются один раз на все выходы.
+        Program<long double> program = parseProgram(
+            "# risk formulas\n"
+            "decay = exp(-t / tau)\n"
+            "a = sin(theta) * decay\n"
+            "\n"
+            "b = sin(theta) * exp(-t / tau) + 1\n"
+            "c = a * b - decay\n");
+        std::map<std::string, long double> context = {{"t", 0.3L}, {"tau", 2}, {"theta", 0.9L}};
+        std::vector<long double> outputs = program.eval(context);
+        long double decay = std::exp(-0.3L / 2), a = std::sin(0.9L) * decay, b = a + 1;
+        bool ok = outputs.size() == 4 && program.outputNames()[2] == "b";
+        ok = ok && outputs[program.output("a")] == a && outputs[program.output("b")] == b;
+        ok = ok && std::abs(outputs[program.output("c")] - (a * b - decay)) < 1e-15L;
+        size_t sines = 0;
+        for (const auto &ins: program.instructions())
+            sines += ins.op == OpCode::Sin;
+        ok = ok && sines == 1;
+        bool redefinition = false;
+        try {
+            parseProgram("x = 1\nx = 2");
+        } catch (const std::exception &ex) {
+            redefinition = std::string(ex.what()).find("Line 2") == 0;
+        }
+        // Умножение на нуль и деление нуля не отбрасывают операнд: ошибка в нём возникает, как в дереве.
+        for (const char *formula: {"(1 / y) * 0", "0 / ln(y)", "ln(y) ^ 0"}) {
+            bool thrown = false;
+            try {
+                compile(parseExpression<long double>(formula)).eval({{"y", 0}});
+            } catch (const std::runtime_error &) {
+                thrown = true;
+            }
+            ok = ok && thrown;
+        }
+        if (ok && redefinition)
+            std::cout << "testProgram: OK\n";
+        else
+            std::cout << "testProgram: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testProgram: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+
+void testLeafOperands() {
+    try {
+        // Листья x, y и 2 читаются родительскими инструкциями напрямую и не занимают регистров.
+        Expression<long double> x("x"), y("y");
+        Expression<long double> expr = x * y + Expression<long double>(2) * x;
+        ProgramBuilder<long double> builder(VariableTable({"y", "x", "unused"}));
+        builder.add(sin(x) * y);
+        builder.addOutput(builder.add(expr), "f");
+        builder.addOutput(builder.variable("x"), "x");
+        Program<long double> program = builder.build();
+        bool ok = program.instructions().size() == 4 && program.variables().size() == 3;
+        ok = ok && program.variableTable().find("x") == 1;
+        for (const auto &ins: program.instructions())
+            ok = ok && ins.op != OpCode::Sin && ins.op != OpCode::Constant;
+        std::map<std::string, long double> context = {{"x", 1.5L}, {"y", -4}, {"unused", 0}};
+        std::vector<long double> outputs = program.eval(context);
+        ok = ok && outputs[0] == expr.eval(context) && outputs[1] == 1.5L;
+        long double xs[] = {1, 2, 3}, ys[] = {4, 5, 6}, zs[] = {0, 0, 0}, fs[3], copies[3];
+        const long double *inputs[] = {ys, xs, zs};
+        long double *results[] = {fs, copies};
+        program.evalBatch(inputs, results, 3);
+        for (size_t i = 0; i < 3; ++i)
+            ok = ok && fs[i] == xs[i] * ys[i] + 2 * xs[i] && copies[i] == xs[i];
+        if (ok)
+            std::cout << "testLeafOperands: OK\n";
+        else
+            std::cout << "testLeafOperands: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testLeafOperands: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+
+void testProfiler() {
+    try {
+        profile::Profiler &profiler = profile::Profiler::instance();
+        profiler.reset();
+        profiler.enable(true);
+        Expression<long double> x("x");
+        Expression<long double> expr = Expression<long double>(1) / (x - x);
+        {
+            profile::Scope outer(profile::Kind::Eval, expr.getImpl().get());
+            {
+                profile::Scope leaf(profile::Kind::Eval, x.getImpl().get());
+            }
+            try {
+                profile::Scope leaf(profile::Kind::Eval, x.getImpl().get());
+                throw std::runtime_error("Division by zero");
+            } catch (const std::exception &) {
+            }
+        }
+        const auto &frames = profiler.frames();
+        bool ok = frames.size() == 3 && frames[1].label == "(... / ...)" && frames[1].calls == 1;
+        ok = ok && frames[1].exceptions == 0 && frames[2].calls == 2 && frames[2].exceptions == 1;
+        ok = ok && profiler.toJson().find("\"node\": \"x\", \"calls\": 2") != std::string::npos;
+#ifdef EXPRESSION_PROFILE
+        // В инструментированной сборке исключение засчитывается узлу деления, а не его предкам.
+        profiler.reset();
+        std::map<std::string, long double> context = {{"x", 2}};
+        try {
+            expr.eval(context);
+            ok = false;
+        } catch (const std::exception &) {
+        }
+        ok = ok && profiler.frames()[1].exceptions == 1 && profiler.frames()[1].calls == 1;
+        profiler.reset();
+        expr.differentiate("x");
+        ok = ok && profiler.frames()[1].kind == profile::Kind::Differentiate && profiler.frames()[1].allocations > 0;
+        ok = ok && profiler.toFolded().find("differentiate ") == 0;
+        // Дерево выше RECURSION_LIMIT вычисляется с явным стеком и учитывается одним кадром корня.
+        profiler.reset();
+        Expression<long double> tall = x;
+        for (size_t i = 0; i < RECURSION_LIMIT; ++i)
+            tall = sin(tall);
+        tall.eval(context);
+        ok = ok && profiler.frames().size() == 2 && profiler.frames()[1].label == "sin(...)";
+#endif
+        profiler.enable(false);
+        profiler.reset();
+        if (ok)
+            std::cout << "testProfiler: OK\n";
+        else
+            std::cout << "testProfiler: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testProfiler: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+
+void testErrorPolicy() {
+    try {
+        Expression<long double> x("x");
+        Expression<long double> expr = Expression<long double>(1) / x + ln(x);
+        std::map<std::string, long double> zero = {{"x", 0}};
+        bool thrown = false;
+        try {
+            expr.eval(zero);
+        } catch (const std::exception &) {
+            thrown = true;
+        }
+        bool ok = thrown && std::isinf((Expression<long double>(1) / x).eval(zero, ErrorPolicy::Propagate));
+        ok = ok && std::isnan(expr.eval({{"x", -1}}, ErrorPolicy::Propagate));
+        ok = ok && std::isnan(expr.eval({}, ErrorPolicy::Propagate)) && errorPolicy() == ErrorPolicy::Throw;
+
+        // Пакет продолжает вычисление после плохих строк и отмечает их в битовой карте.
+        Program<long double> program = compile(parseExpression("sqrt(x) + 1 / (x - 1)"));
+        long double xs[] = {4, -1, 1, 9}, ys[4];
+        const long double *inputs[] = {xs};
+        long double *outputs[] = {ys};
+        std::vector<bool> errors;
+        program.evalBatch(inputs, outputs, 4, ErrorPolicy::Propagate, &errors);
+        ok = ok && errors == std::vector<bool>({false, true, true, false});
+        ok = ok && ys[0] == 2 + 1 / 3.0L && ys[3] == 3 + 1 / 8.0L;
+        // Переполнение и ошибка в невыбранной ветви не отмечаются, ошибка в выбранной — отмечается.
+        Program<long double> guarded = compile(parseExpression("exp(x) + select(x > -2, ln(x), 0)"));
+        long double wide[] = {20000, -1, -3}, results[3];
+        const long double *wideInputs[] = {wide};
+        long double *wideOutputs[] = {results};
+        guarded.evalBatch(wideInputs, wideOutputs, 3, ErrorPolicy::Propagate, &errors);
+        ok = ok && errors == std::vector<bool>({false, true, false}) && std::isinf(results[0]);
+        thrown = false;
+        try {
+            program.evalBatch(inputs, outputs, 4);
+        } catch (const std::exception &) {
+            thrown = true;
+        }
+        if (ok && thrown)
+            std::cout << "testErrorPolicy: OK\n";
+        else
+            std::cout << "testErrorPolicy: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testErrorPolicy: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+
+void testSolve() {
+    try {
+        // Значение и две производные за один обход совпадают с вычислением по деревьям производных.
+        Expression<long double> f = parseExpression("x^3 * sin(x) + exp(2 * x) / x + ln(x) * sqrt(x) + x^y");
+        Expression<long double> polynomial = hornerForm(parseExpression("(x + 2 * y)^3 - x * y"));
+        std::map<std::string, long double> context = {{"x", 1.3L}, {"y", 0.7L}};
+        bool ok = true;
+        for (const auto &expr: {f, polynomial}) {
+            Jet<long double> jet = expr.evalJet("x", context);
+            Expression<long double> d1 = expr.differentiate("x");
+            ok = ok && std::abs(jet.value - expr.eval(context)) < 1e-15L;
+            ok = ok && std::abs(jet.first - d1.eval(context)) < 1e-14L;
+            ok = ok && std::abs(jet.second - d1.differentiate("x").eval(context)) < 1e-13L;
+            ok = ok && expr.evalWithDerivative("x", context).second == jet.first;
+        }
+
+        Expression<long double> x("x");
+        long double root2 = solve(x * x - Expression<long double>(2), "x", 1.0L);
+        SolveOptions halley;
+        halley.method = SolveMethod::Halley;
+        long double dottie = solve(cos(x) - x, "x", 1.0L, {}, halley);
+        long double cube = solve(parseExpression("x^3 - a"), "x", 1.0L, {{"a", 27}}, halley);
+        ok = ok && std::abs(root2 - std::sqrt(2.0L)) < 1e-18L && std::abs(dottie - std::cos(dottie)) < 1e-18L;
+        ok = ok && std::abs(cube - 3) < 1e-17L;
+        // Точность по умолчанию берётся из типа: в float корни находятся с точностью до нескольких ulp.
+        for (const char *equation: {"x^2 - 2", "exp(x) - 3 * x", "x^3 - 2 * x - 5"}) {
+            const float single = solve(parseExpression<float>(equation), "x", 1.0f);
+            const double precise = solve(parseExpression<double>(equation), "x", 1.0);
+            ok = ok && std::abs(single - precise) <= 8 * std::numeric_limits<float>::epsilon() * std::abs(precise);
+        }
+
+        using Complex = std::complex<long double>;
+        Expression<Complex> z("z");
+        Complex i = solve(z * z + Expression<Complex>(Complex(1)), "z", Complex(0.5L, 0.5L));
+        ok = ok && std::abs(i - Complex(0, 1)) < 1e-17L;
+        bool thrown = false;
+        try {
+            solve(x * x + Expression<long double>(1), "x", 0.0L);
+        } catch (const std::exception &) {
+            thrown = true;
+        }
+        if (ok && thrown)
+            std::cout << "testSolve: OK\n";
+        else
+            std::cout << "testSolve: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testSolve: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+
+void testColumns() {
+    const char *files[] = {"test_x.bin", "test_y.bin", "test_f.bin", "test_g.bin"};
+    try {
+        const size_t rows = 1000;
+        std::vector<long double> xs(rows), ys(rows);
+        for (size_t i = 0; i < rows; ++i) {
+            xs[i] = 0.01L * i;
+            ys[i] = 2 - 0.003L * i;
+        }
+        std::ofstream(files[0], std::ios::binary).write(reinterpret_cast<const char *>(xs.data()), rows * sizeof(long double));
+        std::ofstream(files[1], std::ios::binary).write(reinterpret_cast<const char *>(ys.data()), rows * sizeof(long double));
+
+        Program<long double> program = parseProgram("f = x * sin(y) + 1\ng = exp(-x) / y");
+        // Порции по 333 строки: граница порции не совпадает ни с блоком пакета, ни со страницей.
+        size_t count = evalColumns(program, {{"x", files[0]}, {"y", files[1]}}, {files[2], files[3]},
+                                   ErrorPolicy::Throw, 333);
+        MappedFile f(files[2]), g(files[3]);
+        const long double *fs = reinterpret_cast<const long double *>(f.data());
+        const long double *gs = reinterpret_cast<const long double *>(g.data());
+        bool ok = count == rows && f.size() == rows * sizeof(long double);
+        for (size_t i = 0; i < rows; ++i) {
+            std::map<std::string, long double> context = {{"x", xs[i]}, {"y", ys[i]}};
+            std::vector<long double> expected = program.eval(context);
+            ok = ok && fs[i] == expected[0] && gs[i] == expected[1];
+        }
+        bool thrown = false;
+        try {
+            evalColumns(program, {{"x", files[0]}}, {files[2], files[3]});
+        } catch (const std::exception &) {
+            thrown = true;
+        }
+        if (ok && thrown)
+            std::cout << "testColumns: OK\n";
+        else
+            std::cout << "testColumns: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testColumns: FAIL (" << ex.what() << ")\n";
+    }
+    for (const char *file: files)
+        std::remove(file);
+}
+
+
+void testPrecision() {
+    try {
+        // Один и тот же текст разбирается в выражения разной точности.
+        const std::string text = "sin(x)^2 + cos(x)^2 + 1 / 3";
+        std::map<std::string, float> contextF = {{"x", 0.7f}};
+        std::map<std::string, double> contextD = {{"x", 0.7}};
+        std::map<std::string, long double> contextL = {{"x", 0.7L}};
+        float f = parseExpression<float>(text).eval(contextF);
+        double d = parseExpression<double>(text).eval(contextD);
+        long double l = parseExpression(text).eval(contextL);
+        bool ok = std::abs(f - 4.0f / 3) < 1e-6f && std::abs(d - 4.0 / 3) < 1e-15 && std::abs(l - 4.0L / 3) < 1e-18L;
+        ok = ok && parseExpression<double>("0.1").eval({}) == 0.1 && parseExpression<float>("0.1").eval({}) == 0.1f;
+
+        Program<double> program = parseProgram<double>("f = x * y\ng = f ^ 2 - y");
+        double xs[] = {1, 2, 3}, ys[] = {4, 5, 6}, fs[3], gs[3];
+        const double *inputs[] = {xs, ys};
+        double *outputs[] = {fs, gs};
+        program.evalBatch(inputs, outputs, 3);
+        ok = ok && fs[2] == 18 && gs[1] == 95;
+
+        using Complex = std::complex<double>;
+        Expression<Complex> z = parseExpression<Complex>("exp(z) * z^2");
+        Complex value = z.differentiate("z").eval({{"z", Complex(0.5, -1)}});
+        Complex expected = std::exp(Complex(0.5, -1)) * (Complex(0.5, -1) * Complex(0.5, -1) + 2.0 * Complex(0.5, -1));
+        ok = ok && std::abs(value - expected) < 1e-14;
+        if (ok)
+            std::cout << "testPrecision: OK\n";
+        else
+            std::cout << "testPrecision: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testPrecision: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+
+void testMixedPrecision() {
+    try {
+        // (1 + x)^2 - 1 - 2x = x^2: при малых x в double теряется около половины значащих цифр.
+        Program<long double> program = parseProgram("f = (1 + x)^2 - 1 - 2 * x\ng = sqrt(x) + 1");
+        MixedProgram mixed(program, 1e-12);
+        const size_t rows = 1000;
+        std::vector<double> xs(rows), fs(rows), gs(rows);
+        for (size_t i = 0; i < rows; ++i)
+            xs[i] = i < 10 ? 1e-5 * (i + 1) : 1.0 + i;
+        const double *inputs[] = {xs.data()};
+        double *outputs[] = {fs.data(), gs.data()};
+        std::vector<bool> fallback;
+        size_t recomputed = mixed.evalBatch(inputs, outputs, rows, ErrorPolicy::Throw, &fallback);
+        bool ok = recomputed == 10;
+        for (size_t i = 0; i < rows; ++i) {
+            std::vector<long double> expected = program.eval({{"x", xs[i]}});
+            // Пересчитанные строки совпадают с long double, остальные укладываются в допуск.
+            long double tolerance = fallback[i] ? 0 : 1e-12L * std::abs(expected[0]);
+            ok = ok && (i >= 10 || fallback[i]) && std::abs(fs[i] - static_cast<double>(expected[0])) <= tolerance;
+            ok = ok && std::abs(gs[i] - expected[1]) <= 1e-15L * expected[1];
+        }
+        if (ok)
+            std::cout << "testMixedPrecision: OK\n";
+        else
+            std::cout << "testMixedPrecision: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testMixedPrecision: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+
+void testComplexBatch() {
+    try {
+        using Complex = std::complex<double>;
+        // Передаточная функция H(s) = (s + 2) / (s^2 + 0.5 s + 4) на оси s = i w.
+        Expression<Complex> h = parseExpression<Complex>("(s + 2) / (s^2 + 0.5 * s + 4) + exp(-0.1i * w) * ln(s + 1j)");
+        bool ok = parseExpression<Complex>("2.5i + j * 2").eval({}) == Complex(0, 4.5);
+        Expression<Complex> sweep = h.substitute("s", parseExpression<Complex>("i * w"));
+        Program<Complex> program = compile(sweep);
+        const size_t rows = 700;
+        std::vector<double> wRe(rows), wIm(rows, 0.0), hRe(rows), hIm(rows);
+        for (size_t k = 0; k < rows; ++k)
+            wRe[k] = 0.01 * k;
+        const double *inputsRe[] = {wRe.data()}, *inputsIm[] = {wIm.data()};
+        double *outputsRe[] = {hRe.data()}, *outputsIm[] = {hIm.data()};
+        evalBatchSplit(program, inputsRe, inputsIm, outputsRe, outputsIm, rows);
+        for (size_t k = 0; k < rows; ++k) {
+            Complex expected = sweep.eval({{"w", Complex(wRe[k])}});
+            ok = ok && std::abs(Complex(hRe[k], hIm[k]) - expected) <= 1e-13 * std::abs(expected);
+        }
+        // Степени в нуле совпадают с деревом: 0^-3 даёт (Inf, NaN) без исключения, 0^2.5 и 0^v — нуль.
+        std::vector<double> vRe(rows), vIm(rows, 0.0);
+        for (size_t k = 0; k < rows; ++k)
+            vRe[k] = 0.5 + 0.01 * k;
+        auto same = [](double a, double b) { return a == b || (std::isnan(a) && std::isnan(b)); };
+        for (const char *text: {"w^-3", "w^2.5", "w^v"}) {
+            Expression<Complex> power = parseExpression<Complex>(text);
+            Program<Complex> powerProgram = compile(power);
+            std::vector<const double *> re, im;
+            for (const std::string &name: powerProgram.variables()) {
+                re.push_back(name == "w" ? wRe.data() : vRe.data());
+                im.push_back(name == "w" ? wIm.data() : vIm.data());
+            }
+            evalBatchSplit(powerProgram, re.data(), im.data(), outputsRe, outputsIm, rows);
+            for (size_t k = 0; k < rows; ++k) {
+                Complex expected = power.eval({{"w", Complex(wRe[k])}, {"v", Complex(vRe[k])}});
+                ok = ok && (k == 0 ? same(hRe[k], expected.real()) && same(hIm[k], expected.imag())
+                                   : std::abs(Complex(hRe[k], hIm[k]) - expected) <= 1e-13 * std::abs(expected));
+            }
+        }
+        // Деление на ноль в невыбранной ветви не прерывает пакет, в выбранной — прерывает, как в evalBatch.
+        Program<Complex> guarded = compile(parseExpression<Complex>("select(w == 0, 0, 1 / w)"));
+        evalBatchSplit(guarded, inputsRe, inputsIm, outputsRe, outputsIm, rows);
+        ok = ok && hRe[0] == 0 && hIm[0] == 0 && hRe[1] == 1 / wRe[1];
+        Program<Complex> unguarded = compile(parseExpression<Complex>("select(w != 0, 0, 1 / w)"));
+        bool thrown = false;
+        try {
+            evalBatchSplit(unguarded, inputsRe, inputsIm, outputsRe, outputsIm, rows);
+        } catch (const std::runtime_error &) {
+            thrown = true;
+        }
+        ok = ok && thrown;
+        if (ok)
+            std::cout << "testComplexBatch: OK\n";
+        else
+            std::cout << "testComplexBatch: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testComplexBatch: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+
+void testOptimizer() {
+    try {
+        Expression<long double> expr = parseExpression("ln(exp(x)) / 4 + exp(x) * exp(y) + a + b + c + d");
+        Expression<long double> derivative = expr.differentiate("x");
+        PassManager<long double> manager = defaultPipeline<long double>();
+        Expression<long double> optimized = manager.run(derivative);
+        std::map<std::string, long double> context = {{"x", 0.3L}, {"y", -0.7L}, {"a", 1}, {"b", 2}, {"c", 3}, {"d", 4}};
+        bool ok = std::abs(optimized.eval(context) - derivative.eval(context)) < 1e-15L;
+        ok = ok && manager.reports().size() == 4;
+        const PassReport &first = manager.reports().front();
+        const PassReport &last = manager.reports().back();
+        ok = ok && first.after.nodes < first.before.nodes && last.after.cost <= first.before.cost;
+        // Сумма восьми слагаемых: цепочка глубины 7 становится деревом глубины 3.
+        Expression<long double> chain = parseExpression("a + b + c + d + e + f + g + h");
+        ExpressionStats before = expressionStats(chain);
+        ExpressionStats after = expressionStats(Reassociation<long double>().run(chain));
+        ok = ok && before.nodes == after.nodes && before.critical == 7 && after.critical == 3;
+        // Деление на константу заменяется умножением, ln(exp(x)) — самим x.
+        Expression<long double> reduced = optimize(parseExpression("ln(exp(x)) / 4"));
+        ok = ok && reduced.to_string() == "(x * 0.25)";
+        // Умножение на нуль отбрасывает поддерево только в явно подключённом проходе zero-absorption.
+        Expression<long double> trap = parseExpression("ln(x) * 0 + y ^ 0");
+        bool thrown = false;
+        try {
+            optimize(trap).eval({{"x", -1}, {"y", 2}});
+        } catch (const std::runtime_error &) {
+            thrown = true;
+        }
+        ok = ok && thrown && ZeroAbsorption<long double>().run(trap).to_string() == "(0 + 1)";
+        if (ok)
+            std::cout << "testOptimizer: OK\n";
+        else
+            std::cout << "testOptimizer: FAIL\n" << manager.summary();
+    } catch (const std::exception &ex) {
+        std::cout << "testOptimizer: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+
+void testTieredExecution() {
+    try {
+        Expression<double> expr = parseExpression<double>("sin(x) * sin(x) + cos(x) * cos(x) + y / 2 + 0 * x");
+        TierOptions options;
+        options.optimizeAfter = 4;
+        options.compileAfter = 16;
+        TieredExpression<double> tiered(expr, options);
+        bool ok = tiered.tier() == Tier::Tree;
+        for (int k = 0; k < 200; ++k) {
+            std::map<std::string, double> context = {{"x", 0.01 * k}, {"y", 2.0 * k}};
+            ok = ok && std::abs(tiered.eval(context) - expr.eval(context)) < 1e-12 * (1 + k);
+        }
+        tiered.wait();
+        ok = ok && tiered.tier() == Tier::Compiled && std::abs(tiered.eval({{"x", 1}, {"y", 4}}) - 3) < 1e-12;
+        TierCounters counters = tiered.counters();
+        ok = ok && counters.promotions == 2 && !counters.promotionFailed &&
+             counters.evaluations[0] + counters.evaluations[1] + counters.evaluations[2] == 201 &&
+             counters.evaluations[static_cast<size_t>(Tier::Compiled)] >= 1;
+        // Смена уровня не меняет ни ошибок, ни значений при Propagate.
+        Expression<double> trap = parseExpression<double>("(1 / y) * 0 + x");
+        TierOptions eager;
+        eager.optimizeAfter = 2;
+        eager.compileAfter = 4;
+        TieredExpression<double> trapped(trap, eager);
+        bool visited[TIER_COUNT] = {};
+        for (int k = 0; k < 8; ++k) {
+            visited[static_cast<size_t>(trapped.tier())] = true;
+            bool thrown = false;
+            try {
+                trapped.eval({{"x", 1}, {"y", 0}});
+            } catch (const std::runtime_error &) {
+                thrown = true;
+            }
+            ok = ok && thrown && std::isnan(trapped.eval({{"x", 1}, {"y", 0}}, ErrorPolicy::Propagate)) ==
+                                 std::isnan(trap.eval({{"x", 1}, {"y", 0}}, ErrorPolicy::Propagate));
+            trapped.wait();
+        }
+        ok = ok && visited[0] && visited[1] && visited[2];
+        // Глубокое дерево не оптимизируется и не компилируется: рекурсивные проходы переполнили бы стек.
+        std::string sum = "x";
+        for (int k = 1; k < 50000; ++k)
+            sum += "+x";
+        TieredExpression<double> deep(parseExpression<double>(sum), eager);
+        for (int k = 0; k < 8; ++k) {
+            ok = ok && deep.eval({{"x", 0.5}}) == 25000;
+            deep.wait();
+        }
+        ok = ok && deep.tier() == Tier::Tree && deep.counters().promotions == 0 && !deep.counters().promotionFailed;
+        if (ok)
+            std::cout << "testTieredExecution: OK\n";
+        else
+            std::cout << "testTieredExecution: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testTieredExecution: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+
+void testServer() {
+    try {
+        const std::string path = "/tmp/expression_test_server.sock";
+        EvaluationServer<double> server(path, 4);
+        std::thread acceptor([&server] { server.run(); });
+        bool ok = true;
+        std::vector<std::thread> clients;
+        std::vector<bool> results(4, false);
+        for (size_t c = 0; c < results.size(); ++c) {
+            clients.emplace_back([&, c] {
+                // Запросы отправляются пачкой, не дожидаясь ответов, и объединяются сервером в порции.
+                EvaluationClient client(path);
+                const int count = 50;
+                for (int k = 0; k < count; ++k)
+                    client.send("eval\n" + std::to_string(k) + "\nx^2 + y\nx=" + std::to_string(k) + "\ny=0.5");
+                bool good = true;
+                for (int k = 0; k < count; ++k) {
+                    std::istringstream answer(client.receive());
+                    std::string id, status;
+                    double value;
+                    answer >> id >> status >> value;
+                    int row = std::stoi(id);
+                    good = good && status == "ok" && value == row * row + 0.5;
+                }
+                results[c] = good;
+            });
+        }
+        for (auto &client: clients)
+            client.join();
+        for (bool result: results)
+            ok = ok && result;
+        EvaluationClient client(path);
+        ok = ok && client.call("diff\n7\nsin(x) * y\nx") == "7\nok\n(((cos(x) * 1) * y) + (sin(x) * 0))";
+        ok = ok && client.call("eval\n8\nx + z\nx=1").rfind("8\nerror\n", 0) == 0;
+        ok = ok && client.call("eval\n9\nx +\nx=1").rfind("9\nerror\n", 0) == 0;
+        // Сумма из миллиона слагаемых не компилируется, а вычисляется обходом дерева.
+        std::string sum = "x";
+        for (int k = 1; k < 1000000; ++k)
+            sum += "+x";
+        ok = ok && client.call("eval\n10\n" + sum + "\nx=0.5") == "10\nok\n500000";
+        // Потоки отключившихся клиентов присоединяются, пока сервер работает; остаётся поток client.
+        for (int k = 0; k < 100 && server.stats().readers > 1; ++k)
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        ok = ok && server.stats().readers == 1;
+        server.stop();
+        acceptor.join();
+        ServerStats stats = server.stats();
+        ok = ok && stats.requests == 204 && stats.batches <= 201 && stats.cacheMisses == 5;
+        if (ok)
+            std::cout << "testServer: OK\n";
+        else
+            std::cout << "testServer: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testServer: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+
+void testCodegen() {
+    try {
+        auto definitions = parseDefinitions<double>("# формулы\nr = x^2 + y\nf = r * sin(x)\n");
+        bool ok = definitions.size() == 2 && definitions[1].first == "f" &&
+                  std::abs(definitions[1].second.eval({{"x", 0.5}, {"y", 2}}) - 2.25 * std::sin(0.5)) < 1e-15;
+        CodegenOptions options;
+        options.name = "sample";
+        options.derivatives = {"x"};
+        std::string header = emitCpp(definitions, options);
+        ok = ok && header.find("namespace sample {") != std::string::npos &&
+             header.find("using Real = double;") != std::string::npos &&
+             header.find("const int OUTPUT_COUNT = 4;") != std::string::npos &&
+             header.find("inline Real d_f_d_x(Real x, Real y) {") != std::string::npos &&
+             header.find("inline void evalAll(Real x, Real y, Real *out_) {") != std::string::npos &&
+             header.find("std::sin(x)") != std::string::npos;
+        // Переменные с именами вида r0 и out не пересекаются с локальными константами.
+        std::string shadowed = emitCpp(parseDefinitions<double>("f = r0 * out + sin(r0)\n"), CodegenOptions());
+        ok = ok && shadowed.find("inline Real f(Real r0, Real out) {") != std::string::npos &&
+             shadowed.find("const Real r0_ = r0 * out;") != std::string::npos;
+        const std::vector<std::vector<std::pair<std::string, Expression<double> > > > invalid = {
+            {{"f", Expression<double>("class")}},
+            {{"Real", Expression<double>("x")}},
+            {{"f", Expression<double>("x y")}},
+            {{"d_f_d_x", Expression<double>("x")}, {"f", Expression<double>("x")}},
+        };
+        for (const auto &bad: invalid) {
+            bool thrown = false;
+            try {
+                emitCpp(bad, options);
+            } catch (const std::runtime_error &) {
+                thrown = true;
+            }
+            ok = ok && thrown;
+        }
+        if (ok)
+            std::cout << "testCodegen: OK\n";
+        else
+            std::cout << "testCodegen: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testCodegen: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+
+void testDeepExpressions() {
+    try {
+        // Порядок операций и ошибки разбора с явным стеком те же, что у рекурсивного спуска.
+        bool ok = parseExpression<double>("-x^2").to_string() == "((-1 * x) ^ 2)" &&
+                  parseExpression<double>("2^3^2").eval({}) == 512 &&
+                  parseExpression<double>("8 - 4 - 2 / 2 * 4").eval({}) == 0 &&
+                  parseExpression<double>("atan2(-(1), 2 * (3 - 4))").to_string() == "atan2((-1 * 1), (2 * (3 - 4)))";
+        for (const char *bad: {"(x", "sin(x", "(x, y)", "atan2(x y)", "x +", "f()"}) {
+            bool thrown = false;
+            try {
+                Parser<double> parser(bad);
+                parser.parseExpression();
+                thrown = !parser.atEnd();
+            } catch (const std::runtime_error &) {
+                thrown = true;
+            }
+            ok = ok && thrown;
+        }
+
+        // Цепочка x + x + ... + x и вложенность sin(sin(...)) высотой в миллион узлов.
+        const size_t depth = 1000000;
+        std::string sum = "x";
+        for (size_t i = 1; i < depth; ++i)
+            sum += "+x";
+        std::string nested;
+        for (size_t i = 0; i < depth; ++i)
+            nested += "sin(";
+        nested += "x" + std::string(depth, ')');
+        {
+            Expression<double> chain = parseExpression<double>(sum);
+            Expression<double> sines = parseExpression<double>(nested);
+            ok = ok && chain.getImpl()->height() == depth && sines.getImpl()->height() == depth + 1;
+            ok = ok && chain.eval({{"x", 0.5}}) == 0.5 * depth;
+            ok = ok && chain.differentiate("x").eval({}) == depth;
+            ok = ok && chain.substitute("x", Expression<double>(2.0)).eval({}) == 2.0 * depth;
+            ok = ok && chain.to_string().size() == depth + 5 * (depth - 1);
+            // Рекурсивные обходы сообщают о слишком глубоком дереве исключением, а не переполнением стека.
+            const std::vector<std::function<void()> > recursive = {
+                [&] { compile(chain); },
+                [&] { chain.evalJet("x", {{"x", 0.5}}); },
+                [&] { chain.evalWithDerivative("x", {{"x", 0.5}}); },
+                [&] { chain.taylor("x", {{"x", 0.5}}, 2); },
+                [&] { optimize(chain); }
+            };
+            for (const auto &call: recursive) {
+                bool thrown = false;
+                try {
+                    call();
+                } catch (const std::runtime_error &) {
+                    thrown = true;
+                }
+                ok = ok && thrown;
+            }
+
+            double value = 0.3;
+            for (size_t i = 0; i < depth; ++i)
+                value = std::sin(value);
+            ok = ok && std::abs(sines.eval({{"x", 0.3}}) - value) < 1e-12;
+            ok = ok && sines.to_string() == nested;
+            Expression<double> copy = sines;
+            ok = ok && copy.getImpl() == sines.getImpl();
+        }
+        if (ok)
+            std::cout << "testDeepExpressions: OK\n";
+        else
+            std::cout << "testDeepExpressions: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testDeepExpressions: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+
+void testConditionals() {
+    try {
+        // Сравнения связывают слабее арифметики; select вычисляет только выбранную ветвь.
+        Expression<double> relu = parseExpression<double>("select(x > 0, x^2, 0)");
+        bool ok = relu.to_string() == "select((x > 0), (x ^ 2), 0)" &&
+                  relu.eval({{"x", 3}}) == 9 && relu.eval({{"x", -3}}) == 0 &&
+                  parseExpression<double>("1 + 1 == 2").eval({}) == 1 &&
+                  parseExpression<double>("2 <= 1 != 1 < 2").eval({}) == 1;
+        Expression<double> guarded = parseExpression<double>("select(x > 0, ln(x), 0)");
+        ok = ok && guarded.eval({{"x", -1}}) == 0;
+        ok = ok && relu.differentiate("x").eval({{"x", 3}}) == 6 && relu.differentiate("x").eval({{"x", -3}}) == 0;
+        Expression<double> steps = parseExpression<double>("piecewise(x < 0, -1, x < 1, x, 1)");
+        ok = ok && steps.eval({{"x", -5}}) == -1 && steps.eval({{"x", 0.5}}) == 0.5 && steps.eval({{"x", 7}}) == 1;
+        bool thrown = false;
+        try {
+            parseExpression<double>("piecewise(x < 0, 1)");
+        } catch (const std::runtime_error &) {
+            thrown = true;
+        }
+        ok = ok && thrown;
+
+        // Пакет: обе ветви считаются для всех строк, ошибка невыбранной ветви не прерывает вычисление.
+        ProgramBuilder<double> builder{VariableTable({"x"})};
+        builder.addOutput(builder.add(guarded));
+        builder.addOutput(builder.add(steps));
+        Program<double> program = builder.build();
+        const size_t rows = 600;
+        std::vector<double> xs(rows), first(rows), second(rows);
+        for (size_t i = 0; i < rows; ++i)
+            xs[i] = -3 + 0.01 * static_cast<double>(i);
+        const double *inputs[] = {xs.data()};
+        double *outputs[] = {first.data(), second.data()};
+        program.evalBatch(inputs, outputs, rows, ErrorPolicy::Throw);
+        for (size_t i = 0; i < rows; ++i) {
+            ok = ok && first[i] == guarded.eval({{"x", xs[i]}}) && second[i] == steps.eval({{"x", xs[i]}});
+            ok = ok && program.eval({{"x", xs[i]}})[0] == first[i];
+        }
+
+        // Ошибка выбранной ветви прерывает вычисление и в программе, и в пакете — как в дереве.
+        for (const char *formula: {"select(x > 0, 1 / y, 0)", "select(x > 0, ln(y) + 1, 0)",
+                                   "select(x > 0, 2 * sqrt(y - 1), 0)"}) {
+            Expression<double> branchy = parseExpression<double>(formula);
+            Program<double> compiled = compile(branchy);
+            auto fails = [](const std::function<void()> &f) {
+                try {
+                    f();
+                } catch (const std::runtime_error &) {
+                    return true;
+                }
+                return false;
+            };
+            ok = ok && fails([&] { branchy.eval({{"x", 1}, {"y", 0}}); });
+            ok = ok && fails([&] { compiled.eval({{"x", 1}, {"y", 0}}); });
+            ok = ok && compiled.eval({{"x", -1}, {"y", 0}})[0] == 0;
+            std::vector<double> conditions(rows, -1), ys(rows, 0), values(rows);
+            const double *columns[] = {conditions.data(), ys.data()};
+            double *results[] = {values.data()};
+            ok = ok && compiled.variables() == std::vector<std::string>({"x", "y"});
+            ok = ok && !fails([&] { compiled.evalBatch(columns, results, rows); }) && values[rows - 1] == 0;
+            conditions[rows - 7] = 1;
+            ok = ok && fails([&] { compiled.evalBatch(columns, results, rows); });
+        }
+        // Упорядочивание комплексных констант не сворачивается при сборке: ошибка возникает при вычислении.
+        using Complex = std::complex<double>;
+        ProgramBuilder<Complex> complexBuilder;
+        complexBuilder.addOutput(complexBuilder.binary(OpCode::Less, complexBuilder.constant(Complex(1)),
+                                                       complexBuilder.constant(Complex(2))));
+        Program<Complex> ordered = complexBuilder.build();
+        thrown = false;
+        try {
+            ordered.eval(std::map<std::string, Complex>());
+        } catch (const std::runtime_error &) {
+            thrown = true;
+        }
+        ok = ok && thrown;
+        if (ok)
+            std::cout << "testConditionals: OK\n";
+        else
+            std::cout << "testConditionals: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testConditionals: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+
+void testReductions() {
+    try {
+        // Квадратичная потеря по данным: одна вершина sum вместо цепочки из тысяч сложений.
+        const size_t rows = 1000;
+        ArrayContext<double> data{{"x", std::vector<double>(rows)}, {"y", std::vector<double>(rows)}};
+        double loss = 0, gradient = 0;
+        for (size_t i = 0; i < rows; ++i) {
+            double x = 0.001 * static_cast<double>(i), y = std::sin(x);
+            data["x"][i] = x;
+            data["y"][i] = y;
+            loss += (1.5 * x - y) * (1.5 * x - y);
+            gradient += 2 * (1.5 * x - y) * x;
+        }
+        Expression<double> expr = parseExpression<double>("sum((w * x - y)^2)");
+        std::map<std::string, double> context{{"w", 1.5}};
+        bool ok = expr.to_string() == "sum((((w * x) - y) ^ 2))" &&
+                  std::abs(expr.eval(context, data) - loss) < 1e-9 * loss;
+        Expression<double> derivative = optimize(expr.differentiate("w"));
+        ok = ok && derivative.to_string().compare(0, 4, "sum(") == 0 &&
+             std::abs(derivative.eval(context, data) - gradient) < 1e-9 * std::abs(gradient);
+        {
+            ArrayScope<double> scope(data);
+            Jet<double> jet = expr.evalJet("w", context);
+            ok = ok && std::abs(jet.first - gradient) < 1e-9 * std::abs(gradient);
+        }
+
+        ArrayContext<double> small{{"a", {3, 4}}, {"b", {1, 2}}};
+        ok = ok && parseExpression<double>("dot(a, b)").eval({}, small) == 11 &&
+             parseExpression<double>("norm(a)").eval({}, small) == 5 &&
+             parseExpression<double>("prod(a + k)").eval({{"k", 1}}, small) == 20 &&
+             parseExpression<double>("sum((a - sum(a) / 2)^2)").eval({}, small) == 0.5 &&
+             std::abs(parseExpression<double>("norm(a * t)").differentiate("t").eval({{"t", 2}}, small) - 5) < 1e-15;
+        // Производная произведения верна и при нулевом элементе: d/dw prod(w + x) при w = 1, x = (-1, 2, 3)
+        // равна 3 * 4 = 12, а вторая производная — 2 * (0 + 3 + 4) = 14.
+        ArrayContext<double> withZero{{"x", {-1, 2, 3}}};
+        Expression<double> product = parseExpression<double>("prod(w + x)");
+        Expression<double> first = product.differentiate("w"), second = first.differentiate("w");
+        ok = ok && first.to_string().compare(0, 6, "dprod(") == 0 && first.eval({{"w", 1}}, withZero) == 12 &&
+             second.eval({{"w", 1}}, withZero) == 14 &&
+             parseExpression<double>(second.to_string()).eval({{"w", 1}}, withZero) == 14;
+        {
+            ArrayScope<double> scope(withZero);
+            ok = ok && product.evalJet("w", {{"w", 1}}).first == 12 && first.evalJet("w", {{"w", 1}}).first == 14;
+        }
+        for (const char *bad: {"sum(k)", "dot(a, c)", "dprod(a)"}) {
+            bool thrown = false;
+            try {
+                ArrayContext<double> arrays = small;
+                arrays["c"] = {1, 2, 3};
+                parseExpression<double>(bad).eval({{"k", 1}}, arrays);
+            } catch (const std::runtime_error &) {
+                thrown = true;
+            }
+            ok = ok && thrown;
+        }
+        if (ok)
+            std::cout << "testReductions: OK\n";
+        else
+            std::cout << "testReductions: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testReductions: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+
+void testIntegration() {
+    try {
+        const double pi = 3.14159265358979323846;
+        auto sine = integrate(parseExpression<double>("sin(x)"), "x", 0.0, pi);
+        auto log = integrate(parseExpression<double>("ln(x)"), "x", 0.0, 1.0);
+        auto reversed = integrate(parseExpression<double>("a * x^2"), "x", 1.0, 0.0, {{"a", 3}});
+        bool ok = std::abs(sine.value - 2) < 1e-12 && std::abs(log.value + 1) < 1e-9 && log.boxes > 1 &&
+                  std::abs(reversed.value + 1) < 1e-14;
+
+        // Кубатура: один поток и несколько потоков дают одинаковое разбиение и результат.
+        Expression<double> gauss = parseExpression<double>("exp(-(x^2 + y^2)) * cos(x * y)");
+        IntegrateOptions options;
+        options.tolerance = options.relativeTolerance = 1e-10;
+        options.threads = 1;
+        auto single = integrateBox(gauss, {"x", "y"}, {-4.0, -4.0}, {4.0, 4.0}, {}, options);
+        options.threads = 4;
+        auto parallel = integrateBox(gauss, {"x", "y"}, {-4.0, -4.0}, {4.0, 4.0}, {}, options);
+        auto plane = integrateBox(parseExpression<double>("exp(x * y)"), {"x", "y"}, {0.0, 0.0}, {1.0, 1.0});
+        ok = ok && single.value == parallel.value && single.boxes == parallel.boxes &&
+             std::abs(single.value - 2 * pi / std::sqrt(5.0)) < 1e-8 &&
+             std::abs(plane.value - 1.3179021514544038) < 1e-13;
+
+        for (int bad = 0; bad < 2; ++bad) {
+            bool thrown = false;
+            try {
+                if (bad == 0)
+                    integrate(parseExpression<double>("1 / x"), "x", -1.0, 1.0);
+                else
+                    integrate(parseExpression<double>("x"), "x", 0.0, std::numeric_limits<double>::infinity());
+            } catch (const std::runtime_error &) {
+                thrown = true;
+            }
+            ok = ok && thrown;
+        }
+        if (ok)
+            std::cout << "testIntegration: OK\n";
+        else
+            std::cout << "testIntegration: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testIntegration: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+
+void testCatalog() {
+    try {
+        // Каталог больше одной порции: результаты порций склеиваются в порядке строк.
+        std::string text = "# каталог\n\n";
+        std::vector<std::string> formulas;
+        for (size_t i = 0; i < 6000; ++i) {
+            formulas.push_back("sin(x * " + std::to_string(i) + ") + y^" + std::to_string(i % 5 + 2));
+            text += formulas.back() + (i % 2 ? "\r\n" : "\n");
+        }
+        std::vector<Expression<double> > expressions = parseCatalog<double>(text, 4);
+        bool ok = expressions.size() == formulas.size();
+        for (size_t i = 0; ok && i < formulas.size(); ++i)
+            ok = expressions[i].to_string() == parseExpression<double>(formulas[i]).to_string();
+
+        const char *file = "test_catalog.txt";
+        {
+            std::ofstream out(file);
+            out << text;
+        }
+        ok = ok && loadCatalog<double>(file, 2).size() == formulas.size();
+        std::remove(file);
+
+        // Ошибка сообщается с номером строки в файле и колонкой.
+        std::string message;
+        try {
+            parseCatalog<double>(text + "x + (y * 2\n1 + 2\n", 4);
+        } catch (const std::runtime_error &ex) {
+            message = ex.what();
+        }
+        ok = ok && message == "Line 6003, column 11: Expected ')'";
+        if (ok)
+            std::cout << "testCatalog: OK\n";
+        else
+            std::cout << "testCatalog: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testCatalog: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+
+void testCompact() {
+    try {
+        const std::vector<std::string> formulas = {
+            "select(x < y, ln(x), 1 / y) + max(x, y) * atan(x)",
+            "x^3 - x^y + cos(2) * exp(x) - (x == 2) + (y != 2) - (x >= y) * (x <= 1)",
+            "sin(x * 2) + sum(a * x)",
+            "select(x > 0, ln(x), 0) + 2",
+        };
+        CompactCatalog<double> catalog;
+        std::vector<Expression<double> > expressions;
+        for (const auto &formula: formulas) {
+            expressions.push_back(parseExpression<double>(formula));
+            catalog.add(expressions.back());
+        }
+        // Производная разделяет поддеревья: каждое кодируется один раз.
+        expressions.push_back(expressions[1].differentiate("x"));
+        catalog.add(expressions.back());
+        catalog.shrink();
+        expressions.push_back(parseExpression<double>("atan2(x, 2) / y"));
+        catalog.add(expressions.back());
+
+        ArrayContext<double> arrays{{"a", {1, 2, 3}}};
+        ArrayScope<double> scope(arrays);
+        bool ok = catalog.size() == expressions.size();
+        for (double x: {0.5, 2.0, 3.0}) {
+            std::map<std::string, double> context{{"x", x}, {"y", 2}};
+            for (size_t i = 0; ok && i < expressions.size(); ++i) {
+                ok = std::abs(catalog.eval(i, context) - expressions[i].eval(context)) < 1e-12 &&
+                     catalog.expression(i).to_string() == expressions[i].to_string();
+            }
+        }
+        // Ошибка только в невыбранной ветви select не бросает исключения.
+        ok = ok && catalog.eval(3, {{"x", -1}}) == 2;
+        std::string message;
+        try {
+            catalog.eval(0, {{"x", 1}});
+        } catch (const std::runtime_error &ex) {
+            message = ex.what();
+        }
+        ok = ok && message == "Variable \"y\" not found in context";
+        // Ошибка выбранной ветви — как в дереве, с тем же сообщением.
+        const std::vector<std::pair<std::string, std::map<std::string, double> > > traps = {
+            {"select(x > 0, 1 / y, 0)", {{"x", 1}, {"y", 0}}},
+            {"select(x > 0, ln(y), 0)", {{"x", 1}, {"y", 0}}},
+            {"select(x > 0, y, 0)", {{"x", 1}}},
+            {"select(x > 0, select(x > 2, 0, 1 / y), 0) * 2", {{"x", 1}, {"y", 0}}},
+        };
+        for (const auto &[formula, context]: traps) {
+            const size_t index = catalog.add(parseExpression<double>(formula));
+            std::string expected, actual;
+            try {
+                parseExpression<double>(formula).eval(context);
+            } catch (const std::runtime_error &ex) {
+                expected = ex.what();
+            }
+            try {
+                catalog.eval(index, context);
+            } catch (const std::runtime_error &ex) {
+                actual = ex.what();
+            }
+            std::map<std::string, double> skipped = context;
+            skipped["x"] = -1;
+            ok = ok && !expected.empty() && actual == expected && catalog.eval(index, skipped) == 0;
+        }
+        if (ok)
+            std::cout << "testCompact: OK\n";
+        else
+            std::cout << "testCompact: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testCompact: FAIL (" << ex.what() << ")\n";
+    }
+}
+
+
+void testLazyDerivatives() {
+    try {
+        Expression<double> f = parseExpression<double>("sin(x * y) * exp(x) + ln(x + y^2) / x - atan2(y, x)");
+        Expression<double> fx = f.differentiate("x");
+        Expression<double> lazy = lazyDerivative(f, "x");
+        // Запись совпадает с готовой производной, оптимизация раскрывает ленивые узлы.
+        bool ok = lazy.to_string() == fx.to_string() && optimize(lazy).to_string() == optimize(fx).to_string();
+
+        // Смешанная производная и производная четвёртого порядка без промежуточных деревьев.
+        Expression<double> fxy = lazyDerivative(lazy, "y");
+        Expression<double> fxxxx = lazyDerivative(lazyDerivative(lazyDerivative(lazy, "x"), "x"), "x");
+        Expression<double> exy = fx.differentiate("y");
+        Expression<double> exxxx = fx.differentiate("x").differentiate("x").differentiate("x");
+        for (double x: {0.5, 1.5}) {
+            std::map<std::string, double> context{{"x", x}, {"y", 0.7}};
+            auto close = [&context](const Expression<double> &l, const Expression<double> &r) {
+                const double a = l.eval(context), b = r.eval(context);
+                return std::abs(a - b) <= 1e-9 * std::max(1.0, std::abs(b));
+            };
+            ok = ok && close(lazy, fx) && close(fxy, exy) && close(fxxxx, exxxx) &&
+                 close(lazy.substitute("y", Expression<double>(0.7)), fx) &&
+                 std::abs(lazy.evalJet("y", context).first - exy.eval(context)) < 1e-9;
+        }
+        ok = ok && fxy.to_string() == exy.to_string() && materialize(fxxxx).to_string() == exxxx.to_string();
+
+        // Ленивая производная глубокой цепочки раскрывается обходом с явным стеком.
+        Expression<double> deep = Expression<double>("x");
+        for (int i = 0; i < 5000; ++i)
+            deep = deep * Expression<double>(0.9999) + Expression<double>("x");
+        ok = ok && std::abs(lazyDerivative(deep, "x").eval({{"x", 1}}) - deep.differentiate("x").eval({{"x", 1}})) <
+                       1e-6;
+        if (ok)
+            std::cout << "testLazyDerivatives: OK\n";
+        else
+            std::cout << "testLazyDerivatives: FAIL\n";
+    } catch (const std::exception &ex) {
+        std::cout << "testLazyDerivatives: FAIL (" << ex.what() << ")\n";
+    }
+}
+
 
 int main() {
     testEvaluation();
@@ -91,5 +1306,30 @@ int main() {
     testSubstitution();
     testParsing();
     testComplexUsage();
+    testTaylorDerivatives();
+    testJacobian();
+    testIntegerPower();
+    testPolynomialForm();
+    testFunctionLibrary();
+    testProgram();
+    testLeafOperands();
+    testProfiler();
+    testErrorPolicy();
+    testSolve();
+    testColumns();
+    testPrecision();
+    testMixedPrecision();
+    testComplexBatch();
+    testOptimizer();
+    testTieredExecution();
+    testServer();
+    testCodegen();
+    testDeepExpressions();
+    testConditionals();
+    testReductions();
+    testIntegration();
+    testCatalog();
+    testCompact();
+    testLazyDerivatives();
     return 0;
 }